@@ -31,26 +31,110 @@ in vec3 fragment_position;
 // Coordinate di texture dei punti ricervuti dal vertex shader
 in vec2 fragment_textcoord;
 
-// Informazioni di luce ambientale 
-uniform AmbientLightStruct AmbientLight;
+// Colore dell'istanza ricevuto dal vertex shader
+in vec4 fragment_tint;
 
-// Informazioni di luce diffusiva 
-uniform DiffusiveLightStruct DiffusiveLight;
+// Camera e luci, comuni a tutti i programmi e aggiornate una volta per
+// frame (MyShaderClass::FrameBlock). Il blocco deve essere identico in 
+// tutti gli shader
+layout (std140) uniform FrameBlock {
+	mat4 World2Camera;
 
-// Informazioni di luce speculare 
-uniform SpecularLightStruct SpecularLight;
+	// Informazioni di luce ambientale 
+	AmbientLightStruct AmbientLight;
 
-// Posizione della camera in coordinate mondo
-uniform vec3 CameraPosition;
+	// Informazioni di luce diffusiva 
+	DiffusiveLightStruct DiffusiveLight;
+
+	// Informazioni di luce speculare 
+	SpecularLightStruct SpecularLight;
+
+	// Posizione della camera in coordinate mondo
+	vec3 CameraPosition;
+
+	// Griglia dei cluster delle luci (LightClusters::Grid): la profondità 
+	// di vista di un punto è dot(ClusterDepthPlane, punto) e la fetta è
+	// log(profondità) * ClusterDepthScale + ClusterDepthBias
+	vec4 ClusterDepthPlane;
+
+	// Tile per pixel sui due assi
+	vec2 ClusterTileScale;
+	float ClusterDepthScale;
+	float ClusterDepthBias;
+
+	// Dimensioni della griglia
+	ivec3 ClusterCount;
+};
 
 uniform sampler2D TextSampler;
 
+// Luci puntiformi e spot (LightClusters): tre texel per luce con 
+// posizione e range, colore e coseno esterno del cono, direzione e coseno
+// interno del cono
+uniform samplerBuffer LightData;
+
+// Primo indice e numero di luci di ogni cluster
+uniform usamplerBuffer ClusterGrid;
+
+// Indici delle luci dei cluster
+uniform usamplerBuffer LightIndices;
+
 out vec4 out_color;
 
+// Contributo diffusivo e speculare delle luci puntiformi e spot del 
+// cluster che contiene il frammento
+vec3 cluster_lights(vec3 normal, vec3 view_dir)
+{
+	float depth = max(dot(ClusterDepthPlane, vec4(fragment_position, 1.0)), 1e-4);
+
+	ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * ClusterTileScale), 
+	                      int(log(depth) * ClusterDepthScale + ClusterDepthBias));
+	cluster = clamp(cluster, ivec3(0), ClusterCount - 1);
+
+	uvec2 list = texelFetch(ClusterGrid, (cluster.z * ClusterCount.y + cluster.y) * ClusterCount.x + cluster.x).xy;
+
+	vec3 result = vec3(0,0,0);
+
+	for (uint i = 0u ; i < list.y ; i++) {
+		int light = int(texelFetch(LightIndices, int(list.x + i)).r) * 3;
+
+		vec4 position_range  = texelFetch(LightData, light);
+		vec4 color_outer     = texelFetch(LightData, light + 1);
+		vec4 direction_inner = texelFetch(LightData, light + 2);
+
+		vec3 to_light = position_range.xyz - fragment_position;
+		float dist = length(to_light);
+		if (dist >= position_range.w) continue;
+
+		vec3 light_dir = to_light / dist;
+
+		// Attenuazione con l'inverso del quadrato della distanza, portata
+		// a zero in modo continuo al range della luce
+		float falloff = clamp(1.0 - pow(dist / position_range.w, 4.0), 0.0, 1.0);
+		float attenuation = falloff * falloff / (1.0 + dist * dist);
+
+		// Cono dello spot. Le luci puntiformi hanno direzione nulla e i 
+		// coseni fuori dall'intervallo [-1,1]: il fattore vale 1
+		attenuation *= smoothstep(color_outer.w, direction_inner.w, dot(-light_dir, direction_inner.xyz));
+
+		float cosTheta = dot(normal, light_dir);
+		if (cosTheta>0) {
+			result += color_outer.rgb * (cosTheta * attenuation);
+
+			float cosAlpha = dot(view_dir, reflect(-light_dir, normal));
+			if (cosAlpha>0) {
+				result += color_outer.rgb * (SpecularLight.intensity * pow(cosAlpha,SpecularLight.shininess) * attenuation);
+			}
+		}
+	}
+
+	return result;
+}
+
 void main()
 {
 	// La funzione texture ritorna un vec4. 
-	vec4 material_color = texture(TextSampler, fragment_textcoord);
+	vec4 material_color = texture(TextSampler, fragment_textcoord) * fragment_tint;
 
 	vec3 amb =  (AmbientLight.color * AmbientLight.intensity);
 
@@ -74,5 +158,7 @@ void main()
 		spec = (DiffusiveLight.color * SpecularLight.intensity) * pow(cosAlpha,SpecularLight.shininess);
 	}
 
-	out_color = vec4(material_color.rgb*(amb + dif + spec), material_color.a);
+	vec3 lights = cluster_lights(normal, view_dir);
+
+	out_color = vec4(material_color.rgb*(amb + dif + spec + lights), material_color.a);
 }
\ No newline at end of file
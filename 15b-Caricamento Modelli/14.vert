@@ -5,8 +5,53 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;    
 layout (location = 2) in vec2 textcoord;  
 
-uniform mat4 Model2World;
-uniform mat4 World2Camera;
+// Strutture delle luci, come in 14.frag
+struct AmbientLightStruct {
+    vec3 color;
+    float intensity;
+};
+
+struct DiffusiveLightStruct {
+    vec3 color;
+    vec3 direction;
+    float intensity;
+};
+
+struct SpecularLightStruct {
+    float intensity;
+    float shininess;
+};
+
+// Camera e luci, comuni a tutti i programmi (MyShaderClass::FrameBlock). 
+// Il blocco deve essere identico in tutti gli shader
+layout (std140) uniform FrameBlock {
+    mat4 World2Camera;
+    AmbientLightStruct AmbientLight;
+    DiffusiveLightStruct DiffusiveLight;
+    SpecularLightStruct SpecularLight;
+    vec3 CameraPosition;
+
+    // Griglia dei cluster delle luci (usata nel fragment shader)
+    vec4 ClusterDepthPlane;
+    vec2 ClusterTileScale;
+    float ClusterDepthScale;
+    float ClusterDepthBias;
+    ivec3 ClusterCount;
+};
+
+// Modello da disegnare (MyShaderClass::ObjectBlock)
+layout (std140) uniform ObjectBlock {
+    mat4 Model2World;
+
+    // Trasposta inversa di Model2World calcolata sulla CPU, a meno di un
+    // fattore positivo (le normali sono normalizzate nel fragment shader)
+    mat3 NormalMatrix;
+
+    // Parametri per ricostruire le posizioni dei vertici quantizzati. 
+    // Per i vertici float la scala vale 1 e l'offset 0.
+    vec3 PositionScale;
+    vec3 PositionBias;
+};
 
 // Passiamo al fragment shader le informazioni sulle normali dei vertici  
 out vec3 fragment_normal;
@@ -17,19 +62,26 @@ out vec3 fragment_position;
 // Passiamo al fragment shader le coordinate mondo dei vertici
 out vec2 fragment_textcoord;
 
+// Colore che moltiplica quello del materiale (usato dalle istanze, vedi
+// 14_instanced.vert)
+out vec4 fragment_tint;
+
 void main()
 {
-    gl_Position = World2Camera * Model2World * vec4(position, 1.0);
+    vec3 model_position = position * PositionScale + PositionBias;
+
+    gl_Position = World2Camera * Model2World * vec4(model_position, 1.0);
 
     // I vettori delle normali ricevuti in input sono passati 
     // in output al fragment shader dopo essere stati trasformati 
-    // con la trasformazione trasposta inversa del modello.
+    // con la trasformazione trasposta inversa del modello, calcolata
+    // una volta per modello sulla CPU (LocalTransform::N()).
 
-    mat4 Model2WorldTI = transpose(inverse(Model2World));
+    fragment_normal = NormalMatrix * normal;
 
-    fragment_normal = (Model2WorldTI * vec4(normal,0.0)).xyz;
-
-    fragment_position = (Model2World * vec4(position,1.0)).xyz;
+    fragment_position = (Model2World * vec4(model_position,1.0)).xyz;
 
     fragment_textcoord = textcoord;
+
+    fragment_tint = vec4(1.0);
 }
\ No newline at end of file
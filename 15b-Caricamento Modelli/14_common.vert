@@ -0,0 +1,19 @@
+#version 330
+
+// Funzioni comuni alle varianti di 14.vert (14_instanced.vert e 
+// 14_indirect.vert), collegate nello stesso programma (vedi 
+// MyShaderClass::load_shaders()).
+
+// Matrice delle normali di m a meno di un fattore positivo: è la matrice
+// dei cofattori (la trasposta inversa di m moltiplicata per il 
+// determinante) con il segno del determinante. Basta per le normali 
+// (sono normalizzate nel fragment shader) e costa tre prodotti vettoriali
+// invece di una inversa. Senza la correzione del segno una matrice che 
+// inverte l'orientamento (es. una scala negativa) capovolgerebbe le normali.
+mat3 cofactor(mat3 m)
+{
+    mat3 c = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+
+    // Il determinante è il prodotto misto dot(m[0], cross(m[1], m[2]))
+    return (dot(m[0], c[0]) < 0.0) ? -c : c;
+}
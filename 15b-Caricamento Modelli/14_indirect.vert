@@ -0,0 +1,102 @@
+#version 330
+
+// Variante di 14.vert per le draw call indirect (IndirectBatch). I dati di
+// ogni oggetto sono letti come attributi per istanza: ogni comando disegna
+// una istanza il cui base instance è l'indice dell'oggetto. Anche i 
+// parametri di dequantizzazione delle posizioni sono per oggetto, perchè
+// una sola chiamata disegna modelli diversi.
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;    
+layout (location = 2) in vec2 textcoord;  
+
+// Una mat4 occupa le location da 3 a 6 (una colonna per location)
+layout (location = 3) in mat4 ObjectModel;
+layout (location = 7) in vec4 ObjectTint;
+layout (location = 8) in vec3 ObjectPositionScale;
+layout (location = 9) in vec3 ObjectPositionBias;
+
+// Strutture delle luci, come in 14.frag
+struct AmbientLightStruct {
+    vec3 color;
+    float intensity;
+};
+
+struct DiffusiveLightStruct {
+    vec3 color;
+    vec3 direction;
+    float intensity;
+};
+
+struct SpecularLightStruct {
+    float intensity;
+    float shininess;
+};
+
+// Camera e luci, comuni a tutti i programmi (MyShaderClass::FrameBlock). 
+// Il blocco deve essere identico in tutti gli shader
+layout (std140) uniform FrameBlock {
+    mat4 World2Camera;
+    AmbientLightStruct AmbientLight;
+    DiffusiveLightStruct DiffusiveLight;
+    SpecularLightStruct SpecularLight;
+    vec3 CameraPosition;
+
+    // Griglia dei cluster delle luci (usata nel fragment shader)
+    vec4 ClusterDepthPlane;
+    vec2 ClusterTileScale;
+    float ClusterDepthScale;
+    float ClusterDepthBias;
+    ivec3 ClusterCount;
+};
+
+// Model2World è la trasformazione comune a tutti gli oggetti, applicata 
+// dopo quella dell'oggetto (MyShaderClass::ObjectBlock). La 
+// dequantizzazione del blocco non è usata: è letta per oggetto
+layout (std140) uniform ObjectBlock {
+    mat4 Model2World;
+
+    // Trasposta inversa di Model2World calcolata sulla CPU, a meno di un
+    // fattore positivo (le normali sono normalizzate nel fragment shader)
+    mat3 NormalMatrix;
+
+    // Parametri per ricostruire le posizioni dei vertici quantizzati. 
+    // Per i vertici float la scala vale 1 e l'offset 0.
+    vec3 PositionScale;
+    vec3 PositionBias;
+};
+
+// Passiamo al fragment shader le informazioni sulle normali dei vertici  
+out vec3 fragment_normal;
+
+// Passiamo al fragment shader le coordinate mondo dei vertici
+out vec3 fragment_position;
+
+// Passiamo al fragment shader le coordinate mondo dei vertici
+out vec2 fragment_textcoord;
+
+// Passiamo al fragment shader il colore dell'oggetto
+out vec4 fragment_tint;
+
+// Definita in 14_common.vert
+mat3 cofactor(mat3 m);
+
+void main()
+{
+    vec3 model_position = position * ObjectPositionScale + ObjectPositionBias;
+
+    mat4 Object2World = Model2World * ObjectModel;
+
+    gl_Position = World2Camera * Object2World * vec4(model_position, 1.0);
+
+    // La matrice delle normali di un prodotto è il prodotto delle matrici
+    // delle normali: quella comune è calcolata sulla CPU. La matrice di 
+    // ogni oggetto può invertire l'orientamento (es. un modello 
+    // specchiato): cofactor() ne corregge il segno
+    fragment_normal = NormalMatrix * cofactor(mat3(ObjectModel)) * normal;
+
+    fragment_position = (Object2World * vec4(model_position,1.0)).xyz;
+
+    fragment_textcoord = textcoord;
+
+    fragment_tint = ObjectTint;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#version 330
+
+// Variante di 14.vert per il rendering instanced (Mesh::render_instanced).
+// Oltre agli attributi dei vertici riceve gli attributi di ogni istanza,
+// letti da un InstanceBuffer: la matrice dell'istanza e il suo colore.
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;    
+layout (location = 2) in vec2 textcoord;  
+
+// Una mat4 occupa le location da 3 a 6 (una colonna per location)
+layout (location = 3) in mat4 InstanceModel;
+layout (location = 7) in vec4 InstanceTint;
+
+// Strutture delle luci, come in 14.frag
+struct AmbientLightStruct {
+    vec3 color;
+    float intensity;
+};
+
+struct DiffusiveLightStruct {
+    vec3 color;
+    vec3 direction;
+    float intensity;
+};
+
+struct SpecularLightStruct {
+    float intensity;
+    float shininess;
+};
+
+// Camera e luci, comuni a tutti i programmi (MyShaderClass::FrameBlock). 
+// Il blocco deve essere identico in tutti gli shader
+layout (std140) uniform FrameBlock {
+    mat4 World2Camera;
+    AmbientLightStruct AmbientLight;
+    DiffusiveLightStruct DiffusiveLight;
+    SpecularLightStruct SpecularLight;
+    vec3 CameraPosition;
+
+    // Griglia dei cluster delle luci (usata nel fragment shader)
+    vec4 ClusterDepthPlane;
+    vec2 ClusterTileScale;
+    float ClusterDepthScale;
+    float ClusterDepthBias;
+    ivec3 ClusterCount;
+};
+
+// Model2World è la trasformazione comune a tutte le istanze, applicata 
+// dopo quella dell'istanza (MyShaderClass::ObjectBlock)
+layout (std140) uniform ObjectBlock {
+    mat4 Model2World;
+
+    // Trasposta inversa di Model2World calcolata sulla CPU, a meno di un
+    // fattore positivo (le normali sono normalizzate nel fragment shader)
+    mat3 NormalMatrix;
+
+    // Parametri per ricostruire le posizioni dei vertici quantizzati. 
+    // Per i vertici float la scala vale 1 e l'offset 0.
+    vec3 PositionScale;
+    vec3 PositionBias;
+};
+
+// Passiamo al fragment shader le informazioni sulle normali dei vertici  
+out vec3 fragment_normal;
+
+// Passiamo al fragment shader le coordinate mondo dei vertici
+out vec3 fragment_position;
+
+// Passiamo al fragment shader le coordinate mondo dei vertici
+out vec2 fragment_textcoord;
+
+// Passiamo al fragment shader il colore dell'istanza
+out vec4 fragment_tint;
+
+// Definita in 14_common.vert
+mat3 cofactor(mat3 m);
+
+void main()
+{
+    vec3 model_position = position * PositionScale + PositionBias;
+
+    mat4 Instance2World = Model2World * InstanceModel;
+
+    gl_Position = World2Camera * Instance2World * vec4(model_position, 1.0);
+
+    // La matrice delle normali di un prodotto è il prodotto delle matrici
+    // delle normali: quella del modello è calcolata sulla CPU. Un'istanza
+    // può essere specchiata (scala negativa): cofactor() ne corregge il 
+    // segno, così le normali restano rivolte verso l'esterno
+    fragment_normal = NormalMatrix * cofactor(mat3(InstanceModel)) * normal;
+
+    fragment_position = (Instance2World * vec4(model_position,1.0)).xyz;
+
+    fragment_textcoord = textcoord;
+
+    fragment_tint = InstanceTint;
+}
\ No newline at end of file
@@ -0,0 +1,718 @@
+#include "bvh.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BVH_SSE
+#endif
+
+namespace {
+	const unsigned int NUM_BINS      = 16; // Intervalli valutati per ogni asse
+	const unsigned int MAX_LEAF_SIZE = 4;  // Triangoli per foglia (un pacchetto)
+	const unsigned int MAX_SAH_DEPTH = 48; // Oltre questa profondità i nodi sono divisi a metà
+	const unsigned int STACK_SIZE    = 256;// Limite della profondità dell'albero a 4 figli (x3)
+
+	// Vettore di 4 float e maschera del risultato di un confronto. Senza SSE
+	// le operazioni sono eseguite su ogni componente
+#ifdef BVH_SSE
+	struct float4 { __m128 v; };
+	struct mask4  { __m128 v; };
+
+	inline float4 splat(float x) { float4 r = { _mm_set1_ps(x) }; return r; }
+	inline float4 load(const float *p) { float4 r = { _mm_loadu_ps(p) }; return r; }
+	inline void store(float *p, const float4 &a) { _mm_storeu_ps(p, a.v); }
+
+	inline float4 operator+(const float4 &a, const float4 &b) { float4 r = { _mm_add_ps(a.v, b.v) }; return r; }
+	inline float4 operator-(const float4 &a, const float4 &b) { float4 r = { _mm_sub_ps(a.v, b.v) }; return r; }
+	inline float4 operator*(const float4 &a, const float4 &b) { float4 r = { _mm_mul_ps(a.v, b.v) }; return r; }
+	inline float4 operator/(const float4 &a, const float4 &b) { float4 r = { _mm_div_ps(a.v, b.v) }; return r; }
+	inline float4 min4(const float4 &a, const float4 &b) { float4 r = { _mm_min_ps(a.v, b.v) }; return r; }
+	inline float4 max4(const float4 &a, const float4 &b) { float4 r = { _mm_max_ps(a.v, b.v) }; return r; }
+
+	inline mask4 operator<(const float4 &a, const float4 &b)  { mask4 r = { _mm_cmplt_ps(a.v, b.v) }; return r; }
+	inline mask4 operator<=(const float4 &a, const float4 &b) { mask4 r = { _mm_cmple_ps(a.v, b.v) }; return r; }
+	inline mask4 operator>(const float4 &a, const float4 &b)  { mask4 r = { _mm_cmpgt_ps(a.v, b.v) }; return r; }
+	inline mask4 operator>=(const float4 &a, const float4 &b) { mask4 r = { _mm_cmpge_ps(a.v, b.v) }; return r; }
+	inline mask4 operator&(const mask4 &a, const mask4 &b) { mask4 r = { _mm_and_ps(a.v, b.v) }; return r; }
+	inline mask4 operator|(const mask4 &a, const mask4 &b) { mask4 r = { _mm_or_ps(a.v, b.v) }; return r; }
+	inline int movemask(const mask4 &m) { return _mm_movemask_ps(m.v); }
+#else
+	struct float4 { float v[4]; };
+	struct mask4  { bool v[4]; };
+
+	inline float4 splat(float x) { float4 r = { { x, x, x, x } }; return r; }
+	inline float4 load(const float *p) { float4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+	inline void store(float *p, const float4 &a) { for (int i = 0 ; i < 4 ; i++) p[i] = a.v[i]; }
+
+#define BVH_OP(type, name, expr) \
+	inline type name(const float4 &a, const float4 &b) { type r; for (int i = 0 ; i < 4 ; i++) r.v[i] = (expr); return r; }
+
+	BVH_OP(float4, operator+, a.v[i] + b.v[i])
+	BVH_OP(float4, operator-, a.v[i] - b.v[i])
+	BVH_OP(float4, operator*, a.v[i] * b.v[i])
+	BVH_OP(float4, operator/, a.v[i] / b.v[i])
+	// Come le istruzioni SSE: con un NaN il risultato è il secondo operando
+	BVH_OP(float4, min4, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+	BVH_OP(float4, max4, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+	BVH_OP(mask4, operator<,  a.v[i] <  b.v[i])
+	BVH_OP(mask4, operator<=, a.v[i] <= b.v[i])
+	BVH_OP(mask4, operator>,  a.v[i] >  b.v[i])
+	BVH_OP(mask4, operator>=, a.v[i] >= b.v[i])
+
+#undef BVH_OP
+
+	inline mask4 operator&(const mask4 &a, const mask4 &b) {
+		mask4 r; for (int i = 0 ; i < 4 ; i++) r.v[i] = a.v[i] && b.v[i]; return r;
+	}
+	inline mask4 operator|(const mask4 &a, const mask4 &b) {
+		mask4 r; for (int i = 0 ; i < 4 ; i++) r.v[i] = a.v[i] || b.v[i]; return r;
+	}
+	inline int movemask(const mask4 &m) {
+		return int(m.v[0]) | (int(m.v[1]) << 1) | (int(m.v[2]) << 2) | (int(m.v[3]) << 3);
+	}
+#endif
+
+	struct Bounds {
+		glm::vec3 bmin, bmax;
+
+		Bounds() : bmin(std::numeric_limits<float>::max()), bmax(-std::numeric_limits<float>::max()) {}
+
+		void grow(const glm::vec3 &p) {
+			bmin = glm::min(bmin, p);
+			bmax = glm::max(bmax, p);
+		}
+
+		void grow(const Bounds &b) {
+			bmin = glm::min(bmin, b.bmin);
+			bmax = glm::max(bmax, b.bmax);
+		}
+
+		float area() const {
+			glm::vec3 d = bmax - bmin;
+			return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+	};
+
+	// Nodo dell'albero binario usato durante la costruzione
+	struct BuildNode {
+		Bounds bounds;
+		unsigned int left, right;  // Figli (nodi interni)
+		unsigned int first, count; // Intervallo dei riferimenti (foglie, count > 0)
+	};
+
+	// Sotto-albero da costruire in parallelo
+	struct BuildTask {
+		unsigned int begin, end, depth;
+		unsigned int node; // Nodo segnaposto dell'albero principale
+	};
+
+	/**
+		Costruzione top-down dell'albero binario su un intervallo dei
+		riferimenti ai triangoli. Se tasks non è nullo, gli intervalli più
+		piccoli di task_size non sono divisi ma accodati in tasks.
+	*/
+	class Builder {
+	public:
+		std::vector<BuildNode> nodes;
+
+		Builder(const std::vector<Bounds> &bounds, const std::vector<glm::vec3> &centroids,
+		        std::vector<unsigned int> &refs, std::vector<BuildTask> *tasks=nullptr, size_t task_size=0) :
+			_bounds(bounds), _centroids(centroids), _refs(refs), _tasks(tasks), _task_size(task_size) {}
+
+		unsigned int build(unsigned int begin, unsigned int end, unsigned int depth) {
+			Bounds node_bounds, centroid_bounds;
+			for (unsigned int i = begin ; i < end ; i++) {
+				node_bounds.grow(_bounds[_refs[i]]);
+				centroid_bounds.grow(_centroids[_refs[i]]);
+			}
+
+			const unsigned int index = nodes.size();
+			BuildNode node;
+			node.bounds = node_bounds;
+			node.left = node.right = 0;
+			node.first = begin;
+			node.count = 0;
+			nodes.push_back(node);
+
+			const unsigned int count = end - begin;
+
+			if (count <= MAX_LEAF_SIZE) {
+				nodes[index].count = count;
+				return index;
+			}
+
+			if (_tasks != nullptr && count <= _task_size) {
+				BuildTask task = { begin, end, depth, index };
+				_tasks->push_back(task);
+				return index;
+			}
+
+			const unsigned int mid = split(begin, end, depth, centroid_bounds);
+
+			const unsigned int left  = build(begin, mid, depth + 1);
+			const unsigned int right = build(mid, end, depth + 1);
+			nodes[index].left  = left;
+			nodes[index].right = right;
+
+			return index;
+		}
+
+	private:
+		const std::vector<Bounds>    &_bounds;
+		const std::vector<glm::vec3> &_centroids;
+		std::vector<unsigned int>    &_refs;
+		std::vector<BuildTask>       *_tasks;
+		size_t                        _task_size;
+
+		/**
+			Divide l'intervallo con la SAH e ritorna il primo riferimento della
+			seconda metà (sempre strettamente tra begin e end)
+		*/
+		unsigned int split(unsigned int begin, unsigned int end, unsigned int depth, const Bounds &centroid_bounds) {
+			const glm::vec3 extent = centroid_bounds.bmax - centroid_bounds.bmin;
+
+			int best_axis = -1;
+			unsigned int best_bin = 0;
+			float best_cost = std::numeric_limits<float>::max();
+
+			if (depth < MAX_SAH_DEPTH) {
+				for (int axis = 0 ; axis < 3 ; axis++) {
+					if (!(extent[axis] > 0.0f)) continue;
+
+					const float scale = NUM_BINS * 0.999f / extent[axis];
+
+					Bounds bins[NUM_BINS];
+					unsigned int counts[NUM_BINS] = { 0 };
+
+					for (unsigned int i = begin ; i < end ; i++) {
+						const unsigned int t = _refs[i];
+						const unsigned int b = std::min(NUM_BINS - 1,
+							(unsigned int)((_centroids[t][axis] - centroid_bounds.bmin[axis]) * scale));
+						counts[b]++;
+						bins[b].grow(_bounds[t]);
+					}
+
+					// Costo della parte destra di ogni divisione
+					float right_cost[NUM_BINS];
+					Bounds acc;
+					unsigned int acc_count = 0;
+					for (unsigned int b = NUM_BINS - 1 ; b > 0 ; b--) {
+						acc.grow(bins[b]);
+						acc_count += counts[b];
+						right_cost[b] = acc_count ? acc.area() * acc_count : 0.0f;
+					}
+
+					acc = Bounds();
+					acc_count = 0;
+					for (unsigned int b = 0 ; b < NUM_BINS - 1 ; b++) {
+						acc.grow(bins[b]);
+						acc_count += counts[b];
+
+						if (acc_count == 0 || acc_count == end - begin) continue;
+
+						const float cost = acc.area() * acc_count + right_cost[b + 1];
+						if (cost < best_cost) {
+							best_cost = cost;
+							best_axis = axis;
+							best_bin  = b;
+						}
+					}
+				}
+			}
+
+			if (best_axis >= 0) {
+				const int axis = best_axis;
+				const float scale = NUM_BINS * 0.999f / extent[axis];
+				const float origin = centroid_bounds.bmin[axis];
+				const std::vector<glm::vec3> &centroids = _centroids;
+
+				unsigned int *mid = std::partition(&_refs[begin], &_refs[0] + end, [&](unsigned int t) {
+					return std::min(NUM_BINS - 1, (unsigned int)((centroids[t][axis] - origin) * scale)) <= best_bin;
+				});
+
+				const unsigned int m = mid - &_refs[0];
+				if (m > begin && m < end) return m;
+			}
+
+			// Divisione a metà lungo l'asse più lungo (anche con tutti i
+			// centroidi coincidenti l'albero resta bilanciato)
+			int axis = 0;
+			if (extent.y > extent[axis]) axis = 1;
+			if (extent.z > extent[axis]) axis = 2;
+
+			const unsigned int m = begin + (end - begin) / 2;
+			const std::vector<glm::vec3> &centroids = _centroids;
+			std::nth_element(&_refs[begin], &_refs[0] + m, &_refs[0] + end, [&](unsigned int a, unsigned int b) {
+				return centroids[a][axis] < centroids[b][axis];
+			});
+
+			return m;
+		}
+	};
+
+	/**
+		Punto del triangolo abc più vicino a p (Ericson, "Real-Time Collision
+		Detection", 5.1.5)
+	*/
+	glm::vec3 closest_point_triangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+		const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+		const glm::vec3 bp = p - b;
+		const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return b;
+
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+		const glm::vec3 cp = p - c;
+		const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return c;
+
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		const float denom = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+}
+
+Bvh::Bvh() : _num_triangles(0) {}
+
+void Bvh::clear() {
+	std::vector<Node>().swap(_nodes);
+	std::vector<TrianglePacket>().swap(_packets);
+	_num_triangles = 0;
+}
+
+void Bvh::swap(Bvh &other) {
+	_nodes.swap(other._nodes);
+	_packets.swap(other._packets);
+	std::swap(_num_triangles, other._num_triangles);
+}
+
+bool Bvh::empty() const {
+	return _nodes.empty();
+}
+
+size_t Bvh::num_triangles() const {
+	return _num_triangles;
+}
+
+size_t Bvh::num_nodes() const {
+	return _nodes.size();
+}
+
+size_t Bvh::memory_usage() const {
+	return _nodes.size() * sizeof(Node) + _packets.size() * sizeof(TrianglePacket);
+}
+
+void Bvh::build(const glm::vec3 *corners, size_t num_triangles) {
+	clear();
+
+	if (num_triangles == 0) return;
+
+	_num_triangles = num_triangles;
+
+	ThreadPool &pool = ThreadPool::instance();
+
+	// Bounding box e centroide di ogni triangolo
+	std::vector<Bounds> bounds(num_triangles);
+	std::vector<glm::vec3> centroids(num_triangles);
+	std::vector<unsigned int> refs(num_triangles);
+
+	const size_t block = 16384;
+	pool.parallel_for((num_triangles + block - 1) / block, [&](unsigned int b) {
+		const size_t last = std::min(num_triangles, (b + 1) * block);
+		for (size_t t = b * block ; t < last ; t++) {
+			Bounds &tb = bounds[t];
+			tb.grow(corners[3 * t]);
+			tb.grow(corners[3 * t + 1]);
+			tb.grow(corners[3 * t + 2]);
+			centroids[t] = (tb.bmin + tb.bmax) * 0.5f;
+			refs[t] = t;
+		}
+	});
+
+	// I livelli più alti sono divisi qui; i sotto-alberi abbastanza piccoli
+	// sono costruiti in parallelo e poi accodati ai nodi dell'albero
+	std::vector<BuildTask> tasks;
+	const size_t task_size = std::max<size_t>(4096, num_triangles / (pool.size() * 4));
+
+	Builder top(bounds, centroids, refs, &tasks, task_size);
+	top.build(0, num_triangles, 0);
+
+	std::vector<std::vector<BuildNode> > subtrees(tasks.size());
+	pool.parallel_for(tasks.size(), [&](unsigned int i) {
+		Builder builder(bounds, centroids, refs);
+		builder.build(tasks[i].begin, tasks[i].end, tasks[i].depth);
+		subtrees[i].swap(builder.nodes);
+	});
+
+	std::vector<BuildNode> &nodes = top.nodes;
+	for (unsigned int i = 0 ; i < tasks.size() ; i++) {
+		const unsigned int offset = nodes.size();
+		for (unsigned int n = 0 ; n < subtrees[i].size() ; n++) {
+			BuildNode node = subtrees[i][n];
+			if (node.count == 0) {
+				node.left  += offset;
+				node.right += offset;
+			}
+			nodes.push_back(node);
+		}
+		// La radice del sotto-albero prende il posto del segnaposto
+		nodes[tasks[i].node] = nodes[offset];
+	}
+
+	// Compattiamo l'albero binario in un albero a 4 figli: ogni nodo
+	// prende i due figli del nodo binario e li sostituisce con i loro
+	// figli (partendo dal più grande) finchè non ne ha 4
+	struct Pending {
+		unsigned int binary; // Nodo dell'albero binario
+		unsigned int parent; // Nodo a 4 figli a cui agganciarlo
+		unsigned int slot;   // Posizione tra i figli del padre
+	};
+
+	std::vector<Pending> stack;
+	Pending root = { 0, ~0u, 0 };
+	stack.push_back(root);
+
+	_nodes.reserve(nodes.size() / 2 + 1);
+	_packets.reserve(num_triangles / 2 + 1);
+
+	while (!stack.empty()) {
+		const Pending item = stack.back();
+		stack.pop_back();
+
+		unsigned int children[4];
+		unsigned int num_children = 0;
+
+		const BuildNode &b = nodes[item.binary];
+		if (b.count > 0) {
+			// Solo la radice può essere una foglia
+			children[num_children++] = item.binary;
+		}
+		else {
+			children[num_children++] = b.left;
+			children[num_children++] = b.right;
+
+			while (num_children < 4) {
+				int largest = -1;
+				float largest_area = -1.0f;
+				for (unsigned int i = 0 ; i < num_children ; i++) {
+					const BuildNode &c = nodes[children[i]];
+					if (c.count == 0 && c.bounds.area() > largest_area) {
+						largest = i;
+						largest_area = c.bounds.area();
+					}
+				}
+				if (largest < 0) break;
+
+				const BuildNode &c = nodes[children[largest]];
+				children[largest] = c.left;
+				children[num_children++] = c.right;
+			}
+		}
+
+		const unsigned int index = _nodes.size();
+		if (item.parent != ~0u) _nodes[item.parent].child[item.slot] = index;
+
+		Node node;
+		node.num_children = num_children;
+		node.padding[0] = node.padding[1] = node.padding[2] = 0;
+
+		for (unsigned int i = 0 ; i < 4 ; i++) {
+			// I figli non validi sono esclusi da num_children nelle query
+			const Bounds cb = (i < num_children) ? nodes[children[i]].bounds : Bounds();
+			node.min_x[i] = cb.bmin.x; node.min_y[i] = cb.bmin.y; node.min_z[i] = cb.bmin.z;
+			node.max_x[i] = cb.bmax.x; node.max_y[i] = cb.bmax.y; node.max_z[i] = cb.bmax.z;
+			node.child[i] = 0;
+
+			if (i >= num_children) continue;
+
+			const BuildNode &c = nodes[children[i]];
+			if (c.count > 0) {
+				TrianglePacket packet;
+				for (unsigned int k = 0 ; k < 4 ; k++) {
+					glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+					unsigned int t = ~0u;
+					if (k < c.count) {
+						t  = refs[c.first + k];
+						v0 = corners[3 * t];
+						e1 = corners[3 * t + 1] - v0;
+						e2 = corners[3 * t + 2] - v0;
+					}
+					for (int a = 0 ; a < 3 ; a++) {
+						packet.v0[a][k] = v0[a];
+						packet.e1[a][k] = e1[a];
+						packet.e2[a][k] = e2[a];
+					}
+					packet.triangle[k] = t;
+				}
+				node.child[i] = LEAF | _packets.size();
+				_packets.push_back(packet);
+			}
+			else {
+				Pending p = { children[i], index, i };
+				stack.push_back(p);
+			}
+		}
+
+		_nodes.push_back(node);
+	}
+}
+
+bool Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_t, Hit &hit) const {
+	if (_nodes.empty()) return false;
+
+	// Le componenti nulle della direzione sono sostituite con valori molto
+	// piccoli: gli inversi restano finiti e il test dei box non produce NaN
+	glm::vec3 inv;
+	for (int k = 0 ; k < 3 ; k++) {
+		float d = direction[k];
+		if (std::fabs(d) < 1e-20f) d = (d < 0.0f) ? -1e-20f : 1e-20f;
+		inv[k] = 1.0f / d;
+	}
+
+	const float4 ix = splat(inv.x), iy = splat(inv.y), iz = splat(inv.z);
+	const float4 oix = splat(origin.x * inv.x), oiy = splat(origin.y * inv.y), oiz = splat(origin.z * inv.z);
+	const float4 ox = splat(origin.x), oy = splat(origin.y), oz = splat(origin.z);
+	const float4 dx = splat(direction.x), dy = splat(direction.y), dz = splat(direction.z);
+	const float4 zero = splat(0.0f), one = splat(1.0f);
+
+	float best = max_t;
+	bool found = false;
+
+	unsigned int stack_node[STACK_SIZE];
+	float        stack_t[STACK_SIZE];
+	unsigned int sp = 0;
+
+	stack_node[sp] = 0;
+	stack_t[sp++] = 0.0f;
+
+	while (sp > 0) {
+		--sp;
+		if (stack_t[sp] > best) continue;
+
+		const unsigned int c = stack_node[sp];
+
+		if (c & LEAF) {
+			// Möller-Trumbore sui 4 triangoli del pacchetto
+			const TrianglePacket &p = _packets[c & ~LEAF];
+
+			const float4 e1x = load(p.e1[0]), e1y = load(p.e1[1]), e1z = load(p.e1[2]);
+			const float4 e2x = load(p.e2[0]), e2y = load(p.e2[1]), e2z = load(p.e2[2]);
+
+			const float4 px = dy * e2z - dz * e2y;
+			const float4 py = dz * e2x - dx * e2z;
+			const float4 pz = dx * e2y - dy * e2x;
+			const float4 det = e1x * px + e1y * py + e1z * pz;
+			const float4 inv_det = one / det;
+
+			const float4 tx = ox - load(p.v0[0]), ty = oy - load(p.v0[1]), tz = oz - load(p.v0[2]);
+			const float4 u = (tx * px + ty * py + tz * pz) * inv_det;
+
+			const float4 qx = ty * e1z - tz * e1y;
+			const float4 qy = tz * e1x - tx * e1z;
+			const float4 qz = tx * e1y - ty * e1x;
+			const float4 v = (dx * qx + dy * qy + dz * qz) * inv_det;
+			const float4 t = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+
+			const int mask = movemask(((det > zero) | (det < zero)) & (u >= zero) & (v >= zero) &
+			                          (u + v <= one) & (t >= zero) & (t < splat(best)));
+			if (mask == 0) continue;
+
+			float tt[4], uu[4], vv[4];
+			store(tt, t); store(uu, u); store(vv, v);
+
+			for (int k = 0 ; k < 4 ; k++) {
+				if (((mask >> k) & 1) && tt[k] < best) {
+					best = tt[k];
+					hit.t = tt[k];
+					hit.u = uu[k];
+					hit.v = vv[k];
+					hit.triangle = p.triangle[k];
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Slab test sui 4 figli
+		const Node &n = _nodes[c];
+
+		const float4 tx0 = load(n.min_x) * ix - oix, tx1 = load(n.max_x) * ix - oix;
+		const float4 ty0 = load(n.min_y) * iy - oiy, ty1 = load(n.max_y) * iy - oiy;
+		const float4 tz0 = load(n.min_z) * iz - oiz, tz1 = load(n.max_z) * iz - oiz;
+
+		const float4 tnear = max4(max4(min4(tx0, tx1), min4(ty0, ty1)), max4(min4(tz0, tz1), zero));
+		const float4 tfar  = min4(min4(max4(tx0, tx1), max4(ty0, ty1)), min4(max4(tz0, tz1), splat(best)));
+
+		const int mask = movemask(tnear <= tfar) & ((1 << n.num_children) - 1);
+		if (mask == 0) continue;
+
+		float near[4];
+		store(near, tnear);
+
+		// I figli colpiti sono inseriti dal più lontano: il più vicino è
+		// visitato per primo
+		unsigned int order[4], count = 0;
+		for (unsigned int i = 0 ; i < 4 ; i++) {
+			if (!((mask >> i) & 1)) continue;
+			unsigned int j = count++;
+			while (j > 0 && near[order[j - 1]] < near[i]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+
+		for (unsigned int j = 0 ; j < count ; j++) {
+			stack_node[sp] = n.child[order[j]];
+			stack_t[sp++] = near[order[j]];
+		}
+	}
+
+	return found;
+}
+
+bool Bvh::closest_point(const glm::vec3 &point, float max_distance, Closest &result) const {
+	if (_nodes.empty()) return false;
+
+	const float4 px = splat(point.x), py = splat(point.y), pz = splat(point.z);
+	const float4 zero = splat(0.0f);
+
+	float best = max_distance * max_distance;
+	bool found = false;
+
+	unsigned int stack_node[STACK_SIZE];
+	float        stack_d[STACK_SIZE];
+	unsigned int sp = 0;
+
+	stack_node[sp] = 0;
+	stack_d[sp++] = 0.0f;
+
+	while (sp > 0) {
+		--sp;
+		if (stack_d[sp] > best) continue;
+
+		const unsigned int c = stack_node[sp];
+
+		if (c & LEAF) {
+			const TrianglePacket &p = _packets[c & ~LEAF];
+
+			for (int k = 0 ; k < 4 ; k++) {
+				if (p.triangle[k] == ~0u) continue;
+
+				const glm::vec3 v0(p.v0[0][k], p.v0[1][k], p.v0[2][k]);
+				const glm::vec3 v1 = v0 + glm::vec3(p.e1[0][k], p.e1[1][k], p.e1[2][k]);
+				const glm::vec3 v2 = v0 + glm::vec3(p.e2[0][k], p.e2[1][k], p.e2[2][k]);
+
+				const glm::vec3 q = closest_point_triangle(point, v0, v1, v2);
+				const glm::vec3 d = q - point;
+				const float d2 = glm::dot(d, d);
+
+				if (d2 <= best) {
+					best = d2;
+					result.point = q;
+					result.triangle = p.triangle[k];
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Distanza al quadrato dal punto ai 4 box
+		const Node &n = _nodes[c];
+
+		const float4 dx = max4(max4(load(n.min_x) - px, px - load(n.max_x)), zero);
+		const float4 dy = max4(max4(load(n.min_y) - py, py - load(n.max_y)), zero);
+		const float4 dz = max4(max4(load(n.min_z) - pz, pz - load(n.max_z)), zero);
+		const float4 d2 = dx * dx + dy * dy + dz * dz;
+
+		const int mask = movemask(d2 <= splat(best)) & ((1 << n.num_children) - 1);
+		if (mask == 0) continue;
+
+		float dist[4];
+		store(dist, d2);
+
+		unsigned int order[4], count = 0;
+		for (unsigned int i = 0 ; i < 4 ; i++) {
+			if (!((mask >> i) & 1)) continue;
+			unsigned int j = count++;
+			while (j > 0 && dist[order[j - 1]] < dist[i]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+
+		for (unsigned int j = 0 ; j < count ; j++) {
+			stack_node[sp] = n.child[order[j]];
+			stack_d[sp++] = dist[order[j]];
+		}
+	}
+
+	if (found) result.distance = std::sqrt(best);
+
+	return found;
+}
+
+size_t Bvh::overlap_sphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &triangles) const {
+	if (_nodes.empty()) return 0;
+
+	const float4 cx = splat(center.x), cy = splat(center.y), cz = splat(center.z);
+	const float4 zero = splat(0.0f);
+	const float r2 = radius * radius;
+	const float4 radius2 = splat(r2);
+
+	const size_t first = triangles.size();
+
+	unsigned int stack[STACK_SIZE];
+	unsigned int sp = 0;
+	stack[sp++] = 0;
+
+	while (sp > 0) {
+		const unsigned int c = stack[--sp];
+
+		if (c & LEAF) {
+			const TrianglePacket &p = _packets[c & ~LEAF];
+
+			for (int k = 0 ; k < 4 ; k++) {
+				if (p.triangle[k] == ~0u) continue;
+
+				const glm::vec3 v0(p.v0[0][k], p.v0[1][k], p.v0[2][k]);
+				const glm::vec3 v1 = v0 + glm::vec3(p.e1[0][k], p.e1[1][k], p.e1[2][k]);
+				const glm::vec3 v2 = v0 + glm::vec3(p.e2[0][k], p.e2[1][k], p.e2[2][k]);
+
+				const glm::vec3 d = closest_point_triangle(center, v0, v1, v2) - center;
+				if (glm::dot(d, d) <= r2) triangles.push_back(p.triangle[k]);
+			}
+			continue;
+		}
+
+		const Node &n = _nodes[c];
+
+		const float4 dx = max4(max4(load(n.min_x) - cx, cx - load(n.max_x)), zero);
+		const float4 dy = max4(max4(load(n.min_y) - cy, cy - load(n.max_y)), zero);
+		const float4 dz = max4(max4(load(n.min_z) - cz, cz - load(n.max_z)), zero);
+
+		const int mask = movemask(dx * dx + dy * dy + dz * dz <= radius2) & ((1 << n.num_children) - 1);
+
+		for (unsigned int i = 0 ; i < 4 ; i++) {
+			if ((mask >> i) & 1) stack[sp++] = n.child[i];
+		}
+	}
+
+	return triangles.size() - first;
+}
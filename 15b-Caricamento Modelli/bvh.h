@@ -0,0 +1,154 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <vector>
+#include "glm/glm.hpp"
+
+/**
+	Bounding volume hierarchy di una lista di triangoli, usata per le query
+	sulla geometria lato CPU (picking, collisioni).
+
+	La gerarchia è costruita con la surface area heuristic (SAH) valutata su
+	un numero fisso di intervalli (binning) lungo i tre assi. I livelli più
+	alti sono divisi dal thread chiamante, i sotto-alberi risultanti sono
+	costruiti in parallelo dal pool di thread. L'albero binario è poi
+	compattato in un albero a 4 figli: i bounding box dei figli di ogni nodo
+	sono memorizzati in formato SoA, in modo da essere testati insieme con
+	le istruzioni SIMD. Ogni foglia contiene al più 4 triangoli, memorizzati
+	anch'essi in formato SoA (vertice e due spigoli) e intersecati insieme.
+
+	Tutte le query lavorano nel sistema di coordinate dei triangoli (es.
+	coordinate locali del modello). I triangoli sono identificati dal loro
+	indice nella lista usata per costruire la gerarchia.
+*/
+class Bvh {
+public:
+
+	/**
+		Risultato di raycast()
+	*/
+	struct Hit {
+		float t;              ///< Distanza lungo il raggio (in unità di direction)
+		float u, v;           ///< Coordinate baricentriche del punto (rispetto al 2° e 3° vertice)
+		unsigned int triangle;///< Indice del triangolo
+	};
+
+	/**
+		Risultato di closest_point()
+	*/
+	struct Closest {
+		glm::vec3 point;      ///< Punto più vicino sulla superficie
+		float distance;       ///< Distanza dal punto della query
+		unsigned int triangle;///< Indice del triangolo
+	};
+
+	Bvh();
+
+	/**
+		Costruisce la gerarchia. I vertici dei triangoli sono passati per
+		esteso (tre per triangolo): il triangolo i ha i vertici
+		corners[3i], corners[3i+1] e corners[3i+2].
+
+		@param corners vertici dei triangoli
+		@param num_triangles numero di triangoli
+	*/
+	void build(const glm::vec3 *corners, size_t num_triangles);
+
+	/**
+		Libera la memoria della gerarchia
+	*/
+	void clear();
+
+	/**
+		Scambia il contenuto con un'altra gerarchia
+	*/
+	void swap(Bvh &other);
+
+	/**
+		Ritorna true se la gerarchia non contiene triangoli
+	*/
+	bool empty() const;
+
+	/**
+		Ritorna il numero di triangoli
+	*/
+	size_t num_triangles() const;
+
+	/**
+		Ritorna il numero di nodi (a 4 figli)
+	*/
+	size_t num_nodes() const;
+
+	/**
+		Ritorna la memoria occupata dalla gerarchia in byte
+	*/
+	size_t memory_usage() const;
+
+	/**
+		Cerca la prima intersezione del raggio con i triangoli (entrambe le
+		facce). I nodi sono visitati dal più vicino e i sotto-alberi più
+		lontani dell'intersezione già trovata sono scartati.
+
+		@param origin origine del raggio
+		@param direction direzione del raggio (non necessariamente normalizzata)
+		@param max_t distanza massima lungo il raggio (in unità di direction)
+		@param hit intersezione trovata
+		@return true se il raggio interseca almeno un triangolo
+	*/
+	bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_t, Hit &hit) const;
+
+	/**
+		Cerca il punto della superficie più vicino al punto indicato
+
+		@param point punto della query
+		@param max_distance distanza massima di ricerca
+		@param result punto trovato
+		@return true se c'è un triangolo entro la distanza massima
+	*/
+	bool closest_point(const glm::vec3 &point, float max_distance, Closest &result) const;
+
+	/**
+		Cerca i triangoli che intersecano una sfera
+
+		@param center centro della sfera
+		@param radius raggio della sfera
+		@param triangles vettore che riceve gli indici dei triangoli (in coda)
+		@return il numero di triangoli aggiunti
+	*/
+	size_t overlap_sphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &triangles) const;
+
+private:
+
+	/**
+		Nodo a 4 figli (128 byte). I figli validi sono i primi num_children;
+		un figlio è una foglia se ha il bit LEAF, e in quel caso il resto del
+		valore è l'indice del suo pacchetto di triangoli.
+	*/
+	struct Node {
+		float min_x[4], min_y[4], min_z[4]; ///< Angoli minimi dei figli
+		float max_x[4], max_y[4], max_z[4]; ///< Angoli massimi dei figli
+		unsigned int child[4];              ///< Nodo o pacchetto di ogni figlio
+		unsigned int num_children;          ///< Numero di figli validi
+		unsigned int padding[3];
+	};
+
+	/**
+		Pacchetto di 4 triangoli in formato SoA. Le posizioni inutilizzate
+		hanno spigoli nulli (non intersecano mai) e triangolo ~0.
+	*/
+	struct TrianglePacket {
+		float v0[3][4];            ///< Primo vertice
+		float e1[3][4];            ///< Spigolo v1 - v0
+		float e2[3][4];            ///< Spigolo v2 - v0
+		unsigned int triangle[4];  ///< Indice di ogni triangolo
+	};
+
+	static const unsigned int LEAF = 0x80000000u;
+
+	std::vector<Node>           _nodes;    ///< Nodi (la radice è il primo)
+	std::vector<TrianglePacket> _packets;  ///< Triangoli delle foglie
+	size_t                      _num_triangles;
+};
+
+#endif
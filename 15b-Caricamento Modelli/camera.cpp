@@ -12,6 +12,13 @@
 
 #include <iostream>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CAMERA_SSE
+#endif
+
 static std::ostream &operator<<(std::ostream &os, const glm::vec3 &v) {
 	for(int y=0; y<3; ++y) {
 		os<<v[y]<<" ";
@@ -25,6 +32,7 @@ Camera::Camera() {
 
 void Camera::reset() {
 	_combined   = _projection = _camera = glm::mat4(1.0f);
+	_viewport_height = 1.0f;
 	_position   = glm::vec3(0,0,0);
 	_lookat_dir = glm::vec3(0,0,-1);
 	_up         = glm::vec3(0,1,0);
@@ -37,16 +45,117 @@ void Camera::reset() {
 
 	_speed = 0.05f;
 	_mouse_speed = _speed *2;
+
+	update();
 }
 
 void Camera::update() {
 	_combined = _projection * _camera;  
+
+	// Piani del frustum estratti dalle righe della matrice completa
+	// (metodo di Gribb-Hartmann)
+	const glm::mat4 m = glm::transpose(_combined);
+
+	_frustum[0] = m[3] + m[0];
+	_frustum[1] = m[3] - m[0];
+	_frustum[2] = m[3] + m[1];
+	_frustum[3] = m[3] - m[1];
+	_frustum[4] = m[3] + m[2];
+	_frustum[5] = m[3] - m[2];
+
+	for (int i = 0 ; i < 6 ; i++) {
+		float len = glm::length(glm::vec3(_frustum[i]));
+		if (len > 0.0f) _frustum[i] /= len;
+	}
 }
 
 const glm::mat4& Camera::CP() const {
 	return _combined;
 }
 
+const glm::vec4* Camera::frustum_planes() const {
+	return _frustum;
+}
+
+bool Camera::sphere_visible(const glm::vec3 &center, float radius) const {
+	for (int i = 0 ; i < 6 ; i++) {
+		if (glm::dot(glm::vec3(_frustum[i]), center) + _frustum[i].w < -radius) return false;
+	}
+	return true;
+}
+
+unsigned int Camera::cull_spheres(const glm::vec4 *spheres, unsigned int count, unsigned char *visible) const {
+	unsigned int i = 0, num_visible = 0;
+
+	// Le sfere sono trasposte in registri con le sole x, y, z e raggi (SoA)
+	// e ogni piano è confrontato con tutte le sfere del blocco
+#if defined(__AVX__)
+	for ( ; i + 8 <= count ; i += 8) {
+		const float *s = &spheres[i].x;
+
+		__m128 a0 = _mm_loadu_ps(s),      a1 = _mm_loadu_ps(s + 4);
+		__m128 a2 = _mm_loadu_ps(s + 8),  a3 = _mm_loadu_ps(s + 12);
+		__m128 b0 = _mm_loadu_ps(s + 16), b1 = _mm_loadu_ps(s + 20);
+		__m128 b2 = _mm_loadu_ps(s + 24), b3 = _mm_loadu_ps(s + 28);
+		_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+		_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+		__m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(a0), b0, 1);
+		__m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(a1), b1, 1);
+		__m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(a2), b2, 1);
+		__m256 r = _mm256_insertf128_ps(_mm256_castps128_ps256(a3), b3, 1);
+		__m256 neg_r = _mm256_sub_ps(_mm256_setzero_ps(), r);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0 ; p < 6 ; p++) {
+			__m256 d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(_frustum[p].x)),
+			                         _mm256_mul_ps(y, _mm256_set1_ps(_frustum[p].y)));
+			d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(_frustum[p].z)));
+			d = _mm256_add_ps(d, _mm256_set1_ps(_frustum[p].w));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (int k = 0 ; k < 8 ; k++) {
+			visible[i + k] = (mask >> k) & 1;
+			num_visible += visible[i + k];
+		}
+	}
+#elif defined(CAMERA_SSE)
+	for ( ; i + 4 <= count ; i += 4) {
+		const float *s = &spheres[i].x;
+
+		__m128 x = _mm_loadu_ps(s),     y = _mm_loadu_ps(s + 4);
+		__m128 z = _mm_loadu_ps(s + 8), r = _mm_loadu_ps(s + 12);
+		_MM_TRANSPOSE4_PS(x, y, z, r);
+		__m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+
+		__m128 inside = _mm_cmpeq_ps(x, x);
+		for (int p = 0 ; p < 6 ; p++) {
+			__m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(_frustum[p].x)),
+			                      _mm_mul_ps(y, _mm_set1_ps(_frustum[p].y)));
+			d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(_frustum[p].z)));
+			d = _mm_add_ps(d, _mm_set1_ps(_frustum[p].w));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int k = 0 ; k < 4 ; k++) {
+			visible[i + k] = (mask >> k) & 1;
+			num_visible += visible[i + k];
+		}
+	}
+#endif
+
+	// Sfere rimanenti (o tutte, senza SIMD)
+	for ( ; i < count ; i++) {
+		visible[i] = sphere_visible(glm::vec3(spheres[i]), spheres[i].w) ? 1 : 0;
+		num_visible += visible[i];
+	}
+
+	return num_visible;
+}
+
 void Camera::set_camera(const glm::vec3 &position, const glm::vec3 &lookat, const glm::vec3 &up){
 	_position = position;
 	_up = up;
@@ -74,6 +183,7 @@ const glm::mat4& Camera::camera() const {
 
 void Camera::set_perspective(float FOVDeg, float width, float height, float znear, float zfar) {
 	_projection = perspective_projection(FOVDeg,width,height,znear,zfar);
+	_viewport_height = height;
 	update();
 }
 
@@ -95,6 +205,12 @@ const glm::mat4& Camera::projection() const {
 	return _projection;
 }
 
+float Camera::projected_size(float size, float distance) const {
+	// _projection[1][1] vale 1/tan(fovy/2): a distanza 1 l'altezza della 
+	// window corrisponde a 2/_projection[1][1] unità
+	return size * _projection[1][1] * _viewport_height * 0.5f / distance;
+}
+
 void Camera::set_speed(float speed) {
 	_speed = speed;
 }
@@ -198,3 +314,13 @@ void Camera::lock_mouse_position(bool lock) {
 const glm::vec3 &Camera::position() const {
   return _position;
 }
+
+void Camera::ray(float x, float y, glm::vec3 &origin, glm::vec3 &direction) const {
+	const glm::mat4 inverse = glm::inverse(_combined);
+
+	glm::vec4 near_point = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 far_point = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+
+	origin = glm::vec3(near_point) / near_point.w;
+	direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+}
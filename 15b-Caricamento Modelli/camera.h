@@ -63,6 +63,16 @@ public:
 	*/
 	const glm::mat4& projection() const;
 
+	/**
+		Ritorna la dimensione in pixel sullo schermo di un segmento 
+		perpendicolare alla direzione di vista, usando la proiezione corrente.
+
+		@param size lunghezza del segmento in coordinate mondo
+		@param distance distanza del segmento dalla camera
+		@return la dimensione proiettata in pixel
+	*/
+	float projected_size(float size, float distance) const;
+
 	/**
 		Ritorna la matrice di trasformazione di proiezione prospettica.
 
@@ -88,6 +98,49 @@ public:
 	*/
 	const glm::mat4& CP() const;
 
+	/**
+		Ritorna i sei piani del frustum (sinistro, destro, basso, alto, near,
+		far) in coordinate mondo. I piani sono normalizzati e le normali 
+		puntano verso l'interno: un punto p è dentro il piano se
+		dot(xyz, p) + w >= 0. Sono ricalcolati ad ogni modifica di CP().
+		@return puntatore al primo dei sei piani
+	*/
+	const glm::vec4* frustum_planes() const;
+
+	/**
+		Controlla se una sfera (in coordinate mondo) interseca il frustum.
+		Il test è conservativo: alcune sfere vicine agli spigoli del frustum
+		sono considerate visibili anche se non lo sono.
+
+		@param center centro della sfera
+		@param radius raggio della sfera
+		@return true se la sfera è (potenzialmente) visibile
+	*/
+	bool sphere_visible(const glm::vec3 &center, float radius) const;
+
+	/**
+		Versione a blocchi di sphere_visible(): controlla molte sfere con 
+		le istruzioni SIMD (4 sfere per volta con SSE, 8 con AVX).
+
+		@param spheres sfere in coordinate mondo (xyz centro, w raggio)
+		@param count numero di sfere
+		@param visible array di count elementi che riceve 1 per le sfere 
+		       visibili e 0 per le altre
+		@return il numero di sfere visibili
+	*/
+	unsigned int cull_spheres(const glm::vec4 *spheres, unsigned int count, unsigned char *visible) const;
+
+	/**
+		Calcola il raggio in coordinate mondo che passa per un punto dello
+		schermo (es. per il picking degli oggetti con il mouse).
+
+		@param x coordinata x del punto in NDC (da -1 a sinistra a 1 a destra)
+		@param y coordinata y del punto in NDC (da -1 in basso a 1 in alto)
+		@param origin origine del raggio (sul near plane)
+		@param direction direzione normalizzata del raggio
+	*/
+	void ray(float x, float y, glm::vec3 &origin, glm::vec3 &direction) const;
+
 	/**
 		Ritorna l'intensità degli spostamenti
 		@return l'intensità degli spostamenti
@@ -142,6 +195,10 @@ private:
 
 	glm::mat4 _combined;
 
+	glm::vec4 _frustum[6]; ///<< piani del frustum in coordinate mondo
+
+	float _viewport_height; ///<< altezza della window in pixel
+
 	float _speed;
 	glm::vec3 _up;
 	glm::vec3 _position;
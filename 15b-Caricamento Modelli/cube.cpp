@@ -1,4 +1,7 @@
 #include "cube.h"
+#include "resourcecache.h"
+#include "gpumemory.h"
+#include "glstate.h"
 #include "glm/glm.hpp"
 
 #include <iostream>
@@ -25,7 +28,15 @@
   };
 
 
-Cube::Cube() : _initialized(false) {}
+Cube::Cube() : _VAO(0), _VBO(0), _initialized(false) {}
+
+Cube::~Cube() {
+  if (!_initialized) return;
+
+  GpuMemory::instance().release_buffer(_VBO);
+  GlState::instance().delete_buffer(_VBO);
+  GlState::instance().delete_vertex_array(_VAO);
+}
 
 
 void Cube::init(void) {
@@ -35,7 +46,8 @@ void Cube::init(void) {
     exit(0);
   }
 
-  _texture.load("test.png");
+  // Texture e programma sono condivisi da tutte le istanze di Cube
+  _texture = ResourceCache::instance().texture("test.png");
 
   Vertex Vertices[] = {
     Vertex(glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec2(1,0)),
@@ -82,12 +94,12 @@ void Cube::init(void) {
   };
   
   glGenVertexArrays(1, &(_VAO));
-  glBindVertexArray(_VAO);
+  GlState::instance().bind_vertex_array(_VAO);
  
-  GLuint VBO;
-  glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glGenBuffers(1, &_VBO);
+  GlState::instance().bind_buffer(GL_ARRAY_BUFFER, _VBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices), Vertices, GL_STATIC_DRAW);
+  GpuMemory::instance().track_buffer(_VBO, sizeof(Vertices), "cube", GpuMemory::VERTEX_BUFFER);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 
     reinterpret_cast<GLvoid*>(offsetof(struct Vertex, position)));
@@ -106,21 +118,23 @@ void Cube::render(void) {
   if (!_initialized)
     init();
 
+  GlState &state = GlState::instance();
+
   _shaders.enable();
 
-  glBindVertexArray(_VAO);
+  state.bind_vertex_array(_VAO);
 
   _shaders.set_sampler(0);
   
-  _texture.bind(0);
+  if (_texture) _texture->bind(0);
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glEnableVertexAttribArray(2);  
+  state.enable_vertex_attrib_array(0);
+  state.enable_vertex_attrib_array(1);
+  state.enable_vertex_attrib_array(2);  
 
   glDrawArrays(GL_TRIANGLES, 0, 36);
 
-  glBindVertexArray(0);
+  state.bind_vertex_array(0);
 }
 
 MyShaderClass &Cube::shaders() {
@@ -2,6 +2,7 @@
 #define CUBE_H
 
 #include <string>
+#include <memory>
 #include "GL/glew.h" // prima di freeglut
 #include "texture.h"
 #include "myshaderclass.h"
@@ -14,6 +15,11 @@ public:
   */
   Cube();
 
+  /**
+    Distruttore: rilascia gli oggetti OpenGL
+  */
+  ~Cube();
+
   /**
     Renderizza l'oggetto. Se necessario, l'oggetto viene prima inizializzato
     chiamando la init().
@@ -28,7 +34,8 @@ public:
 
 private:
   GLuint _VAO;       // Vertex Array Object
-  Texture _texture;  // Texture
+  GLuint _VBO;       // Vertex Buffer Object
+  std::shared_ptr<Texture> _texture; // Texture (condivisa, vedi ResourceCache)
   bool _initialized; // Oggetto usabile?
 
   MyShaderClass _shaders; // Shaders da usare con Cube
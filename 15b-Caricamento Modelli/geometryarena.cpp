@@ -0,0 +1,219 @@
+#include "geometryarena.h"
+#include "gpumemory.h"
+#include "glstate.h"
+
+#include <algorithm>
+
+namespace {
+	void allocate_buffer(GLenum target, size_t bytes) {
+		// Come in Mesh: con ARB_buffer_storage lo spazio è immutabile e
+		// può essere mappato in scrittura per l'upload
+		if (GLEW_ARB_buffer_storage) {
+			glBufferStorage(target, bytes, nullptr, GL_MAP_WRITE_BIT);
+		}
+		else {
+			glBufferData(target, bytes, nullptr, GL_STATIC_DRAW);
+		}
+	}
+}
+
+GeometryArena::Range::Range() : page(0), first_vertex(0), num_vertices(0), first_index(0), num_indices(0) {}
+
+GeometryArena::GeometryArena(unsigned int vertex_size, unsigned int index_size, const std::function<void()> &set_attributes,
+                             const std::string &name, size_t page_bytes) :
+	_vertex_size(vertex_size), _index_size(index_size), _set_attributes(set_attributes), _name(name),
+	_page_bytes(page_bytes) {}
+
+GeometryArena::~GeometryArena() {
+	GlState &state = GlState::instance();
+
+	for (unsigned int i = 0 ; i < _retired.size() ; i++) {
+		glDeleteSync(_retired[i].fence);
+	}
+
+	for (unsigned int p = 0 ; p < _pages.size() ; p++) {
+		GpuMemory::instance().release_buffer(_pages[p].vbo);
+		GpuMemory::instance().release_buffer(_pages[p].ibo);
+		state.delete_buffer(_pages[p].vbo);
+		state.delete_buffer(_pages[p].ibo);
+		state.delete_vertex_array(_pages[p].vao);
+	}
+}
+
+bool GeometryArena::take(FreeList &list, size_t count, size_t &offset) {
+	offset = 0;
+	if (count == 0) return true;
+
+	// First fit: le pagine sono poche e gli intervalli liberi restano pochi
+	// grazie all'unione di quelli adiacenti
+	for (FreeList::iterator it = list.begin() ; it != list.end() ; ++it) {
+		if (it->second < count) continue;
+
+		offset = it->first;
+		const size_t remaining = it->second - count;
+		list.erase(it);
+		if (remaining > 0) list[offset + count] = remaining;
+		return true;
+	}
+
+	return false;
+}
+
+void GeometryArena::give(FreeList &list, size_t offset, size_t count) {
+	if (count == 0) return;
+
+	FreeList::iterator it = list.insert(std::make_pair(offset, count)).first;
+
+	FreeList::iterator next = it;
+	++next;
+	if (next != list.end() && it->first + it->second == next->first) {
+		it->second += next->second;
+		list.erase(next);
+	}
+
+	if (it != list.begin()) {
+		FreeList::iterator previous = it;
+		--previous;
+		if (previous->first + previous->second == it->first) {
+			previous->second += it->second;
+			list.erase(it);
+		}
+	}
+}
+
+void GeometryArena::add_page(size_t num_vertices, size_t num_indices) {
+	GlState &state = GlState::instance();
+
+	Page page;
+	page.vertex_capacity = std::max(num_vertices, _page_bytes / _vertex_size);
+	page.index_capacity  = std::max(num_indices, _page_bytes / _index_size);
+	page.used_vertices = page.used_indices = 0;
+	page.allocations = 0;
+
+	glGenVertexArrays(1, &page.vao);
+	state.bind_vertex_array(page.vao);
+
+	glGenBuffers(1, &page.vbo);
+	state.bind_buffer(GL_ARRAY_BUFFER, page.vbo);
+	allocate_buffer(GL_ARRAY_BUFFER, page.vertex_capacity * _vertex_size);
+	_set_attributes();
+
+	glGenBuffers(1, &page.ibo);
+	state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, page.ibo);
+	allocate_buffer(GL_ELEMENT_ARRAY_BUFFER, page.index_capacity * _index_size);
+
+	state.bind_vertex_array(0);
+	state.bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	GpuMemory::instance().track_buffer(page.vbo, page.vertex_capacity * _vertex_size, _name, GpuMemory::VERTEX_BUFFER);
+	GpuMemory::instance().track_buffer(page.ibo, page.index_capacity * _index_size, _name, GpuMemory::INDEX_BUFFER);
+
+	page.free_vertices[0] = page.vertex_capacity;
+	page.free_indices[0]  = page.index_capacity;
+	_pages.push_back(page);
+}
+
+bool GeometryArena::allocate(unsigned int p, size_t num_vertices, size_t num_indices, Range &range) {
+	Page &page = _pages[p];
+
+	// Vertici e indici devono stare nella stessa pagina (stesso VAO)
+	if (!take(page.free_vertices, num_vertices, range.first_vertex)) return false;
+	if (!take(page.free_indices, num_indices, range.first_index)) {
+		give(page.free_vertices, range.first_vertex, num_vertices);
+		return false;
+	}
+
+	range.page = p;
+	range.num_vertices = num_vertices;
+	range.num_indices  = num_indices;
+
+	page.used_vertices += num_vertices;
+	page.used_indices  += num_indices;
+	page.allocations++;
+	return true;
+}
+
+void GeometryArena::collect() {
+	// Gli intervalli i cui fence sono segnalati tornano liberi. Il timeout
+	// è zero: non attendiamo mai la GPU, gli altri restano in coda
+	std::vector<Retired>::iterator out = _retired.begin();
+	for (std::vector<Retired>::iterator it = _retired.begin() ; it != _retired.end() ; ++it) {
+		const GLenum status = glClientWaitSync(it->fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			*out++ = *it;
+			continue;
+		}
+
+		glDeleteSync(it->fence);
+
+		Page &page = _pages[it->range.page];
+		give(page.free_vertices, it->range.first_vertex, it->range.num_vertices);
+		give(page.free_indices, it->range.first_index, it->range.num_indices);
+	}
+	_retired.erase(out, _retired.end());
+}
+
+bool GeometryArena::allocate(size_t num_vertices, size_t num_indices, Range &range) {
+	collect();
+
+	for (unsigned int p = 0 ; p < _pages.size() ; p++) {
+		if (allocate(p, num_vertices, num_indices, range)) return true;
+	}
+
+	// Nessuna pagina ha spazio: ne aggiungiamo una abbastanza grande
+	add_page(num_vertices, num_indices);
+	return allocate(_pages.size() - 1, num_vertices, num_indices, range);
+}
+
+void GeometryArena::free(const Range &range) {
+	if (range.page >= _pages.size()) return;
+
+	// L'intervallo è riutilizzabile solo quando la GPU ha eseguito le
+	// draw call che lo leggono, già inviate ma forse non completate
+	Retired retired;
+	retired.range = range;
+	retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_retired.push_back(retired);
+
+	Page &page = _pages[range.page];
+	page.used_vertices -= range.num_vertices;
+	page.used_indices  -= range.num_indices;
+	page.allocations--;
+}
+
+unsigned int GeometryArena::num_pages() const {
+	return _pages.size();
+}
+
+GLuint GeometryArena::vao(unsigned int page) const {
+	return _pages[page].vao;
+}
+
+GLuint GeometryArena::vbo(unsigned int page) const {
+	return _pages[page].vbo;
+}
+
+GLuint GeometryArena::ibo(unsigned int page) const {
+	return _pages[page].ibo;
+}
+
+unsigned int GeometryArena::vertex_size() const {
+	return _vertex_size;
+}
+
+unsigned int GeometryArena::index_size() const {
+	return _index_size;
+}
+
+void GeometryArena::print_stats(std::ostream &os) const {
+	os << _name << ": " << _pages.size() << " pages, " << _retired.size()
+	   << " ranges waiting for the GPU" << std::endl;
+	for (unsigned int p = 0 ; p < _pages.size() ; p++) {
+		const Page &page = _pages[p];
+		os << "  page " << p << ": " << page.allocations << " models, "
+		   << page.used_vertices * _vertex_size / 1024 << "/" << page.vertex_capacity * _vertex_size / 1024
+		   << " KB vertices, " << page.used_indices * _index_size / 1024 << "/"
+		   << page.index_capacity * _index_size / 1024 << " KB indices, "
+		   << page.free_vertices.size() + page.free_indices.size() << " free ranges" << std::endl;
+	}
+}
@@ -0,0 +1,169 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <ostream>
+#include "GL/glew.h" // prima di freeglut
+
+/**
+	Arena di buffer condivisi per la geometria di più modelli con lo stesso
+	formato dei vertici e degli indici.
+
+	Invece di avere un VAO, un VBO e un IBO per modello, i modelli ricevono
+	un intervallo di vertici e uno di indici all'interno di pochi buffer
+	grandi (pagine). Tutti i modelli di una pagina usano lo stesso VAO e
+	possono essere disegnati con una sola glMultiDrawElementsIndirect (vedi
+	IndirectBatch).
+
+	Ogni pagina ha una capacità fissa: quando nessuna pagina ha spazio
+	sufficiente ne viene creata una nuova (grande almeno quanto la
+	richiesta). Gli intervalli liberati sono riutilizzati dalle allocazioni
+	successive e uniti a quelli liberi adiacenti, ma solo dopo che la GPU
+	ha completato i comandi inviati prima del rilascio (glFenceSync):
+	altrimenti un nuovo upload potrebbe sovrascrivere dati ancora letti
+	da una draw call in corso.
+*/
+class GeometryArena {
+public:
+
+	/**
+		Intervallo assegnato a un modello
+	*/
+	struct Range {
+		unsigned int page;    ///< Pagina che contiene l'intervallo
+		size_t first_vertex;  ///< Primo vertice nel VBO della pagina
+		size_t num_vertices;  ///< Numero di vertici
+		size_t first_index;   ///< Primo indice nell'IBO della pagina
+		size_t num_indices;   ///< Numero di indici
+
+		Range();
+	};
+
+	/**
+		Costruttore. Le pagine sono create alla prima allocazione.
+
+		@param vertex_size dimensione in byte di un vertice
+		@param index_size dimensione in byte di un indice (2 o 4)
+		@param set_attributes funzione che imposta gli attributi dei vertici
+		       nel VAO di una pagina (chiamata con il VAO e il VBO bindati)
+		@param name nome usato per registrare i buffer in GpuMemory
+		@param page_bytes dimensione in byte del VBO (e dell'IBO) di una pagina
+	*/
+	GeometryArena(unsigned int vertex_size, unsigned int index_size, const std::function<void()> &set_attributes,
+	              const std::string &name, size_t page_bytes = 32 * 1024 * 1024);
+
+	~GeometryArena();
+
+	/**
+		Alloca un intervallo di vertici e uno di indici nella stessa pagina
+
+		@param num_vertices numero di vertici
+		@param num_indices numero di indici
+		@param range intervallo allocato
+		@return true se l'intervallo è stato allocato
+	*/
+	bool allocate(size_t num_vertices, size_t num_indices, Range &range);
+
+	/**
+		Rilascia un intervallo. La memoria non viene restituita a OpenGL ma
+		resta alla pagina per le allocazioni successive: l'intervallo torna
+		libero quando la GPU ha completato i comandi inviati fino ad ora.
+
+		@param range intervallo da rilasciare
+	*/
+	void free(const Range &range);
+
+	/**
+		Ritorna il numero di pagine
+	*/
+	unsigned int num_pages() const;
+
+	/**
+		Ritorna il VAO di una pagina (con VBO, IBO e attributi collegati)
+	*/
+	GLuint vao(unsigned int page) const;
+
+	/**
+		Ritorna il VBO di una pagina
+	*/
+	GLuint vbo(unsigned int page) const;
+
+	/**
+		Ritorna l'IBO di una pagina
+	*/
+	GLuint ibo(unsigned int page) const;
+
+	/**
+		Ritorna la dimensione in byte di un vertice
+	*/
+	unsigned int vertex_size() const;
+
+	/**
+		Ritorna la dimensione in byte di un indice
+	*/
+	unsigned int index_size() const;
+
+	/**
+		Scrive l'occupazione di ogni pagina
+
+		@param os stream di output
+	*/
+	void print_stats(std::ostream &os) const;
+
+private:
+
+	// Intervalli liberi: offset -> numero di elementi
+	typedef std::map<size_t, size_t> FreeList;
+
+	/**
+		Pagina dell'arena
+	*/
+	struct Page {
+		GLuint vao;
+		GLuint vbo;
+		GLuint ibo;
+		size_t vertex_capacity;   ///< Vertici allocati nel VBO
+		size_t index_capacity;    ///< Indici allocati nell'IBO
+		size_t used_vertices;     ///< Vertici assegnati ai modelli
+		size_t used_indices;      ///< Indici assegnati ai modelli
+		unsigned int allocations; ///< Intervalli assegnati ai modelli
+		FreeList free_vertices;
+		FreeList free_indices;
+	};
+
+	/**
+		Intervallo rilasciato che la GPU potrebbe ancora leggere
+	*/
+	struct Retired {
+		Range range;
+		GLsync fence; ///< Segnalato quando i comandi precedenti il rilascio sono completati
+	};
+
+	void add_page(size_t num_vertices, size_t num_indices);
+
+	void collect();
+
+	bool allocate(unsigned int page, size_t num_vertices, size_t num_indices, Range &range);
+
+	static bool take(FreeList &list, size_t count, size_t &offset);
+
+	static void give(FreeList &list, size_t offset, size_t count);
+
+	unsigned int _vertex_size;
+	unsigned int _index_size;
+	std::function<void()> _set_attributes;
+	std::string _name;
+	size_t _page_bytes;
+	std::vector<Page> _pages;
+	std::vector<Retired> _retired; ///<< Intervalli in attesa del loro fence
+
+	// Blocchiamo le operazioni di copia: non possiamo condividere i buffer
+	GeometryArena&operator=(const GeometryArena &other);
+	GeometryArena(const GeometryArena &other);
+};
+
+#endif
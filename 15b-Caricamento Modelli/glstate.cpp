@@ -0,0 +1,240 @@
+#include "glstate.h"
+
+namespace {
+	// Valore di un nome non ancora noto (OpenGL non lo assegna mai)
+	const GLuint UNKNOWN = ~GLuint(0);
+
+	const char *CALL_NAMES[GlState::NUM_CALLS] = {
+		"program", "vertex array", "vertex attrib", "texture", "buffer", "capability", "parameter"
+	};
+}
+
+GlState::Stats::Stats() {
+	for (unsigned int c = 0 ; c < NUM_CALLS ; c++) {
+		issued[c] = elided[c] = 0;
+	}
+}
+
+unsigned int GlState::Stats::total_issued() const {
+	unsigned int total = 0;
+	for (unsigned int c = 0 ; c < NUM_CALLS ; c++) total += issued[c];
+	return total;
+}
+
+unsigned int GlState::Stats::total_elided() const {
+	unsigned int total = 0;
+	for (unsigned int c = 0 ; c < NUM_CALLS ; c++) total += elided[c];
+	return total;
+}
+
+GlState::VertexArray::VertexArray() : enabled(0), known(0), element_buffer(UNKNOWN) {}
+
+GlState::GlState() {
+	invalidate();
+}
+
+GlState &GlState::instance() {
+	// Come GpuMemory, lo stato non viene mai distrutto: i modelli globali
+	// cancellano i loro buffer anche dopo la fine di main()
+	static GlState *state = new GlState();
+	return *state;
+}
+
+void GlState::invalidate() {
+	_program = UNKNOWN;
+	_vao = UNKNOWN;
+	_active_unit = UNKNOWN;
+	_vertex_arrays.clear();
+	_textures.clear();
+	_buffers.clear();
+	_indexed_buffers.clear();
+	_capabilities.clear();
+	_blend_known = false;
+	_restart_known = false;
+}
+
+bool GlState::elide(Call call, bool redundant) {
+	if (redundant) _stats.elided[call]++;
+	else _stats.issued[call]++;
+	return redundant;
+}
+
+void GlState::use_program(GLuint program) {
+	if (elide(PROGRAM, _program == program)) return;
+
+	glUseProgram(program);
+	_program = program;
+}
+
+void GlState::bind_vertex_array(GLuint vao) {
+	if (elide(VERTEX_ARRAY, _vao == vao)) return;
+
+	glBindVertexArray(vao);
+	_vao = vao;
+}
+
+void GlState::enable_vertex_attrib_array(GLuint index) {
+	const unsigned int bit = 1u << index;
+
+	// Senza un VAO noto non possiamo sapere dove finisce lo stato
+	if (_vao == UNKNOWN) {
+		_stats.issued[VERTEX_ATTRIB]++;
+		glEnableVertexAttribArray(index);
+		return;
+	}
+
+	VertexArray &va = _vertex_arrays[_vao];
+	if (elide(VERTEX_ATTRIB, (va.known & bit) && (va.enabled & bit))) return;
+
+	glEnableVertexAttribArray(index);
+	va.known |= bit;
+	va.enabled |= bit;
+}
+
+void GlState::disable_vertex_attrib_array(GLuint index) {
+	const unsigned int bit = 1u << index;
+
+	if (_vao == UNKNOWN) {
+		_stats.issued[VERTEX_ATTRIB]++;
+		glDisableVertexAttribArray(index);
+		return;
+	}
+
+	VertexArray &va = _vertex_arrays[_vao];
+	if (elide(VERTEX_ATTRIB, (va.known & bit) && !(va.enabled & bit))) return;
+
+	glDisableVertexAttribArray(index);
+	va.known |= bit;
+	va.enabled &= ~bit;
+}
+
+void GlState::bind_texture(unsigned int unit, GLenum target, GLuint texture) {
+	GLuint &bound = _textures.insert(std::make_pair(std::make_pair(unit, target), UNKNOWN)).first->second;
+
+	// La texture è già collegata: non serve nemmeno attivare la TextureUnit
+	if (bound == texture) {
+		_stats.elided[TEXTURE] += 2;
+		return;
+	}
+
+	_stats.issued[TEXTURE]++;
+
+	if (!elide(TEXTURE, _active_unit == unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		_active_unit = unit;
+	}
+
+	glBindTexture(target, texture);
+	bound = texture;
+}
+
+void GlState::bind_buffer(GLenum target, GLuint buffer) {
+	// L'IBO fa parte dello stato del VAO corrente
+	GLuint *bound = nullptr;
+	if (target == GL_ELEMENT_ARRAY_BUFFER) {
+		if (_vao != UNKNOWN) bound = &_vertex_arrays[_vao].element_buffer;
+	}
+	else {
+		bound = &_buffers.insert(std::make_pair(target, UNKNOWN)).first->second;
+	}
+
+	if (elide(BUFFER, bound != nullptr && *bound == buffer)) return;
+
+	glBindBuffer(target, buffer);
+	if (bound != nullptr) *bound = buffer;
+}
+
+void GlState::bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+	GLuint &bound = _indexed_buffers.insert(std::make_pair(std::make_pair(target, index), UNKNOWN)).first->second;
+	if (elide(BUFFER, bound == buffer)) return;
+
+	glBindBufferBase(target, index, buffer);
+	bound = buffer;
+	_buffers[target] = buffer;
+}
+
+void GlState::enable(GLenum capability) {
+	std::map<GLenum, bool>::iterator it = _capabilities.find(capability);
+	if (elide(CAPABILITY, it != _capabilities.end() && it->second)) return;
+
+	glEnable(capability);
+	_capabilities[capability] = true;
+}
+
+void GlState::disable(GLenum capability) {
+	std::map<GLenum, bool>::iterator it = _capabilities.find(capability);
+	if (elide(CAPABILITY, it != _capabilities.end() && !it->second)) return;
+
+	glDisable(capability);
+	_capabilities[capability] = false;
+}
+
+void GlState::blend_func(GLenum source, GLenum destination) {
+	if (elide(PARAMETER, _blend_known && _blend_source == source && _blend_destination == destination)) return;
+
+	glBlendFunc(source, destination);
+	_blend_known = true;
+	_blend_source = source;
+	_blend_destination = destination;
+}
+
+void GlState::primitive_restart_index(GLuint index) {
+	if (elide(PARAMETER, _restart_known && _restart_index == index)) return;
+
+	glPrimitiveRestartIndex(index);
+	_restart_known = true;
+	_restart_index = index;
+}
+
+void GlState::delete_program(GLuint program) {
+	// Un programma in uso è cancellato solo quando non è più usato: non
+	// sappiamo quale nome verrà assegnato
+	if (_program == program) _program = UNKNOWN;
+	glDeleteProgram(program);
+}
+
+void GlState::delete_vertex_array(GLuint vao) {
+	// OpenGL collega il VAO 0 se cancelliamo quello corrente
+	if (_vao == vao) _vao = 0;
+	_vertex_arrays.erase(vao);
+	glDeleteVertexArrays(1, &vao);
+}
+
+void GlState::delete_texture(GLuint texture) {
+	// Le texture cancellate sono scollegate solo dalle TextureUnit del
+	// contesto corrente
+	for (std::map<std::pair<unsigned int, GLenum>, GLuint>::iterator it = _textures.begin() ; it != _textures.end() ; ++it) {
+		if (it->second == texture) it->second = 0;
+	}
+	glDeleteTextures(1, &texture);
+}
+
+void GlState::delete_buffer(GLuint buffer) {
+	// Un IBO resta collegato ai VAO non correnti: il suo nome non è più
+	// affidabile
+	for (std::map<GLenum, GLuint>::iterator it = _buffers.begin() ; it != _buffers.end() ; ++it) {
+		if (it->second == buffer) it->second = 0;
+	}
+	for (std::map<std::pair<GLenum, GLuint>, GLuint>::iterator it = _indexed_buffers.begin() ; it != _indexed_buffers.end() ; ++it) {
+		if (it->second == buffer) it->second = 0;
+	}
+	for (std::map<GLuint, VertexArray>::iterator it = _vertex_arrays.begin() ; it != _vertex_arrays.end() ; ++it) {
+		if (it->second.element_buffer == buffer) it->second.element_buffer = UNKNOWN;
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+const GlState::Stats &GlState::stats() const {
+	return _stats;
+}
+
+void GlState::reset_stats() {
+	_stats = Stats();
+}
+
+void GlState::print_stats(std::ostream &os, const Stats &stats) {
+	os << "GL state calls: " << stats.total_issued() << " issued, " << stats.total_elided() << " elided" << std::endl;
+	for (unsigned int c = 0 ; c < NUM_CALLS ; c++) {
+		os << "  " << CALL_NAMES[c] << ": " << stats.issued[c] << " issued, " << stats.elided[c] << " elided" << std::endl;
+	}
+}
@@ -0,0 +1,183 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <map>
+#include <utility>
+#include <ostream>
+#include "GL/glew.h" // prima di freeglut
+
+/**
+	Copia dello stato di OpenGL usata per evitare le chiamate ridondanti.
+
+	Le classi che disegnano (Mesh, Cube, Texture, ShaderClass, ...) non
+	chiamano direttamente glUseProgram, glBindVertexArray, glBindTexture,
+	glBindBuffer, glEnable, ecc. ma i metodi di questa classe, che
+	chiamano OpenGL solo se il valore richiesto è diverso da quello
+	corrente. Ad esempio, disegnando più volte lo stesso modello la
+	texture e gli attributi dei vertici non vengono ricollegati.
+
+	Lo stato è inizialmente sconosciuto: la prima richiesta di ogni valore
+	è sempre inviata a OpenGL. Gli attributi abilitati e l'IBO fanno parte
+	dello stato del VAO e sono memorizzati per ogni VAO. Gli oggetti vanno
+	cancellati con i metodi delete_* perché i loro nomi possono essere
+	riassegnati da OpenGL.
+
+	Per ogni tipo di chiamata sono contate le chiamate inviate a OpenGL e
+	quelle evitate.
+
+	Lo stato va usato solo dal thread che possiede il contesto OpenGL.
+*/
+class GlState {
+public:
+
+	/**
+		Tipi di chiamata contati nelle statistiche
+	*/
+	enum Call {
+		PROGRAM,       ///< glUseProgram
+		VERTEX_ARRAY,  ///< glBindVertexArray
+		VERTEX_ATTRIB, ///< glEnableVertexAttribArray, glDisableVertexAttribArray
+		TEXTURE,       ///< glActiveTexture, glBindTexture
+		BUFFER,        ///< glBindBuffer, glBindBufferBase
+		CAPABILITY,    ///< glEnable, glDisable
+		PARAMETER,     ///< glBlendFunc, glPrimitiveRestartIndex
+		NUM_CALLS
+	};
+
+	/**
+		Chiamate inviate ed evitate per ogni tipo
+	*/
+	struct Stats {
+		unsigned int issued[NUM_CALLS]; ///< Chiamate inviate a OpenGL
+		unsigned int elided[NUM_CALLS]; ///< Chiamate ridondanti evitate
+
+		Stats();
+
+		unsigned int total_issued() const;
+
+		unsigned int total_elided() const;
+	};
+
+	/**
+		Ritorna lo stato del contesto OpenGL
+	*/
+	static GlState &instance();
+
+	void use_program(GLuint program);
+
+	void bind_vertex_array(GLuint vao);
+
+	/**
+		Abilita un attributo nel VAO corrente
+	*/
+	void enable_vertex_attrib_array(GLuint index);
+
+	/**
+		Disabilita un attributo nel VAO corrente
+	*/
+	void disable_vertex_attrib_array(GLuint index);
+
+	/**
+		Collega una texture a una TextureUnit (attivandola se necessario)
+
+		@param unit TextureUnit (0 per GL_TEXTURE0)
+		@param target tipo di texture (es. GL_TEXTURE_2D)
+		@param texture nome della texture
+	*/
+	void bind_texture(unsigned int unit, GLenum target, GLuint texture);
+
+	/**
+		Collega un buffer. Il GL_ELEMENT_ARRAY_BUFFER è memorizzato nel VAO
+		corrente.
+	*/
+	void bind_buffer(GLenum target, GLuint buffer);
+
+	/**
+		Collega un buffer a un punto di binding indicizzato (es. di
+		GL_UNIFORM_BUFFER). Come in OpenGL, il buffer diventa anche quello
+		collegato al target.
+	*/
+	void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+
+	void enable(GLenum capability);
+
+	void disable(GLenum capability);
+
+	void blend_func(GLenum source, GLenum destination);
+
+	void primitive_restart_index(GLuint index);
+
+	/**
+		Cancellano un oggetto OpenGL e lo rimuovono dallo stato
+	*/
+	void delete_program(GLuint program);
+
+	void delete_vertex_array(GLuint vao);
+
+	void delete_texture(GLuint texture);
+
+	void delete_buffer(GLuint buffer);
+
+	/**
+		Dimentica tutto lo stato: le richieste successive sono inviate a
+		OpenGL. Va chiamato se lo stato è stato modificato senza passare da
+		questa classe.
+	*/
+	void invalidate();
+
+	/**
+		Ritorna le chiamate contate dall'ultima reset_stats()
+	*/
+	const Stats &stats() const;
+
+	void reset_stats();
+
+	/**
+		Scrive le statistiche di uno Stats
+
+		@param os stream di output
+		@param stats statistiche da scrivere
+	*/
+	static void print_stats(std::ostream &os, const Stats &stats);
+
+private:
+
+	/**
+		Stato di un VAO
+	*/
+	struct VertexArray {
+		unsigned int enabled;  ///< Maschera degli attributi abilitati
+		unsigned int known;    ///< Maschera degli attributi con stato noto
+		GLuint element_buffer; ///< IBO collegato
+
+		VertexArray();
+	};
+
+	GlState();
+
+	bool elide(Call call, bool redundant);
+
+	GLuint _program;
+	GLuint _vao;
+	GLuint _active_unit;
+	std::map<GLuint, VertexArray> _vertex_arrays;
+	std::map<std::pair<unsigned int, GLenum>, GLuint> _textures;
+	std::map<GLenum, GLuint> _buffers;
+	std::map<std::pair<GLenum, GLuint>, GLuint> _indexed_buffers;
+	std::map<GLenum, bool> _capabilities;
+
+	bool _blend_known;
+	GLenum _blend_source;
+	GLenum _blend_destination;
+
+	bool _restart_known;
+	GLuint _restart_index;
+
+	Stats _stats;
+
+	// Blocchiamo le operazioni di copia: lo stato è unico
+	GlState&operator=(const GlState &other);
+	GlState(const GlState &other);
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "gpumemory.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+namespace {
+	const char *usage_names[GpuMemory::NUM_USAGES] = {
+		"Vertex buffers", "Index buffers", "Uniform buffers", "Light buffers", "Draw commands", "Textures"
+	};
+
+	// Occupazione di una risorsa per tipo di utilizzo
+	struct AssetFootprint {
+		std::string owner;
+		size_t bytes[GpuMemory::NUM_USAGES];
+		size_t total;
+	};
+
+	std::string megabytes(size_t bytes) {
+		std::ostringstream os;
+		os << std::fixed << std::setprecision(2) << bytes / (1024.0 * 1024.0);
+		return os.str();
+	}
+}
+
+GpuMemory::GpuMemory() : _total(0), _peak(0) {
+	std::fill(_totals, _totals + NUM_USAGES, 0);
+}
+
+GpuMemory &GpuMemory::instance() {
+	// Il registro non viene mai distrutto: i modelli globali e le arene di
+	// geometria rilasciano i loro buffer anche dopo la fine di main()
+	static GpuMemory *registry = new GpuMemory();
+	return *registry;
+}
+
+void GpuMemory::track(bool texture, GLuint id, size_t bytes, const std::string &owner, Usage usage) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Allocation &a = _allocations[std::make_pair(texture, id)];
+	if (a.bytes > 0) {
+		// Riallocazione dello stesso oggetto: sostituisce la precedente
+		_totals[a.usage] -= a.bytes;
+		_total -= a.bytes;
+	}
+
+	a.bytes = bytes;
+	a.owner = owner.empty() ? "(unnamed)" : owner;
+	a.usage = usage;
+
+	_totals[usage] += bytes;
+	_total += bytes;
+	_peak = std::max(_peak, _total);
+}
+
+void GpuMemory::release(bool texture, GLuint id) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Allocations::iterator it = _allocations.find(std::make_pair(texture, id));
+	if (it == _allocations.end()) return;
+
+	_totals[it->second.usage] -= it->second.bytes;
+	_total -= it->second.bytes;
+	_allocations.erase(it);
+}
+
+void GpuMemory::track_buffer(GLuint buffer, size_t bytes, const std::string &owner, Usage usage) {
+	track(false, buffer, bytes, owner, usage);
+}
+
+void GpuMemory::track_texture(GLuint texture, size_t bytes, const std::string &owner) {
+	track(true, texture, bytes, owner, TEXTURE);
+}
+
+void GpuMemory::release_buffer(GLuint buffer) {
+	release(false, buffer);
+}
+
+void GpuMemory::release_texture(GLuint texture) {
+	release(true, texture);
+}
+
+size_t GpuMemory::total() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _total;
+}
+
+size_t GpuMemory::total(Usage usage) const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _totals[usage];
+}
+
+size_t GpuMemory::peak() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _peak;
+}
+
+void GpuMemory::report(std::ostream &os) const {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Raggruppiamo le allocazioni per risorsa
+	std::map<std::string, AssetFootprint> assets;
+	for (Allocations::const_iterator it = _allocations.begin() ; it != _allocations.end() ; ++it) {
+		AssetFootprint &asset = assets[it->second.owner];
+		if (asset.owner.empty()) {
+			asset.owner = it->second.owner;
+			std::fill(asset.bytes, asset.bytes + NUM_USAGES, 0);
+			asset.total = 0;
+		}
+		asset.bytes[it->second.usage] += it->second.bytes;
+		asset.total += it->second.bytes;
+	}
+
+	std::vector<AssetFootprint> sorted;
+	for (std::map<std::string, AssetFootprint>::const_iterator it = assets.begin() ; it != assets.end() ; ++it) {
+		sorted.push_back(it->second);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const AssetFootprint &a, const AssetFootprint &b) {
+		return a.total > b.total;
+	});
+
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+
+	os << "GPU memory: " << megabytes(_total) << " MB in " << _allocations.size()
+	   << " allocations (peak " << megabytes(_peak) << " MB)" << std::endl;
+	for (unsigned int u = 0 ; u < NUM_USAGES ; u++) {
+		os << "  " << std::left << std::setw(16) << usage_names[u] << std::right
+		   << std::setw(10) << megabytes(_totals[u]) << " MB" << std::endl;
+	}
+	os << std::endl;
+
+	os << std::left << std::setw(48) << "Asset" << std::right;
+	for (unsigned int u = 0 ; u < NUM_USAGES ; u++) {
+		os << std::setw(16) << usage_names[u];
+	}
+	os << std::setw(12) << "Total MB" << std::setw(8) << "%" << std::endl;
+
+	for (unsigned int i = 0 ; i < sorted.size() ; i++) {
+		const AssetFootprint &asset = sorted[i];
+		const double percent = _total ? 100.0 * asset.total / _total : 0.0;
+
+		os << std::left << std::setw(48) << asset.owner << std::right;
+		for (unsigned int u = 0 ; u < NUM_USAGES ; u++) {
+			os << std::setw(16) << megabytes(asset.bytes[u]);
+		}
+		os << std::setw(12) << megabytes(asset.total)
+		   << std::setw(8) << std::fixed << std::setprecision(1) << percent << std::endl;
+	}
+
+	os.flags(flags);
+	os.precision(precision);
+}
+
+bool GpuMemory::dump(const std::string &FileName) const {
+	std::ofstream file(FileName.c_str());
+	if (!file) return false;
+
+	report(file);
+	return bool(file);
+}
@@ -0,0 +1,145 @@
+#ifndef GPUMEMORY_H
+#define GPUMEMORY_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include "GL/glew.h" // prima di freeglut
+
+/**
+	Registro delle allocazioni di memoria sulla GPU (buffer e texture).
+
+	Le classi che creano buffer o texture registrano ogni allocazione con
+	la sua dimensione in byte, il nome della risorsa che la possiede (es. il
+	file del modello o della texture) e il tipo di utilizzo, e la rimuovono
+	quando l'oggetto OpenGL viene distrutto. Il registro permette di
+	conoscere l'occupazione totale e per risorsa, ad esempio per verificare
+	il risparmio dovuto alla quantizzazione dei vertici.
+
+	Le dimensioni sono quelle richieste a OpenGL: il driver può allocare
+	qualcosa in più (allineamenti, mipmap, copie interne).
+*/
+class GpuMemory {
+public:
+
+	/**
+		Tipo di utilizzo della memoria
+	*/
+	enum Usage {
+		VERTEX_BUFFER,  ///< Vertici (VBO)
+		INDEX_BUFFER,   ///< Indici (IBO)
+		UNIFORM_BUFFER, ///< Uniform block (UBO)
+		LIGHT_BUFFER,   ///< Luci e cluster (buffer texture, vedi LightClusters)
+		INDIRECT_BUFFER, ///< Comandi delle draw call indirect (vedi IndirectBatch)
+		TEXTURE,        ///< Texture
+		NUM_USAGES
+	};
+
+	/**
+		Ritorna il registro dell'applicazione
+	*/
+	static GpuMemory &instance();
+
+	/**
+		Registra (o aggiorna) l'allocazione della memoria di un buffer
+
+		@param buffer handle OpenGL del buffer
+		@param bytes dimensione in byte
+		@param owner nome della risorsa che possiede il buffer
+		@param usage tipo di utilizzo
+	*/
+	void track_buffer(GLuint buffer, size_t bytes, const std::string &owner, Usage usage);
+
+	/**
+		Registra (o aggiorna) l'allocazione della memoria di una texture
+
+		@param texture handle OpenGL della texture
+		@param bytes dimensione in byte
+		@param owner nome della risorsa che possiede la texture
+	*/
+	void track_texture(GLuint texture, size_t bytes, const std::string &owner);
+
+	/**
+		Rimuove l'allocazione di un buffer (da chiamare prima di distruggerlo).
+		I buffer non registrati sono ignorati.
+
+		@param buffer handle OpenGL del buffer
+	*/
+	void release_buffer(GLuint buffer);
+
+	/**
+		Rimuove l'allocazione di una texture (da chiamare prima di
+		distruggerla). Le texture non registrate sono ignorate.
+
+		@param texture handle OpenGL della texture
+	*/
+	void release_texture(GLuint texture);
+
+	/**
+		Ritorna il numero di byte allocati
+	*/
+	size_t total() const;
+
+	/**
+		Ritorna il numero di byte allocati per un tipo di utilizzo
+
+		@param usage tipo di utilizzo
+	*/
+	size_t total(Usage usage) const;
+
+	/**
+		Ritorna il massimo numero di byte allocati contemporaneamente
+	*/
+	size_t peak() const;
+
+	/**
+		Scrive il totale, il totale per tipo di utilizzo e una tabella con
+		l'occupazione di ogni risorsa, ordinata dalla più grande
+
+		@param os stream di output
+	*/
+	void report(std::ostream &os) const;
+
+	/**
+		Scrive il report in un file di testo
+
+		@param FileName nome del file
+		@return true se il file è stato scritto correttamente
+	*/
+	bool dump(const std::string &FileName) const;
+
+private:
+	GpuMemory();
+
+	/**
+		Singola allocazione registrata
+	*/
+	struct Allocation {
+		size_t bytes;      ///< Dimensione in byte
+		std::string owner; ///< Risorsa che la possiede
+		Usage usage;       ///< Tipo di utilizzo
+
+		Allocation() : bytes(0), usage(VERTEX_BUFFER) {}
+	};
+
+	// Buffer e texture hanno spazi di nomi distinti: la chiave comprende
+	// un flag che indica se l'handle è di una texture
+	typedef std::map<std::pair<bool, GLuint>, Allocation> Allocations;
+
+	void track(bool texture, GLuint id, size_t bytes, const std::string &owner, Usage usage);
+
+	void release(bool texture, GLuint id);
+
+	mutable std::mutex _mutex;   ///<< Protegge il registro
+	Allocations _allocations;    ///<< Allocazioni registrate
+	size_t _totals[NUM_USAGES];  ///<< Byte allocati per tipo di utilizzo
+	size_t _total;               ///<< Byte allocati
+	size_t _peak;                ///<< Massimo di _total
+
+	// Blocchiamo le operazioni di copia
+	GpuMemory&operator=(const GpuMemory &other);
+	GpuMemory(const GpuMemory &other);
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "indirectbatch.h"
+#include "texture.h"
+#include "gpumemory.h"
+#include "glstate.h"
+
+#include <algorithm>
+#include <functional>
+#include <cstddef>
+
+namespace {
+	// Attributi per oggetto: 4 colonne della matrice, colore, scala e
+	// offset delle posizioni
+	const GLuint NUM_ATTRIBUTES = 7;
+}
+
+IndirectBatch::IndirectBatch(const std::string &name) : _object_buffer(0), _command_buffer(0),
+	_object_capacity(0), _command_capacity(0), _name(name) {}
+
+IndirectBatch::~IndirectBatch() {
+	if (_object_buffer != 0) {
+		GpuMemory::instance().release_buffer(_object_buffer);
+		GlState::instance().delete_buffer(_object_buffer);
+	}
+	if (_command_buffer != 0) {
+		GpuMemory::instance().release_buffer(_command_buffer);
+		GlState::instance().delete_buffer(_command_buffer);
+	}
+}
+
+bool IndirectBatch::multi_draw_supported() {
+	// Il campo base_instance dei comandi è usato solo con ARB_base_instance
+	return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+void IndirectBatch::clear() {
+	_objects.clear();
+	_draws.clear();
+}
+
+unsigned int IndirectBatch::add_object(const glm::mat4 &model, const glm::vec4 &tint,
+                                       const glm::vec3 &position_scale, const glm::vec3 &position_bias) {
+	ObjectData object;
+	object.model = model;
+	object.tint = tint;
+	object.position_scale = glm::vec4(position_scale, 0.0f);
+	object.position_bias  = glm::vec4(position_bias, 0.0f);
+
+	_objects.push_back(object);
+	return _objects.size() - 1;
+}
+
+void IndirectBatch::add_draw(GLuint vao, GLenum primitive, GLenum index_type, const Texture *texture, bool blend,
+                             GLuint count, GLuint first_index, GLint base_vertex, unsigned int object) {
+	Draw draw;
+	draw.command.count = count;
+	draw.command.instance_count = 1;
+	draw.command.first_index = first_index;
+	draw.command.base_vertex = base_vertex;
+	draw.command.base_instance = object;
+	draw.vao = vao;
+	draw.primitive = primitive;
+	draw.index_type = index_type;
+	draw.texture = texture;
+	draw.blend = blend;
+
+	_draws.push_back(draw);
+}
+
+unsigned int IndirectBatch::num_objects() const {
+	return _objects.size();
+}
+
+unsigned int IndirectBatch::num_draws() const {
+	return _draws.size();
+}
+
+void IndirectBatch::upload(GLenum target, GLuint &buffer, size_t &capacity, const void *data, size_t bytes,
+                           const std::string &owner) {
+	if (buffer == 0) glGenBuffers(1, &buffer);
+
+	GlState::instance().bind_buffer(target, buffer);
+
+	// Il buffer è riallocato ad ogni frame (orphaning): il driver non deve
+	// attendere che la GPU finisca di usare i dati del frame precedente
+	const bool grow = bytes > capacity;
+	if (grow) capacity = std::max(bytes, 2 * capacity);
+	glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(target, 0, bytes, data);
+
+	GlState::instance().bind_buffer(target, 0);
+
+	// I comandi non sono dati dei vertici: hanno la loro voce nel report
+	const GpuMemory::Usage usage = (target == GL_DRAW_INDIRECT_BUFFER) ? GpuMemory::INDIRECT_BUFFER
+	                                                                   : GpuMemory::VERTEX_BUFFER;
+	if (grow) GpuMemory::instance().track_buffer(buffer, capacity, owner, usage);
+}
+
+void IndirectBatch::bind_objects(GLuint first_object) const {
+	GlState &state = GlState::instance();
+
+	state.bind_buffer(GL_ARRAY_BUFFER, _object_buffer);
+
+	const size_t base = size_t(first_object) * sizeof(ObjectData);
+
+	for (GLuint c = 0 ; c < 4 ; c++) {
+		glVertexAttribPointer(FIRST_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData),
+		                      (void*)(base + offsetof(ObjectData, model) + c * sizeof(glm::vec4)));
+	}
+	glVertexAttribPointer(FIRST_ATTRIBUTE + 4, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData),
+	                      (void*)(base + offsetof(ObjectData, tint)));
+	glVertexAttribPointer(FIRST_ATTRIBUTE + 5, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData),
+	                      (void*)(base + offsetof(ObjectData, position_scale)));
+	glVertexAttribPointer(FIRST_ATTRIBUTE + 6, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData),
+	                      (void*)(base + offsetof(ObjectData, position_bias)));
+
+	for (GLuint a = FIRST_ATTRIBUTE ; a < FIRST_ATTRIBUTE + NUM_ATTRIBUTES ; a++) {
+		state.enable_vertex_attrib_array(a);
+		glVertexAttribDivisor(a, 1);
+	}
+
+	state.bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+void IndirectBatch::unbind_objects() const {
+	// Il VAO è condiviso con le draw call non indirect dei modelli
+	for (GLuint a = FIRST_ATTRIBUTE ; a < FIRST_ATTRIBUTE + NUM_ATTRIBUTES ; a++) {
+		glVertexAttribDivisor(a, 0);
+		GlState::instance().disable_vertex_attrib_array(a);
+	}
+}
+
+unsigned int IndirectBatch::flush(unsigned int TextureUnit) {
+	GlState &state = GlState::instance();
+
+	if (_draws.empty()) return 0;
+
+	const bool multi_draw = multi_draw_supported();
+
+	// Le draw call con lo stesso stato diventano consecutive; quelle con
+	// il blending vanno dopo le opache
+	auto same_state = [](const Draw &a, const Draw &b) {
+		return a.blend == b.blend && a.vao == b.vao && a.primitive == b.primitive &&
+		       a.index_type == b.index_type && a.texture == b.texture;
+	};
+
+	std::stable_sort(_draws.begin(), _draws.end(), [](const Draw &a, const Draw &b) {
+		if (a.blend != b.blend) return b.blend;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		if (a.primitive != b.primitive) return a.primitive < b.primitive;
+		if (a.index_type != b.index_type) return a.index_type < b.index_type;
+		return std::less<const Texture*>()(a.texture, b.texture);
+	});
+
+	upload(GL_ARRAY_BUFFER, _object_buffer, _object_capacity, _objects.data(),
+	       _objects.size() * sizeof(ObjectData), _name);
+
+	if (multi_draw) {
+		_commands.resize(_draws.size());
+		for (size_t i = 0 ; i < _draws.size() ; i++) {
+			_commands[i] = _draws[i].command;
+		}
+
+		upload(GL_DRAW_INDIRECT_BUFFER, _command_buffer, _command_capacity, _commands.data(),
+		       _commands.size() * sizeof(Command), _name);
+		state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, _command_buffer);
+	}
+
+	unsigned int calls = 0;
+	GLuint vao = 0;
+	const Texture *texture = nullptr;
+	bool blend = false;
+	bool restart = false;
+
+	for (size_t begin = 0, end = 0 ; begin < _draws.size() ; begin = end) {
+		const Draw &first = _draws[begin];
+		for (end = begin + 1 ; end < _draws.size() && same_state(_draws[end], first) ; end++);
+
+		if (first.vao != vao) {
+			if (vao != 0) unbind_objects();
+
+			vao = first.vao;
+			state.bind_vertex_array(vao);
+
+			state.enable_vertex_attrib_array(0);
+			state.enable_vertex_attrib_array(1);
+			state.enable_vertex_attrib_array(2);
+
+			// Con i comandi indirect ogni draw call legge il suo oggetto
+			// tramite il base instance
+			if (multi_draw) bind_objects(0);
+		}
+
+		if (first.texture != texture) {
+			texture = first.texture;
+			if (texture != nullptr) texture->bind(TextureUnit);
+		}
+
+		if (first.blend && !blend) {
+			state.enable(GL_BLEND);
+			state.enable(GL_ALPHA_TEST);
+			state.blend_func(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+			blend = true;
+		}
+
+		// Le strip sono separate dall'indice massimo rappresentabile
+		if (first.primitive == GL_TRIANGLE_STRIP) {
+			state.enable(GL_PRIMITIVE_RESTART);
+			state.primitive_restart_index(first.index_type == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+			restart = true;
+		}
+		else if (restart) {
+			state.disable(GL_PRIMITIVE_RESTART);
+			restart = false;
+		}
+
+		if (multi_draw) {
+			glMultiDrawElementsIndirect(first.primitive, first.index_type, (void*)(begin * sizeof(Command)),
+			                            end - begin, 0);
+			calls++;
+		}
+		else {
+			const size_t index_size = (first.index_type == GL_UNSIGNED_SHORT) ? sizeof(unsigned short) : sizeof(unsigned int);
+
+			for (size_t i = begin ; i < end ; i++) {
+				const Command &command = _draws[i].command;
+				bind_objects(command.base_instance);
+				glDrawElementsInstancedBaseVertex(first.primitive, command.count, first.index_type,
+				                                  (void*)(index_size * command.first_index), 1, command.base_vertex);
+				calls++;
+			}
+		}
+	}
+
+	if (vao != 0) unbind_objects();
+	state.bind_vertex_array(0);
+
+	if (blend) {
+		state.disable(GL_BLEND);
+		state.disable(GL_ALPHA_TEST);
+	}
+	if (restart) state.disable(GL_PRIMITIVE_RESTART);
+	if (multi_draw) state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	return calls;
+}
@@ -0,0 +1,163 @@
+#ifndef INDIRECTBATCH_H
+#define INDIRECTBATCH_H
+
+#include <string>
+#include <vector>
+#include "GL/glew.h" // prima di freeglut
+#include "glm/glm.hpp"
+
+class Texture;
+
+/**
+	Lista delle draw call di un frame, inviate a OpenGL con
+	glMultiDrawElementsIndirect.
+
+	I modelli caricati nelle arene di geometria (vedi GeometryArena e
+	Mesh::GEOMETRY_ARENA) condividono VAO, VBO e IBO: le loro sotto-mesh
+	sono accodate con Mesh::submit() come comandi DrawElementsIndirect e
+	flush() le disegna con una chiamata per ogni combinazione di VAO,
+	primitiva e texture, invece di una o più chiamate per modello.
+
+	I dati di ogni oggetto (matrice, colore e parametri di
+	dequantizzazione delle posizioni) sono in un vertex buffer letto come
+	attributo per istanza (locations da 3 a 9, vedi 14_indirect.vert): ogni
+	comando disegna una sola istanza e il suo base instance è l'indice
+	dell'oggetto.
+
+	Senza ARB_multi_draw_indirect (OpenGL 4.3) i comandi sono eseguiti uno
+	per volta, spostando l'inizio degli attributi per oggetto.
+*/
+class IndirectBatch {
+public:
+
+	/**
+		Dati di un oggetto, nel formato letto dal vertex shader
+	*/
+	struct ObjectData {
+		glm::mat4 model;          ///< Matrice di trasformazione del modello
+		glm::vec4 tint;           ///< Colore che moltiplica quello del materiale
+		glm::vec4 position_scale; ///< Scala di dequantizzazione delle posizioni (w inutilizzato)
+		glm::vec4 position_bias;  ///< Offset di dequantizzazione delle posizioni (w inutilizzato)
+	};
+
+	/**
+		Location del primo attributo per oggetto nel vertex shader
+	*/
+	static const GLuint FIRST_ATTRIBUTE = 3;
+
+	/**
+		Costruttore
+
+		@param name nome usato per registrare i buffer in GpuMemory
+	*/
+	explicit IndirectBatch(const std::string &name = "indirect batch");
+
+	~IndirectBatch();
+
+	/**
+		Svuota la lista (da chiamare all'inizio di ogni frame)
+	*/
+	void clear();
+
+	/**
+		Aggiunge un oggetto, a cui fanno riferimento le draw call aggiunte
+		con add_draw()
+
+		@param model matrice di trasformazione del modello
+		@param tint colore che moltiplica quello del materiale
+		@param position_scale scala di dequantizzazione delle posizioni
+		@param position_bias offset di dequantizzazione delle posizioni
+		@return l'indice dell'oggetto
+	*/
+	unsigned int add_object(const glm::mat4 &model, const glm::vec4 &tint,
+	                        const glm::vec3 &position_scale, const glm::vec3 &position_bias);
+
+	/**
+		Aggiunge una draw call indicizzata
+
+		@param vao VAO con i buffer della geometria
+		@param primitive tipo di primitiva (GL_TRIANGLES o GL_TRIANGLE_STRIP)
+		@param index_type tipo degli indici (GL_UNSIGNED_SHORT o GL_UNSIGNED_INT)
+		@param texture texture del materiale
+		@param blend true se la draw call va disegnata con il blending (dopo le altre)
+		@param count numero di indici
+		@param first_index primo indice nell'IBO
+		@param base_vertex valore sommato agli indici
+		@param object oggetto ritornato da add_object()
+	*/
+	void add_draw(GLuint vao, GLenum primitive, GLenum index_type, const Texture *texture, bool blend,
+	              GLuint count, GLuint first_index, GLint base_vertex, unsigned int object);
+
+	/**
+		Disegna le draw call accodate. Le draw call sono ordinate per
+		stato (VAO, primitiva, texture) e quelle con lo stesso stato sono
+		inviate con una sola glMultiDrawElementsIndirect. Le draw call con
+		il blending sono disegnate per ultime.
+
+		@param TextureUnit TextureUnit usata per le texture
+		@return il numero di chiamate a OpenGL usate per disegnare
+	*/
+	unsigned int flush(unsigned int TextureUnit = 0);
+
+	/**
+		Ritorna il numero di oggetti accodati
+	*/
+	unsigned int num_objects() const;
+
+	/**
+		Ritorna il numero di draw call accodate
+	*/
+	unsigned int num_draws() const;
+
+	/**
+		Ritorna true se il driver supporta glMultiDrawElementsIndirect
+	*/
+	static bool multi_draw_supported();
+
+private:
+
+	/**
+		Comando nel formato di DrawElementsIndirectCommand
+	*/
+	struct Command {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint  base_vertex;
+		GLuint base_instance;
+	};
+
+	/**
+		Draw call accodata con lo stato necessario per disegnarla
+	*/
+	struct Draw {
+		Command command;
+		GLuint vao;
+		GLenum primitive;
+		GLenum index_type;
+		const Texture *texture;
+		bool blend;
+	};
+
+	void bind_objects(GLuint first_object) const;
+
+	void unbind_objects() const;
+
+	static void upload(GLenum target, GLuint &buffer, size_t &capacity, const void *data, size_t bytes,
+	                   const std::string &owner);
+
+	std::vector<ObjectData> _objects;  ///<< Oggetti del frame
+	std::vector<Draw>       _draws;    ///<< Draw call del frame
+	std::vector<Command>    _commands; ///<< Comandi ordinati (vettore di lavoro)
+	GLuint _object_buffer;             ///<< Vertex buffer con i dati degli oggetti
+	GLuint _command_buffer;            ///<< Buffer GL_DRAW_INDIRECT_BUFFER con i comandi
+	size_t _object_capacity;           ///<< Byte allocati in _object_buffer
+	size_t _command_capacity;          ///<< Byte allocati in _command_buffer
+	std::string _name;                 ///<< Nome dei buffer nel report della memoria
+
+	// Blocchiamo le operazioni di copia: non possiamo condividere i buffer
+	IndirectBatch&operator=(const IndirectBatch &other);
+	IndirectBatch(const IndirectBatch &other);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "instancebuffer.h"
+#include "gpumemory.h"
+#include "glstate.h"
+
+#include <cstddef>
+
+namespace {
+	// Attributi per istanza: 4 colonne della matrice e il colore
+	const GLuint NUM_ATTRIBUTES = 5;
+}
+
+InstanceBuffer::Instance::Instance() : model(1.0f), tint(1.0f) {}
+
+InstanceBuffer::Instance::Instance(const glm::mat4 &m, const glm::vec4 &t) : model(m), tint(t) {}
+
+InstanceBuffer::InstanceBuffer(const std::string &name) : _buffer(0), _size(0), _capacity(0), _name(name) {}
+
+InstanceBuffer::~InstanceBuffer() {
+	clear();
+}
+
+void InstanceBuffer::set(const Instance *instances, unsigned int count) {
+	if (_buffer == 0) glGenBuffers(1, &_buffer);
+
+	GlState::instance().bind_buffer(GL_ARRAY_BUFFER, _buffer);
+
+	// Riallocando il buffer (anche con la stessa dimensione) il driver non
+	// deve attendere che la GPU finisca di usare il contenuto precedente
+	if (count > _capacity) _capacity = count;
+	glBufferData(GL_ARRAY_BUFFER, size_t(_capacity) * sizeof(Instance), nullptr, GL_DYNAMIC_DRAW);
+	if (count > 0) glBufferSubData(GL_ARRAY_BUFFER, 0, size_t(count) * sizeof(Instance), instances);
+
+	GlState::instance().bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	GpuMemory::instance().track_buffer(_buffer, size_t(_capacity) * sizeof(Instance), _name, GpuMemory::VERTEX_BUFFER);
+
+	_size = count;
+}
+
+void InstanceBuffer::set(const std::vector<Instance> &instances) {
+	set(instances.data(), instances.size());
+}
+
+bool InstanceBuffer::update(unsigned int first, const Instance *instances, unsigned int count) {
+	if (first > _size || count > _size - first) return false;
+	if (count == 0) return true;
+
+	GlState::instance().bind_buffer(GL_ARRAY_BUFFER, _buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, size_t(first) * sizeof(Instance), size_t(count) * sizeof(Instance), instances);
+	GlState::instance().bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	return true;
+}
+
+unsigned int InstanceBuffer::size() const {
+	return _size;
+}
+
+bool InstanceBuffer::empty() const {
+	return _size == 0;
+}
+
+void InstanceBuffer::clear() {
+	if (_buffer != 0) {
+		GpuMemory::instance().release_buffer(_buffer);
+		GlState::instance().delete_buffer(_buffer);
+	}
+	_buffer = 0;
+	_size = _capacity = 0;
+}
+
+void InstanceBuffer::bind(unsigned int first_instance) const {
+	GlState &state = GlState::instance();
+
+	state.bind_buffer(GL_ARRAY_BUFFER, _buffer);
+
+	const size_t base = size_t(first_instance) * sizeof(Instance);
+
+	// Un attributo mat4 occupa quattro location consecutive, una per colonna
+	for (GLuint c = 0 ; c < 4 ; c++) {
+		const GLuint location = FIRST_ATTRIBUTE + c;
+		state.enable_vertex_attrib_array(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+		                      (void*)(base + offsetof(Instance, model) + c * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	const GLuint tint = FIRST_ATTRIBUTE + 4;
+	state.enable_vertex_attrib_array(tint);
+	glVertexAttribPointer(tint, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, tint)));
+	glVertexAttribDivisor(tint, 1);
+
+	state.bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::unbind() const {
+	for (GLuint a = FIRST_ATTRIBUTE ; a < FIRST_ATTRIBUTE + NUM_ATTRIBUTES ; a++) {
+		glVertexAttribDivisor(a, 0);
+		GlState::instance().disable_vertex_attrib_array(a);
+	}
+}
@@ -0,0 +1,118 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <string>
+#include <vector>
+#include "GL/glew.h" // prima di freeglut
+#include "glm/glm.hpp"
+
+/**
+	Buffer con i dati delle istanze di un modello disegnato con
+	Mesh::render_instanced().
+
+	Ogni istanza ha una matrice di trasformazione e un colore (tint) che
+	moltiplica quello del materiale. I dati sono memorizzati in un vertex
+	buffer e letti dal vertex shader come attributi per istanza
+	(glVertexAttribDivisor): la matrice occupa le location da 3 a 6 (una
+	per colonna) e il colore la location 7 (vedi 14_instanced.vert).
+
+	Lo stesso buffer può essere usato per disegnare modelli diversi. Il
+	buffer OpenGL è creato al primo set(), quindi l'oggetto può essere
+	istanziato prima dell'inizializzazione di OpenGL.
+*/
+class InstanceBuffer {
+public:
+
+	/**
+		Dati di una istanza, nel formato letto dal vertex shader
+	*/
+	struct Instance {
+		glm::mat4 model; ///< Matrice di trasformazione dell'istanza
+		glm::vec4 tint;  ///< Colore che moltiplica quello del materiale
+
+		Instance();
+
+		Instance(const glm::mat4 &m, const glm::vec4 &t = glm::vec4(1.0f));
+	};
+
+	/**
+		Location del primo attributo per istanza nel vertex shader
+	*/
+	static const GLuint FIRST_ATTRIBUTE = 3;
+
+	/**
+		Costruttore
+
+		@param name nome usato per registrare il buffer in GpuMemory
+	*/
+	explicit InstanceBuffer(const std::string &name = "instances");
+
+	~InstanceBuffer();
+
+	/**
+		Sostituisce le istanze. Il buffer OpenGL viene riallocato solo se
+		le istanze sono più della sua capacità, altrimenti il contenuto
+		precedente viene scartato (orphaning) e sovrascritto.
+
+		@param instances dati delle istanze
+		@param count numero di istanze
+	*/
+	void set(const Instance *instances, unsigned int count);
+
+	/**
+		Sostituisce le istanze
+
+		@param instances dati delle istanze
+	*/
+	void set(const std::vector<Instance> &instances);
+
+	/**
+		Aggiorna un intervallo di istanze già presenti nel buffer
+
+		@param first prima istanza da aggiornare
+		@param instances nuovi dati delle istanze
+		@param count numero di istanze da aggiornare
+		@return false se l'intervallo esce dalle istanze presenti
+	*/
+	bool update(unsigned int first, const Instance *instances, unsigned int count);
+
+	/**
+		Ritorna il numero di istanze
+	*/
+	unsigned int size() const;
+
+	/**
+		Ritorna true se il buffer non contiene istanze
+	*/
+	bool empty() const;
+
+	/**
+		Libera il buffer OpenGL
+	*/
+	void clear();
+
+	/**
+		Collega gli attributi per istanza al VAO correntemente bindato
+
+		@param first_instance prima istanza letta dagli attributi
+	*/
+	void bind(unsigned int first_instance = 0) const;
+
+	/**
+		Scollega gli attributi per istanza dal VAO correntemente bindato,
+		così che non siano letti dalle draw call non instanced
+	*/
+	void unbind() const;
+
+private:
+	GLuint _buffer;         ///<< Vertex buffer con le istanze
+	unsigned int _size;     ///<< Numero di istanze
+	unsigned int _capacity; ///<< Numero di istanze allocate nel buffer
+	std::string _name;      ///<< Nome del buffer nel report della memoria
+
+	// Blocchiamo le operazioni di copia: non possiamo condividere il buffer
+	InstanceBuffer&operator=(const InstanceBuffer &other);
+	InstanceBuffer(const InstanceBuffer &other);
+};
+
+#endif
@@ -88,4 +88,82 @@ float SpecularLight::intensity() const {
 
 float SpecularLight::shininess() const {
   return _shininess;
+}
+
+
+PointLight::PointLight() :
+	_position(glm::vec3(0.0f,0.0f,0.0f)),
+	_color(glm::vec3(1.0f,1.0f,1.0f)),
+	_intensity(1.0f), _range(1.0f) {}
+
+PointLight::PointLight(const glm::vec3 &pos, const glm::vec3 &col, float i, float range) :
+	_position(pos), _color(col), _intensity(i), _range(range) {}
+
+void PointLight::set_position(const glm::vec3 &pos) {
+	_position = pos;
+}
+
+glm::vec3 PointLight::position() const {
+	return _position;
+}
+
+glm::vec3 PointLight::color() const {
+	return _color;
+}
+
+float PointLight::intensity() const {
+	return _intensity;
+}
+
+float PointLight::range() const {
+	return _range;
+}
+
+
+SpotLight::SpotLight() :
+	_position(glm::vec3(0.0f,0.0f,0.0f)),
+	_direction(glm::vec3(0.0f,-1.0f,0.0f)),
+	_color(glm::vec3(1.0f,1.0f,1.0f)),
+	_intensity(1.0f), _range(1.0f),
+	_inner_deg(25.0f), _outer_deg(30.0f) {}
+
+SpotLight::SpotLight(const glm::vec3 &pos, const glm::vec3 &dir, const glm::vec3 &col, float i, float range,
+                     float inner_deg, float outer_deg) :
+	_position(pos), _direction(glm::normalize(dir)), _color(col), _intensity(i), _range(range),
+	_inner_deg(inner_deg), _outer_deg(outer_deg) {}
+
+void SpotLight::set_position(const glm::vec3 &pos) {
+	_position = pos;
+}
+
+void SpotLight::set_direction(const glm::vec3 &dir) {
+	_direction = glm::normalize(dir);
+}
+
+glm::vec3 SpotLight::position() const {
+	return _position;
+}
+
+glm::vec3 SpotLight::direction() const {
+	return _direction;
+}
+
+glm::vec3 SpotLight::color() const {
+	return _color;
+}
+
+float SpotLight::intensity() const {
+	return _intensity;
+}
+
+float SpotLight::range() const {
+	return _range;
+}
+
+float SpotLight::inner_angle() const {
+	return _inner_deg;
+}
+
+float SpotLight::outer_angle() const {
+	return _outer_deg;
 }
\ No newline at end of file
@@ -148,4 +148,143 @@ public:
 
 };
 
+
+/**
+    Luce puntiforme: illumina in tutte le direzioni fino a una distanza 
+    massima (range), oltre la quale il suo contributo è nullo. Le luci 
+    puntiformi e spot sono disegnate con LightClusters.
+*/
+class PointLight {
+    glm::vec3 _position; ///<< Posizione della luce in coordinate mondo
+    glm::vec3 _color; ///<< Colore della luce
+    float _intensity; ///<< Intensità della luce
+    float _range; ///<< Distanza massima illuminata
+
+public:
+    /**
+        Setta la luce al colore bianco e massima intensità, nell'origine e
+        con range unitario
+    */
+    PointLight();
+
+    /**
+        Setta la luce
+        @param pos posizione della luce
+        @param col colore della luce
+        @param i intensità della luce
+        @param range distanza massima illuminata
+    */
+    PointLight(const glm::vec3 &pos, const glm::vec3 &col, float i, float range);
+
+    /**
+        Sposta la luce
+        @param pos nuova posizione della luce
+    */
+    void set_position(const glm::vec3 &pos);
+
+    /**
+        Ritorna la posizione della luce
+    */
+    glm::vec3 position() const;
+
+    /**
+        Ritorna il colore della luce
+    */
+    glm::vec3 color() const;
+
+    /**
+        Ritorna l'intensità della luce
+    */
+    float intensity() const;
+
+    /**
+        Ritorna la distanza massima illuminata
+    */
+    float range() const;
+};
+
+
+/**
+    Luce spot: una luce puntiforme che illumina solo all'interno di un 
+    cono. L'intensità è piena fino all'angolo interno e si annulla 
+    gradualmente fino all'angolo esterno.
+*/
+class SpotLight {
+    glm::vec3 _position; ///<< Posizione della luce in coordinate mondo
+    glm::vec3 _direction; ///<< Direzione dell'asse del cono (normalizzata)
+    glm::vec3 _color; ///<< Colore della luce
+    float _intensity; ///<< Intensità della luce
+    float _range; ///<< Distanza massima illuminata
+    float _inner_deg; ///<< Semi-apertura del cono a piena intensità
+    float _outer_deg; ///<< Semi-apertura del cono
+
+public:
+    /**
+        Setta la luce al colore bianco e massima intensità, nell'origine,
+        rivolta verso il basso, con range unitario e cono di 30 gradi
+    */
+    SpotLight();
+
+    /**
+        Setta la luce. Gli angoli sono in gradi, misurati dall'asse del 
+        cono (semi-aperture).
+        @param pos posizione della luce
+        @param dir direzione dell'asse del cono
+        @param col colore della luce
+        @param i intensità della luce
+        @param range distanza massima illuminata
+        @param inner_deg angolo entro cui l'intensità è piena
+        @param outer_deg angolo oltre cui la luce è nulla
+    */
+    SpotLight(const glm::vec3 &pos, const glm::vec3 &dir, const glm::vec3 &col, float i, float range,
+              float inner_deg, float outer_deg);
+
+    /**
+        Sposta la luce
+        @param pos nuova posizione della luce
+    */
+    void set_position(const glm::vec3 &pos);
+
+    /**
+        Cambia la direzione della luce
+        @param dir nuova direzione dell'asse del cono
+    */
+    void set_direction(const glm::vec3 &dir);
+
+    /**
+        Ritorna la posizione della luce
+    */
+    glm::vec3 position() const;
+
+    /**
+        Ritorna la direzione (normalizzata) dell'asse del cono
+    */
+    glm::vec3 direction() const;
+
+    /**
+        Ritorna il colore della luce
+    */
+    glm::vec3 color() const;
+
+    /**
+        Ritorna l'intensità della luce
+    */
+    float intensity() const;
+
+    /**
+        Ritorna la distanza massima illuminata
+    */
+    float range() const;
+
+    /**
+        Ritorna l'angolo (in gradi) entro cui l'intensità è piena
+    */
+    float inner_angle() const;
+
+    /**
+        Ritorna l'angolo (in gradi) oltre cui la luce è nulla
+    */
+    float outer_angle() const;
+};
+
 #endif
\ No newline at end of file
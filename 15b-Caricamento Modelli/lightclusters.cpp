@@ -0,0 +1,358 @@
+#include "lightclusters.h"
+#include "light.h"
+#include "camera.h"
+#include "transform.h"
+#include "threadpool.h"
+#include "gpumemory.h"
+#include "glstate.h"
+
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define LIGHTCLUSTERS_SSE
+#endif
+
+namespace {
+	// Formato dei texel di ogni buffer texture
+	const GLenum FORMATS[] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+
+	// Dimensione minima dei buffer (una buffer texture vuota non è utile)
+	const size_t MIN_CAPACITY = 64;
+
+	// Coseni del cono delle luci puntiformi: il cono comprende tutte le
+	// direzioni (vedi 14.frag)
+	const float POINT_COS_OUTER = -2.0f;
+	const float POINT_COS_INNER = -1.0f;
+
+	// Sotto questo numero di luci nel frustum le fette sono elaborate dal
+	// thread chiamante: il costo di avviare il pool supera il guadagno
+	const unsigned int PARALLEL_LIGHTS = 64;
+}
+
+LightClusters::Grid::Grid() : depth_plane(0.0f), tile_scale(0.0f), depth_scale(0.0f), depth_bias(0.0f) {}
+
+LightClusters::Stats::Stats() : lights(0), references(0), max_lights(0), milliseconds(0.0) {}
+
+LightClusters::LightClusters(unsigned int first_unit, const std::string &name) :
+	_first_unit(first_unit), _name(name), _lights_changed(true), _grid_empty(false), _projection(0.0f), _view(0.0f),
+	_width(0.0f), _height(0.0f), _near(0.0f), _far(0.0f), _boxes(NUM_CLUSTERS), _slices(CLUSTERS_Z),
+	_cluster_grid(NUM_CLUSTERS) {
+	for (unsigned int b = 0 ; b < NUM_BUFFERS ; b++) {
+		_buffers[b] = _textures[b] = 0;
+		_capacity[b] = 0;
+	}
+}
+
+LightClusters::~LightClusters() {
+	GlState &state = GlState::instance();
+
+	for (unsigned int b = 0 ; b < NUM_BUFFERS ; b++) {
+		if (_textures[b] != 0) state.delete_texture(_textures[b]);
+		if (_buffers[b] != 0) {
+			GpuMemory::instance().release_buffer(_buffers[b]);
+			state.delete_buffer(_buffers[b]);
+		}
+	}
+}
+
+void LightClusters::clear() {
+	_lights.clear();
+	_spheres.clear();
+	_lights_changed = true;
+}
+
+bool LightClusters::add(const PointLight &light) {
+	if (_lights.size() >= MAX_LIGHTS) return false;
+
+	GpuLight data;
+	data.position_range = glm::vec4(light.position(), light.range());
+	data.color_outer = glm::vec4(light.color() * light.intensity(), POINT_COS_OUTER);
+	data.direction_inner = glm::vec4(0.0f, 0.0f, 0.0f, POINT_COS_INNER);
+
+	_lights.push_back(data);
+	_spheres.push_back(glm::vec4(light.position(), light.range()));
+	_lights_changed = true;
+	return true;
+}
+
+bool LightClusters::add(const SpotLight &light) {
+	if (_lights.size() >= MAX_LIGHTS) return false;
+
+	const float outer = std::min(light.outer_angle(), 90.0f);
+	const float cos_outer = std::cos(to_radiant(outer));
+	const float cos_inner = std::max(std::cos(to_radiant(light.inner_angle())), cos_outer + 1e-4f);
+
+	GpuLight data;
+	data.position_range = glm::vec4(light.position(), light.range());
+	data.color_outer = glm::vec4(light.color() * light.intensity(), cos_outer);
+	data.direction_inner = glm::vec4(light.direction(), cos_inner);
+
+	// Sfera che contiene il cono: per i coni stretti passa per il vertice,
+	// per quelli larghi è centrata sulla base
+	const float range = light.range();
+	glm::vec4 sphere;
+	if (outer > 45.0f) {
+		sphere = glm::vec4(light.position() + light.direction() * range * cos_outer,
+		                   range * std::sin(to_radiant(outer)));
+	}
+	else {
+		const float radius = range / (2.0f * cos_outer);
+		sphere = glm::vec4(light.position() + light.direction() * radius, radius);
+	}
+
+	_lights.push_back(data);
+	_spheres.push_back(sphere);
+	_lights_changed = true;
+	return true;
+}
+
+unsigned int LightClusters::size() const {
+	return _lights.size();
+}
+
+void LightClusters::update_boxes(const glm::mat4 &projection, float width, float height) {
+	_projection = projection;
+	_width = width;
+	_height = height;
+
+	// Parametri di glm::perspective: P[0][0] = 1/(aspect*tan(fov/2)),
+	// P[1][1] = 1/tan(fov/2), near e far da P[2][2] e P[3][2]
+	const float tan_x = 1.0f / projection[0][0];
+	const float tan_y = 1.0f / projection[1][1];
+	_near = projection[3][2] / (projection[2][2] - 1.0f);
+	_far  = projection[3][2] / (projection[2][2] + 1.0f);
+
+	_grid.tile_scale = glm::vec2(CLUSTERS_X / width, CLUSTERS_Y / height);
+	_grid.depth_scale = CLUSTERS_Z / std::log(_far / _near);
+	_grid.depth_bias = -std::log(_near) * _grid.depth_scale;
+
+	for (unsigned int z = 0 ; z < CLUSTERS_Z ; z++) {
+		const float d0 = _near * std::pow(_far / _near, float(z) / CLUSTERS_Z);
+		const float d1 = _near * std::pow(_far / _near, float(z + 1) / CLUSTERS_Z);
+
+		for (unsigned int y = 0 ; y < CLUSTERS_Y ; y++) {
+			const float y0 = (-1.0f + 2.0f * y / CLUSTERS_Y) * tan_y;
+			const float y1 = (-1.0f + 2.0f * (y + 1) / CLUSTERS_Y) * tan_y;
+
+			for (unsigned int x = 0 ; x < CLUSTERS_X ; x++) {
+				const float x0 = (-1.0f + 2.0f * x / CLUSTERS_X) * tan_x;
+				const float x1 = (-1.0f + 2.0f * (x + 1) / CLUSTERS_X) * tan_x;
+
+				// I lati del tile si allargano con la profondità: gli estremi
+				// sono sulle due facce della fetta
+				Box &box = _boxes[(z * CLUSTERS_Y + y) * CLUSTERS_X + x];
+				box.min = glm::vec3(std::min(x0 * d0, x0 * d1), std::min(y0 * d0, y0 * d1), d0);
+				box.max = glm::vec3(std::max(x1 * d0, x1 * d1), std::max(y1 * d0, y1 * d1), d1);
+			}
+		}
+	}
+}
+
+void LightClusters::bin_slice(unsigned int z) {
+	Slice &slice = _slices[z];
+	const unsigned int count = slice.lights.size();
+
+	slice.indices.clear();
+	slice.counts.assign(CLUSTERS_X * CLUSTERS_Y, 0);
+	if (count == 0) return;
+
+	for (unsigned int c = 0 ; c < CLUSTERS_X * CLUSTERS_Y ; c++) {
+		const Box &box = _boxes[z * CLUSTERS_X * CLUSTERS_Y + c];
+		const size_t first = slice.indices.size();
+		unsigned int l = 0;
+
+		// Distanza al quadrato tra il centro della sfera e il box (0 se il
+		// centro è dentro), confrontata con il raggio al quadrato
+#if defined(LIGHTCLUSTERS_SSE)
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 min_x = _mm_set1_ps(box.min.x), max_x = _mm_set1_ps(box.max.x);
+		const __m128 min_y = _mm_set1_ps(box.min.y), max_y = _mm_set1_ps(box.max.y);
+		const __m128 min_d = _mm_set1_ps(box.min.z), max_d = _mm_set1_ps(box.max.z);
+
+		for ( ; l + 4 <= count ; l += 4) {
+			const __m128 x = _mm_loadu_ps(&slice.x[l]);
+			const __m128 y = _mm_loadu_ps(&slice.y[l]);
+			const __m128 d = _mm_loadu_ps(&slice.depth[l]);
+
+			__m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_x, x), _mm_sub_ps(x, max_x)));
+			__m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_y, y), _mm_sub_ps(y, max_y)));
+			__m128 dd = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_d, d), _mm_sub_ps(d, max_d)));
+
+			__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dd, dd));
+
+			int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, _mm_loadu_ps(&slice.r2[l])));
+			for (int k = 0 ; mask != 0 ; k++, mask >>= 1) {
+				if (mask & 1) slice.indices.push_back(slice.lights[l + k]);
+			}
+		}
+#endif
+
+		// Luci rimanenti (o tutte, senza SIMD)
+		for ( ; l < count ; l++) {
+			const float dx = std::max(0.0f, std::max(box.min.x - slice.x[l], slice.x[l] - box.max.x));
+			const float dy = std::max(0.0f, std::max(box.min.y - slice.y[l], slice.y[l] - box.max.y));
+			const float dd = std::max(0.0f, std::max(box.min.z - slice.depth[l], slice.depth[l] - box.max.z));
+
+			if (dx * dx + dy * dy + dd * dd <= slice.r2[l]) slice.indices.push_back(slice.lights[l]);
+		}
+
+		slice.counts[c] = slice.indices.size() - first;
+	}
+}
+
+void LightClusters::update(const Camera &camera, float width, float height) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	const glm::mat4 &view = camera.camera();
+	const bool boxes_changed = camera.projection() != _projection || width != _width || height != _height;
+
+	// Con le stesse luci e la stessa vista i buffer sono già aggiornati
+	if (!boxes_changed && !_lights_changed && view == _view) return;
+
+	if (boxes_changed) update_boxes(camera.projection(), width, height);
+	_view = view;
+
+	// La profondità di vista è la distanza dal piano della camera lungo la
+	// direzione di vista (la -z dello spazio di vista)
+	_grid.depth_plane = -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+
+	_stats = Stats();
+
+	// Senza luci basta una griglia vuota, caricata una sola volta
+	if (_lights.empty()) {
+		_lights_changed = false;
+		if (!_grid_empty) {
+			std::fill(_cluster_grid.begin(), _cluster_grid.end(), glm::uvec2(0));
+			upload(CLUSTER_GRID, _cluster_grid.data(), _cluster_grid.size() * sizeof(glm::uvec2));
+			_grid_empty = true;
+		}
+		return;
+	}
+
+	for (unsigned int z = 0 ; z < CLUSTERS_Z ; z++) {
+		Slice &slice = _slices[z];
+		slice.lights.clear();
+		slice.x.clear();
+		slice.y.clear();
+		slice.depth.clear();
+		slice.r2.clear();
+	}
+
+	// Ogni luce nel frustum è aggiunta alle fette intersecate dalla sua
+	// sfera: in ogni fetta basta confrontarla con i box dei tile
+	const unsigned int num_lights = _lights.size();
+	_visible.resize(num_lights);
+	if (num_lights > 0) _stats.lights = camera.cull_spheres(_spheres.data(), num_lights, _visible.data());
+
+	for (unsigned int i = 0 ; i < num_lights ; i++) {
+		if (!_visible[i]) continue;
+
+		const glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(_spheres[i]), 1.0f));
+		const float depth = -center.z;
+		const float radius = _spheres[i].w;
+
+		const float front = std::max(depth - radius, _near);
+		const float back  = std::min(depth + radius, _far);
+		if (front > back) continue;
+
+		const int z0 = std::max(0, int(std::log(front) * _grid.depth_scale + _grid.depth_bias));
+		const int z1 = std::min(int(CLUSTERS_Z) - 1, int(std::log(back) * _grid.depth_scale + _grid.depth_bias));
+
+		for (int z = z0 ; z <= z1 ; z++) {
+			Slice &slice = _slices[z];
+			slice.lights.push_back(i);
+			slice.x.push_back(center.x);
+			slice.y.push_back(center.y);
+			slice.depth.push_back(depth);
+			slice.r2.push_back(radius * radius);
+		}
+	}
+
+	// Il thread di rendering non attende mai il pool, che può essere
+	// occupato dai caricamenti in background
+	if (_stats.lights < PARALLEL_LIGHTS) {
+		for (unsigned int z = 0 ; z < CLUSTERS_Z ; z++) bin_slice(z);
+	}
+	else {
+		ThreadPool::instance().try_parallel_for(CLUSTERS_Z, [this](unsigned int z) {
+			bin_slice(z);
+		});
+	}
+
+	// Le liste delle fette sono concatenate nell'ordine dei cluster
+	_cluster_indices.clear();
+	for (unsigned int z = 0 ; z < CLUSTERS_Z ; z++) {
+		const Slice &slice = _slices[z];
+		unsigned int offset = _cluster_indices.size();
+
+		for (unsigned int c = 0 ; c < CLUSTERS_X * CLUSTERS_Y ; c++) {
+			_cluster_grid[z * CLUSTERS_X * CLUSTERS_Y + c] = glm::uvec2(offset, slice.counts[c]);
+			offset += slice.counts[c];
+			_stats.max_lights = std::max(_stats.max_lights, slice.counts[c]);
+		}
+
+		_cluster_indices.insert(_cluster_indices.end(), slice.indices.begin(), slice.indices.end());
+	}
+	_stats.references = _cluster_indices.size();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	_stats.milliseconds = elapsed.count();
+
+	if (_lights_changed) {
+		upload(LIGHT_DATA, _lights.data(), _lights.size() * sizeof(GpuLight));
+		_lights_changed = false;
+	}
+	upload(CLUSTER_GRID, _cluster_grid.data(), _cluster_grid.size() * sizeof(glm::uvec2));
+	_grid_empty = false;
+	upload(LIGHT_INDICES, _cluster_indices.data(), _cluster_indices.size() * sizeof(std::uint16_t));
+}
+
+void LightClusters::upload(Buffer buffer, const void *data, size_t bytes) {
+	GlState &state = GlState::instance();
+
+	if (_buffers[buffer] == 0) {
+		glGenBuffers(1, &_buffers[buffer]);
+		glGenTextures(1, &_textures[buffer]);
+	}
+
+	state.bind_buffer(GL_TEXTURE_BUFFER, _buffers[buffer]);
+
+	// Riallocando il buffer (anche con la stessa dimensione) il driver non
+	// deve attendere che la GPU finisca di usare il contenuto precedente
+	const bool created = _capacity[buffer] == 0;
+	_capacity[buffer] = std::max(_capacity[buffer], std::max(bytes, MIN_CAPACITY));
+	glBufferData(GL_TEXTURE_BUFFER, _capacity[buffer], nullptr, GL_STREAM_DRAW);
+	if (bytes > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+
+	GpuMemory::instance().track_buffer(_buffers[buffer], _capacity[buffer], _name, GpuMemory::LIGHT_BUFFER);
+
+	// La texture resta associata al buffer anche quando viene riallocato
+	if (created) {
+		state.bind_texture(_first_unit + buffer, GL_TEXTURE_BUFFER, _textures[buffer]);
+		glTexBuffer(GL_TEXTURE_BUFFER, FORMATS[buffer], _buffers[buffer]);
+	}
+}
+
+void LightClusters::bind() const {
+	GlState &state = GlState::instance();
+
+	for (unsigned int b = 0 ; b < NUM_BUFFERS ; b++) {
+		state.bind_texture(_first_unit + b, GL_TEXTURE_BUFFER, _textures[b]);
+	}
+}
+
+unsigned int LightClusters::first_unit() const {
+	return _first_unit;
+}
+
+const LightClusters::Grid &LightClusters::grid() const {
+	return _grid;
+}
+
+const LightClusters::Stats &LightClusters::stats() const {
+	return _stats;
+}
@@ -0,0 +1,229 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GL/glew.h" // prima di freeglut
+#include "glm/glm.hpp"
+
+class Camera;
+class PointLight;
+class SpotLight;
+
+/**
+	Luci puntiformi e spot assegnate ai cluster del frustum della camera
+	(clustered forward shading).
+
+	Il frustum è diviso in una griglia di CLUSTERS_X x CLUSTERS_Y tile
+	sullo schermo e CLUSTERS_Z fette in profondità, con uno spessore che
+	cresce esponenzialmente con la distanza (le fette vicine alla camera
+	sono sottili). Ad ogni frame update() assegna ogni luce ai cluster
+	intersecati dalla sua sfera di influenza e carica sulla GPU tre buffer
+	texture (gli shader sono GLSL 3.30, senza shader storage buffer):
+
+	    luci:    3 texel RGBA32F per luce (posizione e range, colore per
+	             intensità e coseno esterno, direzione e coseno interno)
+	    griglia: un texel RG32UI per cluster (primo indice, numero di luci)
+	    indici:  un texel R16UI per ogni coppia cluster-luce
+
+	Il fragment shader trova il cluster del frammento dalla posizione sullo
+	schermo e dalla profondità e valuta solo le luci della sua lista: il
+	costo per pixel dipende dalle luci vicine e non dal numero totale.
+
+	Con molte luci le fette sono elaborate in parallelo con il ThreadPool
+	(vedi update()). In ogni fetta le sfere delle luci sono confrontate con
+	i bounding box dei cluster 4 per volta con le istruzioni SSE. Le luci
+	fuori dal frustum sono scartate prima con Camera::cull_spheres().
+
+	La griglia assume una proiezione prospettica simmetrica (quella di
+	Camera::set_perspective()).
+*/
+class LightClusters {
+public:
+
+	static const unsigned int CLUSTERS_X = 16; ///< Tile in orizzontale
+	static const unsigned int CLUSTERS_Y = 9;  ///< Tile in verticale
+	static const unsigned int CLUSTERS_Z = 24; ///< Fette in profondità
+
+	static const unsigned int NUM_CLUSTERS = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+	/**
+		Massimo numero di luci (gli indici sulla GPU sono a 16 bit)
+	*/
+	static const unsigned int MAX_LIGHTS = 65536;
+
+	/**
+		Parametri per trovare il cluster di un frammento (vedi
+		MyShaderClass::FrameBlock)
+	*/
+	struct Grid {
+		glm::vec4 depth_plane; ///< Piano che dà la profondità di vista di un punto in coordinate mondo
+		glm::vec2 tile_scale;  ///< Tile per pixel sui due assi
+		float depth_scale;     ///< Fetta = log(profondità) * depth_scale + depth_bias
+		float depth_bias;
+
+		Grid();
+	};
+
+	/**
+		Risultato dell'ultima update()
+	*/
+	struct Stats {
+		unsigned int lights;     ///< Luci nel frustum
+		unsigned int references; ///< Coppie cluster-luce
+		unsigned int max_lights; ///< Massimo numero di luci in un cluster
+		double milliseconds;     ///< Tempo dell'assegnazione sulla CPU
+
+		Stats();
+	};
+
+	/**
+		Costruttore
+
+		@param first_unit prima delle tre TextureUnit usate per le buffer
+		       texture (luci, griglia, indici)
+		@param name nome usato per registrare i buffer in GpuMemory
+	*/
+	LightClusters(unsigned int first_unit, const std::string &name);
+
+	~LightClusters();
+
+	/**
+		Rimuove tutte le luci
+	*/
+	void clear();
+
+	/**
+		Aggiunge una luce puntiforme
+
+		@param light luce da aggiungere
+		@return false se è stato raggiunto MAX_LIGHTS
+	*/
+	bool add(const PointLight &light);
+
+	/**
+		Aggiunge una luce spot
+
+		@param light luce da aggiungere
+		@return false se è stato raggiunto MAX_LIGHTS
+	*/
+	bool add(const SpotLight &light);
+
+	/**
+		Ritorna il numero di luci
+	*/
+	unsigned int size() const;
+
+	/**
+		Assegna le luci ai cluster della vista corrente e aggiorna i buffer
+		sulla GPU. Va chiamata una volta per frame, prima di disegnare. Se
+		le luci e la camera non sono cambiate non fa nulla. Il thread
+		chiamante non attende mai il ThreadPool: con poche luci, o con il
+		pool occupato dai caricamenti, le fette sono elaborate
+		sequenzialmente.
+
+		@param camera camera del frame
+		@param width larghezza della viewport in pixel
+		@param height altezza della viewport in pixel
+	*/
+	void update(const Camera &camera, float width, float height);
+
+	/**
+		Collega le buffer texture alle loro TextureUnit
+	*/
+	void bind() const;
+
+	/**
+		Ritorna la prima TextureUnit usata (vedi MyShaderClass::set_light_samplers())
+	*/
+	unsigned int first_unit() const;
+
+	/**
+		Ritorna i parametri della griglia dell'ultima update()
+	*/
+	const Grid &grid() const;
+
+	/**
+		Ritorna il risultato dell'ultima update()
+	*/
+	const Stats &stats() const;
+
+private:
+
+	/**
+		Buffer texture usate dagli shader
+	*/
+	enum Buffer {
+		LIGHT_DATA,    ///< Dati delle luci
+		CLUSTER_GRID,  ///< Lista di luci di ogni cluster
+		LIGHT_INDICES, ///< Indici delle luci delle liste
+		NUM_BUFFERS
+	};
+
+	/**
+		Dati di una luce come letti dal fragment shader
+	*/
+	struct GpuLight {
+		glm::vec4 position_range;  ///< Posizione e range
+		glm::vec4 color_outer;     ///< Colore per intensità e coseno dell'angolo esterno
+		glm::vec4 direction_inner; ///< Direzione e coseno dell'angolo interno
+	};
+
+	/**
+		Bounding box di un cluster nello spazio di vista (x, y e
+		profondità positiva)
+	*/
+	struct Box {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	/**
+		Dati di lavoro di una fetta
+	*/
+	struct Slice {
+		std::vector<std::uint16_t> lights;  ///< Luci che intersecano la fetta
+		std::vector<float> x, y, depth, r2; ///< Sfere delle luci nello spazio di vista (SoA)
+		std::vector<std::uint16_t> indices; ///< Luci dei cluster della fetta, consecutive
+		std::vector<unsigned int> counts;   ///< Numero di luci di ogni cluster della fetta
+	};
+
+	void update_boxes(const glm::mat4 &projection, float width, float height);
+
+	void bin_slice(unsigned int z);
+
+	void upload(Buffer buffer, const void *data, size_t bytes);
+
+	unsigned int _first_unit; ///<< Prima TextureUnit
+	std::string _name;        ///<< Nome dei buffer nel report della memoria
+
+	std::vector<GpuLight>  _lights;  ///<< Luci aggiunte
+	std::vector<glm::vec4> _spheres; ///<< Sfere di influenza delle luci (coordinate mondo)
+	bool _lights_changed;            ///<< true se i dati delle luci vanno ricaricati
+	bool _grid_empty;                ///<< true se sulla GPU c'è la griglia vuota
+
+	glm::mat4 _projection;     ///<< Proiezione usata per calcolare i box
+	glm::mat4 _view;           ///<< Vista dell'ultima assegnazione
+	float _width, _height;     ///<< Viewport usata per calcolare i box
+	float _near, _far;         ///<< Piani near e far della proiezione
+	std::vector<Box> _boxes;   ///<< Box dei cluster
+	std::vector<Slice> _slices; ///<< Dati di lavoro delle fette
+
+	std::vector<glm::uvec2> _cluster_grid;       ///<< Primo indice e numero di luci di ogni cluster
+	std::vector<std::uint16_t> _cluster_indices; ///<< Liste di luci dei cluster
+	std::vector<unsigned char> _visible;         ///<< Luci nel frustum
+
+	GLuint _buffers[NUM_BUFFERS];  ///<< Buffer OpenGL
+	GLuint _textures[NUM_BUFFERS]; ///<< Buffer texture
+	size_t _capacity[NUM_BUFFERS]; ///<< Dimensione allocata dei buffer
+
+	Grid _grid;   ///<< Parametri della griglia
+	Stats _stats; ///<< Risultato dell'ultima update()
+
+	// Blocchiamo le operazioni di copia: non possiamo condividere i buffer
+	LightClusters&operator=(const LightClusters &other);
+	LightClusters(const LightClusters &other);
+};
+
+#endif
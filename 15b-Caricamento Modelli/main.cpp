@@ -1,8 +1,8 @@
 /**
   Codice che mostra come sfruttare la libreria esterna assimp per impofrtare dei
   modelli 3D e renderizzarli nella scena.
-  Al momento, il codice è in grado di renderizzare modelli costituiti da una
-  singola mesh e con una singola Texture associata.
+  Il codice è in grado di renderizzare modelli costituiti da più mesh, 
+  ciascuna con una singola Texture associata.
 
   I modelli 3D sono memorizzato nella cartella models (nella root di questo codice).
   Il formato dei file è Wavefront (https://en.wikipedia.org/wiki/Wavefront_.obj_file), 
@@ -12,8 +12,8 @@
   E' stata creata una classe Mesh che gestisce il caricamento e il rendering dei
   modelli.
 
-  Per comodità, sono state istanziate delle variabili globali di tipo Mesh che
-  contengono diversi modelli 3D:
+  Per comodità, sono state istanziate delle variabili globali che puntano alle
+  Mesh, ottenute da ResourceCache, che contengono diversi modelli 3D:
 
   Modelli singoli:
   'teapot': Una teiera (visualizzabile premendo 't')
@@ -21,20 +21,78 @@
   'dragon': Una drago (visualizzabile premendo 'g')
   'boot'  : Uno scarpone (visualizzabile premendo 'b')
   'flower': Un fiore (visualizzabile premendo 'f')
+
+  Modello instanced
+  'skulls': Una griglia di 100x100 teschi (visualizzabile premendo 'i').
+  Le istanze hanno ciascuna la sua matrice e il suo colore, memorizzati in
+  un InstanceBuffer, e sono disegnate con una sola chiamata a 
+  render_instanced() usando la variante instanced degli shader.
+
+  Scena composta
+  'all': Tutti i modelli insieme (visualizzabile premendo 'x'). 
+  I modelli sono caricati nelle arene di geometria condivise e sono 
+  accodati in un IndirectBatch: le sotto-mesh con lo stesso VAO e la 
+  stessa texture sono disegnate con una sola glMultiDrawElementsIndirect.
+
+  'queue': Una griglia di 12x12 copie dei modelli (visualizzabile premendo 
+  'q'). Le draw call sono accodate in una RenderQueue, ordinate per 
+  programma, texture e mesh ed eseguite cambiando lo stato solo quando 
+  serve. Le uniform della camera e delle luci sono impostate una volta 
+  per frame.
   
   Modello composto
   'marius': Un volto (visualizzabile premendo 'm'). 
   Questo modello è composto da diverse mesh (6) ciascuna definita in un suo 
-  file separato. Una volta caricate le singole mesh, queste sono renderizzate 
-  di seguito all'interno dello stesso ciclo di rendering per avere il volto 
-  completo. Inoltre, per questo modello, alcune texture hanno delle trasparenze
-  Per poterle usare in modo corretto è necessario impostare OpenGL.
-  Vedere la funzione render_marius().
+  file separato. I file sono caricati in un unico oggetto Mesh: le singole 
+  mesh diventano sotto-mesh che condividono lo stesso VAO/VBO/IBO e sono 
+  renderizzate con una sola chiamata a render(). Inoltre, per questo modello, 
+  alcune texture hanno delle trasparenze. Le sotto-mesh con trasparenze sono
+  disegnate dalla Mesh per ultime con il blending abilitato.
+
+  Ogni modello ha una catena di livelli di dettaglio: il livello disegnato è
+  il più semplice il cui errore proiettato sullo schermo resta sotto la 
+  soglia (1 pixel, modificabile con i tasti '9' e '0').
+
+  I modelli la cui sfera di contenimento è fuori dal frustum della camera 
+  (es. dopo uno spostamento con le frecce) non vengono disegnati.
+
+  I file OBJ sono letti con un parser dedicato, più veloce di Assimp. Con
+  l'argomento --bench-obj il programma confronta i due parser e termina.
+
+  I modelli sono caricati in background: la finestra compare subito e, 
+  finchè un modello non è pronto, al suo posto è disegnato il suo bounding
+  box. Il modello visibile ha la precedenza, gli altri sono caricati in 
+  anticipo. Ad ogni frame sulla GPU viene trasferita al più una quantità 
+  fissa di dati, così il cambio di modello non blocca il rendering.
+
+  Premendo 'p' la memoria occupata sulla GPU da buffer e texture, totale e
+  per risorsa, viene scritta nel file gpu_memory.txt e viene stampata 
+  l'occupazione delle arene di geometria. Vengono stampate anche le 
+  chiamate di cambio di stato di OpenGL dell'ultimo frame, inviate al 
+  driver ed evitate perché ridondanti (vedi GlState).
+
+  Oltre alle luci ambientale, diffusiva e speculare la scena può avere 
+  centinaia di luci puntiformi e spot (il tasto 'l' ne cambia il numero). 
+  Ad ogni frame le luci sono assegnate ai cluster in cui è diviso il 
+  frustum della camera (LightClusters) e il fragment shader valuta solo 
+  quelle del cluster del frammento.
+
+  Premendo 'r' il modello corrente viene disegnato per BENCH_FRAMES 
+  frame di seguito e viene stampato il tempo medio di un frame (con il 
+  vsync del driver disabilitato, altrimenti il tempo è quello dello 
+  schermo). Serve a confrontare le modifiche agli shader e al rendering.
+
+  Cliccando con il tasto sinistro del mouse viene lanciato un raggio dal 
+  centro della vista (dove punta la camera) e viene stampato il triangolo
+  del modello colpito. Il raggio è intersecato con la BVH dei triangoli 
+  costruita durante il caricamento.
 */
 
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
 #include "GL/glew.h" // prima di freeglut
 #include "GL/freeglut.h"
 #include "glm/glm.hpp"
@@ -46,12 +104,32 @@
 #include "myshaderclass.h"
 
 #include "mesh.h"
+#include "instancebuffer.h"
+#include "indirectbatch.h"
+#include "renderqueue.h"
+#include "gpumemory.h"
+#include "glstate.h"
+#include "resourcecache.h"
+#include "lightclusters.h"
 
 MyShaderClass myshaders;
+MyShaderClass myshaders_instanced(MyShaderClass::INSTANCED);
+MyShaderClass myshaders_indirect(MyShaderClass::INDIRECT);
+
+// I modelli sono condivisi tramite ResourceCache (vedi create_scene())
+std::shared_ptr<Mesh> marius;
+
+std::shared_ptr<Mesh> teapot, skull, boot, dragon, flower;
+
+InstanceBuffer skull_instances("skull instances");
 
-Mesh marius[6];
+IndirectBatch batch("scene batch");
 
-Mesh teapot, skull, boot, dragon, flower;
+RenderQueue queue;
+
+// Le buffer texture delle luci usano le TextureUnit 1, 2 e 3 (la 0 è quella
+// dei materiali)
+LightClusters light_clusters(1, "scene lights");
 
 unsigned char MODEL_TO_RENDER = 't';
 
@@ -74,7 +152,39 @@ struct global_struct {
   float gradX;
   float gradY; 
 
-  global_struct() : gradX(0.0f), gradY(0.0f) {}
+  // Errore massimo (in pixel) dei livelli di dettaglio dei modelli
+  float lod_error;
+
+  // Byte trasferiti sulla GPU ad ogni frame per i modelli in caricamento
+  const size_t STREAM_BUDGET = 4 * 1024 * 1024;
+
+  // Modello disegnato nell'ultimo frame e sua matrice (per il picking)
+  Mesh *visible_mesh;
+  glm::mat4 visible_model;
+
+  // Lato della griglia di teschi disegnata con il rendering instanced
+  const unsigned int GRID_SIZE = 100;
+
+  // Matrice dell'istanza più vicina alla camera (per il livello di dettaglio)
+  glm::mat4 nearest_instance;
+
+  // Chiamate a OpenGL usate per l'ultimo IndirectBatch
+  unsigned int batch_calls;
+
+  // Lato della griglia di modelli disegnata con la RenderQueue
+  const unsigned int QUEUE_GRID_SIZE = 12;
+
+  // Chiamate di cambio di stato dell'ultimo frame
+  GlState::Stats gl_stats;
+
+  // Frame disegnati dal benchmark (tasto 'r')
+  const unsigned int BENCH_FRAMES = 200;
+
+  // Numero di luci puntiformi e spot (tasto 'l')
+  unsigned int num_lights;
+  const unsigned int MAX_SCENE_LIGHTS = 1024;
+
+  global_struct() : gradX(0.0f), gradY(0.0f), lod_error(1.0f), visible_mesh(nullptr), batch_calls(0), num_lights(0) {}
 
 } global;
 
@@ -90,6 +200,7 @@ void MyKeyboard(unsigned char key, int x, int y);
 void MyClose(void);
 void MySpecialKeyboard(int Key, int x, int y);
 void MyMouse(int x, int y);
+void MyMouseButton(int button, int state, int x, int y);
 
 void init(int argc, char*argv[]) {
   glutInit(&argc, argv);
@@ -132,30 +243,57 @@ void init(int argc, char*argv[]) {
 
   glutPassiveMotionFunc(MyMouse);
 
-  glEnable(GL_CULL_FACE);
+  glutMouseFunc(MyMouseButton);
+
+  GlState::instance().enable(GL_CULL_FACE);
   glCullFace(GL_BACK);
   glFrontFace(GL_CCW);
-  glEnable(GL_DEPTH_TEST);
+  GlState::instance().enable(GL_DEPTH_TEST);
 }
 
 void create_scene() {
 
-  marius[0].load_mesh("models/marius/head.obj",aiProcess_FlipUVs);
-  marius[1].load_mesh("models/marius/eyes.obj",aiProcess_FlipUVs);
-  marius[2].load_mesh("models/marius/eyebrows.obj",aiProcess_FlipUVs);
-  marius[3].load_mesh("models/marius/hair_plate.obj",aiProcess_FlipUVs);
-  marius[4].load_mesh("models/marius/eyelashesLower.obj",aiProcess_FlipUVs);
-  marius[5].load_mesh("models/marius/eyelashesUpper.obj",aiProcess_FlipUVs);
-
-  teapot.load_mesh("models/teapot.obj");
-
-  boot.load_mesh("models/boot/boot.obj");
-
-  dragon.load_mesh("models/dragon.obj");
-
-  skull.load_mesh("models/skull.obj");
-
-  flower.load_mesh("models/flower/flower.obj", aiProcess_Triangulate);
+  std::vector<std::string> marius_parts;
+  marius_parts.push_back("models/marius/head.obj");
+  marius_parts.push_back("models/marius/eyes.obj");
+  marius_parts.push_back("models/marius/eyebrows.obj");
+  marius_parts.push_back("models/marius/hair_plate.obj");
+  marius_parts.push_back("models/marius/eyelashesLower.obj");
+  marius_parts.push_back("models/marius/eyelashesUpper.obj");
+
+  // I modelli sono letti e convertiti in background e trasferiti sulla 
+  // GPU a piccoli passi da MyRenderScene(). Il modello visibile all'avvio
+  // è richiesto subito, gli altri sono caricati in anticipo (prefetch).
+  // I vertici uguali (a meno di una piccola tolleranza) sono uniti per 
+  // poter riordinare i triangoli per la cache post-transform della GPU. 
+  // Sui modelli opachi riordiniamo anche i triangoli per ridurre 
+  // l'overdraw. I vertici sono memorizzati nel 
+  // formato compatto a 16 byte e, dove conviene, gli indici sono convertiti
+  // in triangle strip. Per ogni modello è generata una catena di livelli
+  // di dettaglio scelti in base alla distanza. I modelli più grandi sono
+  // divisi in cluster che vengono scartati se fuori dal frustum o girati
+  // dalla parte opposta rispetto alla camera.
+  // Per il picking viene costruita anche la BVH dei triangoli. I buffer 
+  // dei modelli sono allocati nelle arene condivise, così che la scena
+  // composta possa essere disegnata con le draw call indirect.
+  // I modelli sono richiesti a ResourceCache, che accoda il caricamento
+  // solo se lo stesso modello non è già stato richiesto.
+  const unsigned int optimize = Mesh::WELD_VERTICES | Mesh::OPTIMIZE_VERTEX_CACHE | Mesh::OPTIMIZE_VERTEX_FETCH | 
+                                Mesh::QUANTIZE_VERTICES | Mesh::TRIANGLE_STRIPS | Mesh::GENERATE_LODS |
+                                Mesh::BUILD_BVH | Mesh::GEOMETRY_ARENA;
+  const unsigned int opaque   = optimize | Mesh::OPTIMIZE_OVERDRAW;
+  const unsigned int clusters = Mesh::BUILD_MESHLETS;
+
+  ResourceCache &cache = ResourceCache::instance();
+
+  teapot = cache.mesh("models/teapot.obj", 0, opaque);
+
+  const bool prefetch = true;
+  boot   = cache.mesh("models/boot/boot.obj", 0, opaque, prefetch);
+  skull  = cache.mesh("models/skull.obj",  0, opaque | clusters, prefetch);
+  dragon = cache.mesh("models/dragon.obj", 0, opaque | clusters, prefetch);
+  marius = cache.mesh(marius_parts, aiProcess_FlipUVs, optimize | clusters, prefetch);
+  flower = cache.mesh("models/flower/flower.obj", aiProcess_Triangulate, optimize, prefetch);
 
   global.camera.set_camera(
           glm::vec3(0, 0, 0),
@@ -175,9 +313,20 @@ void create_scene() {
   global.diffusive_light = DiffusiveLight(glm::vec3(1,1,1),glm::vec3(0,0,-1),0.5); // 0.5
   global.specular_light = SpecularLight(0.5,30);
 
+  myshaders_instanced.init();
+  myshaders_instanced.enable();
+  myshaders_instanced.set_sampler(0);
+  myshaders_instanced.set_light_samplers(light_clusters.first_unit());
+
+  myshaders_indirect.init();
+  myshaders_indirect.enable();
+  myshaders_indirect.set_sampler(0);
+  myshaders_indirect.set_light_samplers(light_clusters.first_unit());
+
   myshaders.init();
   myshaders.enable();
   myshaders.set_sampler(0);
+  myshaders.set_light_samplers(light_clusters.first_unit());
 
 }
 
@@ -186,24 +335,13 @@ void render_marius() {
   modelT.rotate(global.gradX, 180+global.gradY ,0.0f);
   modelT.translate(0,-1.7,-0.8);
 
-  myshaders.set_model_transform(modelT.T());
-  myshaders.set_camera_transform(global.camera.CP());
-  myshaders.set_ambient_light(global.ambient_light);
-  myshaders.set_diffusive_light(global.diffusive_light);
-  myshaders.set_specular_light(global.specular_light);
-  myshaders.set_camera_position(global.camera.position());
-
-  marius[0].render();
-  marius[1].render();
-  glEnable(GL_BLEND);
-  glEnable(GL_ALPHA_TEST);
-  glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
-  marius[2].render();
-  marius[3].render();
-  marius[4].render();
-  marius[5].render();
-  glDisable(GL_BLEND);
-  glDisable(GL_ALPHA_TEST);  
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), marius->position_scale(), marius->position_bias());
+
+  unsigned int lod = marius->select_lod(global.camera, modelT.T(), global.lod_error);
+  marius->render(global.camera, modelT.T(), 0, lod);
+
+  global.visible_mesh = marius.get();
+  global.visible_model = modelT.T();
 }
 
 void render_teapot() {
@@ -211,14 +349,13 @@ void render_teapot() {
   modelT.rotate(global.gradX, global.gradY ,0.0f);
   modelT.translate(0,-1.6,-10);
 
-  myshaders.set_model_transform(modelT.T());
-  myshaders.set_camera_transform(global.camera.CP());
-  myshaders.set_ambient_light(global.ambient_light);
-  myshaders.set_diffusive_light(global.diffusive_light);
-  myshaders.set_specular_light(global.specular_light);
-  myshaders.set_camera_position(global.camera.position());
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), teapot->position_scale(), teapot->position_bias());
+
+  unsigned int lod = teapot->select_lod(global.camera, modelT.T(), global.lod_error);
+  teapot->render(global.camera, modelT.T(), 0, lod);
 
-  teapot.render();  
+  global.visible_mesh = teapot.get();
+  global.visible_model = modelT.T();
 }
 
 void render_boot() {
@@ -226,14 +363,13 @@ void render_boot() {
   modelT.rotate(global.gradX, global.gradY ,0.0f);
   modelT.translate(0,-10,-70);
 
-  myshaders.set_model_transform(modelT.T());
-  myshaders.set_camera_transform(global.camera.CP());
-  myshaders.set_ambient_light(global.ambient_light);
-  myshaders.set_diffusive_light(global.diffusive_light);
-  myshaders.set_specular_light(global.specular_light);
-  myshaders.set_camera_position(global.camera.position());
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), boot->position_scale(), boot->position_bias());
+
+  unsigned int lod = boot->select_lod(global.camera, modelT.T(), global.lod_error);
+  boot->render(global.camera, modelT.T(), 0, lod);
 
-  boot.render();  
+  global.visible_mesh = boot.get();
+  global.visible_model = modelT.T();
 }
 
 void render_flower() {
@@ -241,14 +377,13 @@ void render_flower() {
   modelT.rotate(-90+global.gradX, global.gradY ,0.0f);
   modelT.translate(0, -4,-15);
 
-  myshaders.set_model_transform(modelT.T());
-  myshaders.set_camera_transform(global.camera.CP());
-  myshaders.set_ambient_light(global.ambient_light);
-  myshaders.set_diffusive_light(global.diffusive_light);
-  myshaders.set_specular_light(global.specular_light);
-  myshaders.set_camera_position(global.camera.position());
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), flower->position_scale(), flower->position_bias());
 
-  flower.render();  
+  unsigned int lod = flower->select_lod(global.camera, modelT.T(), global.lod_error);
+  flower->render(global.camera, modelT.T(), 0, lod);
+
+  global.visible_mesh = flower.get();
+  global.visible_model = modelT.T();
 }
 
 void render_dragon() {
@@ -256,14 +391,13 @@ void render_dragon() {
   modelT.rotate(global.gradX, global.gradY ,0.0f);
   modelT.translate(0,0,-5);
 
-  myshaders.set_model_transform(modelT.T());
-  myshaders.set_camera_transform(global.camera.CP());
-  myshaders.set_ambient_light(global.ambient_light);
-  myshaders.set_diffusive_light(global.diffusive_light);
-  myshaders.set_specular_light(global.specular_light);
-  myshaders.set_camera_position(global.camera.position());
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), dragon->position_scale(), dragon->position_bias());
+
+  unsigned int lod = dragon->select_lod(global.camera, modelT.T(), global.lod_error);
+  dragon->render(global.camera, modelT.T(), 0, lod);
 
-  dragon.render();  
+  global.visible_mesh = dragon.get();
+  global.visible_model = modelT.T();
 }
 
 void render_skull() {
@@ -271,19 +405,192 @@ void render_skull() {
   modelT.rotate(global.gradX, global.gradY ,0.0f);
   modelT.translate(0,-5,-20);
 
-  myshaders.set_model_transform(modelT.T());
-  myshaders.set_camera_transform(global.camera.CP());
-  myshaders.set_ambient_light(global.ambient_light);
-  myshaders.set_diffusive_light(global.diffusive_light);
-  myshaders.set_specular_light(global.specular_light);
-  myshaders.set_camera_position(global.camera.position());
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), skull->position_scale(), skull->position_bias());
+
+  unsigned int lod = skull->select_lod(global.camera, modelT.T(), global.lod_error);
+  skull->render(global.camera, modelT.T(), 0, lod);
+
+  global.visible_mesh = skull.get();
+  global.visible_model = modelT.T();
+}
+
+// Dispone le istanze del teschio su una griglia sul piano XZ, con lato 
+// unitario e un colore diverso per ogni istanza. Serve il bounding box del
+// modello, noto appena il caricamento è iniziato.
+void build_skull_grid() {
+  const float radius = skull->bounding_sphere_radius();
+  const glm::vec3 center = skull->bounding_sphere_center();
+  const float scale = 0.4f / radius;
+
+  std::vector<InstanceBuffer::Instance> instances;
+  instances.reserve(global.GRID_SIZE * global.GRID_SIZE);
+
+  for (unsigned int row = 0 ; row < global.GRID_SIZE ; row++) {
+    for (unsigned int col = 0 ; col < global.GRID_SIZE ; col++) {
+      const float x = col - 0.5f * (global.GRID_SIZE - 1);
+      const float z = -float(row);
+
+      glm::mat4 model(scale);
+      model[3] = glm::vec4(glm::vec3(x, 0.0f, z) - center * scale, 1.0f);
+
+      const glm::vec4 tint(0.6f + 0.4f * float(col) / global.GRID_SIZE,
+                           0.6f + 0.4f * float(row) / global.GRID_SIZE,
+                           0.6f + 0.4f * float((row + col) % 7) / 6.0f, 1.0f);
+
+      instances.push_back(InstanceBuffer::Instance(model, tint));
+    }
+  }
+
+  global.nearest_instance = instances[global.GRID_SIZE / 2].model;
 
-  skull.render();  
+  skull_instances.set(instances);
+}
+
+// Crea le luci puntiformi e spot sparse nella zona dei modelli. Posizioni
+// e colori sono pseudo-casuali ma uguali ad ogni esecuzione
+void build_lights(unsigned int count) {
+  light_clusters.clear();
+
+  unsigned int seed = 12345;
+  auto random = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / float(1 << 24);
+  };
+
+  for (unsigned int i = 0 ; i < count ; i++) {
+    const glm::vec3 position(-6.0f + 12.0f * random(), -2.5f + 3.5f * random(), -16.0f + 15.0f * random());
+    const glm::vec3 color(0.3f + 0.7f * random(), 0.3f + 0.7f * random(), 0.3f + 0.7f * random());
+    const float range = 1.5f + 1.5f * random();
+
+    // Una luce su quattro è uno spot rivolto verso il basso
+    if (i % 4 == 3) {
+      light_clusters.add(SpotLight(position, glm::vec3(0,-1,0), color, 2.0f, 1.5f * range, 20.0f, 30.0f));
+    }
+    else {
+      light_clusters.add(PointLight(position, color, 1.5f, range));
+    }
+  }
+}
+
+void render_skull_grid() {
+  global.visible_mesh = nullptr;
+
+  if (skull_instances.empty()) {
+    if (skull->bounding_sphere_radius() <= 0.0f) {
+      skull->request_residency();
+      return;
+    }
+    build_skull_grid();
+  }
+
+  LocalTransform modelT;
+  modelT.rotate(global.gradX, global.gradY ,0.0f);
+  modelT.translate(0,-2,-3);
+
+  myshaders_instanced.enable();
+  MyShaderClass::set_object_uniforms(modelT.T(), modelT.N(), skull->position_scale(), skull->position_bias());
+
+  // Tutte le istanze usano il livello di dettaglio della più vicina
+  unsigned int lod = skull->select_lod(global.camera, modelT.T() * global.nearest_instance, global.lod_error);
+  skull->render_instanced(skull_instances, 0, lod);
+
+  // Gli altri modelli usano gli shader non instanced
+  myshaders.enable();
+}
+
+// Disegna tutti i modelli su due file, scalati alla stessa dimensione, 
+// con un solo IndirectBatch
+void render_all() {
+  global.visible_mesh = nullptr;
+
+  Mesh *models[] = { teapot.get(), boot.get(), skull.get(), dragon.get(), marius.get(), flower.get() };
+  const unsigned int num_models = sizeof(models) / sizeof(models[0]);
+
+  LocalTransform sceneT;
+  sceneT.rotate(global.gradX, global.gradY ,0.0f);
+  sceneT.translate(0,0,-10);
+
+  batch.clear();
+
+  for (unsigned int i = 0 ; i < num_models ; i++) {
+    Mesh &mesh = *models[i];
+    if (!mesh.is_resident()) {
+      mesh.request_residency();
+      continue;
+    }
+
+    const float scale = 1.0f / mesh.bounding_sphere_radius();
+    const glm::vec3 position((float(i % 3) - 1.0f) * 2.2f, (0.5f - float(i / 3)) * 2.2f, 0.0f);
+
+    glm::mat4 model(scale);
+    model[3] = glm::vec4(position - mesh.bounding_sphere_center() * scale, 1.0f);
+    model = sceneT.T() * model;
+
+    unsigned int lod = mesh.select_lod(global.camera, model, global.lod_error);
+    mesh.submit(batch, global.camera, model, lod);
+  }
+
+  // Le matrici dei modelli sono già complete
+  myshaders_indirect.enable();
+  MyShaderClass::set_model_transform(glm::mat4(1.0f));
+
+  global.batch_calls = batch.flush(0);
+
+  myshaders.enable();
+}
+
+// Disegna una griglia di copie dei modelli, scalate alla stessa dimensione,
+// con una RenderQueue
+void render_queue() {
+  global.visible_mesh = nullptr;
+
+  Mesh *models[] = { teapot.get(), boot.get(), skull.get(), dragon.get(), marius.get(), flower.get() };
+  const unsigned int num_models = sizeof(models) / sizeof(models[0]);
+
+  LocalTransform sceneT;
+  sceneT.rotate(global.gradX, global.gradY ,0.0f);
+  sceneT.translate(0,-2,-4);
+
+  queue.clear();
+
+  for (unsigned int row = 0 ; row < global.QUEUE_GRID_SIZE ; row++) {
+    for (unsigned int col = 0 ; col < global.QUEUE_GRID_SIZE ; col++) {
+      Mesh &mesh = *models[(row * global.QUEUE_GRID_SIZE + col) % num_models];
+      if (mesh.bounding_sphere_radius() <= 0.0f) {
+        mesh.request_residency();
+        continue;
+      }
+
+      const float scale = 0.4f / mesh.bounding_sphere_radius();
+      const glm::vec3 position(col - 0.5f * (global.QUEUE_GRID_SIZE - 1), 0.0f, -float(row));
+
+      glm::mat4 model(scale);
+      model[3] = glm::vec4(position - mesh.bounding_sphere_center() * scale, 1.0f);
+      model = sceneT.T() * model;
+
+      unsigned int lod = mesh.select_lod(global.camera, model, global.lod_error);
+      mesh.submit(queue, myshaders, global.camera, model, lod);
+    }
+  }
+
+  queue.execute(0);
 }
 
 void MyRenderScene() {
+  // Trasferiamo sulla GPU una parte dei modelli in caricamento
+  bool streaming = Mesh::update_streaming(global.STREAM_BUDGET);
+
   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
+  // Le luci puntiformi e spot sono assegnate ai cluster della vista corrente
+  light_clusters.update(global.camera, global.WINDOW_WIDTH, global.WINDOW_HEIGHT);
+  light_clusters.bind();
+
+  // Camera e luci sono le stesse per tutti i modelli e tutti i programmi
+  MyShaderClass::set_frame_uniforms(global.camera.CP(), global.camera.position(), 
+                                    global.ambient_light, global.diffusive_light, global.specular_light,
+                                    light_clusters);
+
   switch (MODEL_TO_RENDER) {
     case 't': render_teapot(); break;
     case 'b': render_boot(); break;
@@ -291,9 +598,37 @@ void MyRenderScene() {
     case 'g': render_dragon(); break;
     case 'm': render_marius(); break;
     case 'f': render_flower(); break;
+    case 'i': render_skull_grid(); break;
+    case 'x': render_all(); break;
+    case 'q': render_queue(); break;
   }
 
+  global.gl_stats = GlState::instance().stats();
+  GlState::instance().reset_stats();
+
   glutSwapBuffers();
+
+  // Finchè ci sono caricamenti in corso continuiamo a ridisegnare
+  if (streaming) glutPostRedisplay();
+}
+
+// Disegna più volte il modello corrente e stampa il tempo medio di un 
+// frame. glFinish() attende che la GPU abbia completato ogni frame, così 
+// il tempo misurato comprende anche l'esecuzione degli shader.
+void benchmark_frames(unsigned int frames) {
+  // Il primo frame completa i caricamenti e le allocazioni in sospeso
+  MyRenderScene();
+  glFinish();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned int f = 0 ; f < frames ; f++) {
+    MyRenderScene();
+    glFinish();
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout<<"Frame benchmark '"<<MODEL_TO_RENDER<<"': "<<elapsed.count() / frames<<" ms/frame over "
+           <<frames<<" frames"<<std::endl;
 }
 
 // Funzione globale che si occupa di gestire l'input da tastiera.
@@ -358,6 +693,17 @@ void MyKeyboard(unsigned char key, int x, int y) {
       global.specular_light.inc_shine(1);
     break;
 
+    // Variamo l'errore massimo tollerato per i livelli di dettaglio
+    case '9':
+      global.lod_error = std::max(0.0f, global.lod_error - 0.5f);
+      std::cout<<"LOD error: "<<global.lod_error<<" pixels"<<std::endl;
+    break;
+
+    case '0':
+      global.lod_error += 0.5f;
+      std::cout<<"LOD error: "<<global.lod_error<<" pixels"<<std::endl;
+    break;
+
     case ' ': // Reimpostiamo la camera
       global.camera.set_camera(
           glm::vec3(0, 0, 0),
@@ -366,12 +712,47 @@ void MyKeyboard(unsigned char key, int x, int y) {
       );
     break;
 
+    // Scriviamo il report della memoria usata sulla GPU
+    case 'p':
+      if (GpuMemory::instance().dump("gpu_memory.txt")) {
+        std::cout<<"GPU memory: "<<GpuMemory::instance().total() / (1024 * 1024)<<" MB, report written to gpu_memory.txt"<<std::endl;
+      }
+      ResourceCache::instance().print_stats(std::cout);
+      Mesh::print_arena_stats(std::cout);
+      std::cout<<"Scene batch: "<<batch.num_objects()<<" objects, "<<batch.num_draws()<<" draws in "
+               <<global.batch_calls<<" calls"<<(IndirectBatch::multi_draw_supported() ? "" : " (no multi draw indirect)")<<std::endl;
+      std::cout<<"Render queue: "<<queue.stats().draws<<" draws, "<<queue.stats().programs<<" programs, "
+               <<queue.stats().textures<<" textures, "<<queue.stats().meshes<<" meshes, "
+               <<queue.stats().objects<<" objects"<<std::endl;
+      GlState::print_stats(std::cout, global.gl_stats);
+      std::cout<<"Lights: "<<light_clusters.stats().lights<<" of "<<light_clusters.size()<<" in view, "
+               <<light_clusters.stats().references<<" cluster references, at most "
+               <<light_clusters.stats().max_lights<<" per cluster, binned in "
+               <<light_clusters.stats().milliseconds<<" ms"<<std::endl;
+    break;
+
+    // Cambiamo il numero di luci puntiformi e spot (0, 64, 256, 1024)
+    case 'l':
+      global.num_lights = (global.num_lights == 0) ? 64 : global.num_lights * 4;
+      if (global.num_lights > global.MAX_SCENE_LIGHTS) global.num_lights = 0;
+      build_lights(global.num_lights);
+      std::cout<<"Lights: "<<global.num_lights<<std::endl;
+    break;
+
+    // Misuriamo il tempo di frame del modello corrente
+    case 'r':
+      benchmark_frames(global.BENCH_FRAMES);
+    break;
+
     case 't':
     case 'b':
     case 'g': 
     case 'k':
     case 'm':
     case 'f':
+    case 'i':
+    case 'x':
+    case 'q':
       MODEL_TO_RENDER = key;
     break;
   }
@@ -393,6 +774,31 @@ void MyMouse(int x, int y) {
   glutPostRedisplay();
 }
 
+// Con il tasto sinistro cerchiamo il triangolo del modello visibile 
+// colpito dal raggio che passa per il centro della vista. Il cursore è
+// nascosto e riportato al centro ad ogni movimento (vedi MyMouse), quindi 
+// la posizione del click non indica il punto mirato
+void MyMouseButton(int button, int state, int x, int y) {
+  if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN || global.visible_mesh == nullptr) return;
+
+  glm::vec3 origin, direction;
+  global.camera.ray(0.0f, 0.0f, origin, direction);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  Bvh::Hit hit;
+  bool found = global.visible_mesh->raycast(origin, direction, global.visible_model, hit);
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (found) {
+    std::cout<<"Picked "<<global.visible_mesh->name()<<": triangle "<<hit.triangle
+             <<" (submesh "<<global.visible_mesh->triangle_submesh(hit.triangle)<<"), distance "
+             <<hit.t<<" in "<<elapsed.count()<<" us"<<std::endl;
+  }
+  else {
+    std::cout<<"Nothing picked ("<<elapsed.count()<<" us)"<<std::endl;
+  }
+}
+
 
 // Funzione globale che si occupa di gestire la chiusura della finestra.
 void MyClose(void) {
@@ -405,6 +811,27 @@ void MyClose(void) {
 
 int main(int argc, char* argv[])
 {
+  // Con --bench-obj confrontiamo la velocità di import dei file OBJ più 
+  // grandi tra Assimp e il parser dedicato, senza aprire la finestra.
+  // Misuriamo a parte il caso di più file caricati insieme, in cui il 
+  // parsing a blocchi di ogni file non è parallelo (vedi load_meshes)
+  if (argc > 1 && std::string(argv[1]) == "--bench-obj") {
+    const unsigned int flags = aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices;
+    // I due import devono dare lo stesso risultato: boot.obj e hair_vac.obj
+    // sono divisi in gruppi (g)
+    bool same = Mesh::benchmark_import("models/marius/head.obj", flags);
+    same = Mesh::benchmark_import("models/marius/hair_vac.obj", flags) && same;
+    same = Mesh::benchmark_import("models/boot/boot.obj", flags) && same;
+
+    std::vector<std::string> batch;
+    batch.push_back("models/marius/head.obj");
+    batch.push_back("models/marius/hair_vac.obj");
+    batch.push_back("models/boot/boot.obj");
+    batch.push_back("models/skull.obj");
+    Mesh::benchmark_batch_import(batch, flags);
+    return same ? 0 : 1;
+  }
+
   init(argc,argv);
 
   create_scene();
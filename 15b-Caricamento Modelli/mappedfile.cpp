@@ -0,0 +1,106 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _handle(nullptr) {}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &FileName) {
+	close();
+
+	HANDLE file = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return false;
+
+	void *ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (ptr == NULL) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	_data = static_cast<const unsigned char*>(ptr);
+	_size = static_cast<size_t>(size.QuadPart);
+	_handle = mapping;
+
+	return true;
+}
+
+void MappedFile::close() {
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+		CloseHandle(static_cast<HANDLE>(_handle));
+	}
+	_data = nullptr;
+	_size = 0;
+	_handle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &FileName) {
+	close();
+
+	int fd = ::open(FileName.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// Il descrittore non serve più: la mappatura resta valida
+	::close(fd);
+	if (ptr == MAP_FAILED) return false;
+
+	_data = static_cast<const unsigned char*>(ptr);
+	_size = static_cast<size_t>(st.st_size);
+
+	return true;
+}
+
+void MappedFile::close() {
+	if (_data != nullptr) {
+		munmap(const_cast<unsigned char*>(_data), _size);
+	}
+	_data = nullptr;
+	_size = 0;
+	_handle = nullptr;
+}
+
+#endif
+
+const unsigned char *MappedFile::data() const {
+	return _data;
+}
+
+size_t MappedFile::size() const {
+	return _size;
+}
+
+bool MappedFile::is_open() const {
+	return _data != nullptr;
+}
@@ -0,0 +1,62 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+/**
+	Classe di supporto che mappa in memoria (in sola lettura) il contenuto
+	di un file. I dati restano accessibili fino alla chiusura del file o
+	alla distruzione dell'oggetto.
+*/
+class MappedFile {
+public:
+	/**
+		Costruttore
+	*/
+	MappedFile();
+
+	/**
+		Distruttore. Rilascia la mappatura se presente.
+	*/
+	~MappedFile();
+
+	/**
+		Mappa in memoria il file indicato.
+
+		@param FileName nome del file
+		@return true se il file è stato mappato correttamente
+	*/
+	bool open(const std::string &FileName);
+
+	/**
+		Rilascia la mappatura del file.
+	*/
+	void close();
+
+	/**
+		Ritorna il puntatore al primo byte del file.
+	*/
+	const unsigned char *data() const;
+
+	/**
+		Ritorna la dimensione del file in byte.
+	*/
+	size_t size() const;
+
+	/**
+		Controlla se un file è attualmente mappato.
+	*/
+	bool is_open() const;
+
+private:
+	const unsigned char *_data; ///<< Inizio della zona mappata
+	size_t _size;               ///<< Dimensione del file
+	void *_handle;              ///<< Handle dipendente dal sistema operativo
+
+	// Blocchiamo le operazioni di copia: la mappatura non è condivisibile
+	MappedFile&operator=(const MappedFile &other);
+	MappedFile(const MappedFile &other);
+};
+
+#endif
@@ -1,9 +1,84 @@
 
 #include "mesh.h"
+#include "meshcache.h"
+#include "threadpool.h"
+#include "meshopt.h"
+#include "camera.h"
+#include "objloader.h"
+#include "resourcecache.h"
+#include "gpumemory.h"
+#include "instancebuffer.h"
+#include "indirectbatch.h"
+#include "renderqueue.h"
+#include "glstate.h"
 
 #include "assimp/Importer.hpp" // Assimp Importer object
 
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <set>
+#include <memory>
+#include <sstream>
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+/**
+    Ritorna la memoria residente attuale del processo in byte (0 se non 
+    disponibile)
+*/
+static size_t memory_usage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize;
+#elif defined(__linux__)
+    // La seconda voce di statm è il numero di pagine residenti
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+/**
+    Ritorna il picco della memoria residente del processo in byte (0 se 
+    non disponibile). E' il massimo dall'avvio del processo, non di una
+    singola operazione.
+*/
+static size_t peak_memory_usage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
 
 std::ostream &operator<<(std::ostream &os, const Mesh::Vertex &v) {
     os<<"["<<v.position.x<<", "<<v.position.y<<", "<<v.position.z<<"] ";
@@ -19,166 +94,2078 @@ Mesh::Vertex::Vertex(const glm::vec3& p, const glm::vec3& n,const glm::vec2& t)
     position(p), textcoord(t), normal(n) {
 }
 
-Mesh::Mesh(): _VAO(-1), _VBO(-1), _IBO(-1), _num_indices(0) {
+Mesh::MeshData::MeshData() : bbox_min(0.0f), bbox_max(0.0f), sphere_center(0.0f), sphere_radius(0.0f),
+    index_size(sizeof(unsigned int)), quantized(false) {}
+
+size_t Mesh::MeshData::vertex_bytes() const {
+    return vertices.size() * (quantized ? sizeof(PackedVertex) : sizeof(Vertex));
+}
+
+size_t Mesh::MeshData::index_bytes() const {
+    return indices.size() * index_size;
+}
+
+Mesh::Mesh(): _drawn_meshlets(0), _culled_meshlets(0), _blank_material(-1), _has_transparency(false),
+    _has_strips(false), _index_size(sizeof(unsigned int)),
+    _bbox_min(0.0f), _bbox_max(0.0f), _sphere_center(0.0f), _sphere_radius(0.0f), _quantized(false), _position_scale(1.0f), _position_bias(0.0f),
+    _resident(false), _has_placeholder(false), _streaming(false), _arena(nullptr), _VAO(-1), _VBO(-1), _IBO(-1) {
 }
 
 
 Mesh::~Mesh() {
+    if (_streaming) cancel_async(*this);
     clear();
 }
 
 void Mesh::clear() { 
-    glDeleteBuffers(1, &_VBO); _VBO = -1;
-    glDeleteBuffers(1, &_IBO); _IBO = -1;
-    glDeleteVertexArrays(1, &_VAO); _VAO = -1;
-    _num_indices = 0;
+    if (_arena != nullptr) {
+        // I buffer sono dell'arena: restituiamo solo l'intervallo
+        _arena->free(_arena_range);
+        _arena = nullptr;
+        _arena_range = GeometryArena::Range();
+        _VBO = _IBO = _VAO = -1;
+    }
+    else {
+        GpuMemory::instance().release_buffer(_VBO);
+        GpuMemory::instance().release_buffer(_IBO);
+        GlState::instance().delete_buffer(_VBO); _VBO = -1;
+        GlState::instance().delete_buffer(_IBO); _IBO = -1;
+        GlState::instance().delete_vertex_array(_VAO); _VAO = -1;
+    }
+
+    // Le texture sono distrutte quando l'ultimo modello che le usa le rilascia
+    _materials.clear();
+    _submeshes.clear();
+    _lods.clear();
+    _meshlets.clear();
+    _drawn_meshlets = _culled_meshlets = 0;
+    _blank_material = -1;
+    _has_transparency = false;
+    _has_strips = false;
+    _index_size = sizeof(unsigned int);
+    _bbox_min = _bbox_max = glm::vec3(0.0f);
+    _sphere_center = glm::vec3(0.0f);
+    _sphere_radius = 0.0f;
+    _quantized = false;
+    _position_scale = glm::vec3(1.0f);
+    _position_bias  = glm::vec3(0.0f);
+    _resident = false;
+    _has_placeholder = false;
+    _name.clear();
+    _bvh.clear();
+    _triangle_offsets.clear();
+}
+
+
+/**
+    Stato di un caricamento in corso: prodotto in parallelo da prepare()
+    e consumato sul thread OpenGL da finish() (o, per i caricamenti 
+    asincroni, a passi da stream_step())
+*/
+struct Mesh::PendingLoad {
+    LoadRequest   request;
+
+    MeshCache     cache;
+    MeshCacheView view;       ///< Dati letti dalla cache (se from_cache)
+    MeshData      data;       ///< Dati importati con Assimp (se !from_cache)
+    bool          from_cache;
+    bool          ok;
+    size_t        uploaded;   ///< Byte trasferiti nei buffer OpenGL
+    std::ostringstream log;   ///< Messaggi stampati al termine del caricamento
+    Bvh           bvh;        ///< BVH dei triangoli (con BUILD_BVH)
+    std::vector<unsigned int> triangle_offsets; ///< Primo triangolo della BVH di ogni sotto-mesh
+
+    // Stato dei caricamenti asincroni
+    ImageMap      images;     ///< Texture decodificate dal thread in background
+    bool          prefetch;   ///< Caricamento anticipato (priorità bassa)
+    bool          cancelled;  ///< Annullato mentre era in preparazione
+    bool          started;    ///< Oggetti OpenGL già creati
+    size_t        vertices_written; ///< Vertici già trasferiti
+    size_t        indices_written;  ///< Indici già trasferiti
+    std::chrono::steady_clock::time_point start;
+
+    explicit PendingLoad(const LoadRequest &r) :
+        // BUILD_BVH e GEOMETRY_ARENA non cambiano il contenuto della cache
+        request(r), cache(r.filenames, r.flags, r.options & ~(BUILD_BVH | GEOMETRY_ARENA), r.settings()), from_cache(false), ok(true),
+        uploaded(0), prefetch(false), cancelled(false), started(false), vertices_written(0), 
+        indices_written(0), start(std::chrono::steady_clock::now()) {}
+
+    ~PendingLoad() {
+        for (ImageMap::iterator it = images.begin() ; it != images.end() ; ++it) {
+            Texture::release(it->second);
+        }
+    }
+
+    const std::vector<std::string> &textures() const {
+        return from_cache ? view.textures : data.textures;
+    }
+
+    size_t num_vertices() const {
+        return from_cache ? view.num_vertices : data.vertices.size();
+    }
+
+    size_t num_indices() const {
+        return from_cache ? view.num_indices : data.indices.size();
+    }
+
+    bool quantized() const {
+        return (request.options & QUANTIZE_VERTICES) != 0;
+    }
+
+    size_t vertex_size() const {
+        return quantized() ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+
+    size_t index_size() const {
+        return from_cache ? view.index_size : data.index_size;
+    }
+};
+
+/**
+    Coda dei caricamenti asincroni. Il thread in background prende le 
+    richieste da queued (prima quelle che non sono prefetch), esegue 
+    prepare() e la decodifica delle texture e le sposta in ready. Il thread
+    OpenGL le sposta in uploads e le trasferisce sulla GPU a passi in 
+    update_streaming().
+*/
+struct Mesh::StreamQueue {
+    typedef std::vector<std::unique_ptr<PendingLoad> > LoadList;
+
+    std::mutex   mutex;
+    std::condition_variable cv;
+    LoadList     queued;      ///< In attesa del thread in background
+    PendingLoad *preparing;   ///< In preparazione nel thread in background
+    LoadList     ready;       ///< Pronti per il trasferimento sulla GPU
+    LoadList     uploads;     ///< In trasferimento (usata solo dal thread OpenGL)
+    bool         quit;
+    std::thread  worker;
+
+    StreamQueue() : preparing(nullptr), quit(false) {
+        // Il pool usato da prepare() e la cache delle risorse usata dal 
+        // thread in background devono essere distrutti dopo la coda
+        ThreadPool::instance();
+        ResourceCache::instance();
+        worker = std::thread(&Mesh::stream_worker, std::ref(*this));
+    }
+
+    ~StreamQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        worker.join();
+
+        // Le mesh sopravvivono alla coda (sono distrutte dopo): non devono 
+        // cercare di annullare i loro caricamenti
+        LoadList *lists[] = { &queued, &ready, &uploads };
+        for (LoadList *list : lists) {
+            for (unsigned int i = 0 ; i < list->size() ; i++) {
+                (*list)[i]->request.mesh->_streaming = false;
+            }
+        }
+    }
+};
+
+Mesh::LoadRequest::LoadRequest(Mesh &m, const std::string &filename, unsigned int f, unsigned int o) :
+    mesh(&m), filenames(1, filename), flags(f), options(o), overdraw_threshold(1.05f),
+    lod_levels(5), lod_max_error(0.05f), meshlet_max_vertices(64), meshlet_max_triangles(124),
+    weld_position_epsilon(1e-6f), weld_normal_epsilon(1e-3f), weld_uv_epsilon(1e-5f) {}
+
+Mesh::LoadRequest::LoadRequest(Mesh &m, const std::vector<std::string> &files, unsigned int f, unsigned int o) :
+    mesh(&m), filenames(files), flags(f), options(o), overdraw_threshold(1.05f),
+    lod_levels(5), lod_max_error(0.05f), meshlet_max_vertices(64), meshlet_max_triangles(124),
+    weld_position_epsilon(1e-6f), weld_normal_epsilon(1e-3f), weld_uv_epsilon(1e-5f) {}
+
+Mesh::LoadRequest::LoadRequest(const std::vector<std::string> &files, unsigned int f, unsigned int o) :
+    mesh(nullptr), filenames(files), flags(f), options(o), overdraw_threshold(1.05f),
+    lod_levels(5), lod_max_error(0.05f), meshlet_max_vertices(64), meshlet_max_triangles(124),
+    weld_position_epsilon(1e-6f), weld_normal_epsilon(1e-3f), weld_uv_epsilon(1e-5f) {}
+
+unsigned int Mesh::LoadRequest::settings() const {
+    // Hash FNV-1a dei parametri delle sole opzioni attive
+    unsigned int h = 2166136261u;
+
+    auto mix = [&h](const void *data, size_t bytes) {
+        const unsigned char *p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0 ; i < bytes ; i++) {
+            h = (h ^ p[i]) * 16777619u;
+        }
+    };
+
+    if (options & OPTIMIZE_OVERDRAW) {
+        mix(&overdraw_threshold, sizeof(overdraw_threshold));
+    }
+
+    if (options & GENERATE_LODS) {
+        mix(&lod_levels, sizeof(lod_levels));
+        mix(&lod_max_error, sizeof(lod_max_error));
+    }
+
+    if (options & WELD_VERTICES) {
+        mix(&weld_position_epsilon, sizeof(weld_position_epsilon));
+        mix(&weld_normal_epsilon, sizeof(weld_normal_epsilon));
+        mix(&weld_uv_epsilon, sizeof(weld_uv_epsilon));
+    }
+
+    if (options & BUILD_MESHLETS) {
+        mix(&meshlet_max_vertices, sizeof(meshlet_max_vertices));
+        mix(&meshlet_max_triangles, sizeof(meshlet_max_triangles));
+    }
+
+    return h;
 }
 
 
-bool Mesh::load_mesh(const std::string& Filename, unsigned int flags)
+bool Mesh::load_mesh(const std::string& Filename, unsigned int flags, unsigned int options)
 {
-    // Release the previously loaded mesh (if it exists)
-    clear();
-    
-    bool Ret = false;
-    Assimp::Importer Importer;
+    return load_mesh(std::vector<std::string>(1, Filename), flags, options);
+}
 
-    std::cout << "Loading '" << Filename << "'" << std::endl;
-    const aiScene* pScene = Importer.ReadFile(Filename.c_str(), flags);//aiProcess_Triangulate | aiProcess_GenSmoothNormals);// | aiProcess_FlipUVs);
+bool Mesh::load_mesh(const std::vector<std::string>& Filenames, unsigned int flags, unsigned int options)
+{
+    return load_meshes(std::vector<LoadRequest>(1, LoadRequest(*this, Filenames, flags, options)));
+}
+
+bool Mesh::load_meshes(const std::vector<LoadRequest>& requests)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Il picco è quello del processo: per isolare il caricamento lo 
+    // confrontiamo con la memoria residente e il picco all'inizio
+    const size_t start_memory = memory_usage();
+    const size_t start_peak = peak_memory_usage();
+
+    std::vector<std::unique_ptr<PendingLoad> > loads;
+
+    for (unsigned int i = 0 ; i < requests.size() ; i++) {
+        // Release the previously loaded mesh (if it exists)
+        if (requests[i].mesh->_streaming) cancel_async(*requests[i].mesh);
+        requests[i].mesh->clear();
+        loads.push_back(std::unique_ptr<PendingLoad>(new PendingLoad(requests[i])));
+    }
 
-    std::string Filepath = get_file_path(Filename);
+    ThreadPool &pool = ThreadPool::instance();
 
-    if (pScene) {
-        Ret = init_from_scene(pScene, Filepath);
+    // Fase 1 (parallela): lettura della cache o import con Assimp e 
+    // conversione dei vertici. Un parallel_for annidato è eseguito 
+    // sequenzialmente: con meno modelli che thread conviene lasciare il 
+    // pool ai cicli interni (parsing OBJ a blocchi, BVH, conversione dei 
+    // vertici) e preparare i modelli uno alla volta
+    const bool per_model = loads.size() >= pool.size();
+    std::chrono::steady_clock::time_point prepare_start = std::chrono::steady_clock::now();
+    if (per_model) {
+        pool.parallel_for(loads.size(), [&](unsigned int i) {
+            prepare(*loads[i]);
+        });
     }
     else {
-        std::cout<<"Error loading "<<Filename<<" : "<<Importer.GetErrorString()<<std::endl;
+        for (unsigned int i = 0 ; i < loads.size() ; i++) prepare(*loads[i]);
+    }
+    std::chrono::duration<double, std::milli> prepare_elapsed = std::chrono::steady_clock::now() - prepare_start;
+
+    // Fase 2 (parallela): decodifica delle texture. Ogni immagine viene 
+    // decodificata una sola volta anche se usata da più modelli e le 
+    // texture già sulla GPU (vedi ResourceCache) non sono decodificate
+    ResourceCache &cache = ResourceCache::instance();
+    std::vector<std::string> paths;
+    std::set<std::string> unique_paths;
+    for (unsigned int i = 0 ; i < loads.size() ; i++) {
+        const std::vector<std::string> &textures = loads[i]->textures();
+        for (unsigned int t = 0 ; t < textures.size() ; t++) {
+            const std::string path = textures[t].empty() ? "white.png" : textures[t];
+            if (cache.has_texture(path)) continue;
+            if (unique_paths.insert(path).second) paths.push_back(path);
+        }
+    }
+
+    std::vector<Texture::Image> decoded(paths.size());
+    pool.parallel_for(paths.size(), [&](unsigned int i) {
+        Texture::decode(paths[i], decoded[i]);
+    });
+
+    ImageMap images;
+    for (unsigned int i = 0 ; i < paths.size() ; i++) {
+        if (decoded[i].pixels != nullptr) images[paths[i]] = decoded[i];
+    }
+
+    // Fase 3 (thread OpenGL): creazione degli oggetti OpenGL e upload
+    bool Ret = true;
+    size_t uploaded = 0;
+    for (unsigned int i = 0 ; i < loads.size() ; i++) {
+        Ret = loads[i]->request.mesh->finish(*loads[i], images) && Ret;
+        uploaded += loads[i]->uploaded;
+    }
+
+    for (ImageMap::iterator it = images.begin() ; it != images.end() ; ++it) {
+        Texture::release(it->second);
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout<<"Loaded "<<loads.size()<<" model(s) in "<<elapsed.count()<<" ms ("
+             <<pool.size()<<" threads), prepared in "<<prepare_elapsed.count()<<" ms "
+             <<(per_model ? "(one thread per model)" : "(one model at a time)")<<std::endl;
+    std::cout<<uploaded / (1024 * 1024)<<" MB of vertex and index data, ";
+
+    // Se il picco del processo è cresciuto è stato raggiunto durante il 
+    // caricamento: la differenza con la memoria iniziale è la crescita 
+    // dovuta al caricamento. Altrimenti sappiamo solo che il caricamento
+    // è rimasto sotto il picco precedente.
+    const size_t peak = peak_memory_usage();
+    std::cout<<"process high-water mark "<<peak / (1024 * 1024)<<" MB";
+    if (peak <= start_peak) {
+        std::cout<<" (not raised by this load)";
+    }
+    else if (start_memory != 0) {
+        std::cout<<" (+"<<(peak - std::min(start_memory, peak)) / (1024 * 1024)<<" MB during this load)";
     }
+    std::cout<<std::endl;
 
     return Ret;
 }
 
-bool Mesh::init_from_scene(const aiScene* pScene, const std::string& Filepath) {  
+void Mesh::prepare(PendingLoad &load) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    // Copiamo i dati dal formato Assimp agli array di vertici e indici
-    //
-    // NOTA: CONSIDERIAMO SOLO *UNA* MESH E LA RELATIVA TEXTURE COLORE 
+    if (load.cache.open(load.view)) {
+        load.log << "Loading '" << load.cache.filename() << "'" << std::endl;
+        load.from_cache = true;
+    }
+    else {
+        const LoadRequest &request = load.request;
 
-    bool Ret = true;
-    std::vector<Vertex>       Vertices;
-    std::vector<unsigned int> Indices;
+        for (unsigned int f = 0 ; f < request.filenames.size() ; f++) {
+            load.ok = import_file(request.filenames[f], request.flags, load.data, load.log) && load.ok;
+        }
 
-    const aiMesh* paiMesh = pScene->mMeshes[0]; // consideriamo solo una mesh (mesh 0)
+        compute_bounding_sphere(load.data);
 
-    const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+        optimize(load.data, request, load.log);
+
+        if (load.ok && !load.data.indices.empty() && !load.cache.write(load.data)) {
+            load.log<<"  Unable to write cache file '"<<load.cache.filename()<<"'"<<std::endl;
+        }
+    }
 
-    for (unsigned int i = 0 ; i < paiMesh->mNumVertices ; i++) {
-        const aiVector3D* pPos      = &(paiMesh->mVertices[i]);
-        const aiVector3D* pNormal   = &(paiMesh->mNormals[i]);
-        const aiVector3D* pTexCoord = paiMesh->HasTextureCoords(0) ? &(paiMesh->mTextureCoords[0][i]) : &Zero3D;
+    if (load.ok && (load.request.options & BUILD_BVH)) {
+        build_bvh(load);
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    load.log<<"  Parsed in "<<elapsed.count()<<" ms"<<std::endl;
+}
+
+bool Mesh::finish(PendingLoad &load, const ImageMap &images) {
+    // Senza limiti di tempo trasferiamo tutto in una volta, con la 
+    // conversione divisa tra i thread del pool
+    bool Ret = begin_upload(load, images) &&
+               upload_range(load, true, 0, load.num_vertices(), true) &&
+               upload_range(load, false, 0, load.num_indices(), true);
+
+    if (!Ret) return false;
+
+    end_upload(load);
+
+    return load.ok;
+}
 
-        Vertex v(glm::vec3(pPos->x, pPos->y, pPos->z),
-                 glm::vec3(pNormal->x, pNormal->y, pNormal->z),
-                 glm::vec2(pTexCoord->x, pTexCoord->y));
+bool Mesh::begin_upload(PendingLoad &load, const ImageMap &images) {
+    std::cout << load.log.str();
 
-        Vertices.push_back(v);
+    if (load.from_cache) {
+        // I dati della cache sono passati direttamente alla GPU dalla 
+        // memoria mappata
+        _submeshes = load.view.submeshes;
+        _lods      = load.view.lods;
+        _meshlets  = load.view.meshlets;
+        _bbox_min  = load.view.bbox_min;
+        _bbox_max  = load.view.bbox_max;
+        _sphere_center = load.view.sphere_center;
+        _sphere_radius = load.view.sphere_radius;
     }
+    else {
+        const MeshData &data = load.data;
+
+        if (data.indices.empty()) return false;
 
-    for (unsigned int i = 0 ; i < paiMesh->mNumFaces ; i++) {
-        const aiFace& Face = paiMesh->mFaces[i];
-        assert(Face.mNumIndices == 3);
-        Indices.push_back(Face.mIndices[0]);
-        Indices.push_back(Face.mIndices[1]);
-        Indices.push_back(Face.mIndices[2]);
+        _submeshes = data.submeshes;
+        _lods      = data.lods;
+        _meshlets  = data.meshlets;
+        _bbox_min  = data.bbox_min;
+        _bbox_max  = data.bbox_max;
+        _sphere_center = data.sphere_center;
+        _sphere_radius = data.sphere_radius;
     }
 
-    _num_indices = Indices.size(); 
+    // La scala di dequantizzazione è impostata solo in end_upload(): fino
+    // ad allora position_scale() e position_bias() servono al segnaposto
+    _quantized    = load.quantized();
+    _index_size   = load.index_size();
+    load.uploaded = load.num_vertices() * load.vertex_size() + load.num_indices() * load.index_size();
 
-    // Creiamo e bindiamo gli oggetti OpenGL
+    // Nome usato nel report della memoria GPU (vedi GpuMemory)
+    const std::vector<std::string> &files = load.request.filenames;
+    _name = files.empty() ? std::string() : files[0];
+    if (files.size() > 1) _name += " (+" + std::to_string(files.size() - 1) + ")";
 
-    glGenVertexArrays(1, &_VAO);
-    glBindVertexArray(_VAO);
+    init_materials(load.textures(), images);
 
-    glGenBuffers(1, &_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
+    return init_buffers(load.num_vertices(), load.num_indices(), (load.request.options & GEOMETRY_ARENA) != 0);
+}
 
-    glGenBuffers(1, &_IBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _IBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+bool Mesh::upload_range(PendingLoad &load, bool vertices, size_t first, size_t count, bool parallel) {
+    GlState &state = GlState::instance();
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, position));
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, normal));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, textcoord));
+    if (count == 0) return true;
+
+    const size_t element = vertices ? load.vertex_size() : load.index_size();
+
+    // Nelle arene l'intervallo del modello non inizia dal primo elemento
+    const size_t base = vertices ? _arena_range.first_vertex : _arena_range.first_index;
+
+    // L'intervallo non è ancora usato per il rendering: possiamo mapparlo
+    // senza sincronizzazione con la GPU. GL_COPY_WRITE_BUFFER non 
+    // modifica lo stato del VAO
+    state.bind_buffer(GL_COPY_WRITE_BUFFER, vertices ? _VBO : _IBO);
+    void *memory = glMapBufferRange(GL_COPY_WRITE_BUFFER, (base + first) * element, count * element,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+    if (memory == nullptr) {
+        state.bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+        std::cout<<"  Unable to map the "<<(vertices ? "vertex" : "index")<<" buffer"<<std::endl;
+        return false;
+    }
+
+    if (load.from_cache) {
+        const void *source = vertices ? load.view.vertices : load.view.indices;
+        memcpy(memory, static_cast<const char*>(source) + first * element, count * element);
+    }
+    else {
+        // La conversione nel formato finale scrive direttamente nella 
+        // memoria del buffer, a blocchi
+        const size_t block = 65536;
+        const MeshData &data = load.data;
 
-    glBindVertexArray(0);
+        auto write_block = [&](unsigned int b) {
+            size_t begin = size_t(b) * block;
+            size_t n = std::min(block, count - begin);
+            void *destination = static_cast<char*>(memory) + begin * element;
 
-    // Carichiamo la texture
-    // Consideriamo solo un materiale che ha una texture diffusiva
-    for (unsigned int i = 1 ; i < pScene->mNumMaterials ; i++) {
+            if (vertices) write_vertices(data, first + begin, n, destination);
+            else          write_indices(data, first + begin, n, destination);
+        };
+
+        const unsigned int num_blocks = (count + block - 1) / block;
+        if (parallel) {
+            ThreadPool::instance().parallel_for(num_blocks, write_block);
+        }
+        else {
+            for (unsigned int b = 0 ; b < num_blocks ; b++) write_block(b);
+        }
+    }
 
-        const aiMaterial* pMaterial = pScene->mMaterials[i];
-        
-        aiString materialName;
+    // glUnmapBuffer ritorna GL_FALSE se il contenuto del buffer è andato
+    // perso mentre era mappato
+    bool ok = (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE);
+    state.bind_buffer(GL_COPY_WRITE_BUFFER, 0);
 
-        pMaterial->Get(AI_MATKEY_NAME, materialName);
+    if (!ok) std::cout<<"  Unable to write the "<<(vertices ? "vertex" : "index")<<" buffer"<<std::endl;
 
-        //std::cout<< i << " " << materialName.data << std::endl;
+    return ok;
+}
 
-        if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-            aiString Path;
+void Mesh::end_upload(PendingLoad &load) {
+    init_dequantization(load.quantized());
 
-            if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string data = Path.data;
+    // I dati lato CPU non servono più: li liberiamo prima di caricare i 
+    // modelli successivi
+    load.data = MeshData();
 
-                std::string FullPath = Filepath + "/" + data;
+    _bvh.swap(load.bvh);
+    _triangle_offsets.swap(load.triangle_offsets);
 
-                if (!_texture.load(FullPath.c_str())) {
-                    std::cout<<"  Error loading texture '"<<FullPath<<"'"<<std::endl;
-                }
-                else {
-                    std::cout<<"  Loaded texture '"<<FullPath<<"'"<<std::endl;
+    _resident = true;
+    _has_placeholder = false;
+    _streaming = false;
+}
+
+Mesh::StreamQueue &Mesh::stream_queue() {
+    static StreamQueue queue;
+    return queue;
+}
+
+void Mesh::load_async(const LoadRequest &request, bool prefetch) {
+    Mesh &mesh = *request.mesh;
+
+    // Un nuovo caricamento sostituisce quello eventualmente in corso
+    if (mesh._streaming) cancel_async(mesh);
+    mesh.clear();
+
+    std::unique_ptr<PendingLoad> load(new PendingLoad(request));
+    load->prefetch = prefetch;
+    mesh._streaming = true;
+
+    StreamQueue &queue = stream_queue();
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.queued.push_back(std::move(load));
+    }
+    queue.cv.notify_one();
+}
+
+void Mesh::cancel_async(Mesh &mesh) {
+    StreamQueue &queue = stream_queue();
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    StreamQueue::LoadList *lists[] = { &queue.queued, &queue.ready, &queue.uploads };
+    for (StreamQueue::LoadList *list : lists) {
+        for (unsigned int i = 0 ; i < list->size() ; ) {
+            if ((*list)[i]->request.mesh == &mesh) list->erase(list->begin() + i);
+            else i++;
+        }
+    }
+
+    // Il thread in background scarta il risultato al termine di prepare()
+    if (queue.preparing != nullptr && queue.preparing->request.mesh == &mesh) {
+        queue.preparing->cancelled = true;
+    }
+
+    mesh._streaming = false;
+}
+
+void Mesh::request_residency() {
+    if (!_streaming) return;
+
+    StreamQueue &queue = stream_queue();
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    StreamQueue::LoadList *lists[] = { &queue.queued, &queue.ready, &queue.uploads };
+    for (StreamQueue::LoadList *list : lists) {
+        for (unsigned int i = 0 ; i < list->size() ; i++) {
+            if ((*list)[i]->request.mesh == this) (*list)[i]->prefetch = false;
+        }
+    }
+
+    if (queue.preparing != nullptr && queue.preparing->request.mesh == this) {
+        queue.preparing->prefetch = false;
+    }
+}
+
+bool Mesh::is_resident() const {
+    return _resident;
+}
+
+void Mesh::stream_worker(StreamQueue &queue) {
+    for (;;) {
+        std::unique_ptr<PendingLoad> load;
+
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.cv.wait(lock, [&]{ return queue.quit || !queue.queued.empty(); });
+            if (queue.quit) return;
+
+            // Le richieste passano davanti ai prefetch; a parità di 
+            // priorità vale l'ordine di arrivo
+            unsigned int next = 0;
+            for (unsigned int i = 0 ; i < queue.queued.size() ; i++) {
+                if (!queue.queued[i]->prefetch) {
+                    next = i;
                     break;
                 }
             }
+
+            load = std::move(queue.queued[next]);
+            queue.queued.erase(queue.queued.begin() + next);
+            queue.preparing = load.get();
+        }
+
+        prepare(*load);
+
+        // Decodifichiamo le texture qui, in modo che sul thread OpenGL 
+        // resti solo l'upload (quelle già sulla GPU sono solo condivise)
+        std::vector<std::string> paths;
+        const std::vector<std::string> &textures = load->textures();
+        for (unsigned int t = 0 ; t < textures.size() ; t++) {
+            const std::string path = textures[t].empty() ? "white.png" : textures[t];
+            if (ResourceCache::instance().has_texture(path)) continue;
+            if (std::find(paths.begin(), paths.end(), path) == paths.end()) paths.push_back(path);
+        }
+
+        std::vector<Texture::Image> decoded(paths.size());
+        ThreadPool::instance().parallel_for(paths.size(), [&](unsigned int i) {
+            Texture::decode(paths[i], decoded[i]);
+        });
+
+        for (unsigned int i = 0 ; i < paths.size() ; i++) {
+            if (decoded[i].pixels != nullptr) load->images[paths[i]] = decoded[i];
         }
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.preparing = nullptr;
+        if (!load->cancelled) queue.ready.push_back(std::move(load));
     }
+}
 
-    if (!_texture.is_valid()) {
-        Ret = _texture.load("white.png");
-        std::cout<<"  Loaded blank texture."<<std::endl;
+bool Mesh::update_streaming(size_t byte_budget) {
+    StreamQueue &queue = stream_queue();
+
+    const unsigned int first_ready = queue.uploads.size();
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (unsigned int i = 0 ; i < queue.ready.size() ; i++) {
+            queue.uploads.push_back(std::move(queue.ready[i]));
+        }
+        queue.ready.clear();
     }
 
-    return Ret;
+    // Il bounding box dei modelli appena preparati è subito disponibile
+    // come segnaposto
+    for (unsigned int i = first_ready ; i < queue.uploads.size() ; i++) {
+        queue.uploads[i]->request.mesh->show_placeholder(*queue.uploads[i]);
+    }
+
+    while (byte_budget > 0 && !queue.uploads.empty()) {
+        // I modelli richiesti passano davanti ai prefetch
+        unsigned int next = 0;
+        for (unsigned int i = 0 ; i < queue.uploads.size() ; i++) {
+            if (!queue.uploads[i]->prefetch) {
+                next = i;
+                break;
+            }
+        }
+
+        PendingLoad &load = *queue.uploads[next];
+        if (load.request.mesh->stream_step(load, byte_budget)) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.uploads.erase(queue.uploads.begin() + next);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    return !queue.queued.empty() || queue.preparing != nullptr || !queue.ready.empty() || !queue.uploads.empty();
 }
 
-std::string Mesh::get_file_path(const std::string &Filename) const {
-    std::string::size_type SlashIndex = Filename.find_last_of("/");
-    std::string Dir;
+bool Mesh::stream_step(PendingLoad &load, size_t &budget) {
+    // Primo passo: oggetti OpenGL e texture. Le texture di un modello 
+    // sono trasferite tutte insieme e consumano il budget del frame
+    if (!load.started) {
+        load.started = true;
 
-    if (SlashIndex == std::string::npos) {
-        Dir = ".";
+        size_t texture_bytes = 0;
+        for (ImageMap::const_iterator it = load.images.begin() ; it != load.images.end() ; ++it) {
+            texture_bytes += size_t(it->second.width) * it->second.height * it->second.channels;
+        }
+        budget -= std::min(budget, texture_bytes);
+
+        bool ok = begin_upload(load, load.images);
+
+        for (ImageMap::iterator it = load.images.begin() ; it != load.images.end() ; ++it) {
+            Texture::release(it->second);
+        }
+        load.images.clear();
+
+        if (!ok) {
+            clear();
+            _streaming = false;
+            return true;
+        }
+
+        return false;
     }
-    else if (SlashIndex == 0) {
-        Dir = "/";
+
+    // Passi successivi: vertici e poi indici, al più budget byte per 
+    // volta (almeno un elemento per garantire l'avanzamento)
+    const bool vertices = load.vertices_written < load.num_vertices();
+    const size_t element = vertices ? load.vertex_size() : load.index_size();
+    size_t &written = vertices ? load.vertices_written : load.indices_written;
+    const size_t total = vertices ? load.num_vertices() : load.num_indices();
+
+    const size_t count = std::min(total - written, std::max<size_t>(1, budget / element));
+
+    if (!upload_range(load, vertices, written, count, false)) {
+        clear();
+        _streaming = false;
+        return true;
+    }
+
+    written += count;
+    budget  -= std::min(budget, count * element);
+
+    if (load.vertices_written < load.num_vertices() || load.indices_written < load.num_indices()) {
+        return false;
+    }
+
+    end_upload(load);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - load.start;
+    std::cout<<"  Resident "<<elapsed.count()<<" ms after the request"<<std::endl;
+
+    return true;
+}
+
+void Mesh::show_placeholder(const PendingLoad &load) {
+    if (load.from_cache) {
+        _bbox_min = load.view.bbox_min;
+        _bbox_max = load.view.bbox_max;
+        _sphere_center = load.view.sphere_center;
+        _sphere_radius = load.view.sphere_radius;
     }
     else {
-        Dir = Filename.substr(0, SlashIndex);
-    }  
-    
-    return Dir;  
+        if (load.data.indices.empty()) return;
+
+        _bbox_min = load.data.bbox_min;
+        _bbox_max = load.data.bbox_max;
+        _sphere_center = load.data.sphere_center;
+        _sphere_radius = load.data.sphere_radius;
+    }
+
+    // Il cubo [-1, 1] del segnaposto è portato sul bounding box dalla 
+    // stessa trasformazione usata per le posizioni quantizzate
+    _position_scale = 0.5f * (_bbox_max - _bbox_min);
+    _position_bias  = 0.5f * (_bbox_max + _bbox_min);
+    _has_placeholder = true;
+}
+
+void Mesh::optimize(MeshData &data, const LoadRequest &request, std::ostream &log) {
+
+    unsigned int options = request.options;
+
+    // L'ottimizzazione dell'overdraw parte da un ordine già ottimizzato 
+    // per la cache
+    if (options & OPTIMIZE_OVERDRAW) options |= OPTIMIZE_VERTEX_CACHE;
+
+    // Le ottimizzazioni successive richiedono vertici condivisi tra i 
+    // triangoli
+    if (options & WELD_VERTICES) {
+        weld_vertices(data, request, log);
+    }
+
+    // I livelli di dettaglio sono aggiunti alla tabella delle sotto-mesh e
+    // passano per le stesse ottimizzazioni del modello completo
+    if (options & GENERATE_LODS) {
+        generate_lods(data, request, log);
+    }
+
+    for (unsigned int s = 0 ; s < data.submeshes.size() ; s++) {
+        const SubMesh &sm = data.submeshes[s];
+        unsigned int *indices = &data.indices[sm.base_index];
+        unsigned int num_vertices = sm.num_vertices;
+
+        if (options & OPTIMIZE_VERTEX_CACHE) {
+            std::vector<unsigned int> optimized(indices, indices + sm.num_indices);
+            optimize_vertex_cache(&optimized[0], optimized.size(), num_vertices);
+
+            float before = compute_acmr(indices, sm.num_indices, num_vertices);
+            float after  = compute_acmr(&optimized[0], optimized.size(), num_vertices);
+
+            // Teniamo il nuovo ordine solo se migliora l'ACMR
+            if (after < before) {
+                std::copy(optimized.begin(), optimized.end(), indices);
+            }
+
+            log<<"  Submesh "<<s<<": ACMR "<<before<<" -> "<<std::min(before, after)<<std::endl;
+        }
+
+        if (options & OPTIMIZE_OVERDRAW) {
+            const float *positions = &data.vertices[sm.base_vertex].position.x;
+
+            float before = compute_overdraw(indices, sm.num_indices, positions, num_vertices, sizeof(Vertex));
+
+            optimize_overdraw(indices, sm.num_indices, positions, num_vertices, sizeof(Vertex), 
+                              request.overdraw_threshold);
+
+            float after = compute_overdraw(indices, sm.num_indices, positions, num_vertices, sizeof(Vertex));
+
+            log<<"  Submesh "<<s<<": overdraw "<<before<<" -> "<<after
+               <<" (ACMR "<<compute_acmr(indices, sm.num_indices, num_vertices)<<")"<<std::endl;
+        }
+    }
+
+    // I cluster sono presi dall'ordine finale dei triangoli
+    if (options & BUILD_MESHLETS) {
+        generate_meshlets(data, request, log);
+    }
+
+    // L'ordine dei vertici segue l'ordine finale degli indici, quindi questo
+    // passo va eseguito per ultimo. Le sotto-mesh vengono compattate in un 
+    // nuovo vettore di vertici.
+    if (options & OPTIMIZE_VERTEX_FETCH) {
+        std::vector<Vertex> vertices;
+        vertices.reserve(data.vertices.size());
+
+        // I livelli di dettaglio condividono i vertici delle sotto-mesh del
+        // modello completo: gli indici di tutti i livelli sono rinumerati 
+        // insieme, seguendo l'ordine del modello completo
+        const unsigned int per_level = data.lods.size() > 1 ? data.lods[1].first_submesh : data.submeshes.size();
+
+        for (unsigned int s = 0 ; s < per_level ; s++) {
+            const SubMesh full = data.submeshes[s];
+            Vertex *first = data.vertices.data() + full.base_vertex;
+
+            std::vector<unsigned int> indices;
+            for (unsigned int l = s ; l < data.submeshes.size() ; l += per_level) {
+                const SubMesh &sm = data.submeshes[l];
+                indices.insert(indices.end(), data.indices.begin() + sm.base_index, 
+                               data.indices.begin() + sm.base_index + sm.num_indices);
+            }
+
+            float before = compute_fetch_efficiency(indices.data(), full.num_indices, full.num_vertices, sizeof(Vertex));
+
+            unsigned int used = optimize_vertex_fetch(first, indices.data(), indices.size(), full.num_vertices, sizeof(Vertex));
+
+            float after = compute_fetch_efficiency(indices.data(), full.num_indices, used, sizeof(Vertex));
+
+            log<<"  Submesh "<<s<<": fetch efficiency "<<before<<" -> "<<after
+               <<", vertices "<<full.num_vertices<<" -> "<<used<<std::endl;
+
+            size_t offset = 0;
+            for (unsigned int l = s ; l < data.submeshes.size() ; l += per_level) {
+                SubMesh &sm = data.submeshes[l];
+                std::copy(indices.begin() + offset, indices.begin() + offset + sm.num_indices, 
+                          data.indices.begin() + sm.base_index);
+                offset += sm.num_indices;
+
+                sm.base_vertex  = vertices.size();
+                sm.num_vertices = used;
+            }
+
+            vertices.insert(vertices.end(), first, first + used);
+        }
+
+        data.vertices.swap(vertices);
+    }
+
+    // La quantizzazione lavora sui vertici finali
+    if (options & QUANTIZE_VERTICES) {
+        quantize(data, log);
+    }
+
+    pack_indices(data, (options & TRIANGLE_STRIPS) != 0, log);
 }
 
-void Mesh::render(unsigned int TextureUnit) {
-  glBindVertexArray(_VAO);
+void Mesh::pack_indices(MeshData &data, bool strips, std::ostream &log) {
+    // Con indici a 16 bit l'indice di restart è 0xFFFF: i vertici di ogni
+    // sotto-mesh devono avere indice minore
+    bool use_short = true;
+    for (unsigned int s = 0 ; s < data.submeshes.size() ; s++) {
+        if (data.submeshes[s].num_vertices > 0xFFFF) use_short = false;
+    }
+
+    const unsigned int restart = use_short ? 0xFFFF : 0xFFFFFFFF;
+
+    size_t list_indices = data.indices.size();
+
+    if (strips) {
+        std::vector<unsigned int> indices;
+        indices.reserve(data.indices.size());
+
+        for (unsigned int s = 0 ; s < data.submeshes.size() ; s++) {
+            SubMesh &sm = data.submeshes[s];
+            const unsigned int *list = data.indices.data() + sm.base_index;
+
+            // I cluster sono intervalli di una lista di triangoli
+            if (sm.num_meshlets > 0) {
+                sm.base_index = indices.size();
+                indices.insert(indices.end(), list, list + sm.num_indices);
+                continue;
+            }
+
+            std::vector<unsigned int> strip(sm.num_indices / 3 * 4);
+            size_t num_strip = stripify(strip.data(), list, sm.num_indices, sm.num_vertices, restart);
+
+            unsigned int base_index = indices.size();
+
+            // Teniamo le strip solo se riducono il numero di indici
+            if (num_strip < sm.num_indices) {
+                log<<"  Submesh "<<s<<": triangle strip "<<sm.num_indices<<" -> "<<num_strip<<" indices"<<std::endl;
+                indices.insert(indices.end(), strip.begin(), strip.begin() + num_strip);
+                sm.num_indices = num_strip;
+                sm.primitive   = GL_TRIANGLE_STRIP;
+            }
+            else {
+                indices.insert(indices.end(), list, list + sm.num_indices);
+            }
+
+            sm.base_index = base_index;
+        }
+
+        data.indices.swap(indices);
+    }
+
+    data.index_size = use_short ? sizeof(unsigned short) : sizeof(unsigned int);
+
+    log<<"  Index buffer: "<<list_indices * sizeof(unsigned int) / 1024<<" KB -> "
+       <<data.indices.size() * (use_short ? sizeof(unsigned short) : sizeof(unsigned int)) / 1024<<" KB ("
+       <<(use_short ? 16 : 32)<<" bit)"<<std::endl;
+}
+
+void Mesh::weld_vertices(MeshData &data, const LoadRequest &request, std::ostream &log) {
+    const float position_epsilon = request.weld_position_epsilon * glm::length(data.bbox_max - data.bbox_min);
+    const float epsilons[8] = {
+        position_epsilon, position_epsilon, position_epsilon,
+        request.weld_normal_epsilon, request.weld_normal_epsilon, request.weld_normal_epsilon,
+        request.weld_uv_epsilon, request.weld_uv_epsilon
+    };
+
+    std::vector<Vertex> vertices;
+    vertices.reserve(data.vertices.size());
+
+    for (unsigned int s = 0 ; s < data.submeshes.size() ; s++) {
+        SubMesh &sm = data.submeshes[s];
+        const Vertex *first = &data.vertices[sm.base_vertex];
+
+        std::vector<unsigned int> remap(sm.num_vertices);
+        size_t unique = generate_weld_remap(remap.data(), &first->position.x, sm.num_vertices, 
+                                            sizeof(Vertex), epsilons, 8);
+
+        // I vertici unici sono numerati nell'ordine della prima occorrenza
+        unsigned int base_vertex = vertices.size();
+        for (unsigned int i = 0 ; i < sm.num_vertices ; i++) {
+            if (remap[i] == vertices.size() - base_vertex) vertices.push_back(first[i]);
+        }
+
+        for (unsigned int i = sm.base_index ; i < sm.base_index + sm.num_indices ; i++) {
+            data.indices[i] = remap[data.indices[i]];
+        }
+
+        sm.base_vertex  = base_vertex;
+        sm.num_vertices = unique;
+    }
+
+    log<<"  Welded vertices: "<<data.vertices.size()<<" -> "<<vertices.size()<<std::endl;
+
+    data.vertices.swap(vertices);
+}
+
+void Mesh::compute_bounding_sphere(MeshData &data) {
+    // Sfera centrata nel centro del bounding box. Il raggio è la distanza
+    // massima dei vertici dal centro, che è al più metà della diagonale
+    data.sphere_center = (data.bbox_min + data.bbox_max) * 0.5f;
+    data.sphere_radius = 0.0f;
+
+    for (unsigned int i = 0 ; i < data.vertices.size() ; i++) {
+        data.sphere_radius = std::max(data.sphere_radius, glm::length(data.vertices[i].position - data.sphere_center));
+    }
+}
+
+void Mesh::generate_meshlets(MeshData &data, const LoadRequest &request, std::ostream &log) {
+    data.meshlets.clear();
+
+    size_t with_cone = 0;
+
+    for (unsigned int s = 0 ; s < data.submeshes.size() ; s++) {
+        SubMesh &sm = data.submeshes[s];
+
+        sm.first_meshlet = data.meshlets.size();
+        sm.num_meshlets  = ::build_meshlets(data.meshlets, &data.indices[sm.base_index], sm.num_indices,
+                                            &data.vertices[sm.base_vertex].position.x, sm.num_vertices, sizeof(Vertex),
+                                            request.meshlet_max_vertices, request.meshlet_max_triangles);
+
+        for (unsigned int m = sm.first_meshlet ; m < data.meshlets.size() ; m++) {
+            if (data.meshlets[m].cone_cutoff < 1.0f) with_cone++;
+        }
+    }
+
+    log<<"  "<<data.meshlets.size()<<" meshlets, "<<with_cone<<" with a normal cone"<<std::endl;
+}
+
+void Mesh::build_bvh(PendingLoad &load) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    const bool from_cache = load.from_cache;
+    const std::vector<SubMesh> &submeshes = from_cache ? load.view.submeshes : load.data.submeshes;
+    const std::vector<Lod> &lods = from_cache ? load.view.lods : load.data.lods;
+    const unsigned int index_size = from_cache ? load.view.index_size : load.data.index_size;
+    const unsigned int restart = (index_size == sizeof(unsigned short)) ? 0xFFFF : 0xFFFFFFFF;
+
+    // Dalla cache i vertici possono essere nel formato compatto
+    glm::vec3 scale, bias;
+    if (from_cache) position_dequantization(load.view.bbox_min, load.view.bbox_max, scale, bias);
+
+    auto index = [&](size_t i) -> unsigned int {
+        if (!from_cache) return load.data.indices[i];
+        if (index_size == sizeof(unsigned short)) return static_cast<const unsigned short*>(load.view.indices)[i];
+        return static_cast<const unsigned int*>(load.view.indices)[i];
+    };
+
+    auto position = [&](unsigned int v) -> glm::vec3 {
+        if (!from_cache) return load.data.vertices[v].position;
+        if (load.quantized()) {
+            const PackedVertex &p = static_cast<const PackedVertex*>(load.view.vertices)[v];
+            return glm::vec3(p.position[0], p.position[1], p.position[2]) * scale + bias;
+        }
+        return static_cast<const Vertex*>(load.view.vertices)[v].position;
+    };
+
+    // Triangoli del modello completo (primo livello di dettaglio)
+    const unsigned int num_submeshes = lods.size() > 1 ? lods[1].first_submesh : submeshes.size();
+
+    std::vector<glm::vec3> corners;
+    load.triangle_offsets.clear();
+
+    for (unsigned int s = 0 ; s < num_submeshes ; s++) {
+        const SubMesh &sm = submeshes[s];
+        load.triangle_offsets.push_back(corners.size() / 3);
+
+        if (sm.primitive == GL_TRIANGLE_STRIP) {
+            // I triangoli dispari delle strip hanno l'orientamento invertito;
+            // quelli degeneri sono scartati
+            unsigned int a = 0, b = 0, strip_length = 0;
+            for (unsigned int i = 0 ; i < sm.num_indices ; i++) {
+                const unsigned int c = index(sm.base_index + i);
+                if (c == restart) {
+                    strip_length = 0;
+                    continue;
+                }
+
+                if (strip_length >= 2 && a != b && b != c && a != c) {
+                    const bool odd = (strip_length % 2) != 0;
+                    corners.push_back(position(sm.base_vertex + (odd ? b : a)));
+                    corners.push_back(position(sm.base_vertex + (odd ? a : b)));
+                    corners.push_back(position(sm.base_vertex + c));
+                }
+
+                a = b;
+                b = c;
+                strip_length++;
+            }
+        }
+        else {
+            for (unsigned int i = 0 ; i < sm.num_indices ; i++) {
+                corners.push_back(position(sm.base_vertex + index(sm.base_index + i)));
+            }
+        }
+    }
+
+    load.bvh.build(corners.data(), corners.size() / 3);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    load.log<<"  BVH: "<<load.bvh.num_triangles()<<" triangles, "<<load.bvh.num_nodes()<<" nodes, "
+            <<load.bvh.memory_usage() / 1024<<" KB, built in "<<elapsed.count()<<" ms"<<std::endl;
+}
+
+void Mesh::generate_lods(MeshData &data, const LoadRequest &request, std::ostream &log) {
+    const unsigned int num_submeshes = data.submeshes.size();
+    const float max_error = request.lod_max_error * glm::length(data.bbox_max - data.bbox_min);
+
+    Lod full = { 0.0f, 0 };
+    data.lods.assign(1, full);
+
+    for (unsigned int level = 1 ; level < request.lod_levels ; level++) {
+        const Lod previous = data.lods.back();
+        const size_t first_index = data.indices.size();
+
+        // L'errore dei livelli è non decrescente, così select_lod() può 
+        // fermarsi al primo livello che supera la soglia
+        Lod lod = { previous.error, (unsigned int)data.submeshes.size() };
+        size_t previous_indices = 0, lod_indices = 0;
+
+        for (unsigned int s = 0 ; s < num_submeshes ; s++) {
+            SubMesh sm = data.submeshes[s];
+            const unsigned int target = data.submeshes[previous.first_submesh + s].num_indices / 6 * 3;
+
+            // Ogni livello è ottenuto dal modello completo, così l'errore 
+            // è sempre misurato rispetto all'originale
+            std::vector<unsigned int> simplified(sm.num_indices);
+            float error = 0.0f;
+            size_t count = simplify(simplified.data(), data.indices.data() + sm.base_index, sm.num_indices,
+                                    &data.vertices[sm.base_vertex].position.x, sm.num_vertices, sizeof(Vertex),
+                                    target, max_error, &error);
+
+            previous_indices += data.submeshes[previous.first_submesh + s].num_indices;
+            lod_indices      += count;
+
+            sm.base_index  = data.indices.size();
+            sm.num_indices = count;
+            data.indices.insert(data.indices.end(), simplified.begin(), simplified.begin() + count);
+            data.submeshes.push_back(sm);
+
+            lod.error = std::max(lod.error, error);
+        }
+
+        // Fermiamo la catena quando la semplificazione non riduce più i 
+        // triangoli in modo significativo
+        if (lod_indices * 10 > previous_indices * 9) {
+            data.submeshes.resize(lod.first_submesh);
+            data.indices.resize(first_index);
+            break;
+        }
+
+        data.lods.push_back(lod);
+
+        log<<"  LOD "<<level<<": "<<lod_indices / 3<<" triangles, error "<<lod.error<<std::endl;
+    }
+}
+
+void Mesh::position_dequantization(const glm::vec3 &bbox_min, const glm::vec3 &bbox_max, 
+                                   glm::vec3 &scale, glm::vec3 &bias) {
+    // Le posizioni sono quantizzate nell'intervallo [-32767, 32767] rispetto
+    // al centro del bounding box
+    glm::vec3 half = (bbox_max - bbox_min) * 0.5f;
+
+    for (int k = 0 ; k < 3 ; k++) {
+        if (!(half[k] > 0.0f)) half[k] = 1.0f;
+    }
+
+    scale = half / 32767.0f;
+    bias  = (bbox_max + bbox_min) * 0.5f;
+}
+
+void Mesh::quantize(MeshData &data, std::ostream &log) {
+    glm::vec3 scale, bias;
+    position_dequantization(data.bbox_min, data.bbox_max, scale, bias);
+
+    // I vertici quantizzati sono prodotti solo al momento della scrittura
+    // (write_vertices): qui misuriamo l'errore della conversione
+    data.quantized = true;
+
+    float max_position = 0.0f, min_normal_cos = 1.0f, max_textcoord = 0.0f;
+
+    for (unsigned int i = 0 ; i < data.vertices.size() ; i++) {
+        const Vertex &v = data.vertices[i];
+        const PackedVertex p = pack_vertex(v, scale, bias);
+
+        // Errore rispetto ai dati float, calcolato con la stessa 
+        // ricostruzione usata dal vertex shader
+        glm::vec3 q(p.position[0], p.position[1], p.position[2]);
+        max_position = std::max(max_position, glm::length(q * scale + bias - v.position));
+
+        glm::vec3 n;
+        unpack_snorm_10_10_10_2(p.normal, n.x, n.y, n.z);
+        if (glm::length(v.normal) > 0.0f && glm::length(n) > 0.0f) {
+            min_normal_cos = std::min(min_normal_cos, glm::dot(glm::normalize(n), glm::normalize(v.normal)));
+        }
+
+        max_textcoord = std::max(max_textcoord, std::max(
+            fabsf(dequantize_half(p.textcoord[0]) - v.textcoord.x),
+            fabsf(dequantize_half(p.textcoord[1]) - v.textcoord.y)));
+    }
+
+    float diagonal = glm::length(data.bbox_max - data.bbox_min);
+
+    log<<"  Quantized vertices: "<<data.vertices.size() * sizeof(Vertex) / 1024<<" KB -> "
+       <<data.vertices.size() * sizeof(PackedVertex) / 1024<<" KB"<<std::endl;
+    log<<"  Max error: position "<<max_position;
+    if (diagonal > 0.0f) log<<" ("<<100.0f * max_position / diagonal<<"% of bbox)";
+    log<<", normal "<<glm::degrees(acosf(std::min(1.0f, min_normal_cos)))<<" deg"
+       <<", textcoord "<<max_textcoord<<std::endl;
+}
+
+Mesh::PackedVertex Mesh::pack_vertex(const Vertex &v, const glm::vec3 &scale, const glm::vec3 &bias) {
+    PackedVertex p;
+
+    glm::vec3 q = glm::clamp(glm::floor((v.position - bias) / scale + 0.5f), -32767.0f, 32767.0f);
+    p.position[0] = short(q.x);
+    p.position[1] = short(q.y);
+    p.position[2] = short(q.z);
+    p.position[3] = 0;
+
+    p.normal = pack_snorm_10_10_10_2(v.normal.x, v.normal.y, v.normal.z);
+
+    p.textcoord[0] = quantize_half(v.textcoord.x);
+    p.textcoord[1] = quantize_half(v.textcoord.y);
+
+    return p;
+}
+
+void Mesh::write_vertices(const MeshData &data, size_t first, size_t count, void *destination) {
+    if (!data.quantized) {
+        memcpy(destination, &data.vertices[first], count * sizeof(Vertex));
+        return;
+    }
+
+    glm::vec3 scale, bias;
+    position_dequantization(data.bbox_min, data.bbox_max, scale, bias);
+
+    PackedVertex *packed = static_cast<PackedVertex*>(destination);
+    for (size_t i = 0 ; i < count ; i++) {
+        packed[i] = pack_vertex(data.vertices[first + i], scale, bias);
+    }
+}
+
+void Mesh::write_indices(const MeshData &data, size_t first, size_t count, void *destination) {
+    if (data.index_size == sizeof(unsigned int)) {
+        memcpy(destination, &data.indices[first], count * sizeof(unsigned int));
+        return;
+    }
+
+    unsigned short *indices = static_cast<unsigned short*>(destination);
+    for (size_t i = 0 ; i < count ; i++) {
+        indices[i] = static_cast<unsigned short>(data.indices[first + i]);
+    }
+}
+
+void Mesh::init_dequantization(bool quantized) {
+    _quantized = quantized;
+
+    if (_quantized) {
+        position_dequantization(_bbox_min, _bbox_max, _position_scale, _position_bias);
+    }
+    else {
+        _position_scale = glm::vec3(1.0f);
+        _position_bias  = glm::vec3(0.0f);
+    }
+}
+
+bool Mesh::import_file(const std::string& Filename, unsigned int flags, MeshData &data, std::ostream &log) {
+    log << "Loading '" << Filename << "'" << std::endl;
+
+    // I file OBJ sono letti con il parser dedicato, se supporta i flag
+    // richiesti
+    if (is_obj_file(Filename) && (flags & ~OBJ_SUPPORTED_FLAGS) == 0) {
+        return import_obj(Filename, flags, data, log);
+    }
+
+    Assimp::Importer Importer;
+
+    const aiScene* pScene = Importer.ReadFile(Filename.c_str(), flags);//aiProcess_Triangulate | aiProcess_GenSmoothNormals);// | aiProcess_FlipUVs);
+
+    if (!pScene) {
+        log<<"Error loading "<<Filename<<" : "<<Importer.GetErrorString()<<std::endl;
+        return false;
+    }
+
+    import_scene(pScene, get_file_path(Filename), data);
+
+    return true;
+}
+
+bool Mesh::is_obj_file(const std::string &Filename) {
+    if (Filename.size() < 4) return false;
+
+    std::string ext = Filename.substr(Filename.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext == ".obj";
+}
+
+bool Mesh::benchmark_import(const std::string &Filename, unsigned int flags, unsigned int repeat) {
+    std::ifstream file(Filename.c_str(), std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cout<<"Unable to open '"<<Filename<<"'"<<std::endl;
+        return false;
+    }
+    const double megabytes = double(file.tellg()) / (1024.0 * 1024.0);
+
+    // Sotto-mesh, vertici e indici di ogni import
+    size_t counts[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+
+    for (int path = 0 ; path < 2 ; path++) {
+        MeshData data;
+        std::ostringstream log;
+        double best = std::numeric_limits<double>::max();
+        bool ok = true;
+
+        for (unsigned int r = 0 ; r < repeat && ok ; r++) {
+            data = MeshData();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            if (path == 0) {
+                Assimp::Importer Importer;
+                const aiScene* pScene = Importer.ReadFile(Filename.c_str(), flags);
+                ok = (pScene != nullptr);
+                if (ok) import_scene(pScene, get_file_path(Filename), data);
+            }
+            else {
+                ok = import_obj(Filename, flags, data, log);
+            }
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+
+        std::cout<<(path == 0 ? "  Assimp   " : "  import_obj")<<" '"<<Filename<<"': ";
+        if (!ok) {
+            std::cout<<"failed"<<std::endl;
+            return false;
+        }
+        std::cout<<megabytes / best<<" MB/s ("<<best * 1000.0<<" ms), "
+                 <<data.submeshes.size()<<" submeshes, "<<data.vertices.size()<<" vertices, "
+                 <<data.indices.size()<<" indices"<<std::endl;
+
+        counts[path][0] = data.submeshes.size();
+        counts[path][1] = data.vertices.size();
+        counts[path][2] = data.indices.size();
+    }
+
+    // Il parser dedicato sostituisce Assimp (anche nella cache): deve
+    // produrre la stessa divisione in sotto-mesh e la stessa geometria
+    if (!std::equal(counts[0], counts[0] + 3, counts[1])) {
+        std::cout<<"  MISMATCH: import_obj and Assimp give different submeshes, vertices or indices"<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void Mesh::benchmark_batch_import(const std::vector<std::string> &Filenames, unsigned int flags,
+                                  unsigned int repeat) {
+    double megabytes = 0.0;
+    for (unsigned int i = 0 ; i < Filenames.size() ; i++) {
+        std::ifstream file(Filenames[i].c_str(), std::ios::binary | std::ios::ate);
+        if (!file) {
+            std::cout<<"Unable to open '"<<Filenames[i]<<"'"<<std::endl;
+            return;
+        }
+        megabytes += double(file.tellg()) / (1024.0 * 1024.0);
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    for (int per_model = 1 ; per_model >= 0 ; per_model--) {
+        double best = std::numeric_limits<double>::max();
+        bool ok = true;
+
+        for (unsigned int r = 0 ; r < repeat && ok ; r++) {
+            std::vector<MeshData> data(Filenames.size());
+            std::vector<char> results(Filenames.size(), 0);
+
+            auto parse = [&](unsigned int i) {
+                std::ostringstream log;
+                results[i] = import_obj(Filenames[i], flags, data[i], log);
+            };
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            if (per_model) {
+                pool.parallel_for(Filenames.size(), parse);
+            }
+            else {
+                for (unsigned int i = 0 ; i < Filenames.size() ; i++) parse(i);
+            }
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+            ok = std::find(results.begin(), results.end(), 0) == results.end();
+        }
+
+        std::cout<<(per_model ? "  one thread per file" : "  one file at a time ")<<" ("
+                 <<Filenames.size()<<" files): ";
+        if (!ok) {
+            std::cout<<"failed"<<std::endl;
+            continue;
+        }
+        std::cout<<megabytes / best<<" MB/s ("<<best * 1000.0<<" ms)"<<std::endl;
+    }
+}
+
+void Mesh::import_scene(const aiScene* pScene, const std::string& Filepath, MeshData &data) {  
+
+    // Copiamo i dati dal formato Assimp agli array di vertici e indici.
+    // Ogni mesh della scena viene accodata ai vettori condivisi e diventa
+    // una sotto-mesh. Gli indici sono relativi al primo vertice della 
+    // sotto-mesh (base vertex).
+
+    // I materiali della scena sono aggiunti una sola volta, alla prima
+    // sotto-mesh che li usa, e poi referenziati dalle sotto-mesh successive
+    std::vector<int> MaterialMap(pScene->mNumMaterials, -1);
+
+    const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+
+    if (data.vertices.empty()) {
+        data.bbox_min = glm::vec3( std::numeric_limits<float>::max());
+        data.bbox_max = glm::vec3(-std::numeric_limits<float>::max());
+    }
+
+    // Le dimensioni finali sono note in anticipo: allocando una volta 
+    // sola evitiamo le riallocazioni (e le copie) dei vettori
+    size_t num_vertices = data.vertices.size(), num_indices = data.indices.size();
+    for (unsigned int m = 0 ; m < pScene->mNumMeshes ; m++) {
+        const aiMesh* paiMesh = pScene->mMeshes[m];
+        num_vertices += paiMesh->mNumVertices;
+        for (unsigned int i = 0 ; i < paiMesh->mNumFaces ; i++) {
+            if (paiMesh->mFaces[i].mNumIndices == 3) num_indices += 3;
+        }
+    }
+    data.vertices.reserve(num_vertices);
+    data.indices.reserve(num_indices);
+
+    for (unsigned int m = 0 ; m < pScene->mNumMeshes ; m++) {
+        const aiMesh* paiMesh = pScene->mMeshes[m];
+
+        SubMesh sm;
+        sm.base_vertex = data.vertices.size();
+        sm.base_index  = data.indices.size();
+        sm.primitive   = GL_TRIANGLES;
+        sm.first_meshlet = 0;
+        sm.num_meshlets  = 0;
+
+        if (paiMesh->mMaterialIndex < MaterialMap.size()) {
+            int &mat = MaterialMap[paiMesh->mMaterialIndex];
+            if (mat < 0) {
+                data.textures.push_back(material_texture(pScene->mMaterials[paiMesh->mMaterialIndex], Filepath));
+                mat = data.textures.size() - 1;
+            }
+            sm.material = mat;
+        }
+        else {
+            data.textures.push_back("");
+            sm.material = data.textures.size() - 1;
+        }
+
+        for (unsigned int i = 0 ; i < paiMesh->mNumVertices ; i++) {
+            const aiVector3D* pPos      = &(paiMesh->mVertices[i]);
+            const aiVector3D* pNormal   = paiMesh->HasNormals() ? &(paiMesh->mNormals[i]) : &Zero3D;
+            const aiVector3D* pTexCoord = paiMesh->HasTextureCoords(0) ? &(paiMesh->mTextureCoords[0][i]) : &Zero3D;
+
+            Vertex v(glm::vec3(pPos->x, pPos->y, pPos->z),
+                     glm::vec3(pNormal->x, pNormal->y, pNormal->z),
+                     glm::vec2(pTexCoord->x, pTexCoord->y));
+
+            data.vertices.push_back(v);
+
+            data.bbox_min = glm::min(data.bbox_min, v.position);
+            data.bbox_max = glm::max(data.bbox_max, v.position);
+        }
+
+        for (unsigned int i = 0 ; i < paiMesh->mNumFaces ; i++) {
+            const aiFace& Face = paiMesh->mFaces[i];
+            // Punti e linee (senza aiProcess_Triangulate anche i poligoni) 
+            // non sono gestiti
+            if (Face.mNumIndices != 3) continue;
+            data.indices.push_back(Face.mIndices[0]);
+            data.indices.push_back(Face.mIndices[1]);
+            data.indices.push_back(Face.mIndices[2]);
+        }
+
+        sm.num_vertices = data.vertices.size() - sm.base_vertex;
+        sm.num_indices  = data.indices.size() - sm.base_index;
+
+        if (sm.num_indices > 0) {
+            data.submeshes.push_back(sm);
+        }
+    }
+}
+
+std::string Mesh::material_texture(const aiMaterial* pMaterial, const std::string& Filepath) {
+
+    // Consideriamo solo la texture diffusiva del materiale
+    if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+        aiString Path;
+
+        if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
+            std::string data = Path.data;
+
+            return Filepath + "/" + data;
+        }
+    }
+
+    return "";
+}
+
+void Mesh::init_materials(const std::vector<std::string> &textures, const ImageMap &images) {
+
+    // Le texture usate da più materiali sono caricate una sola volta
+    std::vector<unsigned int> remap(textures.size());
+    std::map<std::string, unsigned int> loaded;
+
+    for (unsigned int i = 0 ; i < textures.size() ; i++) {
+        const std::string &FullPath = textures[i];
+
+        if (FullPath.empty()) {
+            remap[i] = blank_material(images);
+            continue;
+        }
+
+        std::map<std::string, unsigned int>::const_iterator it = loaded.find(FullPath);
+        if (it != loaded.end()) {
+            remap[i] = it->second;
+            continue;
+        }
+
+        // Se la texture è già usata da un altro modello viene condivisa,
+        // altrimenti, se l'immagine è già stata decodificata, facciamo solo 
+        // l'upload
+        ImageMap::const_iterator img = images.find(FullPath);
+        std::shared_ptr<Texture> texture = 
+            ResourceCache::instance().texture(FullPath, (img != images.end()) ? &img->second : nullptr);
+
+        if (!texture) {
+            std::cout<<"  Error loading texture '"<<FullPath<<"'"<<std::endl;
+            remap[i] = blank_material(images);
+        }
+        else {
+            std::cout<<"  Loaded texture '"<<FullPath<<"'"<<std::endl;
+            _materials.push_back(texture);
+            remap[i] = _materials.size() - 1;
+        }
+
+        loaded[FullPath] = remap[i];
+    }
+
+    for (unsigned int i = 0 ; i < _submeshes.size() ; i++) {
+        _submeshes[i].material = remap[_submeshes[i].material];
+    }
+}
+
+unsigned int Mesh::blank_material(const ImageMap &images) {
+    if (_blank_material < 0) {
+        ImageMap::const_iterator img = images.find("white.png");
+        std::shared_ptr<Texture> texture = 
+            ResourceCache::instance().texture("white.png", (img != images.end()) ? &img->second : nullptr);
+
+        // Una texture non valida non viene usata da bind(), ma il materiale
+        // deve comunque esistere
+        if (!texture) texture = std::make_shared<Texture>();
+
+        std::cout<<"  Loaded blank texture."<<std::endl;
+        _materials.push_back(texture);
+        _blank_material = _materials.size() - 1;
+    }
+
+    return _blank_material;
+}
+
+void Mesh::allocate_buffer(GLenum target, size_t bytes) {
+    // Con ARB_buffer_storage (OpenGL 4.4) lo spazio allocato è immutabile
+    // e il driver non deve gestire riallocazioni successive
+    if (GLEW_ARB_buffer_storage) {
+        glBufferStorage(target, bytes, nullptr, GL_MAP_WRITE_BIT);
+    }
+    else {
+        glBufferData(target, bytes, nullptr, GL_STATIC_DRAW);
+    }
+}
+
+void Mesh::set_vertex_attributes(bool quantized) {
+    if (quantized) {
+        // Le posizioni sono passate come interi non normalizzati: la scala
+        // (che include il fattore 1/32767) è applicata nel vertex shader.
+        // La normale è normalizzata nel fragment shader.
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(struct PackedVertex, position));
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(struct PackedVertex, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(struct PackedVertex, textcoord));
+    }
+    else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, textcoord));
+    }
+}
+
+GeometryArena *Mesh::geometry_arena(bool quantized, unsigned int index_size, bool create) {
+    // Un'arena per ogni combinazione di formato dei vertici e degli indici.
+    // Come il segnaposto, le arene restano allocate fino alla chiusura del
+    // programma: i modelli globali le usano anche nei loro distruttori
+    static GeometryArena *arenas[2][2] = { { nullptr, nullptr }, { nullptr, nullptr } };
+
+    const bool short_indices = (index_size == sizeof(unsigned short));
+    GeometryArena *&arena = arenas[quantized][short_indices];
+
+    if (arena == nullptr && create) {
+        std::string name = std::string("geometry arena (") + (quantized ? "packed" : "float") + 
+                           " vertices, " + (short_indices ? "16" : "32") + " bit indices)";
+        arena = new GeometryArena(quantized ? sizeof(PackedVertex) : sizeof(Vertex), index_size, 
+                                  [quantized]() { set_vertex_attributes(quantized); }, name);
+    }
+
+    return arena;
+}
+
+void Mesh::print_arena_stats(std::ostream &os) {
+    const unsigned int index_sizes[2] = { sizeof(unsigned short), sizeof(unsigned int) };
+
+    for (int q = 0 ; q < 2 ; q++) {
+        for (int i = 0 ; i < 2 ; i++) {
+            GeometryArena *arena = geometry_arena(q != 0, index_sizes[i], false);
+            if (arena != nullptr) arena->print_stats(os);
+        }
+    }
+}
+
+bool Mesh::init_buffers(unsigned int num_vertices, unsigned int num_indices, bool shared) {
+    GlState &state = GlState::instance();
+
+    // Senza livelli di dettaglio c'è solo il modello completo
+    if (_lods.empty()) {
+        Lod full = { 0.0f, 0 };
+        _lods.push_back(full);
+    }
+
+    for (unsigned int i = 0 ; i < _submeshes.size() ; i++) {
+        if (_materials[_submeshes[i].material]->has_alpha()) {
+            _has_transparency = true;
+        }
+        if (_submeshes[i].primitive == GL_TRIANGLE_STRIP) {
+            _has_strips = true;
+        }
+    }
+
+    const unsigned int vertex_size = _quantized ? sizeof(PackedVertex) : sizeof(Vertex);
+
+    if (shared) {
+        GeometryArena *arena = geometry_arena(_quantized, _index_size, true);
+
+        if (arena->allocate(num_vertices, num_indices, _arena_range)) {
+            _arena = arena;
+            _VAO = arena->vao(_arena_range.page);
+            _VBO = arena->vbo(_arena_range.page);
+            _IBO = arena->ibo(_arena_range.page);
+
+            // Le sotto-mesh (di tutti i livelli) sono spostate all'inizio 
+            // dell'intervallo assegnato al modello
+            for (unsigned int i = 0 ; i < _submeshes.size() ; i++) {
+                _submeshes[i].base_vertex += _arena_range.first_vertex;
+                _submeshes[i].base_index  += _arena_range.first_index;
+            }
+
+            std::cout<<"  "<<_submeshes.size()<<" submeshes, "<<num_vertices<<" vertices ("
+                     <<vertex_size * num_vertices / 1024<<" KB), "<<num_indices<<" indices ("
+                     <<_index_size * num_indices / 1024<<" KB) in arena page "<<_arena_range.page<<std::endl;
+
+            return true;
+        }
+
+        std::cout<<"  Unable to allocate the model in the geometry arena"<<std::endl;
+    }
+
+    // Creiamo e bindiamo gli oggetti OpenGL
+
+    glGenVertexArrays(1, &_VAO);
+    state.bind_vertex_array(_VAO);
+
+    // I buffer sono allocati con la loro dimensione finale, senza dati: 
+    // sono riempiti da upload_range() mappandone degli intervalli, 
+    // direttamente nella memoria del driver
+    glGenBuffers(1, &_VBO);
+    state.bind_buffer(GL_ARRAY_BUFFER, _VBO);
+    allocate_buffer(GL_ARRAY_BUFFER, size_t(vertex_size) * num_vertices);
+    GpuMemory::instance().track_buffer(_VBO, size_t(vertex_size) * num_vertices, _name, GpuMemory::VERTEX_BUFFER);
+
+    glGenBuffers(1, &_IBO);
+    state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, _IBO);
+    allocate_buffer(GL_ELEMENT_ARRAY_BUFFER, size_t(_index_size) * num_indices);
+    GpuMemory::instance().track_buffer(_IBO, size_t(_index_size) * num_indices, _name, GpuMemory::INDEX_BUFFER);
+
+    set_vertex_attributes(_quantized);
+
+    state.bind_vertex_array(0);
+
+    std::cout<<"  "<<_submeshes.size()<<" submeshes, "<<num_vertices<<" vertices ("
+             <<vertex_size * num_vertices / 1024<<" KB), "<<num_indices<<" indices ("
+             <<_index_size * num_indices / 1024<<" KB)"<<std::endl;
+
+    return true;
+}
+
+std::string Mesh::get_file_path(const std::string &Filename) {
+    std::string::size_type SlashIndex = Filename.find_last_of("/");
+    std::string Dir;
+
+    if (SlashIndex == std::string::npos) {
+        Dir = ".";
+    }
+    else if (SlashIndex == 0) {
+        Dir = "/";
+    }
+    else {
+        Dir = Filename.substr(0, SlashIndex);
+    }  
+    
+    return Dir;  
+}
+
+unsigned int Mesh::num_submeshes() const {
+    return _lods.size() > 1 ? _lods[1].first_submesh : _submeshes.size();
+}
+
+unsigned int Mesh::num_lods() const {
+    return std::max<size_t>(1, _lods.size());
+}
+
+unsigned int Mesh::select_lod(const Camera &camera, const glm::mat4 &model, float max_error) const {
+    if (_lods.size() < 2) return 0;
+
+    // Il modello è approssimato con la sua sfera. La scala massima della 
+    // trasformazione porta l'errore in coordinate mondo.
+    float scale = std::max(glm::length(glm::vec3(model[0])), 
+                  std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+    glm::vec4 sphere = world_bounding_sphere(model);
+
+    // Usiamo il punto della sfera più vicino alla camera
+    float distance = glm::length(glm::vec3(sphere) - camera.position()) - sphere.w;
+    if (distance <= 0.0f) return 0;
+
+    unsigned int lod = 0;
+    while (lod + 1 < _lods.size() && 
+           camera.projected_size(_lods[lod + 1].error * scale, distance) <= max_error) {
+        lod++;
+    }
+
+    return lod;
+}
+
+const glm::vec3 &Mesh::bbox_min() const {
+    return _bbox_min;
+}
+
+const glm::vec3 &Mesh::bbox_max() const {
+    return _bbox_max;
+}
+
+const glm::vec3 &Mesh::bounding_sphere_center() const {
+    return _sphere_center;
+}
+
+float Mesh::bounding_sphere_radius() const {
+    return _sphere_radius;
+}
+
+glm::vec4 Mesh::world_bounding_sphere(const glm::mat4 &model) const {
+    float scale = std::max(glm::length(glm::vec3(model[0])), 
+                  std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+    return glm::vec4(glm::vec3(model * glm::vec4(_sphere_center, 1.0f)), _sphere_radius * scale);
+}
+
+const glm::vec3 &Mesh::position_scale() const {
+    return _position_scale;
+}
+
+const glm::vec3 &Mesh::position_bias() const {
+    return _position_bias;
+}
+
+const std::string &Mesh::name() const {
+    return _name;
+}
+
+const Bvh &Mesh::bvh() const {
+    return _bvh;
+}
+
+unsigned int Mesh::triangle_submesh(unsigned int triangle) const {
+    std::vector<unsigned int>::const_iterator it = 
+        std::upper_bound(_triangle_offsets.begin(), _triangle_offsets.end(), triangle);
+    return (it == _triangle_offsets.begin()) ? 0 : (it - _triangle_offsets.begin()) - 1;
+}
+
+bool Mesh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, const glm::mat4 &model, Bvh::Hit &hit) const {
+    if (_bvh.empty()) return false;
+
+    // Una trasformazione affine conserva il parametro lungo il raggio
+    const glm::mat4 inverse = glm::inverse(model);
+    const glm::vec3 local_origin    = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+    const glm::vec3 local_direction = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+
+    return _bvh.raycast(local_origin, local_direction, std::numeric_limits<float>::max(), hit);
+}
+
+void Mesh::meshlet_stats(unsigned int &drawn, unsigned int &culled) const {
+    drawn  = _drawn_meshlets;
+    culled = _culled_meshlets;
+}
+
+void Mesh::draw_range(const SubMesh &sm, unsigned int first_index, unsigned int num_indices,
+                      const InstanceBuffer *instances) const {
+    GLenum type = (_index_size == sizeof(unsigned short)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    void *offset = (void*)(size_t(_index_size) * (sm.base_index + first_index));
+
+    if (instances != nullptr) {
+        glDrawElementsInstancedBaseVertex(sm.primitive, num_indices, type, offset, instances->size(), sm.base_vertex);
+    }
+    else {
+        glDrawElementsBaseVertex(sm.primitive, num_indices, type, offset, sm.base_vertex);
+    }
+}
+
+void Mesh::draw_submesh(const SubMesh &sm, unsigned int TextureUnit, int &bound_material, 
+                        const ClusterCulling *culling, const InstanceBuffer *instances) {
+    // Rebindiamo la texture solo se cambia il materiale
+    if (bound_material != (int)sm.material) {
+        _materials[sm.material]->bind(TextureUnit);
+        bound_material = sm.material;
+    }
+
+    if (culling == nullptr || sm.num_meshlets == 0) {
+        draw_range(sm, 0, sm.num_indices, instances);
+        return;
+    }
+
+    // I cluster visibili consecutivi sono contigui nell'IBO: li uniamo in
+    // un'unica draw call
+    unsigned int first = 0, count = 0;
+
+    for (unsigned int m = sm.first_meshlet ; m < sm.first_meshlet + sm.num_meshlets ; m++) {
+        const Meshlet &meshlet = _meshlets[m];
+        const glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+        bool visible = !meshlet_backfacing(meshlet, &culling->eye.x);
+        for (int p = 0 ; p < 6 && visible ; p++) {
+            visible = glm::dot(glm::vec3(culling->planes[p]), center) + culling->planes[p].w >= -meshlet.radius;
+        }
+
+        if (!visible) {
+            _culled_meshlets++;
+            continue;
+        }
+
+        _drawn_meshlets++;
+
+        if (count > 0 && first + count != meshlet.first_index) {
+            draw_range(sm, first, count, instances);
+            count = 0;
+        }
+        if (count == 0) first = meshlet.first_index;
+        count += meshlet.num_indices;
+    }
+
+    if (count > 0) draw_range(sm, first, count, instances);
+}
+
+void Mesh::render(unsigned int TextureUnit, unsigned int lod) {
+  draw(TextureUnit, lod, nullptr, nullptr);
+}
+
+void Mesh::render_instanced(const InstanceBuffer &instances, unsigned int TextureUnit, unsigned int lod) {
+  if (instances.empty()) return;
+
+  draw(TextureUnit, lod, nullptr, &instances);
+}
+
+bool Mesh::submit(IndirectBatch &batch, const Camera &camera, const glm::mat4 &model, unsigned int lod,
+                  const glm::vec4 &tint) {
+  if (!_resident) {
+    request_residency();
+    return false;
+  }
+
+  if (_arena == nullptr) return false;
+
+  glm::vec4 sphere = world_bounding_sphere(model);
+  if (!camera.sphere_visible(glm::vec3(sphere), sphere.w)) return true;
+
+  if (lod >= _lods.size()) lod = _lods.size() - 1;
+
+  const unsigned int first = _lods[lod].first_submesh;
+  const unsigned int last  = (lod + 1 < _lods.size()) ? _lods[lod + 1].first_submesh : _submeshes.size();
+  const GLenum type = (_index_size == sizeof(unsigned short)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+  // Tutte le sotto-mesh del modello condividono i dati dell'oggetto
+  const unsigned int object = batch.add_object(model, tint, _position_scale, _position_bias);
+
+  for (unsigned int i = first ; i < last ; i++) {
+    const SubMesh &sm = _submeshes[i];
+    const Texture *texture = _materials[sm.material].get();
+
+    batch.add_draw(_VAO, sm.primitive, type, texture, texture->has_alpha(), 
+                   sm.num_indices, sm.base_index, sm.base_vertex, object);
+  }
+
+  return true;
+}
+
+bool Mesh::submit(RenderQueue &queue, MyShaderClass &program, const Camera &camera, const glm::mat4 &model,
+                  unsigned int lod) {
+  if (!_resident) {
+    request_residency();
+    return false;
+  }
+
+  if (_lods.empty()) return true;
+
+  glm::vec4 sphere = world_bounding_sphere(model);
+  if (!camera.sphere_visible(glm::vec3(sphere), sphere.w)) return true;
+
+  if (lod >= _lods.size()) lod = _lods.size() - 1;
+
+  const unsigned int first = _lods[lod].first_submesh;
+  const unsigned int last  = (lod + 1 < _lods.size()) ? _lods[lod + 1].first_submesh : _submeshes.size();
+  const GLenum type = (_index_size == sizeof(unsigned short)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+  const float distance = glm::length(glm::vec3(sphere) - camera.position());
+  const unsigned int object = queue.add_object(model, _position_scale, _position_bias, distance);
+
+  for (unsigned int i = first ; i < last ; i++) {
+    const SubMesh &sm = _submeshes[i];
+    const Texture *texture = _materials[sm.material].get();
+    const RenderQueue::Pass pass = texture->has_alpha() ? RenderQueue::TRANSPARENT : RenderQueue::OPAQUE;
+
+    queue.add_draw(program, this, _VAO, sm.primitive, type, texture, pass, 
+                   sm.num_indices, sm.base_index, sm.base_vertex, object);
+  }
+
+  return true;
+}
+
+void Mesh::render(const Camera &camera, const glm::mat4 &model, unsigned int TextureUnit, unsigned int lod) {
+  // Come in submit(), un modello disegnato passa davanti ai prefetch anche
+  // se viene scartato dal culling. Finchè il bounding box non è noto la 
+  // sfera ha raggio nullo e il test non è significativo: lo saltiamo
+  if (!_resident) request_residency();
+
+  glm::vec4 sphere = world_bounding_sphere(model);
+  if (_sphere_radius > 0.0f && !camera.sphere_visible(glm::vec3(sphere), sphere.w)) {
+    _drawn_meshlets = 0;
+    _culled_meshlets = _meshlets.size();
+    return;
+  }
+
+  if (_meshlets.empty()) {
+    draw(TextureUnit, lod, nullptr, nullptr);
+    return;
+  }
+
+  // I piani del frustum sono portati nelle coordinate locali del modello 
+  // (un piano si trasforma con la trasposta della matrice del modello)
+  const glm::mat4 mt = glm::transpose(model);
+  const glm::vec4 *planes = camera.frustum_planes();
+
+  ClusterCulling culling;
+  for (int p = 0 ; p < 6 ; p++) {
+    culling.planes[p] = mt * planes[p];
+    culling.planes[p] /= glm::length(glm::vec3(culling.planes[p]));
+  }
+
+  culling.eye = glm::vec3(glm::inverse(model) * glm::vec4(camera.position(), 1.0f));
+
+  draw(TextureUnit, lod, &culling, nullptr);
+}
+
+void Mesh::draw(unsigned int TextureUnit, unsigned int lod, const ClusterCulling *culling, 
+                const InstanceBuffer *instances) {
+  GlState &state = GlState::instance();
+
+  if (!_resident) {
+    draw_placeholder(TextureUnit, instances);
+    return;
+  }
+
+  if (_lods.empty()) return;
+  if (lod >= _lods.size()) lod = _lods.size() - 1;
+
+  _drawn_meshlets = _culled_meshlets = 0;
+
+  const unsigned int first = _lods[lod].first_submesh;
+  const unsigned int last  = (lod + 1 < _lods.size()) ? _lods[lod + 1].first_submesh : _submeshes.size();
+
+  state.bind_vertex_array(_VAO);
+
+  state.enable_vertex_attrib_array(0);
+  state.enable_vertex_attrib_array(1);
+  state.enable_vertex_attrib_array(2);  
+
+  // Gli attributi delle istanze sono collegati solo per questo disegno
+  if (instances != nullptr) instances->bind();
+
+  // Le strip sono separate dall'indice massimo rappresentabile
+  if (_has_strips) {
+    state.enable(GL_PRIMITIVE_RESTART);
+    state.primitive_restart_index(_index_size == sizeof(unsigned short) ? 0xFFFF : 0xFFFFFFFF);
+  }
+
+  int bound_material = -1;
+
+  for (unsigned int i = first ; i < last ; i++) {
+    if (!_materials[_submeshes[i].material]->has_alpha())
+      draw_submesh(_submeshes[i], TextureUnit, bound_material, culling, instances);
+  }
+
+  // Le sotto-mesh con trasparenze vanno disegnate dopo quelle opache
+  if (_has_transparency) {
+    state.enable(GL_BLEND);
+    state.enable(GL_ALPHA_TEST);
+    state.blend_func(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+
+    for (unsigned int i = first ; i < last ; i++) {
+      if (_materials[_submeshes[i].material]->has_alpha())
+        draw_submesh(_submeshes[i], TextureUnit, bound_material, culling, instances);
+    }
+
+    state.disable(GL_BLEND);
+    state.disable(GL_ALPHA_TEST);
+  }
+
+  if (_has_strips) {
+    state.disable(GL_PRIMITIVE_RESTART);
+  }
+
+  if (instances != nullptr) instances->unbind();
+
+  state.bind_vertex_array(0);
+}
+
+void Mesh::draw_placeholder(unsigned int TextureUnit, const InstanceBuffer *instances) {
+  GlState &state = GlState::instance();
+
+  // Un modello disegnato serve subito: passa davanti ai prefetch
+  request_residency();
+
+  if (!_has_placeholder) return;
+
+  // Il cubo e la texture bianca sono condivisi da tutte le mesh e restano
+  // allocati fino alla chiusura del programma
+  static GLuint vao = 0, vbo = 0, ibo = 0;
+  static std::shared_ptr<Texture> white;
+
+  if (vao == 0) {
+    // Cubo [-1, 1] con quattro vertici per faccia (normali per faccia) e
+    // triangoli in senso antiorario visti dall'esterno
+    std::vector<Vertex> vertices;
+    std::vector<unsigned short> indices;
+
+    for (int f = 0 ; f < 6 ; f++) {
+      const int axis = f / 2;
+      const float sign = (f % 2) ? 1.0f : -1.0f;
+
+      glm::vec3 n(0.0f), u(0.0f), v(0.0f);
+      n[axis] = sign;
+      u[(axis + 1) % 3] = 1.0f;
+      v[(axis + 2) % 3] = 1.0f;
+
+      const unsigned short base = vertices.size();
+      vertices.push_back(Vertex(n - u - v, n, glm::vec2(0.0f)));
+      vertices.push_back(Vertex(n + u - v, n, glm::vec2(0.0f)));
+      vertices.push_back(Vertex(n + u + v, n, glm::vec2(0.0f)));
+      vertices.push_back(Vertex(n - u + v, n, glm::vec2(0.0f)));
+
+      const unsigned short quad[2][6] = { { 0, 2, 1, 0, 3, 2 }, { 0, 1, 2, 0, 2, 3 } };
+      for (int i = 0 ; i < 6 ; i++) {
+        indices.push_back(base + quad[f % 2][i]);
+      }
+    }
+
+    glGenVertexArrays(1, &vao);
+    state.bind_vertex_array(vao);
+
+    glGenBuffers(1, &vbo);
+    state.bind_buffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    GpuMemory::instance().track_buffer(vbo, vertices.size() * sizeof(Vertex), "placeholder", GpuMemory::VERTEX_BUFFER);
+
+    glGenBuffers(1, &ibo);
+    state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+    GpuMemory::instance().track_buffer(ibo, indices.size() * sizeof(unsigned short), "placeholder", GpuMemory::INDEX_BUFFER);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, position));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, normal));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(struct Vertex, textcoord));
+
+    state.bind_vertex_array(0);
+
+    // La stessa texture usata dai materiali senza texture
+    white = ResourceCache::instance().texture("white.png");
+  }
+
+  if (white) white->bind(TextureUnit);
 
-  _texture.bind(TextureUnit);
+  state.bind_vertex_array(vao);
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glEnableVertexAttribArray(2);  
+  state.enable_vertex_attrib_array(0);
+  state.enable_vertex_attrib_array(1);
+  state.enable_vertex_attrib_array(2);  
 
-  glDrawElements(GL_TRIANGLES, _num_indices, GL_UNSIGNED_INT, 0);
+  if (instances != nullptr) {
+    instances->bind();
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, instances->size());
+    instances->unbind();
+  }
+  else {
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+  }
 
-  glBindVertexArray(0);
+  state.bind_vertex_array(0);
 }
@@ -21,20 +21,36 @@
 
 #include <ostream>
 #include <vector>
+#include <string>
+#include <map>
+#include <memory>
 #include <GL/glew.h>
 #include "texture.h"
+#include "meshopt.h"
+#include "bvh.h"
+#include "geometryarena.h"
 #include "glm/glm.hpp"
 #include <cstring>
 #include "assimp/scene.h"       // Assimp output data structure
 #include "assimp/postprocess.h" // Assimp post processing flags
 
+class Camera;
+class InstanceBuffer;
+class IndirectBatch;
+class RenderQueue;
+class MyShaderClass;
+
 
 /**
     Classe che incapsula la gestione dei modelli 3d caricati da file.
     La classe usa la lista dei vertici indicizzati. 
-    Al momento la classe supporta modelli con una sola texture colore.
-    Se il modello non ha una texture associata, viene usata una texture 
-    di default "white.png"
+    Tutte le mesh presenti nella scena (o nei file) caricati sono memorizzate
+    in un unico VBO e in un unico IBO condivisi. Ogni mesh della scena diventa
+    una sotto-mesh descritta dal suo intervallo di vertici/indici e dal suo
+    materiale. Ogni materiale supporta una sola texture colore.
+    Se un materiale non ha una texture associata, viene usata una texture 
+    di default "white.png". Le texture sono condivise con gli altri modelli
+    tramite ResourceCache.
 */
 class Mesh
 {
@@ -54,6 +70,173 @@ public:
         Vertex(const glm::vec3& p, const glm::vec3& n, const glm::vec2& t);
     };
 
+    /**
+        Formato compatto (16 byte) dei vertici usato con QUANTIZE_VERTICES.
+        La posizione è quantizzata a 16 bit rispetto al bounding box della 
+        mesh e viene ricostruita nel vertex shader con position_scale() e 
+        position_bias(). La normale è in formato 10_10_10_2 snorm e le 
+        coordinate di texture sono half float.
+    */
+    struct PackedVertex
+    {
+        short          position[4]; ///< Posizione quantizzata (w inutilizzato)
+        unsigned int   normal;      ///< Normale (GL_INT_2_10_10_10_REV)
+        unsigned short textcoord[2];///< Coordinate di texture (half float)
+    };
+
+    /**
+        Struttura dati che descrive una sotto-mesh all'interno dei buffer
+        condivisi
+    */
+    struct SubMesh
+    {
+        unsigned int base_vertex; ///< Offset del primo vertice nel VBO
+        unsigned int num_vertices;///< Numero di vertici della sotto-mesh
+        unsigned int base_index;  ///< Offset del primo indice nell'IBO
+        unsigned int num_indices; ///< Numero di indici della sotto-mesh
+        unsigned int material;    ///< Indice del materiale associato
+        unsigned int primitive;   ///< Tipo di primitiva (GL_TRIANGLES o GL_TRIANGLE_STRIP)
+        unsigned int first_meshlet;///< Primo cluster della sotto-mesh
+        unsigned int num_meshlets;///< Numero di cluster (0 = nessun culling)
+    };
+
+    /**
+        Livello di dettaglio. Le sotto-mesh di ogni livello sono memorizzate
+        consecutivamente nella tabella delle sotto-mesh, nello stesso ordine
+        di quelle del modello completo di cui condividono i vertici.
+    */
+    struct Lod
+    {
+        float        error;        ///< Errore geometrico massimo (coordinate locali)
+        unsigned int first_submesh;///< Prima sotto-mesh del livello
+    };
+
+    /**
+        Opzioni di caricamento della mesh (combinabili in OR). Le opzioni 
+        sono applicate ai dati lato CPU prima dell'upload e il loro risultato
+        è salvato nella cache.
+    */
+    enum LoadOptions
+    {
+        /// Riordina i triangoli per il riuso della cache post-transform. 
+        /// Ha effetto solo se i vertici sono condivisi tra i triangoli
+        /// (es. con WELD_VERTICES o aiProcess_JoinIdenticalVertices)
+        OPTIMIZE_VERTEX_CACHE = 1 << 0,
+
+        /// Riordina i cluster di triangoli per ridurre l'overdraw (solo per
+        /// mesh opache). Implica OPTIMIZE_VERTEX_CACHE
+        OPTIMIZE_OVERDRAW     = 1 << 1,
+
+        /// Riordina i vertici nell'ordine d'uso degli indici e scarta quelli 
+        /// non referenziati
+        OPTIMIZE_VERTEX_FETCH = 1 << 2,
+
+        /// Memorizza i vertici nel formato compatto PackedVertex. L'errore
+        /// rispetto ai vertici float viene riportato nel log
+        QUANTIZE_VERTICES     = 1 << 3,
+
+        /// Converte le sotto-mesh in triangle strip con primitive restart, 
+        /// se il numero di indici si riduce
+        TRIANGLE_STRIPS       = 1 << 4,
+
+        /// Genera una catena di livelli di dettaglio semplificati. Le 
+        /// cuciture di normali e UV e i bordi aperti sono preservati
+        GENERATE_LODS         = 1 << 5,
+
+        /// Divide le sotto-mesh in cluster di triangoli con sfera e cono
+        /// delle normali, usati da render() per scartare i cluster fuori 
+        /// dal frustum o girati dalla parte opposta. Le sotto-mesh divise in
+        /// cluster restano liste di triangoli (TRIANGLE_STRIPS è ignorata)
+        BUILD_MESHLETS        = 1 << 6,
+
+        /// Unisce i vertici con posizione, normale e coordinate di texture
+        /// uguali a meno delle tolleranze della LoadRequest e riscrive gli
+        /// indici. Sostituisce aiProcess_JoinIdenticalVertices
+        WELD_VERTICES         = 1 << 7,
+
+        /// Costruisce la BVH dei triangoli del modello completo, usata per
+        /// le query sulla geometria (vedi bvh() e raycast()). La BVH non è
+        /// salvata nella cache: è ricostruita dal thread di caricamento
+        BUILD_BVH             = 1 << 8,
+
+        /// Alloca vertici e indici nell'arena condivisa dai modelli con lo
+        /// stesso formato (vedi GeometryArena) invece che in buffer propri.
+        /// I modelli nelle arene possono essere accodati in un 
+        /// IndirectBatch con submit(). Non cambia il contenuto della cache
+        GEOMETRY_ARENA        = 1 << 9
+    };
+
+    /**
+        Dati della mesh lato CPU, prodotti dal caricamento da file e pronti 
+        per essere trasferiti sulla GPU. I vertici e gli indici restano nel 
+        formato a 32 bit: la conversione nel formato finale (vertici 
+        quantizzati, indici a 16 bit) è fatta da write_vertices() e 
+        write_indices() direttamente nella memoria di destinazione (buffer
+        OpenGL mappato o file di cache), senza copie intermedie.
+    */
+    struct MeshData
+    {
+        std::vector<Vertex>       vertices;  ///< Vertici di tutte le sotto-mesh
+        std::vector<unsigned int> indices;   ///< Indici di tutte le sotto-mesh
+        std::vector<SubMesh>      submeshes; ///< Tabella delle sotto-mesh
+        std::vector<Lod>          lods;      ///< Livelli di dettaglio (vuoto = solo il modello completo)
+        std::vector<Meshlet>      meshlets;  ///< Cluster delle sotto-mesh (con BUILD_MESHLETS)
+        std::vector<std::string>  textures;  ///< Texture di ogni materiale ("" = nessuna)
+        glm::vec3 bbox_min;                  ///< Angolo minimo del bounding box
+        glm::vec3 bbox_max;                  ///< Angolo massimo del bounding box
+        glm::vec3 sphere_center;             ///< Centro della sfera che contiene la mesh
+        float     sphere_radius;             ///< Raggio della sfera che contiene la mesh
+        unsigned int index_size;             ///< Byte per indice sulla GPU (2 o 4)
+        bool      quantized;                 ///< I vertici sono trasferiti come PackedVertex
+
+        MeshData();
+
+        /**
+            Ritorna la dimensione in byte del vertex buffer
+        */
+        size_t vertex_bytes() const;
+
+        /**
+            Ritorna la dimensione in byte dell'index buffer
+        */
+        size_t index_bytes() const;
+    };
+
+    /**
+        Richiesta di caricamento di un modello per load_meshes()
+    */
+    struct LoadRequest
+    {
+        Mesh *mesh;                         ///< Mesh da caricare
+        std::vector<std::string> filenames; ///< File che compongono il modello
+        unsigned int flags;                 ///< assimp post processing flags
+        unsigned int options;               ///< Opzioni di caricamento (LoadOptions)
+        float overdraw_threshold;           ///< Soglia ACMR/overdraw per OPTIMIZE_OVERDRAW
+        unsigned int lod_levels;            ///< Numero massimo di livelli per GENERATE_LODS
+        float lod_max_error;                ///< Errore massimo dei livelli (frazione della diagonale del bbox)
+        unsigned int meshlet_max_vertices;  ///< Vertici massimi per cluster (BUILD_MESHLETS)
+        unsigned int meshlet_max_triangles; ///< Triangoli massimi per cluster (BUILD_MESHLETS)
+        float weld_position_epsilon;        ///< Tolleranza sulle posizioni (frazione della diagonale del bbox)
+        float weld_normal_epsilon;          ///< Tolleranza sulle componenti delle normali
+        float weld_uv_epsilon;              ///< Tolleranza sulle coordinate di texture
+
+        LoadRequest(Mesh &m, const std::string &filename, unsigned int f=0, unsigned int o=0);
+
+        LoadRequest(Mesh &m, const std::vector<std::string> &files, unsigned int f=0, unsigned int o=0);
+
+        /**
+            Richiesta senza Mesh (es. per calcolarne la chiave in
+            ResourceCache): mesh va assegnata prima di load_async()
+        */
+        LoadRequest(const std::vector<std::string> &files, unsigned int f=0, unsigned int o=0);
+
+        /**
+            Ritorna l'hash dei parametri che influenzano il risultato del
+            caricamento (usato come chiave della cache)
+        */
+        unsigned int settings() const;
+    };
+
 
     Mesh();
 
@@ -61,34 +244,458 @@ public:
 
     /**
         Funzione che carica il modello e lo prepara per il rendering.
+        Il risultato della conversione viene salvato in una cache binaria
+        (vedi MeshCache). Se la cache è valida, il modello viene caricato
+        dalla cache senza usare Assimp.
         
         @param filename nome del file
         @param flags assimp post processing flags
+        @param options opzioni di caricamento (LoadOptions)
 
         @return true se il modello è stato caricato correttamente
     */
-    bool load_mesh(const std::string& Filename, unsigned int flags=0);
+    bool load_mesh(const std::string& Filename, unsigned int flags=0, unsigned int options=0);
+
+    /**
+        Funzione che carica più file e li unisce in un unico modello.
+        Ogni mesh contenuta nei file diventa una sotto-mesh del modello.
+        
+        @param Filenames lista dei nomi dei file
+        @param flags assimp post processing flags
+        @param options opzioni di caricamento (LoadOptions)
+
+        @return true se tutti i file sono stati caricati correttamente
+    */
+    bool load_mesh(const std::vector<std::string>& Filenames, unsigned int flags=0, unsigned int options=0);
+
+    /**
+        Funzione che carica un insieme di modelli in parallelo.
+        La lettura dei file (o della cache), la conversione dei vertici e la
+        decodifica delle texture sono eseguite dal pool di thread. Il thread
+        chiamante (che deve possedere il contesto OpenGL) si occupa solo 
+        della creazione degli oggetti OpenGL e del trasferimento dei dati.
+        I cicli annidati del ThreadPool sono sequenziali: se i modelli sono
+        almeno quanti i thread ogni modello è preparato da un solo thread
+        (il parsing a blocchi dei file OBJ non è parallelo), altrimenti i
+        modelli sono preparati uno alla volta usando tutto il pool.
+        La funzione ritorna quando tutti i modelli sono pronti per il rendering.
+
+        @param requests lista dei modelli da caricare
+
+        @return true se tutti i modelli sono stati caricati correttamente
+    */
+    static bool load_meshes(const std::vector<LoadRequest>& requests);
+
+    /**
+        Funzione che accoda il caricamento di un modello e ritorna subito.
+        La lettura del file (o della cache), la conversione e la decodifica
+        delle texture sono eseguite da un thread in background; i dati sono
+        poi trasferiti sulla GPU a piccoli passi da update_streaming().
+        Finchè il modello non è residente, render() disegna al suo posto il
+        bounding box (appena noto). 
+        I caricamenti richiesti sono eseguiti prima dei prefetch. Un prefetch
+        passa davanti agli altri appena il modello viene disegnato o con
+        request_residency().
+
+        @param request modello da caricare
+        @param prefetch true se il modello non serve subito (suggerimento 
+               per caricarlo in anticipo con priorità bassa)
+    */
+    static void load_async(const LoadRequest &request, bool prefetch=false);
+
+    /**
+        Funzione da chiamare ad ogni frame dal thread OpenGL: trasferisce 
+        sulla GPU i modelli caricati con load_async() senza superare il 
+        budget indicato. I modelli richiesti hanno la precedenza sui prefetch.
+
+        @param byte_budget numero massimo (indicativo) di byte da trasferire
+        @return true se ci sono ancora caricamenti asincroni in corso
+    */
+    static bool update_streaming(size_t byte_budget);
+
+    /**
+        Porta in testa alla coda dei caricamenti asincroni il modello, se 
+        è stato accodato come prefetch
+    */
+    void request_residency();
+
+    /**
+        Ritorna true se il modello è sulla GPU e pronto per il rendering
+    */
+    bool is_resident() const;
+
+    /**
+        Confronta la velocità di import di un file OBJ tra Assimp e il 
+        parser dedicato (import_obj). Ogni import è ripetuto più volte e per
+        entrambi sono stampati il throughput in MB/s e il numero di 
+        sotto-mesh, vertici e indici ottenuti, che devono coincidere.
+
+        @param Filename nome del file .obj
+        @param flags assimp post processing flags
+        @param repeat numero di ripetizioni di ogni import
+        @return false se un import fallisce o se i due import danno un
+                numero diverso di sotto-mesh, vertici o indici
+    */
+    static bool benchmark_import(const std::string &Filename, unsigned int flags, unsigned int repeat=5);
+
+    /**
+        Misura il parsing di più file OBJ (import_obj) come in 
+        load_meshes(): un file per thread, con il parsing a blocchi di ogni
+        file sequenziale perchè annidato, oppure un file alla volta con il
+        parsing a blocchi sul pool. Stampa il throughput dei due casi.
+
+        @param Filenames nomi dei file .obj
+        @param flags assimp post processing flags
+        @param repeat numero di ripetizioni di ogni misura
+    */
+    static void benchmark_batch_import(const std::vector<std::string> &Filenames, unsigned int flags,
+                                       unsigned int repeat=5);
+
+    /**
+        Scrive un intervallo di vertici nel formato usato sulla GPU 
+        (PackedVertex se data.quantized, altrimenti Vertex).
+
+        @param data dati della mesh
+        @param first primo vertice da scrivere
+        @param count numero di vertici da scrivere
+        @param destination memoria di destinazione (count vertici)
+    */
+    static void write_vertices(const MeshData &data, size_t first, size_t count, void *destination);
+
+    /**
+        Scrive un intervallo di indici nel formato usato sulla GPU 
+        (data.index_size byte per indice).
+
+        @param data dati della mesh
+        @param first primo indice da scrivere
+        @param count numero di indici da scrivere
+        @param destination memoria di destinazione (count indici)
+    */
+    static void write_indices(const MeshData &data, size_t first, size_t count, void *destination);
 
     /**
         Renderizza l'oggetto in scena usando per la texture, la TextureUnit indicata.
+        Le sotto-mesh opache sono disegnate per prime. Quelle con una texture
+        con canale alpha sono disegnate dopo, con il blending abilitato.
+
+        @param TextureUnit TextureUnit usata per recuperare i pixel
+        @param lod livello di dettaglio da disegnare (0 = modello completo)
+
+    */
+    void render(unsigned int TextureUnit=0, unsigned int lod=0);
 
+    /**
+        Come render(), ma il modello non viene disegnato se la sua sfera
+        è fuori dal frustum della camera. Le sotto-mesh divise in cluster 
+        (BUILD_MESHLETS) sono disegnate solo in parte: i cluster fuori dal
+        frustum o con tutti i triangoli girati dalla parte opposta vengono
+        scartati e i cluster visibili consecutivi sono uniti in un'unica 
+        draw call. Il test sul cono delle normali assume che la matrice del
+        modello non contenga scalature non uniformi.
+        Un modello non ancora residente passa comunque davanti ai prefetch
+        (vedi load_async()), anche se è fuori dal frustum.
+
+        @param camera camera usata per il rendering
+        @param model matrice di trasformazione del modello
         @param TextureUnit TextureUnit usata per recuperare i pixel
+        @param lod livello di dettaglio da disegnare (0 = modello completo)
+    */
+    void render(const Camera &camera, const glm::mat4 &model, unsigned int TextureUnit=0, unsigned int lod=0);
+
+    /**
+        Disegna tutte le istanze del buffer con una draw call instanced per
+        sotto-mesh: il costo sulla CPU non dipende dal numero di istanze.
+        Va usato con gli shader per il rendering instanced (vedi 
+        MyShaderClass): la matrice e il colore di ogni istanza sono letti
+        dal buffer, la matrice del modello impostata nello shader è 
+        applicata a tutte le istanze. Il culling (di frustum e dei cluster)
+        non è eseguito: il livello di dettaglio è lo stesso per tutte le 
+        istanze.
+
+        @param instances istanze da disegnare
+        @param TextureUnit TextureUnit usata per recuperare i pixel
+        @param lod livello di dettaglio da disegnare (0 = modello completo)
+    */
+    void render_instanced(const InstanceBuffer &instances, unsigned int TextureUnit=0, unsigned int lod=0);
+
+    /**
+        Accoda le sotto-mesh di un livello di dettaglio in un IndirectBatch,
+        che le disegna insieme a quelle degli altri modelli (vedi 
+        IndirectBatch::flush()). Il modello deve essere stato caricato con
+        GEOMETRY_ARENA. Il modello non viene accodato se la sua sfera è 
+        fuori dal frustum; il culling dei cluster non è eseguito.
+        Va usato con gli shader per le draw call indirect (vedi 
+        MyShaderClass).
 
+        @param batch lista delle draw call del frame
+        @param camera camera usata per il rendering
+        @param model matrice di trasformazione del modello
+        @param lod livello di dettaglio da disegnare (0 = modello completo)
+        @param tint colore che moltiplica quello del materiale
+        @return false se il modello non è residente o non è in un'arena 
+                (in questo caso va disegnato con render())
     */
-    void render(unsigned int TextureUnit=0);
+    bool submit(IndirectBatch &batch, const Camera &camera, const glm::mat4 &model, unsigned int lod=0,
+                const glm::vec4 &tint=glm::vec4(1.0f));
+
+    /**
+        Accoda le sotto-mesh di un livello di dettaglio in una RenderQueue,
+        che le ordina insieme a quelle degli altri modelli per ridurre i
+        cambi di programma, texture e VAO (vedi RenderQueue::execute()).
+        Le sotto-mesh con trasparenze sono accodate nel passo TRANSPARENT.
+        Il modello non viene accodato se la sua sfera è fuori dal frustum;
+        il culling dei cluster non è eseguito.
+
+        @param queue coda delle draw call del frame
+        @param program shader STANDARD usati per disegnare il modello
+        @param camera camera usata per il rendering
+        @param model matrice di trasformazione del modello
+        @param lod livello di dettaglio da disegnare (0 = modello completo)
+        @return false se il modello non è residente
+    */
+    bool submit(RenderQueue &queue, MyShaderClass &program, const Camera &camera, const glm::mat4 &model,
+                unsigned int lod=0);
+
+    /**
+        Scrive l'occupazione delle arene di geometria (vedi GEOMETRY_ARENA)
+
+        @param os stream di output
+    */
+    static void print_arena_stats(std::ostream &os);
+
+    /**
+        Ritorna il numero di cluster disegnati e scartati dall'ultima 
+        chiamata a render()
+    */
+    void meshlet_stats(unsigned int &drawn, unsigned int &culled) const;
+
+    /**
+        Sceglie il livello di dettaglio più semplice il cui errore geometrico,
+        proiettato sullo schermo alla distanza del modello, non supera la 
+        soglia indicata.
+
+        @param camera camera usata per il rendering
+        @param model matrice di trasformazione del modello
+        @param max_error errore massimo tollerato in pixel
+
+        @return il livello di dettaglio da passare a render()
+    */
+    unsigned int select_lod(const Camera &camera, const glm::mat4 &model, float max_error) const;
+
+    /**
+        Ritorna il numero di livelli di dettaglio (almeno 1)
+    */
+    unsigned int num_lods() const;
+
+    /**
+        Ritorna il numero di sotto-mesh del modello (per livello di dettaglio)
+    */
+    unsigned int num_submeshes() const;
+
+    /**
+        Ritorna l'angolo minimo del bounding box del modello (coordinate locali)
+    */
+    const glm::vec3 &bbox_min() const;
+
+    /**
+        Ritorna l'angolo massimo del bounding box del modello (coordinate locali)
+    */
+    const glm::vec3 &bbox_max() const;
+
+    /**
+        Ritorna il centro della sfera che contiene il modello (coordinate locali)
+    */
+    const glm::vec3 &bounding_sphere_center() const;
+
+    /**
+        Ritorna il raggio della sfera che contiene il modello (coordinate locali)
+    */
+    float bounding_sphere_radius() const;
+
+    /**
+        Ritorna la sfera che contiene il modello trasformata in coordinate 
+        mondo (xyz centro, w raggio), pronta per Camera::cull_spheres().
+        Il raggio è scalato con la scala massima della trasformazione.
+
+        @param model matrice di trasformazione del modello
+    */
+    glm::vec4 world_bounding_sphere(const glm::mat4 &model) const;
+
+    /**
+        Ritorna la scala da applicare alle posizioni dei vertici nel vertex
+        shader (1 se i vertici non sono quantizzati)
+    */
+    const glm::vec3 &position_scale() const;
+
+    /**
+        Ritorna l'offset da sommare alle posizioni dei vertici nel vertex
+        shader (0 se i vertici non sono quantizzati)
+    */
+    const glm::vec3 &position_bias() const;
+
+    /**
+        Ritorna la BVH dei triangoli del modello completo, in coordinate 
+        locali (vuota se il modello non è stato caricato con BUILD_BVH).
+        I triangoli delle triangle strip sono estratti come triangoli 
+        separati e quelli quantizzati sono ricostruiti dai vertici compatti.
+    */
+    const Bvh &bvh() const;
+
+    /**
+        Ritorna la sotto-mesh a cui appartiene un triangolo della BVH
+
+        @param triangle indice del triangolo (es. Bvh::Hit::triangle)
+    */
+    unsigned int triangle_submesh(unsigned int triangle) const;
+
+    /**
+        Cerca la prima intersezione di un raggio in coordinate mondo con il
+        modello (es. per il picking). Il raggio è portato in coordinate
+        locali con l'inversa della matrice del modello: hit.t è lo stesso
+        parametro sul raggio in coordinate mondo (il punto colpito è 
+        origin + direction * hit.t).
+
+        @param origin origine del raggio (coordinate mondo)
+        @param direction direzione del raggio (coordinate mondo)
+        @param model matrice di trasformazione del modello
+        @param hit intersezione trovata
+        @return true se il raggio colpisce il modello
+    */
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, const glm::mat4 &model, Bvh::Hit &hit) const;
+
+    /**
+        Ritorna il nome del modello usato nei report (il primo file 
+        caricato, vuoto se il modello non è stato caricato)
+    */
+    const std::string &name() const;
 
 private:
-    bool init_from_scene(const aiScene* pScene, const std::string& Filename);
-    
-    void clear();
+    struct PendingLoad;
+    struct StreamQueue;
+
+    /**
+        Volumi usati per il culling dei cluster, nel sistema di coordinate 
+        locali del modello
+    */
+    struct ClusterCulling
+    {
+        glm::vec4 planes[6]; ///< Piani del frustum (normali verso l'interno)
+        glm::vec3 eye;       ///< Posizione della camera
+    };
+
+    typedef std::map<std::string, Texture::Image> ImageMap;
+
+    static void prepare(PendingLoad &load);
+
+    bool finish(PendingLoad &load, const ImageMap &images);
+
+    bool begin_upload(PendingLoad &load, const ImageMap &images);
+
+    bool upload_range(PendingLoad &load, bool vertices, size_t first, size_t count, bool parallel);
+
+    void end_upload(PendingLoad &load);
+
+    bool stream_step(PendingLoad &load, size_t &budget);
+
+    void show_placeholder(const PendingLoad &load);
+
+    void draw_placeholder(unsigned int TextureUnit, const InstanceBuffer *instances);
+
+    static StreamQueue &stream_queue();
+
+    static void stream_worker(StreamQueue &queue);
+
+    static void cancel_async(Mesh &mesh);
+
+    static void optimize(MeshData &data, const LoadRequest &request, std::ostream &log);
+
+    static void generate_lods(MeshData &data, const LoadRequest &request, std::ostream &log);
 
-    std::string get_file_path(const std::string &Filename) const;
+    static void quantize(MeshData &data, std::ostream &log);
 
-    unsigned int _num_indices;
-    Texture _texture; 
+    static void pack_indices(MeshData &data, bool strips, std::ostream &log);
+
+    static void position_dequantization(const glm::vec3 &bbox_min, const glm::vec3 &bbox_max, 
+                                        glm::vec3 &scale, glm::vec3 &bias);
+
+    void init_dequantization(bool quantized);
+
+    static bool import_file(const std::string& Filename, unsigned int flags, MeshData &data, std::ostream &log);
+
+    static bool is_obj_file(const std::string &Filename);
+
+    static void import_scene(const aiScene* pScene, const std::string& Filepath, MeshData &data);
+
+    static std::string material_texture(const aiMaterial* pMaterial, const std::string& Filepath);
+
+    static std::string get_file_path(const std::string &Filename);
+
+    void init_materials(const std::vector<std::string> &textures, const ImageMap &images);
+
+    unsigned int blank_material(const ImageMap &images);
+
+    bool init_buffers(unsigned int num_vertices, unsigned int num_indices, bool shared);
+
+    static void set_vertex_attributes(bool quantized);
+
+    static GeometryArena *geometry_arena(bool quantized, unsigned int index_size, bool create);
+
+    static void allocate_buffer(GLenum target, size_t bytes);
+
+    static PackedVertex pack_vertex(const Vertex &v, const glm::vec3 &scale, const glm::vec3 &bias);
+
+    static void compute_bounding_sphere(MeshData &data);
+
+    static void weld_vertices(MeshData &data, const LoadRequest &request, std::ostream &log);
+
+    static void generate_meshlets(MeshData &data, const LoadRequest &request, std::ostream &log);
+
+    static void build_bvh(PendingLoad &load);
+
+    void draw(unsigned int TextureUnit, unsigned int lod, const ClusterCulling *culling, 
+              const InstanceBuffer *instances);
+
+    void draw_submesh(const SubMesh &sm, unsigned int TextureUnit, int &bound_material, 
+                      const ClusterCulling *culling, const InstanceBuffer *instances);
+
+    void draw_range(const SubMesh &sm, unsigned int first_index, unsigned int num_indices,
+                    const InstanceBuffer *instances) const;
+
+    void clear();
+
+    std::vector<SubMesh>  _submeshes;  ///< Tabella delle sotto-mesh
+    std::vector<Lod>      _lods;       ///< Livelli di dettaglio
+    std::vector<Meshlet>  _meshlets;   ///< Cluster delle sotto-mesh
+    unsigned int _drawn_meshlets;      ///< Cluster disegnati nell'ultimo render()
+    unsigned int _culled_meshlets;     ///< Cluster scartati nell'ultimo render()
+    std::vector<std::shared_ptr<Texture> > _materials; ///< Texture colore di ogni materiale (condivise)
+    int     _blank_material;           ///< Materiale con la texture "white.png" (-1 se assente)
+    bool    _has_transparency;         ///< Almeno una sotto-mesh usa il blending
+    bool    _has_strips;               ///< Almeno una sotto-mesh usa le triangle strip
+    unsigned int _index_size;          ///< Dimensione in byte degli indici (2 o 4)
+    glm::vec3 _bbox_min;               ///< Angolo minimo del bounding box
+    glm::vec3 _bbox_max;               ///< Angolo massimo del bounding box
+    glm::vec3 _sphere_center;          ///< Centro della sfera che contiene il modello
+    float   _sphere_radius;            ///< Raggio della sfera che contiene il modello
+    bool    _quantized;                ///< I vertici sono nel formato PackedVertex
+    glm::vec3 _position_scale;         ///< Scala di dequantizzazione delle posizioni
+    glm::vec3 _position_bias;          ///< Offset di dequantizzazione delle posizioni
+    bool    _resident;                 ///< Buffer e texture pronti per il rendering
+    bool    _has_placeholder;          ///< Bounding box noto (disegnato finchè non è residente)
+    bool    _streaming;                ///< Caricamento asincrono in corso
+    std::string _name;                 ///< Nome del modello (primo file caricato)
+    Bvh     _bvh;                      ///< BVH dei triangoli (con BUILD_BVH)
+    std::vector<unsigned int> _triangle_offsets; ///< Primo triangolo della BVH di ogni sotto-mesh
+    GeometryArena *_arena;             ///< Arena che contiene vertici e indici (nullptr = buffer propri)
+    GeometryArena::Range _arena_range; ///< Intervallo dell'arena assegnato al modello
     GLuint  _VAO;
     GLuint  _VBO;
     GLuint  _IBO;
+
+    // Blocchiamo le operazioni di copia: non possiamo condividere gli 
+    // oggetti OpenGL e le texture
+    Mesh&operator=(const Mesh &other);
+    Mesh(const Mesh &other);
 };
 
 std::ostream &operator<<(std::ostream &os, const Mesh::Vertex &v);
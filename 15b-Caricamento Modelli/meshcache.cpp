@@ -0,0 +1,404 @@
+#include "meshcache.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+
+namespace {
+
+	/**
+		Versione del formato del file di cache. Va incrementata ad ogni
+		modifica del formato o del contenuto dei dati salvati.
+	*/
+	const uint32_t MESH_CACHE_VERSION = 9;
+
+	const char MESH_CACHE_MAGIC[8] = {'M','E','S','H','C','A','C','H'};
+
+	/**
+		Header a dimensione fissa all'inizio del file di cache
+	*/
+	struct FileHeader {
+		char     magic[8];
+		uint32_t version;
+		uint32_t flags;
+		uint32_t options;
+		uint32_t settings;
+		uint32_t vertex_size;
+		uint32_t index_size;
+		uint32_t num_sources;
+		uint32_t num_submeshes;
+		uint32_t num_lods;
+		uint32_t num_meshlets;
+		uint32_t num_textures;
+		uint32_t num_vertices;
+		uint32_t num_indices;
+		float    bbox[6];
+		float    sphere[4];
+		uint64_t vertex_offset;
+		uint64_t index_offset;
+		uint64_t total_size;
+	};
+
+	/**
+		Cursore di lettura con controllo dei limiti sul file mappato
+	*/
+	class Reader {
+	public:
+		Reader(const unsigned char *data, size_t size) : _data(data), _size(size), _pos(0) {}
+
+		bool read(void *dst, size_t bytes) {
+			if (_pos + bytes > _size) return false;
+			memcpy(dst, _data + _pos, bytes);
+			_pos += bytes;
+			return true;
+		}
+
+		bool read_string(std::string &s) {
+			uint32_t len;
+			if (!read(&len, sizeof(len)) || _pos + len > _size) return false;
+			s.assign(reinterpret_cast<const char*>(_data + _pos), len);
+			_pos += len;
+			return true;
+		}
+
+	private:
+		const unsigned char *_data;
+		size_t _size;
+		size_t _pos;
+	};
+
+	void write_string(std::ostream &os, const std::string &s) {
+		uint32_t len = s.size();
+		os.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		os.write(s.data(), len);
+	}
+
+	uint64_t fnv1a(uint64_t h, const void *data, size_t bytes) {
+		const unsigned char *p = static_cast<const unsigned char*>(data);
+		for (size_t i = 0 ; i < bytes ; i++) {
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	size_t align16(size_t v) {
+		return (v + 15) & ~size_t(15);
+	}
+
+	/**
+		Controlla che gli indici di una sotto-mesh (relativi al suo primo
+		vertice) non escano dai suoi vertici
+	*/
+	template <typename T>
+	bool indices_in_range(const T *indices, const Mesh::SubMesh &sm, T restart) {
+		for (unsigned int i = 0 ; i < sm.num_indices ; i++) {
+			const T index = indices[sm.base_index + i];
+			if (index >= sm.num_vertices && !(sm.primitive == GL_TRIANGLE_STRIP && index == restart)) return false;
+		}
+		return true;
+	}
+
+	/**
+		Controlla che la tabella delle sotto-mesh letta dalla cache sia
+		coerente con i buffer e con i materiali: un file corrotto o scritto
+		da una versione diversa non deve causare letture fuori dai limiti
+	*/
+	bool check_ranges(const MeshCacheView &view) {
+		for (unsigned int i = 0 ; i < view.submeshes.size() ; i++) {
+			const Mesh::SubMesh &sm = view.submeshes[i];
+
+			if (sm.material >= view.textures.size() ||
+			    (sm.primitive != GL_TRIANGLES && sm.primitive != GL_TRIANGLE_STRIP) ||
+			    uint64_t(sm.base_vertex) + sm.num_vertices > view.num_vertices ||
+			    uint64_t(sm.base_index) + sm.num_indices > view.num_indices) {
+				return false;
+			}
+
+			for (unsigned int m = sm.first_meshlet ; m < sm.first_meshlet + sm.num_meshlets ; m++) {
+				const Meshlet &meshlet = view.meshlets[m];
+				if (uint64_t(meshlet.first_index) + meshlet.num_indices > sm.num_indices) return false;
+			}
+
+			const bool in_range = (view.index_size == sizeof(unsigned short)) ?
+				indices_in_range(static_cast<const unsigned short*>(view.indices), sm, (unsigned short)0xFFFF) :
+				indices_in_range(static_cast<const unsigned int*>(view.indices), sm, 0xFFFFFFFFu);
+			if (!in_range) return false;
+		}
+
+		return true;
+	}
+}
+
+MeshCacheView::MeshCacheView() :
+	vertices(nullptr), num_vertices(0), indices(nullptr), num_indices(0), index_size(sizeof(unsigned int)),
+	sphere_radius(0.0f) {}
+
+
+MeshCache::MeshCache(const std::vector<std::string> &Sources, unsigned int flags, unsigned int options,
+                     unsigned int settings) :
+	_flags(flags), _options(options), _settings(settings) {
+
+	uint64_t h = 14695981039346656037ULL;
+
+	for (unsigned int i = 0 ; i < Sources.size() ; i++) {
+		SourceInfo si;
+		si.name  = Sources[i];
+		si.mtime = 0;
+		si.size  = 0;
+
+		struct stat st;
+		if (stat(Sources[i].c_str(), &st) == 0) {
+			si.mtime = st.st_mtime;
+			si.size  = st.st_size;
+		}
+		_sources.push_back(si);
+
+		h = fnv1a(h, Sources[i].c_str(), Sources[i].size() + 1);
+	}
+
+	h = fnv1a(h, &flags, sizeof(flags));
+	h = fnv1a(h, &options, sizeof(options));
+	h = fnv1a(h, &settings, sizeof(settings));
+
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+
+	if (!Sources.empty()) {
+		_filename = Sources[0] + "." + std::string(hex, 8) + ".meshcache";
+	}
+}
+
+const std::string &MeshCache::filename() const {
+	return _filename;
+}
+
+bool MeshCache::open(MeshCacheView &view) {
+	if (_filename.empty() || !_file.open(_filename)) return false;
+
+	const uint32_t vertex_size = (_options & Mesh::QUANTIZE_VERTICES) ? 
+	                             sizeof(Mesh::PackedVertex) : sizeof(Mesh::Vertex);
+
+	Reader r(_file.data(), _file.size());
+	FileHeader header;
+
+	if (!r.read(&header, sizeof(header))) return false;
+
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+	    header.version != MESH_CACHE_VERSION ||
+	    header.flags != _flags ||
+	    header.options != _options ||
+	    header.settings != _settings ||
+	    header.vertex_size != vertex_size ||
+	    (header.index_size != sizeof(unsigned short) && header.index_size != sizeof(unsigned int)) ||
+	    header.num_sources != _sources.size() ||
+	    header.total_size != _file.size()) {
+		_file.close();
+		return false;
+	}
+
+	// I sorgenti devono essere gli stessi e non devono essere cambiati
+	for (unsigned int i = 0 ; i < header.num_sources ; i++) {
+		uint64_t mtime, size;
+		std::string name;
+		if (!r.read(&mtime, sizeof(mtime)) || !r.read(&size, sizeof(size)) ||
+		    !r.read_string(name) ||
+		    name != _sources[i].name || mtime != _sources[i].mtime || size != _sources[i].size) {
+			_file.close();
+			return false;
+		}
+	}
+
+	view.submeshes.resize(header.num_submeshes);
+	for (unsigned int i = 0 ; i < header.num_submeshes ; i++) {
+		uint32_t sm[8];
+		if (!r.read(sm, sizeof(sm)) || uint64_t(sm[6]) + sm[7] > header.num_meshlets) {
+			_file.close();
+			return false;
+		}
+		view.submeshes[i].base_vertex  = sm[0];
+		view.submeshes[i].num_vertices = sm[1];
+		view.submeshes[i].base_index   = sm[2];
+		view.submeshes[i].num_indices  = sm[3];
+		view.submeshes[i].material     = sm[4];
+		view.submeshes[i].primitive    = sm[5];
+		view.submeshes[i].first_meshlet = sm[6];
+		view.submeshes[i].num_meshlets  = sm[7];
+	}
+
+	view.lods.resize(header.num_lods);
+	for (unsigned int i = 0 ; i < header.num_lods ; i++) {
+		if (!r.read(&view.lods[i].error, sizeof(float)) ||
+		    !r.read(&view.lods[i].first_submesh, sizeof(uint32_t)) ||
+		    view.lods[i].first_submesh > header.num_submeshes) {
+			_file.close();
+			return false;
+		}
+	}
+
+	// I cluster sono strutture di soli float e interi a 32 bit
+	view.meshlets.resize(header.num_meshlets);
+	if (header.num_meshlets > 0 && !r.read(&view.meshlets[0], header.num_meshlets * sizeof(Meshlet))) {
+		_file.close();
+		return false;
+	}
+
+	view.textures.resize(header.num_textures);
+	for (unsigned int i = 0 ; i < header.num_textures ; i++) {
+		if (!r.read_string(view.textures[i])) {
+			_file.close();
+			return false;
+		}
+	}
+
+	uint64_t vertex_bytes = uint64_t(header.num_vertices) * header.vertex_size;
+	uint64_t index_bytes  = uint64_t(header.num_indices) * header.index_size;
+
+	if (header.vertex_offset + vertex_bytes > _file.size() ||
+	    header.index_offset + index_bytes > _file.size()) {
+		_file.close();
+		return false;
+	}
+
+	view.vertices     = _file.data() + header.vertex_offset;
+	view.num_vertices = header.num_vertices;
+	view.indices      = _file.data() + header.index_offset;
+	view.num_indices  = header.num_indices;
+	view.index_size   = header.index_size;
+	view.bbox_min     = glm::vec3(header.bbox[0], header.bbox[1], header.bbox[2]);
+	view.bbox_max     = glm::vec3(header.bbox[3], header.bbox[4], header.bbox[5]);
+	view.sphere_center = glm::vec3(header.sphere[0], header.sphere[1], header.sphere[2]);
+	view.sphere_radius = header.sphere[3];
+
+	if (!check_ranges(view)) {
+		_file.close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshCache::write(const Mesh::MeshData &data) const {
+	if (_filename.empty()) return false;
+
+	// Calcoliamo la dimensione della parte variabile dell'header per poter
+	// allineare i dati di vertici e indici
+	size_t meta = sizeof(FileHeader);
+	for (unsigned int i = 0 ; i < _sources.size() ; i++) {
+		meta += 2 * sizeof(uint64_t) + sizeof(uint32_t) + _sources[i].name.size();
+	}
+	meta += data.submeshes.size() * 8 * sizeof(uint32_t);
+	meta += data.lods.size() * (sizeof(float) + sizeof(uint32_t));
+	meta += data.meshlets.size() * sizeof(Meshlet);
+	for (unsigned int i = 0 ; i < data.textures.size() ; i++) {
+		meta += sizeof(uint32_t) + data.textures[i].size();
+	}
+
+	// Vertici e indici sono salvati nello stesso formato usato sulla GPU
+	// (vertici quantizzati, indici a 16 bit) 
+	const size_t vertex_size  = data.quantized ? sizeof(Mesh::PackedVertex) : sizeof(Mesh::Vertex);
+	const size_t index_size   = data.index_size;
+	const size_t vertex_bytes = data.vertex_bytes();
+	const size_t index_bytes  = data.index_bytes();
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version       = MESH_CACHE_VERSION;
+	header.flags         = _flags;
+	header.options       = _options;
+	header.settings      = _settings;
+	header.vertex_size   = vertex_size;
+	header.index_size    = index_size;
+	header.num_sources   = _sources.size();
+	header.num_submeshes = data.submeshes.size();
+	header.num_lods      = data.lods.size();
+	header.num_meshlets  = data.meshlets.size();
+	header.num_textures  = data.textures.size();
+	header.num_vertices  = data.vertices.size();
+	header.num_indices   = data.indices.size();
+	header.bbox[0] = data.bbox_min.x; header.bbox[1] = data.bbox_min.y; header.bbox[2] = data.bbox_min.z;
+	header.bbox[3] = data.bbox_max.x; header.bbox[4] = data.bbox_max.y; header.bbox[5] = data.bbox_max.z;
+	header.sphere[0] = data.sphere_center.x; header.sphere[1] = data.sphere_center.y; 
+	header.sphere[2] = data.sphere_center.z; header.sphere[3] = data.sphere_radius;
+	header.vertex_offset = align16(meta);
+	header.index_offset  = align16(header.vertex_offset + vertex_bytes);
+	header.total_size    = header.index_offset + index_bytes;
+
+	// Scriviamo su un file temporaneo e poi lo rinominiamo: un caricamento
+	// concorrente non vede mai un file scritto a metà
+	std::string tmpname = _filename + ".tmp";
+	std::ofstream os(tmpname.c_str(), std::ios::binary | std::ios::trunc);
+	if (!os) return false;
+
+	os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (unsigned int i = 0 ; i < _sources.size() ; i++) {
+		uint64_t mtime = _sources[i].mtime;
+		uint64_t size  = _sources[i].size;
+		os.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+		os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		write_string(os, _sources[i].name);
+	}
+
+	for (unsigned int i = 0 ; i < data.submeshes.size() ; i++) {
+		uint32_t sm[8] = {
+			data.submeshes[i].base_vertex,
+			data.submeshes[i].num_vertices,
+			data.submeshes[i].base_index,
+			data.submeshes[i].num_indices,
+			data.submeshes[i].material,
+			data.submeshes[i].primitive,
+			data.submeshes[i].first_meshlet,
+			data.submeshes[i].num_meshlets
+		};
+		os.write(reinterpret_cast<const char*>(sm), sizeof(sm));
+	}
+
+	for (unsigned int i = 0 ; i < data.lods.size() ; i++) {
+		float    error = data.lods[i].error;
+		uint32_t first = data.lods[i].first_submesh;
+		os.write(reinterpret_cast<const char*>(&error), sizeof(error));
+		os.write(reinterpret_cast<const char*>(&first), sizeof(first));
+	}
+
+	if (!data.meshlets.empty()) {
+		os.write(reinterpret_cast<const char*>(data.meshlets.data()), data.meshlets.size() * sizeof(Meshlet));
+	}
+
+	for (unsigned int i = 0 ; i < data.textures.size() ; i++) {
+		write_string(os, data.textures[i]);
+	}
+
+	// La conversione nel formato finale passa da un piccolo buffer: non 
+	// serve una copia convertita di tutti i vertici e gli indici
+	const size_t block = 4096;
+	std::vector<char> buffer(block * std::max(vertex_size, index_size));
+
+	const char zeros[16] = {0};
+	os.write(zeros, header.vertex_offset - meta);
+	for (size_t first = 0 ; first < data.vertices.size() ; first += block) {
+		size_t count = std::min(block, data.vertices.size() - first);
+		Mesh::write_vertices(data, first, count, buffer.data());
+		os.write(buffer.data(), count * vertex_size);
+	}
+
+	os.write(zeros, header.index_offset - (header.vertex_offset + vertex_bytes));
+	for (size_t first = 0 ; first < data.indices.size() ; first += block) {
+		size_t count = std::min(block, data.indices.size() - first);
+		Mesh::write_indices(data, first, count, buffer.data());
+		os.write(buffer.data(), count * index_size);
+	}
+
+	os.close();
+	if (!os) {
+		std::remove(tmpname.c_str());
+		return false;
+	}
+
+	std::remove(_filename.c_str());
+	return std::rename(tmpname.c_str(), _filename.c_str()) == 0;
+}
@@ -0,0 +1,103 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "mappedfile.h"
+
+/**
+	Vista (in sola lettura) sul contenuto di un file di cache. I puntatori
+	ai vertici e agli indici puntano direttamente alla zona di memoria mappata
+	e restano validi finchè l'oggetto MeshCache che li ha prodotti è vivo.
+*/
+struct MeshCacheView {
+	const void   *vertices;     ///< Dati del VBO
+	unsigned int  num_vertices; ///< Numero di vertici
+	const void   *indices;      ///< Dati dell'IBO
+	unsigned int  num_indices;  ///< Numero di indici
+	unsigned int  index_size;   ///< Dimensione in byte di un indice (2 o 4)
+
+	std::vector<Mesh::SubMesh> submeshes; ///< Tabella delle sotto-mesh
+	std::vector<Mesh::Lod>     lods;      ///< Livelli di dettaglio
+	std::vector<Meshlet>       meshlets;  ///< Cluster delle sotto-mesh
+	std::vector<std::string>   textures;  ///< Texture di ogni materiale
+	glm::vec3 bbox_min;                   ///< Angolo minimo del bounding box
+	glm::vec3 bbox_max;                   ///< Angolo massimo del bounding box
+	glm::vec3 sphere_center;              ///< Centro della sfera che contiene la mesh
+	float     sphere_radius;              ///< Raggio della sfera che contiene la mesh
+
+	MeshCacheView();
+};
+
+/**
+	Classe che gestisce la cache binaria dei modelli caricati.
+
+	Al primo caricamento di un modello, il risultato della conversione
+	(VBO, IBO, tabella delle sotto-mesh e dei materiali, bounding box) viene
+	salvato in un file binario accanto al primo file sorgente. Il nome del
+	file di cache dipende dalla lista dei file sorgente e dai flag di
+	post-processing. Nell'header sono memorizzati, per ogni sorgente, la data
+	di ultima modifica e la dimensione: se un sorgente cambia, la cache viene
+	ignorata e riscritta.
+
+	Ai caricamenti successivi il file viene mappato in memoria e i dati
+	possono essere passati direttamente alla glBufferData, senza usare Assimp.
+*/
+class MeshCache {
+public:
+	/**
+		Costruttore.
+
+		@param Sources lista dei file sorgente del modello
+		@param flags assimp post processing flags usati nel caricamento
+		@param options opzioni di caricamento della Mesh
+		@param settings hash dei parametri delle opzioni (es. soglie)
+	*/
+	MeshCache(const std::vector<std::string> &Sources, unsigned int flags, unsigned int options=0,
+	          unsigned int settings=0);
+
+	/**
+		Mappa il file di cache e ne controlla la validità.
+
+		@param view struttura riempita con i dati contenuti nella cache
+		@return true se la cache esiste ed è valida per i sorgenti correnti
+	*/
+	bool open(MeshCacheView &view);
+
+	/**
+		Scrive il file di cache con i dati passati.
+
+		@param data dati della mesh da salvare
+		@return true se la scrittura è andata a buon fine
+	*/
+	bool write(const Mesh::MeshData &data) const;
+
+	/**
+		Ritorna il nome del file di cache
+	*/
+	const std::string &filename() const;
+
+private:
+	/**
+		Informazioni sui file sorgente usate per validare la cache
+	*/
+	struct SourceInfo {
+		std::string name;
+		unsigned long long mtime;
+		unsigned long long size;
+	};
+
+	std::vector<SourceInfo> _sources;
+	unsigned int _flags;
+	unsigned int _options;
+	unsigned int _settings;
+	std::string  _filename;
+	MappedFile   _file;
+
+	// Blocchiamo le operazioni di copia
+	MeshCache&operator=(const MeshCache &other);
+	MeshCache(const MeshCache &other);
+};
+
+#endif
@@ -0,0 +1,1234 @@
+#include "meshopt.h"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
+#include "glm/glm.hpp"
+
+namespace {
+
+	// Parametri dell'algoritmo di Forsyth
+	const int   CACHE_SIZE          = 32;
+	const float LAST_TRI_SCORE      = 0.75f;
+	const float CACHE_DECAY_POWER   = 1.5f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+	const int   MAX_VALENCE         = 32;
+
+	/**
+		Tabelle precalcolate dei punteggi dei vertici in funzione della
+		posizione in cache e del numero di triangoli non ancora emessi
+	*/
+	struct ScoreTables {
+		float cache[CACHE_SIZE];
+		float valence[MAX_VALENCE + 1];
+
+		ScoreTables() {
+			for (int i = 0 ; i < CACHE_SIZE ; i++) {
+				if (i < 3) {
+					// I vertici dell'ultimo triangolo hanno un punteggio fisso
+					// per evitare di emettere sempre lo stesso strip
+					cache[i] = LAST_TRI_SCORE;
+				}
+				else {
+					float scale = 1.0f - float(i - 3) / float(CACHE_SIZE - 3);
+					cache[i] = powf(scale, CACHE_DECAY_POWER);
+				}
+			}
+
+			valence[0] = 0.0f;
+			for (int i = 1 ; i <= MAX_VALENCE ; i++) {
+				valence[i] = VALENCE_BOOST_SCALE * powf(float(i), -VALENCE_BOOST_POWER);
+			}
+		}
+	};
+
+	const ScoreTables &score_tables() {
+		static const ScoreTables tables;
+		return tables;
+	}
+
+	/**
+		Cache FIFO simulata usata per misurare i miss di una sequenza di
+		triangoli
+	*/
+	class FifoCache {
+	public:
+		FifoCache(size_t num_vertices, unsigned int size) :
+			_timestamp(num_vertices, 0), _size(size), _time(size + 1) {}
+
+		/**
+			Svuota la cache
+		*/
+		void reset() {
+			_time += _size + 1;
+		}
+
+		/**
+			Simula l'accesso a un vertice e ritorna true in caso di miss
+		*/
+		bool miss(unsigned int v) {
+			if (_time - _timestamp[v] > _size) {
+				_timestamp[v] = _time++;
+				return true;
+			}
+			return false;
+		}
+
+		/**
+			Simula il rendering di un triangolo e ritorna il numero di miss
+		*/
+		unsigned int triangle(const unsigned int *tri) {
+			return miss(tri[0]) + miss(tri[1]) + miss(tri[2]);
+		}
+
+	private:
+		std::vector<size_t> _timestamp;
+		unsigned int _size;
+		size_t _time;
+	};
+
+	const unsigned int OVERDRAW_CACHE_SIZE = 16;
+
+	// Parametri della cache dei vertici in ingresso simulata da 
+	// compute_fetch_efficiency
+	const unsigned int FETCH_LINE_SIZE  = 64;
+	const unsigned int FETCH_CACHE_SIZE = 16 * 1024;
+
+	inline glm::vec3 position(const float *positions, size_t stride, unsigned int v) {
+		const float *p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + v * stride);
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	/**
+		Cluster di triangoli consecutivi con la chiave di ordinamento
+	*/
+	struct Cluster {
+		size_t first;   ///< Primo triangolo
+		size_t count;   ///< Numero di triangoli
+		float  sort;    ///< Potenziale di occlusione
+	};
+
+	bool cluster_less(const Cluster &a, const Cluster &b) {
+		// Prima i cluster rivolti verso l'esterno; a parità di chiave si
+		// mantiene l'ordine originale
+		if (a.sort != b.sort) return a.sort > b.sort;
+		return a.first < b.first;
+	}
+
+	/**
+		Quadrica di errore: somma (pesata con l'area) dei quadrati delle 
+		distanze dai piani dei triangoli
+	*/
+	struct Quadric {
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double w;
+
+		Quadric() : a00(0), a11(0), a22(0), a01(0), a02(0), a12(0), b0(0), b1(0), b2(0), c(0), w(0) {}
+
+		void add_plane(const glm::vec3 &n, float d, float weight) {
+			a00 += weight * n.x * n.x; a11 += weight * n.y * n.y; a22 += weight * n.z * n.z;
+			a01 += weight * n.x * n.y; a02 += weight * n.x * n.z; a12 += weight * n.y * n.z;
+			b0  += weight * n.x * d;   b1  += weight * n.y * d;   b2  += weight * n.z * d;
+			c   += weight * d * d;
+			w   += weight;
+		}
+
+		void add(const Quadric &q) {
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0  += q.b0;  b1  += q.b1;  b2  += q.b2;
+			c   += q.c;
+			w   += q.w;
+		}
+
+		/**
+			Ritorna la distanza quadratica media del punto dai piani
+		*/
+		double eval(const glm::vec3 &p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double e = a00 * x * x + a11 * y * y + a22 * z * z +
+			           2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+			           2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return w > 0.0 ? std::max(0.0, e / w) : 0.0;
+		}
+	};
+
+	/**
+		Candidato al collasso del vertice from sul vertice to
+	*/
+	struct Collapse {
+		unsigned int from;
+		unsigned int to;
+		float error;
+	};
+
+	bool collapse_less(const Collapse &a, const Collapse &b) {
+		if (a.error != b.error) return a.error < b.error;
+		if (a.from != b.from) return a.from < b.from;
+		return a.to < b.to;
+	}
+
+	float vertex_score(int cache_pos, unsigned int live_triangles) {
+		// Un vertice senza triangoli da emettere non contribuisce
+		if (live_triangles == 0) return -1.0f;
+
+		const ScoreTables &t = score_tables();
+
+		float score = (cache_pos >= 0) ? t.cache[cache_pos] : 0.0f;
+
+		return score + t.valence[live_triangles < (unsigned int)MAX_VALENCE ? live_triangles : MAX_VALENCE];
+	}
+}
+
+void optimize_vertex_cache(unsigned int *indices, size_t num_indices, size_t num_vertices) {
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles == 0) return;
+
+	// Lista di adiacenza vertice -> triangoli in formato compatto (CSR)
+	std::vector<unsigned int> live(num_vertices, 0);
+	for (size_t i = 0 ; i < num_triangles * 3 ; i++) {
+		live[indices[i]]++;
+	}
+
+	std::vector<unsigned int> offsets(num_vertices + 1, 0);
+	for (size_t v = 0 ; v < num_vertices ; v++) {
+		offsets[v + 1] = offsets[v] + live[v];
+	}
+
+	std::vector<unsigned int> adjacency(num_triangles * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0 ; t < num_triangles ; t++) {
+		for (int k = 0 ; k < 3 ; k++) {
+			unsigned int v = indices[t * 3 + k];
+			adjacency[fill[v]++] = t;
+		}
+	}
+
+	std::vector<int>   cache_pos(num_vertices, -1);
+	std::vector<float> vscore(num_vertices);
+	for (size_t v = 0 ; v < num_vertices ; v++) {
+		vscore[v] = vertex_score(-1, live[v]);
+	}
+
+	std::vector<float> tscore(num_triangles);
+	std::vector<char>  emitted(num_triangles, 0);
+
+	int   best_triangle = -1;
+	float best_score    = -1.0f;
+
+	for (size_t t = 0 ; t < num_triangles ; t++) {
+		tscore[t] = vscore[indices[t*3]] + vscore[indices[t*3+1]] + vscore[indices[t*3+2]];
+		if (tscore[t] > best_score) {
+			best_score = tscore[t];
+			best_triangle = t;
+		}
+	}
+
+	std::vector<unsigned int> output(num_triangles * 3);
+
+	// Cache LRU simulata. Durante l'aggiornamento può contenere fino a
+	// CACHE_SIZE + 3 vertici
+	unsigned int cache[CACHE_SIZE + 3];
+	unsigned int new_cache[CACHE_SIZE + 3];
+	int cache_count = 0;
+
+	size_t input_cursor = 0;
+
+	for (size_t out = 0 ; out < num_triangles ; out++) {
+
+		if (best_triangle < 0) {
+			// Nessun candidato tra i vertici in cache: riprendiamo dal
+			// primo triangolo non ancora emesso nell'ordine originale
+			while (emitted[input_cursor]) input_cursor++;
+			best_triangle = input_cursor;
+		}
+
+		const unsigned int *tri = &indices[best_triangle * 3];
+		emitted[best_triangle] = 1;
+
+		output[out * 3 + 0] = tri[0];
+		output[out * 3 + 1] = tri[1];
+		output[out * 3 + 2] = tri[2];
+
+		// Rimuoviamo il triangolo dalle liste di adiacenza dei suoi vertici
+		for (int k = 0 ; k < 3 ; k++) {
+			unsigned int v = tri[k];
+			unsigned int *list = &adjacency[offsets[v]];
+			for (unsigned int i = 0 ; i < live[v] ; i++) {
+				if (list[i] == (unsigned int)best_triangle) {
+					list[i] = list[live[v] - 1];
+					break;
+				}
+			}
+			live[v]--;
+		}
+
+		// I vertici del triangolo vanno in testa alla cache, seguiti dai
+		// vertici già presenti
+		int new_count = 0;
+		new_cache[new_count++] = tri[0];
+		new_cache[new_count++] = tri[1];
+		new_cache[new_count++] = tri[2];
+
+		for (int i = 0 ; i < cache_count ; i++) {
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				new_cache[new_count++] = v;
+			}
+		}
+
+		// Aggiorniamo i punteggi dei vertici in cache (e di quelli usciti)
+		for (int i = 0 ; i < new_count ; i++) {
+			unsigned int v = new_cache[i];
+			cache_pos[v] = (i < CACHE_SIZE) ? i : -1;
+			vscore[v] = vertex_score(cache_pos[v], live[v]);
+		}
+
+		// Ricalcoliamo i punteggi dei triangoli adiacenti e scegliamo il
+		// migliore come prossimo triangolo
+		best_triangle = -1;
+		best_score    = -1.0f;
+
+		int cached = new_count < CACHE_SIZE ? new_count : CACHE_SIZE;
+
+		for (int i = 0 ; i < new_count ; i++) {
+			unsigned int v = new_cache[i];
+			const unsigned int *list = &adjacency[offsets[v]];
+
+			for (unsigned int j = 0 ; j < live[v] ; j++) {
+				unsigned int t = list[j];
+				const unsigned int *ti = &indices[t * 3];
+				tscore[t] = vscore[ti[0]] + vscore[ti[1]] + vscore[ti[2]];
+
+				// Solo i triangoli con vertici ancora in cache sono candidati.
+				// A parità di punteggio vince l'indice più basso.
+				if (i < cached && (tscore[t] > best_score ||
+				                   (tscore[t] == best_score && (int)t < best_triangle))) {
+					best_score = tscore[t];
+					best_triangle = t;
+				}
+			}
+		}
+
+		memcpy(cache, new_cache, sizeof(unsigned int) * cached);
+		cache_count = cached;
+	}
+
+	memcpy(indices, &output[0], sizeof(unsigned int) * num_triangles * 3);
+}
+
+float compute_acmr(const unsigned int *indices, size_t num_indices, size_t num_vertices, unsigned int cache_size) {
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles == 0) return 0.0f;
+
+	// Cache FIFO: per ogni vertice memorizziamo il "timestamp" di ingresso
+	std::vector<size_t> timestamp(num_vertices, 0);
+	size_t time = cache_size + 1;
+	size_t misses = 0;
+
+	for (size_t i = 0 ; i < num_triangles * 3 ; i++) {
+		unsigned int v = indices[i];
+
+		if (time - timestamp[v] > cache_size) {
+			timestamp[v] = time++;
+			misses++;
+		}
+	}
+
+	return float(misses) / float(num_triangles);
+}
+
+void optimize_overdraw(unsigned int *indices, size_t num_indices, const float *positions, 
+                       size_t num_vertices, size_t stride, float threshold) {
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles < 2) return;
+
+	FifoCache cache(num_vertices, OVERDRAW_CACHE_SIZE);
+
+	// Confini "hard": triangoli con tre miss, dove l'ordine della cache 
+	// ricomincia da capo
+	std::vector<size_t> hard;
+	for (size_t t = 0 ; t < num_triangles ; t++) {
+		if (cache.triangle(&indices[t * 3]) == 3 || t == 0) hard.push_back(t);
+	}
+	hard.push_back(num_triangles);
+
+	// Confini "soft": all'interno di un cluster hard, spezziamo appena
+	// l'ACMR accumulato scende sotto la soglia rispetto a quello del cluster
+	std::vector<Cluster> clusters;
+
+	for (size_t h = 0 ; h + 1 < hard.size() ; h++) {
+		size_t start = hard[h], end = hard[h + 1];
+
+		cache.reset();
+		unsigned int cluster_misses = 0;
+		for (size_t t = start ; t < end ; t++) {
+			cluster_misses += cache.triangle(&indices[t * 3]);
+		}
+		float cluster_threshold = threshold * float(cluster_misses) / float(end - start);
+
+		cache.reset();
+		unsigned int misses = 0;
+		size_t first = start;
+
+		for (size_t t = start ; t < end ; t++) {
+			misses += cache.triangle(&indices[t * 3]);
+
+			if (t + 1 == end || float(misses) / float(t + 1 - first) <= cluster_threshold) {
+				Cluster c;
+				c.first = first;
+				c.count = t + 1 - first;
+				c.sort  = 0.0f;
+				clusters.push_back(c);
+
+				first  = t + 1;
+				misses = 0;
+				cache.reset();
+			}
+		}
+	}
+
+	// Centro della mesh (baricentro pesato con le aree dei triangoli)
+	glm::vec3 mesh_center(0.0f);
+	float mesh_area = 0.0f;
+
+	for (size_t t = 0 ; t < num_triangles ; t++) {
+		glm::vec3 a = position(positions, stride, indices[t * 3 + 0]);
+		glm::vec3 b = position(positions, stride, indices[t * 3 + 1]);
+		glm::vec3 c = position(positions, stride, indices[t * 3 + 2]);
+		float area = glm::length(glm::cross(b - a, c - a));
+		mesh_center += (a + b + c) * (area / 3.0f);
+		mesh_area   += area;
+	}
+	mesh_center /= (mesh_area > 0.0f ? mesh_area : 1.0f);
+
+	// Potenziale di occlusione: quanto il cluster è "esterno" rispetto al 
+	// centro della mesh, nella direzione della sua normale media
+	for (size_t i = 0 ; i < clusters.size() ; i++) {
+		Cluster &cl = clusters[i];
+
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area_sum = 0.0f;
+
+		for (size_t t = cl.first ; t < cl.first + cl.count ; t++) {
+			glm::vec3 a = position(positions, stride, indices[t * 3 + 0]);
+			glm::vec3 b = position(positions, stride, indices[t * 3 + 1]);
+			glm::vec3 c = position(positions, stride, indices[t * 3 + 2]);
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float area = glm::length(n);
+			center   += (a + b + c) * (area / 3.0f);
+			normal   += n;
+			area_sum += area;
+		}
+
+		if (area_sum > 0.0f) center /= area_sum;
+		float len = glm::length(normal);
+		if (len > 0.0f) normal /= len;
+
+		cl.sort = glm::dot(center - mesh_center, normal);
+	}
+
+	std::sort(clusters.begin(), clusters.end(), cluster_less);
+
+	std::vector<unsigned int> output;
+	output.reserve(num_triangles * 3);
+
+	for (size_t i = 0 ; i < clusters.size() ; i++) {
+		const unsigned int *first = &indices[clusters[i].first * 3];
+		output.insert(output.end(), first, first + clusters[i].count * 3);
+	}
+
+	memcpy(indices, &output[0], sizeof(unsigned int) * num_triangles * 3);
+}
+
+float compute_overdraw(const unsigned int *indices, size_t num_indices, const float *positions, 
+                       size_t num_vertices, size_t stride) {
+	const int RES = 256;
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles == 0 || num_vertices == 0) return 0.0f;
+
+	glm::vec3 bmin = position(positions, stride, 0), bmax = bmin;
+	for (size_t v = 1 ; v < num_vertices ; v++) {
+		glm::vec3 p = position(positions, stride, v);
+		bmin = glm::min(bmin, p);
+		bmax = glm::max(bmax, p);
+	}
+
+	glm::vec3 extent = bmax - bmin;
+	float scale = std::max(extent.x, std::max(extent.y, extent.z));
+	if (scale <= 0.0f) return 0.0f;
+	scale = (RES - 1) / scale;
+
+	std::vector<float> depth(RES * RES);
+	size_t shaded = 0, covered = 0;
+
+	// Sei viste ortografiche lungo gli assi principali
+	for (int axis = 0 ; axis < 3 ; axis++) {
+		for (int dir = 0 ; dir < 2 ; dir++) {
+			int ua = (axis + 1) % 3, va = (axis + 2) % 3;
+			float sign = dir ? -1.0f : 1.0f;
+
+			std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+
+			for (size_t t = 0 ; t < num_triangles ; t++) {
+				float x[3], y[3], z[3];
+				for (int k = 0 ; k < 3 ; k++) {
+					glm::vec3 p = (position(positions, stride, indices[t * 3 + k]) - bmin) * scale;
+					// Specchiamo u nella vista opposta per mantenere l'orientamento
+					x[k] = dir ? (RES - 1) - p[ua] : p[ua];
+					y[k] = p[va];
+					z[k] = -sign * p[axis];
+				}
+
+				float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+				// Back-face culling (e triangoli degeneri)
+				if (sign * area <= 0.0f) continue;
+
+				int minx = std::max(0, (int)floorf(std::min(x[0], std::min(x[1], x[2]))));
+				int maxx = std::min(RES - 1, (int)ceilf(std::max(x[0], std::max(x[1], x[2]))));
+				int miny = std::max(0, (int)floorf(std::min(y[0], std::min(y[1], y[2]))));
+				int maxy = std::min(RES - 1, (int)ceilf(std::max(y[0], std::max(y[1], y[2]))));
+
+				float inv_area = 1.0f / area;
+
+				for (int py = miny ; py <= maxy ; py++) {
+					for (int px = minx ; px <= maxx ; px++) {
+						float cx = px + 0.5f, cy = py + 0.5f;
+						float w0 = ((x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1])) * inv_area;
+						float w1 = ((x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2])) * inv_area;
+						float w2 = 1.0f - w0 - w1;
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+						float d = w0 * z[0] + w1 * z[1] + w2 * z[2];
+						float &dst = depth[py * RES + px];
+						if (d < dst) {
+							if (dst == std::numeric_limits<float>::max()) covered++;
+							dst = d;
+							shaded++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return covered ? float(shaded) / float(covered) : 0.0f;
+}
+
+size_t generate_weld_remap(unsigned int *remap, const float *vertices, size_t num_vertices, size_t stride,
+                           const float *epsilons, size_t num_components) {
+	// Componenti quantizzate di tutti i vertici, memorizzate in modo 
+	// contiguo: i confronti durante la ricerca non toccano i vertici
+	std::vector<int32_t> keys(num_vertices * num_components);
+
+	for (size_t i = 0 ; i < num_vertices ; i++) {
+		const float *v = reinterpret_cast<const float*>(reinterpret_cast<const char*>(vertices) + i * stride);
+		int32_t *key = &keys[i * num_components];
+
+		for (size_t c = 0 ; c < num_components ; c++) {
+			if (epsilons[c] > 0.0f) {
+				double q = std::floor(double(v[c]) / epsilons[c] + 0.5);
+				key[c] = int32_t(std::max(-2147483647.0, std::min(2147483647.0, q)));
+			}
+			else {
+				// Uguaglianza esatta (0 e -0 sono lo stesso valore)
+				float value = (v[c] == 0.0f) ? 0.0f : v[c];
+				memcpy(&key[c], &value, sizeof(value));
+			}
+		}
+	}
+
+	// Tabella hash ad indirizzamento aperto con scansione lineare: 
+	// contiene l'indice del primo vertice con ogni chiave
+	size_t capacity = 1;
+	while (capacity < num_vertices * 2) capacity *= 2;
+
+	const unsigned int EMPTY = ~0u;
+	std::vector<unsigned int> table(capacity, EMPTY);
+	const size_t key_bytes = num_components * sizeof(int32_t);
+
+	size_t unique = 0;
+
+	for (size_t i = 0 ; i < num_vertices ; i++) {
+		const int32_t *key = &keys[i * num_components];
+
+		uint32_t h = 2166136261u;
+		for (size_t c = 0 ; c < num_components ; c++) {
+			h = (h ^ uint32_t(key[c])) * 16777619u;
+		}
+		h ^= h >> 15;
+
+		size_t slot = h & (capacity - 1);
+		while (table[slot] != EMPTY && memcmp(&keys[table[slot] * num_components], key, key_bytes) != 0) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+
+		if (table[slot] == EMPTY) {
+			table[slot] = i;
+			remap[i] = unique++;
+		}
+		else {
+			remap[i] = remap[table[slot]];
+		}
+	}
+
+	return unique;
+}
+
+size_t optimize_vertex_fetch(void *vertices, unsigned int *indices, size_t num_indices, 
+                             size_t num_vertices, size_t vertex_size) {
+	const unsigned int UNUSED = ~0u;
+
+	// I vertici sono rinumerati nell'ordine in cui vengono usati dagli indici;
+	// quelli mai referenziati restano senza numero e vengono scartati
+	std::vector<unsigned int> remap(num_vertices, UNUSED);
+	unsigned int next = 0;
+
+	for (size_t i = 0 ; i < num_indices ; i++) {
+		unsigned int &r = remap[indices[i]];
+		if (r == UNUSED) r = next++;
+		indices[i] = r;
+	}
+
+	std::vector<char> original(static_cast<char*>(vertices), static_cast<char*>(vertices) + num_vertices * vertex_size);
+	char *dst = static_cast<char*>(vertices);
+
+	for (size_t v = 0 ; v < num_vertices ; v++) {
+		if (remap[v] != UNUSED) {
+			memcpy(dst + remap[v] * vertex_size, &original[v * vertex_size], vertex_size);
+		}
+	}
+
+	return next;
+}
+
+float compute_fetch_efficiency(const unsigned int *indices, size_t num_indices, size_t num_vertices, 
+                               size_t vertex_size) {
+	if (num_indices == 0 || num_vertices == 0 || vertex_size == 0) return 0.0f;
+
+	FifoCache transform(num_vertices, OVERDRAW_CACHE_SIZE);
+
+	// Cache delle linee di memoria del vertex buffer, anch'essa FIFO
+	size_t num_lines = (num_vertices * vertex_size + FETCH_LINE_SIZE - 1) / FETCH_LINE_SIZE;
+	const unsigned int cache_lines = FETCH_CACHE_SIZE / FETCH_LINE_SIZE;
+	std::vector<size_t> line_time(num_lines, 0);
+	size_t time = cache_lines + 1;
+
+	std::vector<bool> used(num_vertices, false);
+	size_t num_used = 0;
+	size_t fetched = 0;
+
+	for (size_t i = 0 ; i < num_indices ; i++) {
+		unsigned int v = indices[i];
+
+		if (!used[v]) {
+			used[v] = true;
+			num_used++;
+		}
+
+		// Solo i vertici che mancano la cache post-transform vengono letti
+		// dal vertex buffer
+		if (!transform.miss(v)) continue;
+
+		size_t first = v * vertex_size / FETCH_LINE_SIZE;
+		size_t last  = (v * vertex_size + vertex_size - 1) / FETCH_LINE_SIZE;
+
+		for (size_t l = first ; l <= last ; l++) {
+			if (time - line_time[l] > cache_lines) {
+				line_time[l] = time++;
+				fetched += FETCH_LINE_SIZE;
+			}
+		}
+	}
+
+	return fetched ? float(num_used * vertex_size) / float(fetched) : 0.0f;
+}
+
+size_t simplify(unsigned int *destination, const unsigned int *indices, size_t num_indices,
+                const float *positions, size_t num_vertices, size_t stride,
+                size_t target_index_count, float target_error, float *result_error) {
+	if (result_error) *result_error = 0.0f;
+
+	// Scartiamo subito i triangoli degeneri
+	std::vector<unsigned int> tris;
+	tris.reserve(num_indices);
+	for (size_t i = 0 ; i + 3 <= num_indices ; i += 3) {
+		unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		if (a != b && b != c && a != c) {
+			tris.push_back(a); tris.push_back(b); tris.push_back(c);
+		}
+	}
+
+	std::vector<char> locked(num_vertices, 0);
+
+	// Vertici con la stessa posizione (cuciture di normali o UV): ordiniamo 
+	// i vertici per posizione e blocchiamo quelli duplicati
+	std::vector<unsigned int> order(num_vertices);
+	for (size_t v = 0 ; v < num_vertices ; v++) order[v] = v;
+
+	auto position_less = [&](unsigned int a, unsigned int b) {
+		glm::vec3 pa = position(positions, stride, a), pb = position(positions, stride, b);
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		if (pa.z != pb.z) return pa.z < pb.z;
+		return a < b;
+	};
+	std::sort(order.begin(), order.end(), position_less);
+
+	std::vector<unsigned int> position_id(num_vertices);
+	for (size_t i = 0 ; i < num_vertices ; i++) {
+		unsigned int v = order[i];
+		position_id[v] = v;
+		if (i > 0 && position(positions, stride, v) == position(positions, stride, order[i - 1])) {
+			position_id[v] = position_id[order[i - 1]];
+			locked[v] = locked[order[i - 1]] = 1;
+		}
+	}
+
+	// Bordi aperti e spigoli non manifold: ogni spigolo interno deve essere
+	// percorso una volta per verso. Le chiavi sono gli spigoli ordinati 
+	// (sulle posizioni), i valori contano le occorrenze nei due versi.
+	std::vector<std::pair<unsigned long long, unsigned int> > edges;
+	edges.reserve(tris.size());
+	for (size_t i = 0 ; i < tris.size() ; i += 3) {
+		for (int k = 0 ; k < 3 ; k++) {
+			unsigned int a = position_id[tris[i + k]], b = position_id[tris[i + (k + 1) % 3]];
+			unsigned long long key = a < b ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a);
+			edges.push_back(std::make_pair(key, a < b ? 1u : 0x10000u));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	for (size_t i = 0 ; i < edges.size() ; ) {
+		size_t j = i;
+		unsigned int count = 0;
+		while (j < edges.size() && edges[j].first == edges[i].first) count += edges[j++].second;
+
+		if (count != 0x10001u) {
+			unsigned int a = edges[i].first >> 32, b = edges[i].first & 0xFFFFFFFFu;
+			locked[a] = locked[b] = 1;
+		}
+		i = j;
+	}
+
+	// I vertici bloccati tramite il rappresentante della posizione
+	for (size_t v = 0 ; v < num_vertices ; v++) {
+		if (locked[position_id[v]]) locked[v] = 1;
+	}
+
+	std::vector<Quadric> quadrics(num_vertices);
+	for (size_t i = 0 ; i < tris.size() ; i += 3) {
+		glm::vec3 p0 = position(positions, stride, tris[i]);
+		glm::vec3 p1 = position(positions, stride, tris[i + 1]);
+		glm::vec3 p2 = position(positions, stride, tris[i + 2]);
+
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float len = glm::length(n);
+		if (len <= 0.0f) continue;
+		n /= len;
+
+		for (int k = 0 ; k < 3 ; k++) {
+			quadrics[tris[i + k]].add_plane(n, -glm::dot(n, p0), len * 0.5f);
+		}
+	}
+
+	std::vector<unsigned int> remap(num_vertices);
+	std::vector<char> touched(num_vertices);
+	std::vector<unsigned int> offsets(num_vertices + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<Collapse> candidates;
+	float max_error = 0.0f;
+	float limit_scale = 1.5f;
+
+	// Ad ogni passata eseguiamo i collassi meno costosi che non coinvolgono
+	// vertici già modificati nella stessa passata
+	while (tris.size() > target_index_count) {
+		size_t num_triangles = tris.size() / 3;
+
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (size_t i = 0 ; i < tris.size() ; i++) offsets[tris[i] + 1]++;
+		for (size_t v = 0 ; v < num_vertices ; v++) offsets[v + 1] += offsets[v];
+
+		adjacency.resize(tris.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0 ; t < num_triangles ; t++) {
+			for (int k = 0 ; k < 3 ; k++) adjacency[fill[tris[t * 3 + k]]++] = t;
+		}
+
+		candidates.clear();
+		for (size_t i = 0 ; i < tris.size() ; i += 3) {
+			for (int k = 0 ; k < 3 ; k++) {
+				unsigned int a = tris[i + k], b = tris[i + (k + 1) % 3];
+				for (int dir = 0 ; dir < 2 ; dir++) {
+					unsigned int from = dir ? b : a, to = dir ? a : b;
+					if (locked[from]) continue;
+
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+
+					Collapse c = { from, to, (float)sqrt(q.eval(position(positions, stride, to))) };
+					candidates.push_back(c);
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), collapse_less);
+
+		for (size_t v = 0 ; v < num_vertices ; v++) remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t target_triangles = target_index_count / 3;
+		size_t removed = 0;
+		size_t collapses = 0;
+
+		// Ogni collasso rimuove circa due triangoli: limitiamo l'errore della
+		// passata a quello dei candidati più economici che bastano a 
+		// raggiungere l'obiettivo, così i collassi costosi sono rimandati 
+		// alle passate successive (dove possono diventare superflui)
+		size_t goal = (num_triangles - target_triangles) / 2;
+		float pass_error = target_error;
+		if (goal < candidates.size()) {
+			pass_error = std::min(pass_error, candidates[goal].error * limit_scale);
+		}
+
+		for (size_t i = 0 ; i < candidates.size() ; i++) {
+			const Collapse &c = candidates[i];
+
+			if (c.error > pass_error || num_triangles - removed <= target_triangles) break;
+			if (touched[c.from] || touched[c.to]) continue;
+
+			// Il collasso non deve ribaltare i triangoli che restano
+			bool valid = true;
+			size_t shared = 0;
+			glm::vec3 target = position(positions, stride, c.to);
+
+			for (unsigned int j = offsets[c.from] ; j < offsets[c.from + 1] && valid ; j++) {
+				const unsigned int *tri = &tris[adjacency[j] * 3];
+				if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+					shared++;
+					continue;
+				}
+
+				glm::vec3 p[3], q[3];
+				for (int k = 0 ; k < 3 ; k++) {
+					p[k] = q[k] = position(positions, stride, tri[k]);
+					if (tri[k] == c.from) q[k] = target;
+				}
+
+				glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+				if (glm::dot(n0, n1) <= 0.0f) valid = false;
+			}
+
+			if (!valid) continue;
+
+			remap[c.from] = c.to;
+			quadrics[c.to].add(quadrics[c.from]);
+
+			for (unsigned int j = offsets[c.from] ; j < offsets[c.from + 1] ; j++) {
+				const unsigned int *tri = &tris[adjacency[j] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+
+			removed += shared;
+			collapses++;
+			max_error = std::max(max_error, c.error);
+		}
+
+		// Se nessun collasso è valido entro il limite della passata, 
+		// riproviamo con un limite più alto
+		if (collapses == 0) {
+			if (pass_error >= target_error) break;
+			limit_scale *= 2.0f;
+			continue;
+		}
+		limit_scale = 1.5f;
+
+		size_t count = 0;
+		for (size_t i = 0 ; i < tris.size() ; i += 3) {
+			unsigned int a = remap[tris[i]], b = remap[tris[i + 1]], c = remap[tris[i + 2]];
+			if (a != b && b != c && a != c) {
+				tris[count++] = a; tris[count++] = b; tris[count++] = c;
+			}
+		}
+		tris.resize(count);
+	}
+
+	if (!tris.empty()) memcpy(destination, &tris[0], tris.size() * sizeof(unsigned int));
+	if (result_error) *result_error = max_error;
+
+	return tris.size();
+}
+
+size_t build_meshlets(std::vector<Meshlet> &meshlets, unsigned int *indices, size_t num_indices,
+                      const float *positions, size_t num_vertices, size_t stride,
+                      size_t max_vertices, size_t max_triangles) {
+	const size_t num_triangles = num_indices / 3;
+	const size_t first_meshlet = meshlets.size();
+
+	// Adiacenza vertice -> triangoli (in formato compatto)
+	std::vector<unsigned int> offsets(num_vertices + 1, 0);
+	for (size_t i = 0 ; i < num_indices ; i++) offsets[indices[i] + 1]++;
+	for (size_t v = 0 ; v < num_vertices ; v++) offsets[v + 1] += offsets[v];
+
+	std::vector<unsigned int> adjacency(num_indices);
+	{
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0 ; i < num_indices ; i++) adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	// Normale e baricentro di ogni triangolo
+	std::vector<glm::vec3> normals(num_triangles), centroids(num_triangles);
+	for (size_t t = 0 ; t < num_triangles ; t++) {
+		glm::vec3 p0 = position(positions, stride, indices[t * 3]);
+		glm::vec3 p1 = position(positions, stride, indices[t * 3 + 1]);
+		glm::vec3 p2 = position(positions, stride, indices[t * 3 + 2]);
+
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float len = glm::length(n);
+		normals[t]   = (len > 0.0f) ? n / len : glm::vec3(0.0f);
+		centroids[t] = (p0 + p1 + p2) / 3.0f;
+	}
+
+	std::vector<bool> emitted(num_triangles, false);
+	std::vector<unsigned int> order;
+	order.reserve(num_triangles);
+
+	// Per sapere se un vertice è già nel cluster corrente memorizziamo 
+	// l'indice dell'ultimo cluster che lo ha usato
+	std::vector<size_t> last_meshlet(num_vertices, size_t(-1));
+	std::vector<unsigned int> meshlet_vertices;
+
+	// I cluster partono dal primo triangolo non ancora usato nell'ordine in
+	// input e crescono aggiungendo il triangolo adiacente che introduce 
+	// meno vertici nuovi e, a parità, quello più vicino e con la normale
+	// più allineata al cluster. Così i cluster restano compatti e con un
+	// cono delle normali stretto.
+	size_t seed = 0;
+	while (order.size() < num_triangles) {
+		while (emitted[seed]) seed++;
+
+		const size_t id = meshlets.size();
+		const size_t start = order.size();
+		glm::vec3 axis(0.0f), center(0.0f);
+		meshlet_vertices.clear();
+
+		size_t next = seed;
+		while (next != size_t(-1)) {
+			emitted[next] = true;
+			order.push_back(next);
+			axis   += normals[next];
+			center += centroids[next];
+
+			for (int k = 0 ; k < 3 ; k++) {
+				unsigned int v = indices[next * 3 + k];
+				if (last_meshlet[v] != id) {
+					last_meshlet[v] = id;
+					meshlet_vertices.push_back(v);
+				}
+			}
+
+			const size_t count = order.size() - start;
+			if (count >= max_triangles) break;
+
+			const glm::vec3 mean = center / float(count);
+			const float len = glm::length(axis);
+			const glm::vec3 direction = (len > 0.0f) ? axis / len : glm::vec3(0.0f);
+
+			// Scala delle distanze: raggio medio dei triangoli del cluster
+			float extent = 0.0f;
+			for (size_t i = start ; i < order.size() ; i++) {
+				extent = std::max(extent, glm::length(centroids[order[i]] - mean));
+			}
+			if (extent <= 0.0f) extent = 1.0f;
+
+			next = size_t(-1);
+			unsigned int best_added = 4;
+			float best_score = std::numeric_limits<float>::max();
+
+			for (size_t i = 0 ; i < meshlet_vertices.size() ; i++) {
+				const unsigned int v = meshlet_vertices[i];
+				for (unsigned int a = offsets[v] ; a < offsets[v + 1] ; a++) {
+					const unsigned int t = adjacency[a];
+					if (emitted[t]) continue;
+
+					unsigned int added = 0;
+					for (int k = 0 ; k < 3 ; k++) {
+						if (last_meshlet[indices[t * 3 + k]] != id) added++;
+					}
+					if (meshlet_vertices.size() + added > max_vertices || added > best_added) continue;
+
+					float score = glm::length(centroids[t] - mean) / extent + 
+					              2.0f * (1.0f - glm::dot(normals[t], direction));
+
+					if (added < best_added || score < best_score) {
+						best_added = added;
+						best_score = score;
+						next = t;
+					}
+				}
+			}
+
+			// Senza triangoli adiacenti (es. mesh non indicizzate) i cluster
+			// piccoli cercano tra i prossimi triangoli nell'ordine in input 
+			// quelli vicini e con la normale allineata, per non allargare il
+			// cono
+			if (next == size_t(-1) && count * 4 < max_triangles && meshlet_vertices.size() + 3 <= max_vertices) {
+				size_t window = 0;
+				for (size_t t = seed ; t < num_triangles && window < max_triangles ; t++) {
+					if (emitted[t]) continue;
+					window++;
+
+					if (glm::dot(normals[t], direction) < 0.7f) continue;
+
+					float score = glm::length(centroids[t] - mean) / extent;
+					if (score < 2.0f && score < best_score) {
+						best_score = score;
+						next = t;
+					}
+				}
+			}
+		}
+
+		Meshlet m;
+		m.first_index = start * 3;
+		m.num_indices = (order.size() - start) * 3;
+		meshlets.push_back(m);
+	}
+
+	// Riscriviamo gli indici nell'ordine dei cluster
+	std::vector<unsigned int> source(indices, indices + num_triangles * 3);
+	for (size_t i = 0 ; i < order.size() ; i++) {
+		for (int k = 0 ; k < 3 ; k++) indices[i * 3 + k] = source[order[i] * 3 + k];
+	}
+
+	// Volumi di culling
+	for (size_t i = first_meshlet ; i < meshlets.size() ; i++) {
+		Meshlet &m = meshlets[i];
+		const unsigned int *tri = indices + m.first_index;
+
+		glm::vec3 bmin(std::numeric_limits<float>::max()), bmax(-std::numeric_limits<float>::max());
+		glm::vec3 axis(0.0f);
+		std::vector<glm::vec3> normals;
+		normals.reserve(m.num_indices / 3);
+
+		for (size_t j = 0 ; j < m.num_indices ; j += 3) {
+			glm::vec3 p0 = position(positions, stride, tri[j]);
+			glm::vec3 p1 = position(positions, stride, tri[j + 1]);
+			glm::vec3 p2 = position(positions, stride, tri[j + 2]);
+
+			bmin = glm::min(bmin, glm::min(p0, glm::min(p1, p2)));
+			bmax = glm::max(bmax, glm::max(p0, glm::max(p1, p2)));
+
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float len = glm::length(n);
+			if (len > 0.0f) {
+				normals.push_back(n / len);
+				axis += n / len;
+			}
+		}
+
+		glm::vec3 center = (bmin + bmax) * 0.5f;
+		float radius = 0.0f;
+		for (size_t j = 0 ; j < m.num_indices ; j++) {
+			radius = std::max(radius, glm::length(position(positions, stride, tri[j]) - center));
+		}
+
+		// Il cono è valido solo se tutte le normali stanno in un semi-spazio
+		// con un po' di margine
+		float min_dot = 1.0f;
+		float len = glm::length(axis);
+		if (len > 0.0f) {
+			axis /= len;
+			for (size_t j = 0 ; j < normals.size() ; j++) {
+				min_dot = std::min(min_dot, glm::dot(axis, normals[j]));
+			}
+		}
+		else {
+			min_dot = -1.0f;
+		}
+
+		for (int k = 0 ; k < 3 ; k++) {
+			m.center[k]    = center[k];
+			m.cone_axis[k] = axis[k];
+		}
+		m.radius = radius;
+		m.cone_cutoff = (min_dot > 0.1f) ? sqrtf(1.0f - min_dot * min_dot) : 1.0f;
+	}
+
+	return meshlets.size() - first_meshlet;
+}
+
+bool meshlet_backfacing(const Meshlet &m, const float *eye) {
+	if (m.cone_cutoff >= 1.0f) return false;
+
+	// Tutti i triangoli sono girati dall'altra parte se la direzione di 
+	// vista forma con l'asse del cono un angolo minore di 90 gradi meno il
+	// semi-angolo del cono, per ogni punto della sfera
+	glm::vec3 d(m.center[0] - eye[0], m.center[1] - eye[1], m.center[2] - eye[2]);
+	glm::vec3 axis(m.cone_axis[0], m.cone_axis[1], m.cone_axis[2]);
+
+	return glm::dot(d, axis) >= m.cone_cutoff * glm::length(d) + m.radius;
+}
+
+size_t stripify(unsigned int *destination, const unsigned int *indices, size_t num_indices, 
+                size_t num_vertices, unsigned int restart_index) {
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles == 0) return 0;
+
+	// Lista di adiacenza vertice -> triangoli in formato compatto (CSR)
+	std::vector<unsigned int> offsets(num_vertices + 1, 0);
+	for (size_t i = 0 ; i < num_triangles * 3 ; i++) {
+		offsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0 ; v < num_vertices ; v++) {
+		offsets[v + 1] += offsets[v];
+	}
+
+	std::vector<unsigned int> adjacency(num_triangles * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0 ; t < num_triangles ; t++) {
+		for (int k = 0 ; k < 3 ; k++) {
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	std::vector<char> emitted(num_triangles, 0);
+
+	// Cerca un triangolo non ancora emesso con il lato orientato a->b e 
+	// ne ritorna il terzo vertice
+	auto find = [&](unsigned int a, unsigned int b, unsigned int &third) -> int {
+		for (unsigned int j = offsets[a] ; j < offsets[a + 1] ; j++) {
+			unsigned int t = adjacency[j];
+			if (emitted[t]) continue;
+
+			const unsigned int *tri = &indices[t * 3];
+			for (int k = 0 ; k < 3 ; k++) {
+				if (tri[k] == a && tri[(k + 1) % 3] == b) {
+					third = tri[(k + 2) % 3];
+					return t;
+				}
+			}
+		}
+		return -1;
+	};
+
+	size_t count = 0;
+
+	for (size_t start = 0 ; start < num_triangles ; start++) {
+		if (emitted[start]) continue;
+		emitted[start] = 1;
+
+		// Ruotiamo il primo triangolo in modo che la strip possa proseguire
+		// oltre il suo ultimo lato, se possibile
+		const unsigned int *tri = &indices[start * 3];
+		int rotation = 0;
+		for (int r = 0 ; r < 3 ; r++) {
+			unsigned int third;
+			if (find(tri[(r + 2) % 3], tri[(r + 1) % 3], third) >= 0) {
+				rotation = r;
+				break;
+			}
+		}
+
+		if (count > 0) destination[count++] = restart_index;
+
+		destination[count++] = tri[rotation];
+		destination[count++] = tri[(rotation + 1) % 3];
+		destination[count++] = tri[(rotation + 2) % 3];
+
+		// Il triangolo i della strip è (i, i+1, i+2) per i pari e 
+		// (i+1, i, i+2) per i dispari
+		for (size_t i = 1 ; ; i++) {
+			unsigned int p = destination[count - 2];
+			unsigned int q = destination[count - 1];
+			unsigned int third;
+
+			int t = (i & 1) ? find(q, p, third) : find(p, q, third);
+			if (t < 0) break;
+
+			emitted[t] = 1;
+			destination[count++] = third;
+		}
+	}
+
+	return count;
+}
+
+unsigned short quantize_half(float v) {
+	unsigned int u;
+	memcpy(&u, &v, sizeof(u));
+
+	unsigned int sign = (u >> 16) & 0x8000;
+	unsigned int abs  = u & 0x7fffffff;
+
+	// NaN e infinito
+	if (abs >= 0x7f800000) return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+
+	// Valori che arrotondano oltre 65504
+	if (abs >= 0x477ff000) return sign | 0x7c00;
+
+	// Valori denormalizzati in half (minori di 2^-14)
+	if (abs < 0x38800000) {
+		float f;
+		memcpy(&f, &abs, sizeof(f));
+		return sign | (unsigned short)lrintf(f * 16777216.0f);
+	}
+
+	// Cambiamo il bias dell'esponente (127 -> 15) e arrotondiamo la mantissa
+	// al più vicino (pari in caso di parità)
+	unsigned int h = (abs - 0x38000000) >> 13;
+	unsigned int rem = abs & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+
+	return sign | h;
+}
+
+float dequantize_half(unsigned short h) {
+	unsigned int sign = (h & 0x8000) << 16;
+	unsigned int exp  = (h >> 10) & 0x1f;
+	unsigned int mant = h & 0x3ff;
+
+	if (exp == 0) {
+		float f = mant / 16777216.0f;
+		return sign ? -f : f;
+	}
+
+	unsigned int u = (exp == 31) ? (sign | 0x7f800000 | (mant << 13)) : (sign | ((exp + 112) << 23) | (mant << 13));
+
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+unsigned int pack_snorm_10_10_10_2(float x, float y, float z) {
+	float v[3] = {x, y, z};
+	unsigned int p = 0;
+
+	for (int k = 0 ; k < 3 ; k++) {
+		int c = (int)lrintf(std::max(-1.0f, std::min(1.0f, v[k])) * 511.0f);
+		p |= (unsigned int)(c & 0x3ff) << (10 * k);
+	}
+
+	return p;
+}
+
+void unpack_snorm_10_10_10_2(unsigned int p, float &x, float &y, float &z) {
+	float v[3];
+
+	for (int k = 0 ; k < 3 ; k++) {
+		// Estensione del segno a 10 bit
+		int c = (int)((p >> (10 * k)) & 0x3ff);
+		if (c & 0x200) c -= 0x400;
+		v[k] = std::max(-1.0f, c / 511.0f);
+	}
+
+	x = v[0];
+	y = v[1];
+	z = v[2];
+}
@@ -0,0 +1,253 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+	Funzioni di ottimizzazione delle mesh indicizzate usate durante il
+	caricamento dei modelli.
+
+	Tutte le funzioni lavorano su liste di triangoli (3 indici per triangolo)
+	con indici relativi al primo vertice della mesh (0..num_vertices-1) e
+	sono deterministiche: a parità di input producono sempre lo stesso
+	output, in modo che il risultato possa essere salvato nella cache.
+*/
+
+/**
+	Cluster (meshlet) di triangoli contigui nella lista degli indici, con 
+	i volumi usati per il culling lato CPU
+*/
+struct Meshlet {
+	unsigned int first_index; ///< Primo indice del cluster (relativo alla lista)
+	unsigned int num_indices; ///< Numero di indici del cluster
+	float center[3];          ///< Centro della sfera che contiene il cluster
+	float radius;             ///< Raggio della sfera
+	float cone_axis[3];       ///< Asse del cono delle normali dei triangoli
+	float cone_cutoff;        ///< Seno del semi-angolo del cono (1 = nessun culling)
+};
+
+/**
+	Calcola la tabella di rimappatura che unisce i vertici uguali a meno
+	delle tolleranze indicate. Ogni vertice è formato da num_components 
+	float consecutivi (es. posizione, normale e coordinate di texture); le
+	componenti sono quantizzate con la loro tolleranza e i vertici con le
+	stesse componenti quantizzate sono uniti usando una tabella hash ad 
+	indirizzamento aperto. Una tolleranza pari a 0 richiede l'uguaglianza
+	esatta. I vertici unici mantengono l'ordine della loro prima occorrenza.
+
+	@param remap array di num_vertices elementi che riceve il nuovo indice
+	       di ogni vertice
+	@param vertices puntatore alla prima componente del primo vertice
+	@param num_vertices numero di vertici
+	@param stride distanza in byte tra due vertici consecutivi
+	@param epsilons tolleranza di ogni componente
+	@param num_components numero di componenti float di ogni vertice
+	@return il numero di vertici unici
+*/
+size_t generate_weld_remap(unsigned int *remap, const float *vertices, size_t num_vertices, size_t stride,
+                           const float *epsilons, size_t num_components);
+
+/**
+	Riordina i triangoli per massimizzare il riuso dei vertici nella cache
+	post-transform della GPU (algoritmo di Tom Forsyth, "Linear-Speed Vertex
+	Cache Optimisation"). I vertici non vengono modificati.
+
+	@param indices lista degli indici da riordinare (in place)
+	@param num_indices numero di indici (multiplo di 3)
+	@param num_vertices numero di vertici referenziati dagli indici
+*/
+void optimize_vertex_cache(unsigned int *indices, size_t num_indices, size_t num_vertices);
+
+/**
+	Calcola l'ACMR (Average Cache Miss Ratio), cioè il numero medio di
+	vertici trasformati per triangolo, simulando una cache FIFO.
+	Il valore ottimo tende a 0.5, il caso peggiore è 3.
+
+	@param indices lista degli indici
+	@param num_indices numero di indici (multiplo di 3)
+	@param num_vertices numero di vertici referenziati dagli indici
+	@param cache_size dimensione della cache simulata
+	@return l'ACMR della lista di indici
+*/
+float compute_acmr(const unsigned int *indices, size_t num_indices, size_t num_vertices, unsigned int cache_size=16);
+
+/**
+	Riordina i triangoli per ridurre l'overdraw delle mesh opache. I triangoli
+	(già ottimizzati per la cache con optimize_vertex_cache) sono divisi in
+	cluster nei punti in cui l'ordine non dipende dalla cache; i cluster sono
+	poi ordinati in base al loro potenziale di occlusione indipendente dal
+	punto di vista: prima i cluster rivolti verso l'esterno della mesh.
+	La soglia regola il compromesso tra ACMR e overdraw: valori vicini a 1.0
+	cambiano poco l'ACMR, valori maggiori producono più cluster (più piccoli)
+	che possono essere ordinati più liberamente, a scapito dell'ACMR.
+
+	@param indices lista degli indici da riordinare (in place)
+	@param num_indices numero di indici (multiplo di 3)
+	@param positions puntatore alla prima coordinata x dei vertici
+	@param num_vertices numero di vertici
+	@param stride distanza in byte tra le posizioni di due vertici consecutivi
+	@param threshold soglia di ACMR accettabile rispetto all'ordine in input
+*/
+void optimize_overdraw(unsigned int *indices, size_t num_indices, const float *positions, 
+                       size_t num_vertices, size_t stride, float threshold);
+
+/**
+	Stima l'overdraw della lista di triangoli rasterizzandola in software da
+	sei direzioni (assi principali) con depth test e back-face culling.
+	Il valore ritornato è il rapporto tra i frammenti che passano il depth 
+	test e i pixel coperti: 1.0 indica nessun overdraw.
+
+	@param indices lista degli indici
+	@param num_indices numero di indici (multiplo di 3)
+	@param positions puntatore alla prima coordinata x dei vertici
+	@param num_vertices numero di vertici
+	@param stride distanza in byte tra le posizioni di due vertici consecutivi
+	@return l'overdraw medio della lista di triangoli
+*/
+float compute_overdraw(const unsigned int *indices, size_t num_indices, const float *positions, 
+                       size_t num_vertices, size_t stride);
+
+/**
+	Riordina i vertici nell'ordine in cui vengono usati dalla lista di indici
+	(che viene aggiornata di conseguenza) e scarta quelli non referenziati.
+	Va eseguita dopo le ottimizzazioni che riordinano i triangoli: le letture
+	dei vertici diventano quasi sequenziali e il vertex buffer si riduce.
+
+	@param vertices array dei vertici da riordinare (in place)
+	@param indices lista degli indici da aggiornare (in place)
+	@param num_indices numero di indici
+	@param num_vertices numero di vertici
+	@param vertex_size dimensione in byte di un vertice
+	@return il numero di vertici rimasti, compattati all'inizio dell'array
+*/
+size_t optimize_vertex_fetch(void *vertices, unsigned int *indices, size_t num_indices, 
+                             size_t num_vertices, size_t vertex_size);
+
+/**
+	Calcola l'efficienza delle letture dal vertex buffer simulando la cache
+	post-transform (FIFO di 16 vertici) e una cache di 16KB a linee di 64
+	byte. Il valore è il rapporto tra i byte dei vertici usati e i byte 
+	effettivamente letti: 1.0 indica che ogni vertice è letto una volta sola.
+
+	@param indices lista degli indici
+	@param num_indices numero di indici
+	@param num_vertices numero di vertici
+	@param vertex_size dimensione in byte di un vertice
+	@return l'efficienza delle letture (tra 0 e 1 circa)
+*/
+float compute_fetch_efficiency(const unsigned int *indices, size_t num_indices, size_t num_vertices, 
+                               size_t vertex_size);
+
+/**
+	Semplifica una lista di triangoli con il collasso degli spigoli guidato
+	dalle quadriche di errore (Garland-Heckbert). Ogni collasso sposta un 
+	vertice su un suo vicino, quindi il risultato usa un sottoinsieme dei 
+	vertici originali e può condividere lo stesso vertex buffer. 
+	I vertici che si trovano su un bordo aperto o su una cucitura (più 
+	vertici con la stessa posizione ma normali o coordinate di texture 
+	diverse) non vengono mai rimossi, in modo da preservare i bordi e le 
+	discontinuità degli attributi. I collassi che ribaltano dei triangoli
+	sono scartati.
+
+	@param destination buffer di output (almeno num_indices elementi)
+	@param indices lista degli indici dei triangoli
+	@param num_indices numero di indici (multiplo di 3)
+	@param positions puntatore alla prima coordinata x dei vertici
+	@param num_vertices numero di vertici
+	@param stride distanza in byte tra le posizioni di due vertici consecutivi
+	@param target_index_count numero di indici desiderato
+	@param target_error errore massimo consentito (distanza in coordinate locali)
+	@param result_error se non nullo, riceve l'errore massimo dei collassi eseguiti
+	@return il numero di indici scritti in destination
+*/
+size_t simplify(unsigned int *destination, const unsigned int *indices, size_t num_indices,
+                const float *positions, size_t num_vertices, size_t stride,
+                size_t target_index_count, float target_error, float *result_error);
+
+/**
+	Divide la lista di triangoli in cluster con al più max_vertices vertici
+	distinti e max_triangles triangoli. I triangoli sono riordinati in modo
+	che ogni cluster sia un intervallo contiguo della lista: ogni cluster 
+	parte dal primo triangolo non ancora usato nell'ordine in input (così,
+	partendo da un ordine ottimizzato per la cache e per l'overdraw, 
+	l'ordine complessivo è in buona parte preservato) e cresce per 
+	adiacenza preferendo i triangoli vicini e con normali simili. Per ogni 
+	cluster sono calcolati la sfera che lo contiene e il cono delle normali.
+
+	@param meshlets vettore che riceve i cluster (in coda)
+	@param indices lista degli indici da riordinare (in place)
+	@param num_indices numero di indici (multiplo di 3)
+	@param positions puntatore alla prima coordinata x dei vertici
+	@param num_vertices numero di vertici
+	@param stride distanza in byte tra le posizioni di due vertici consecutivi
+	@param max_vertices numero massimo di vertici per cluster
+	@param max_triangles numero massimo di triangoli per cluster
+	@return il numero di cluster aggiunti
+*/
+size_t build_meshlets(std::vector<Meshlet> &meshlets, unsigned int *indices, size_t num_indices,
+                      const float *positions, size_t num_vertices, size_t stride,
+                      size_t max_vertices, size_t max_triangles);
+
+/**
+	Ritorna true se tutti i triangoli del cluster sono sicuramente rivolti 
+	dalla parte opposta rispetto al punto di vista.
+
+	@param m cluster
+	@param eye posizione della camera (nello stesso sistema dei vertici)
+*/
+bool meshlet_backfacing(const Meshlet &m, const float *eye);
+
+/**
+	Converte una lista di triangoli in triangle strip separate dall'indice
+	di primitive restart. Le strip sono costruite in modo greedy seguendo 
+	l'adiacenza dei triangoli e partendo dai triangoli nell'ordine della 
+	lista, così da mantenere in buona parte l'ordine per la cache. 
+	L'orientamento dei triangoli è preservato.
+
+	@param destination buffer di output (almeno (num_indices / 3) * 4 elementi)
+	@param indices lista degli indici dei triangoli
+	@param num_indices numero di indici (multiplo di 3)
+	@param num_vertices numero di vertici referenziati dagli indici
+	@param restart_index indice usato per separare le strip
+	@return il numero di indici scritti in destination
+*/
+size_t stripify(unsigned int *destination, const unsigned int *indices, size_t num_indices, 
+                size_t num_vertices, unsigned int restart_index);
+
+/**
+	Converte un float in half float (IEEE 754 a 16 bit) con arrotondamento
+	al più vicino. I valori fuori range diventano infinito.
+
+	@param v valore da convertire
+	@return la rappresentazione a 16 bit del valore
+*/
+unsigned short quantize_half(float v);
+
+/**
+	Converte un half float in float
+
+	@param h rappresentazione a 16 bit del valore
+	@return il valore convertito
+*/
+float dequantize_half(unsigned short h);
+
+/**
+	Impacchetta un vettore con componenti in [-1, 1] nel formato 
+	GL_INT_2_10_10_10_REV normalizzato (la componente w vale 0).
+
+	@param x,y,z componenti del vettore
+	@return il vettore impacchettato
+*/
+unsigned int pack_snorm_10_10_10_2(float x, float y, float z);
+
+/**
+	Estrae le componenti x, y, z da un vettore nel formato 
+	GL_INT_2_10_10_10_REV normalizzato
+
+	@param p vettore impacchettato
+	@param x,y,z componenti del vettore
+*/
+void unpack_snorm_10_10_10_2(unsigned int p, float &x, float &y, float &z);
+
+#endif
@@ -1,33 +1,87 @@
 #include "myshaderclass.h"
+#include "uniformbuffer.h"
 #include "utilities.h"
+#include "transform.h"
+#include "lightclusters.h"
 
-void MyShaderClass::set_model_transform(const glm::mat4 &transform) {
-  glUniformMatrix4fv(_model_transform_location, 1, GL_FALSE, const_cast<float *>(&transform[0][0]));       
+#include <cstddef>
+
+static_assert(sizeof(MyShaderClass::FrameBlock) == 192, "FrameBlock non rispetta il layout std140");
+static_assert(sizeof(MyShaderClass::ObjectBlock) == 144, "ObjectBlock non rispetta il layout std140");
+
+namespace {
+  // I buffer dei blocchi sono condivisi da tutti i programmi e non vengono
+  // mai distrutti (come GpuMemory)
+  UniformBuffer &frame_buffer() {
+    static UniformBuffer *buffer = new UniformBuffer(MyShaderClass::FRAME_BLOCK, sizeof(MyShaderClass::FrameBlock), "frame uniforms");
+    return *buffer;
+  }
+
+  UniformBuffer &object_buffer() {
+    static UniformBuffer *buffer = new UniformBuffer(MyShaderClass::OBJECT_BLOCK, sizeof(MyShaderClass::ObjectBlock), "object uniforms");
+    return *buffer;
+  }
+
+  void store_normal_matrix(MyShaderClass::ObjectBlock &block, const glm::mat3 &normal) {
+    for (unsigned int c = 0 ; c < 3 ; c++) {
+      block.normal_matrix[c] = glm::vec4(normal[c], 0.0f);
+    }
+  }
 }
 
-void MyShaderClass::set_camera_transform(const glm::mat4 &transform) {
-  glUniformMatrix4fv(_camera_transform_location, 1, GL_FALSE, const_cast<float *>(&transform[0][0]));       
+MyShaderClass::MyShaderClass(VertexShader vertex_shader) : _vertex_shader(vertex_shader) {}
+
+MyShaderClass::VertexShader MyShaderClass::vertex_shader() const {
+  return _vertex_shader;
 }
 
-void MyShaderClass::set_ambient_light(const AmbientLight &al) {
-  glUniform3fv(_ambient_color_location, 1, const_cast<float *>(&al.color()[0]));
-  glUniform1f(_ambient_intensity_location, al.intensity());
+void MyShaderClass::set_frame_uniforms(const glm::mat4 &camera_transform, const glm::vec3 &camera_position,
+                                       const AmbientLight &al, const DiffusiveLight &dl, const SpecularLight &sl,
+                                       const LightClusters &clusters) {
+  FrameBlock block;
+  block.world2camera = camera_transform;
+  block.ambient_color = al.color();
+  block.ambient_intensity = al.intensity();
+  block.diffusive_color = dl.color();
+  block.diffusive_direction = glm::normalize(dl.direction());
+  block.diffusive_intensity = dl.intensity();
+  block.specular_intensity = sl.intensity();
+  block.specular_shininess = sl.shininess();
+  block.camera_position = camera_position;
+
+  const LightClusters::Grid &grid = clusters.grid();
+  block.cluster_depth_plane = grid.depth_plane;
+  block.cluster_tile_scale = grid.tile_scale;
+  block.cluster_depth_scale = grid.depth_scale;
+  block.cluster_depth_bias = grid.depth_bias;
+  block.cluster_count = glm::ivec3(LightClusters::CLUSTERS_X, LightClusters::CLUSTERS_Y, LightClusters::CLUSTERS_Z);
+
+  frame_buffer().update(&block);
 }
 
-void MyShaderClass::set_diffusive_light(const DiffusiveLight &dl) {
-  glm::vec3 direction_normalized = glm::normalize(dl.direction());
-  glUniform3fv(_diffusive_color_location, 1, const_cast<float *>(&dl.color()[0]));
-  glUniform3fv(_diffusive_direction_location, 1, const_cast<float *>(&direction_normalized[0]));
-  glUniform1f(_diffusive_intensity_location, dl.intensity());
+void MyShaderClass::set_object_uniforms(const glm::mat4 &transform, const glm::mat3 &normal, 
+                                        const glm::vec3 &scale, const glm::vec3 &bias) {
+  ObjectBlock block;
+  block.model2world = transform;
+  store_normal_matrix(block, normal);
+  block.position_scale = scale;
+  block.position_bias = bias;
+
+  object_buffer().update(&block);
 }
 
-void MyShaderClass::set_specular_light(const SpecularLight &sl) {
-  glUniform1f(_specular_intensity_location, sl.intensity());
-  glUniform1f(_specular_shininess_location, sl.shininess());
+void MyShaderClass::set_model_transform(const glm::mat4 &transform) {
+  // Le due matrici sono consecutive: basta un aggiornamento
+  ObjectBlock block;
+  block.model2world = transform;
+  store_normal_matrix(block, LocalTransform::normal_matrix(transform));
+
+  object_buffer().update(&block, 0, offsetof(ObjectBlock, position_scale));
 }
 
-void MyShaderClass::set_camera_position(const glm::vec3 &pos) {
-  glUniform3fv(_camera_position_location, 1, const_cast<float *>(&pos[0]));
+void MyShaderClass::set_position_dequantization(const glm::vec3 &scale, const glm::vec3 &bias) {
+  object_buffer().update(&scale[0], offsetof(ObjectBlock, position_scale), sizeof(glm::vec3));
+  object_buffer().update(&bias[0], offsetof(ObjectBlock, position_bias), sizeof(glm::vec3));
 }
 
 
@@ -35,37 +89,36 @@ void MyShaderClass::set_sampler(int sampler_id) {
   glUniform1i(_texture_sampler_location, sampler_id);
 }
 
-bool MyShaderClass::load_shaders() {
-  return  add_shader(GL_VERTEX_SHADER,"14.vert") &&
-          add_shader(GL_FRAGMENT_SHADER,"14.frag");
+void MyShaderClass::set_light_samplers(int first_unit) {
+  glUniform1i(_light_data_location, first_unit);
+  glUniform1i(_cluster_grid_location, first_unit + 1);
+  glUniform1i(_light_indices_location, first_unit + 2);
 }
 
-bool MyShaderClass::load_done() {
-  _model_transform_location = get_uniform_location("Model2World");
-  _camera_transform_location = get_uniform_location("World2Camera");
+bool MyShaderClass::load_shaders() {
+  const char *vertex_files[] = { "14.vert", "14_instanced.vert", "14_indirect.vert" };
 
-  _ambient_color_location     = get_uniform_location("AmbientLight.color");
-  _ambient_intensity_location = get_uniform_location("AmbientLight.intensity");
+  // Le varianti usano le funzioni di 14_common.vert
+  if (_vertex_shader != STANDARD && !add_shader(GL_VERTEX_SHADER, "14_common.vert")) return false;
 
-  _diffusive_color_location     = get_uniform_location("DiffusiveLight.color");
-  _diffusive_direction_location = get_uniform_location("DiffusiveLight.direction");
-  _diffusive_intensity_location = get_uniform_location("DiffusiveLight.intensity");
+  return  add_shader(GL_VERTEX_SHADER, vertex_files[_vertex_shader]) &&
+          add_shader(GL_FRAGMENT_SHADER,"14.frag");
+}
 
-  _specular_intensity_location  = get_uniform_location("SpecularLight.intensity");
-  _specular_shininess_location  = get_uniform_location("SpecularLight.shininess");
-  _camera_position_location     = get_uniform_location("CameraPosition");
+bool MyShaderClass::load_done() {
+  // Con le draw call indirect la dequantizzazione è un attributo per 
+  // oggetto, ma il blocco ObjectBlock è lo stesso per tutti gli shader
+  bool frame_block  = bind_uniform_block("FrameBlock", FRAME_BLOCK);
+  bool object_block = bind_uniform_block("ObjectBlock", OBJECT_BLOCK);
 
   _texture_sampler_location     = get_uniform_location("TextSampler");
+  _light_data_location          = get_uniform_location("LightData");
+  _cluster_grid_location        = get_uniform_location("ClusterGrid");
+  _light_indices_location       = get_uniform_location("LightIndices");
 
-  return  (_model_transform_location != INVALID_UNIFORM_LOCATION) &&
-          (_camera_transform_location != INVALID_UNIFORM_LOCATION) &&
-          (_ambient_color_location != INVALID_UNIFORM_LOCATION) &&
-          (_ambient_intensity_location != INVALID_UNIFORM_LOCATION) &&
-          (_diffusive_color_location != INVALID_UNIFORM_LOCATION) &&
-          (_diffusive_direction_location != INVALID_UNIFORM_LOCATION) &&
-          (_diffusive_intensity_location != INVALID_UNIFORM_LOCATION) &&
-          (_specular_intensity_location != INVALID_UNIFORM_LOCATION) &&
-          (_specular_shininess_location != INVALID_UNIFORM_LOCATION) &&
-          (_camera_position_location != INVALID_UNIFORM_LOCATION) &&
-          (_texture_sampler_location != INVALID_UNIFORM_LOCATION);
+  return  frame_block && object_block &&
+          (_texture_sampler_location != INVALID_UNIFORM_LOCATION) &&
+          (_light_data_location != INVALID_UNIFORM_LOCATION) &&
+          (_cluster_grid_location != INVALID_UNIFORM_LOCATION) &&
+          (_light_indices_location != INVALID_UNIFORM_LOCATION);
 }
@@ -4,54 +4,150 @@
 #include "shaderclass.h"
 #include "light.h"
 
+class LightClusters;
+
 /**
     Classe che include le funzionalità specifiche legate agli shader da usare
     nell'applicazione. 
     Sono stati overloadati i metodi load_shaders e load_done.
     Sono stati inseriti due metodi pubblici per settare la matrice di trasformazione
     delle coordinate dei vertici. 
+
+    La camera e le luci sono nello uniform block FrameBlock, la matrice del
+    modello e la dequantizzazione delle posizioni nel blocco ObjectBlock 
+    (layout std140). I due blocchi sono condivisi da tutti i programmi: la 
+    camera e le luci vanno impostate una volta per frame con 
+    set_frame_uniforms(), per ogni draw call basta aggiornare ObjectBlock.
+
+    Le luci puntiformi e spot sono lette dal fragment shader dalle buffer 
+    texture di LightClusters, collegate alle TextureUnit impostate con 
+    set_light_samplers().
 */
 class MyShaderClass : public ShaderClass {
 public:
 
     /**
-        Setta la matrice di trasformazione nel vertex shader
+        Varianti del vertex shader
+    */
+    enum VertexShader {
+        STANDARD,  ///< Un modello per draw call (14.vert)
+        INSTANCED, ///< Rendering instanced (14_instanced.vert, vedi Mesh::render_instanced)
+        INDIRECT   ///< Draw call indirect (14_indirect.vert, vedi IndirectBatch)
+    };
 
-        @param transform matrice 4x4 di trasformazione  
+    /**
+        Punti di binding degli uniform block, comuni a tutti i programmi
     */
-    void set_model_transform(const glm::mat4 &transform);
+    enum BlockBinding {
+        FRAME_BLOCK  = 0, ///< Camera e luci (FrameBlock)
+        OBJECT_BLOCK = 1  ///< Matrici e dequantizzazione del modello (ObjectBlock)
+    };
 
     /**
-        Setta la matrice di trasformazione di camera completa
+        Contenuto dello uniform block FrameBlock degli shader (layout std140)
+    */
+    struct FrameBlock {
+        glm::mat4 world2camera;        ///< World2Camera
+        glm::vec3 ambient_color;       ///< AmbientLight.color
+        float     ambient_intensity;   ///< AmbientLight.intensity
+        glm::vec3 diffusive_color;     ///< DiffusiveLight.color
+        float     padding0;
+        glm::vec3 diffusive_direction; ///< DiffusiveLight.direction (normalizzata)
+        float     diffusive_intensity; ///< DiffusiveLight.intensity
+        float     specular_intensity;  ///< SpecularLight.intensity
+        float     specular_shininess;  ///< SpecularLight.shininess
+        float     padding1[2];
+        glm::vec3 camera_position;     ///< CameraPosition
+        float     padding2;
+        glm::vec4 cluster_depth_plane; ///< ClusterDepthPlane
+        glm::vec2 cluster_tile_scale;  ///< ClusterTileScale
+        float     cluster_depth_scale; ///< ClusterDepthScale
+        float     cluster_depth_bias;  ///< ClusterDepthBias
+        glm::ivec3 cluster_count;      ///< ClusterCount
+        int       padding3;
+    };
 
-        @param transform matrice 4x4 di trasformazione  
+    /**
+        Contenuto dello uniform block ObjectBlock degli shader (layout std140)
     */
-    void set_camera_transform(const glm::mat4 &transform);
+    struct ObjectBlock {
+        glm::mat4 model2world;      ///< Model2World
+        glm::vec4 normal_matrix[3]; ///< NormalMatrix (in std140 ogni colonna di una mat3 occupa un vec4)
+        glm::vec3 position_scale;   ///< PositionScale
+        float     padding0;
+        glm::vec3 position_bias;    ///< PositionBias
+        float     padding1;
+    };
 
     /**
-        Setta le proprietà della luce ambientale
+        Costruttore
 
-        @param al informazioni relative alla luce ambientale
+        @param vertex_shader variante del vertex shader. Con INSTANCED e 
+               INDIRECT la matrice impostata con set_model_transform è 
+               applicata a tutte le istanze (oggetti). Con INDIRECT i 
+               parametri di dequantizzazione sono letti per oggetto e
+               set_position_dequantization non ha effetto.
+    */
+    explicit MyShaderClass(VertexShader vertex_shader=STANDARD);
+
+    /**
+        Ritorna la variante del vertex shader
     */
-    void set_ambient_light(const AmbientLight &al);
+    VertexShader vertex_shader() const;
 
     /**
-        Setta le proprietà della luce diffusiva
+        Setta la camera e le luci per tutti i programmi (FrameBlock). Va 
+        chiamata una volta per frame, dopo LightClusters::update().
 
+        @param camera_transform matrice 4x4 di trasformazione di camera completa
+        @param camera_position posizione della camera in coordinate mondo
+        @param al informazioni relative alla luce ambientale
         @param dl informazioni relative alla luce diffusiva
+        @param sl informazioni relative alla luce speculare
+        @param clusters luci puntiformi e spot assegnate ai cluster
     */
-    void set_diffusive_light(const DiffusiveLight &dl);
+    static void set_frame_uniforms(const glm::mat4 &camera_transform, const glm::vec3 &camera_position,
+                                   const AmbientLight &al, const DiffusiveLight &dl, const SpecularLight &sl,
+                                   const LightClusters &clusters);
 
     /**
-        Setta le proprietà della luce speculare
+        Setta la matrice di trasformazione, la matrice delle normali e i 
+        parametri di dequantizzazione del modello da disegnare (ObjectBlock),
+        con un solo aggiornamento
 
-        @param sl informazioni relative alla luce speculare
+        @param transform matrice 4x4 di trasformazione  
+        @param normal matrice 3x3 delle normali (es. LocalTransform::N())
+        @param scale scala delle posizioni
+        @param bias offset delle posizioni
     */
-    void set_specular_light(const SpecularLight &sl);
+    static void set_object_uniforms(const glm::mat4 &transform, const glm::mat3 &normal, 
+                                    const glm::vec3 &scale, const glm::vec3 &bias);
 
-    void set_camera_position(const glm::vec3 &pos);
+    /**
+        Setta la matrice di trasformazione nel vertex shader. La matrice 
+        delle normali è calcolata con LocalTransform::normal_matrix()
+
+        @param transform matrice 4x4 di trasformazione  
+    */
+    static void set_model_transform(const glm::mat4 &transform);
+
+    /**
+        Setta i parametri per ricostruire le posizioni dei vertici quantizzati
+        (vedi Mesh::position_scale() e Mesh::position_bias())
+
+        @param scale scala delle posizioni
+        @param bias offset delle posizioni
+    */
+    static void set_position_dequantization(const glm::vec3 &scale, const glm::vec3 &bias);
 
     void set_sampler(int sampler_id);
+
+    /**
+        Setta le TextureUnit delle buffer texture delle luci
+
+        @param first_unit prima delle tre TextureUnit (vedi LightClusters::first_unit())
+    */
+    void set_light_samplers(int first_unit);
 private:
 
     /**
@@ -69,21 +165,12 @@ private:
     */
     virtual bool load_done();
 
-    GLint _model_transform_location; ///<< Location della variabile Model2World
-    GLint _camera_transform_location; ///<< Location della variabile World2Camera
-
-    GLint _ambient_color_location; ///<< Location del colore della luce ambientale
-    GLint _ambient_intensity_location; ///<< Location dell'intensità della luce ambientale
-
-    GLint _diffusive_color_location; ///<< Location del colore della luce diffusiva
-    GLint _diffusive_direction_location; ///<< Location del colore della luce diffusiva
-    GLint _diffusive_intensity_location; ///<< Location dell'intensità della luce diffusiva
-
-    GLint _specular_intensity_location;
-    GLint _specular_shininess_location;
-    GLint _camera_position_location;
-
     GLint _texture_sampler_location;
+    GLint _light_data_location;
+    GLint _cluster_grid_location;
+    GLint _light_indices_location;
+
+    VertexShader _vertex_shader; ///<< Variante del vertex shader
 
 };
 #endif
\ No newline at end of file
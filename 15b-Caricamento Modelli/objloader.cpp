@@ -0,0 +1,577 @@
+#include "objloader.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+
+namespace {
+
+	/**
+		Indici (0-based) di posizione, texture e normale di un angolo di una
+		faccia. -1 indica una componente assente, valori minori di -1 sono
+		indici relativi alla fine del blocco (vedi RELATIVE_BIAS).
+	*/
+	struct Corner {
+		int v, t, n;
+	};
+
+	/**
+		Gli indici negativi dell'OBJ sono relativi all'ultimo vertice letto.
+		Durante l'analisi in parallelo di un blocco non conosciamo il numero
+		di vertici dei blocchi precedenti: memorizziamo l'indice relativo al
+		blocco spostato di RELATIVE_BIAS e lo correggiamo dopo.
+	*/
+	const int RELATIVE_BIAS = 1 << 30;
+
+	/**
+		Cambio di stato che precede la faccia di indice face nel blocco
+	*/
+	struct Event {
+		enum Type { MATERIAL, OBJECT, LIBRARY }; ///< OBJECT: riga o oppure g
+
+		Type        type;
+		size_t      face;
+		std::string name;
+	};
+
+	/**
+		Risultato dell'analisi di un blocco di righe del file
+	*/
+	struct Chunk {
+		std::vector<float>        positions; ///< 3 float per vertice
+		std::vector<float>        texcoords; ///< 2 float per vertice
+		std::vector<float>        normals;   ///< 3 float per vertice
+		std::vector<Corner>       corners;   ///< Angoli di tutte le facce
+		std::vector<unsigned int> faces;     ///< Numero di angoli di ogni faccia
+		std::vector<Event>        events;    ///< Cambi di materiale/oggetto
+		std::string               error;     ///< Primo errore incontrato
+	};
+
+	/**
+		Vertice usato come chiave per unire gli angoli identici
+	*/
+	struct VertexKey {
+		float attributes[8]; ///< Posizione, normale e coordinate di texture
+
+		explicit VertexKey(const Mesh::Vertex &v) {
+			attributes[0] = v.position.x;  attributes[1] = v.position.y;  attributes[2] = v.position.z;
+			attributes[3] = v.normal.x;    attributes[4] = v.normal.y;    attributes[5] = v.normal.z;
+			attributes[6] = v.textcoord.x; attributes[7] = v.textcoord.y;
+		}
+
+		bool operator==(const VertexKey &other) const {
+			return memcmp(attributes, other.attributes, sizeof(attributes)) == 0;
+		}
+	};
+
+	struct VertexKeyHash {
+		size_t operator()(const VertexKey &k) const {
+			uint32_t bits[8];
+			memcpy(bits, k.attributes, sizeof(bits));
+
+			uint64_t h = 14695981039346656037ULL;
+			for (int i = 0 ; i < 8 ; i++) {
+				h = (h ^ bits[i]) * 1099511628211ULL;
+			}
+			return h ^ (h >> 32);
+		}
+	};
+
+	inline const char *skip_spaces(const char *p, const char *end) {
+		while (p < end && (*p == ' ' || *p == '\t')) p++;
+		return p;
+	}
+
+	/**
+		Confronta la parola chiave all'inizio della riga
+	*/
+	inline bool keyword(const char *p, const char *end, const char *key, size_t len) {
+		return size_t(end - p) >= len && memcmp(p, key, len) == 0 &&
+		       (size_t(end - p) == len || p[len] == ' ' || p[len] == '\t');
+	}
+
+	/**
+		Ritorna il resto della riga senza spazi iniziali e finali
+	*/
+	std::string rest_of_line(const char *p, const char *end) {
+		p = skip_spaces(p, end);
+		while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+		return std::string(p, end);
+	}
+
+	/**
+		Conversione veloce di un numero decimale in float. Le cifre sono
+		accumulate in un intero a 64 bit e scalate una sola volta con una
+		potenza di 10: il risultato differisce da strtod al più di un ulp
+		nei casi comuni.
+	*/
+	const char *parse_float(const char *p, const char *end, float &value) {
+		static const double POW10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		p = skip_spaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int exponent = 0, digits = 0;
+
+		for ( ; p < end && *p >= '0' && *p <= '9' ; p++) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa > 0) digits++;
+			}
+			else {
+				exponent++;
+			}
+		}
+
+		if (p < end && *p == '.') {
+			for (p++ ; p < end && *p >= '0' && *p <= '9' ; p++) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa > 0) digits++;
+					exponent--;
+				}
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			p++;
+			bool negative_exp = false;
+			if (p < end && (*p == '-' || *p == '+')) {
+				negative_exp = (*p == '-');
+				p++;
+			}
+			int e = 0;
+			for ( ; p < end && *p >= '0' && *p <= '9' ; p++) {
+				if (e < 10000) e = e * 10 + (*p - '0');
+			}
+			exponent += negative_exp ? -e : e;
+		}
+
+		double v = double(mantissa);
+		if (exponent < 0) {
+			v = (exponent >= -22) ? v / POW10[-exponent] : v * std::pow(10.0, exponent);
+		}
+		else if (exponent > 0) {
+			v = (exponent <= 22) ? v * POW10[exponent] : v * std::pow(10.0, exponent);
+		}
+
+		value = float(negative ? -v : v);
+		return p;
+	}
+
+	/**
+		Legge un intero con segno. Ritorna nullptr se non ci sono cifre.
+	*/
+	const char *parse_int(const char *p, const char *end, int &value) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			p++;
+		}
+
+		if (p == end || *p < '0' || *p > '9') return nullptr;
+
+		int v = 0;
+		for ( ; p < end && *p >= '0' && *p <= '9' ; p++) {
+			v = v * 10 + (*p - '0');
+		}
+
+		value = negative ? -v : v;
+		return p;
+	}
+
+	/**
+		Converte un indice dell'OBJ (1-based o negativo) nel formato di Corner
+	*/
+	inline bool resolve_index(int index, size_t local_count, int &result) {
+		if (index > 0) {
+			result = index - 1;
+		}
+		else if (index < 0) {
+			result = int(local_count) + index - RELATIVE_BIAS;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	bool parse_face(const char *p, const char *end, Chunk &chunk) {
+		unsigned int count = 0;
+
+		for (p = skip_spaces(p, end) ; p < end ; p = skip_spaces(p, end)) {
+			Corner c = { -1, -1, -1 };
+			int index;
+
+			p = parse_int(p, end, index);
+			if (p == nullptr || !resolve_index(index, chunk.positions.size() / 3, c.v)) return false;
+
+			if (p < end && *p == '/') {
+				p++;
+				if (p < end && *p != '/') {
+					p = parse_int(p, end, index);
+					if (p == nullptr || !resolve_index(index, chunk.texcoords.size() / 2, c.t)) return false;
+				}
+				if (p < end && *p == '/') {
+					p = parse_int(p + 1, end, index);
+					if (p == nullptr || !resolve_index(index, chunk.normals.size() / 3, c.n)) return false;
+				}
+			}
+
+			if (p < end && *p != ' ' && *p != '\t') return false;
+
+			chunk.corners.push_back(c);
+			count++;
+		}
+
+		chunk.faces.push_back(count);
+		return true;
+	}
+
+	/**
+		Analizza le righe nell'intervallo [p, end), che inizia e finisce
+		su un confine di riga
+	*/
+	void parse_chunk(const char *p, const char *end, Chunk &chunk) {
+		while (p < end) {
+			const char *line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (line_end == nullptr) line_end = end;
+
+			const char *e = line_end;
+			if (e > p && e[-1] == '\r') e--;
+
+			const char *q = skip_spaces(p, e);
+
+			if (q < e && *q != '#') {
+				if (keyword(q, e, "v", 1)) {
+					float x, y, z;
+					q = parse_float(q + 1, e, x);
+					q = parse_float(q, e, y);
+					parse_float(q, e, z);
+					chunk.positions.push_back(x);
+					chunk.positions.push_back(y);
+					chunk.positions.push_back(z);
+				}
+				else if (keyword(q, e, "vt", 2)) {
+					float u, v = 0.0f;
+					q = parse_float(q + 2, e, u);
+					if (skip_spaces(q, e) < e) parse_float(q, e, v);
+					chunk.texcoords.push_back(u);
+					chunk.texcoords.push_back(v);
+				}
+				else if (keyword(q, e, "vn", 2)) {
+					float x, y, z;
+					q = parse_float(q + 2, e, x);
+					q = parse_float(q, e, y);
+					parse_float(q, e, z);
+					chunk.normals.push_back(x);
+					chunk.normals.push_back(y);
+					chunk.normals.push_back(z);
+				}
+				else if (keyword(q, e, "f", 1)) {
+					if (!parse_face(q + 1, e, chunk) && chunk.error.empty()) {
+						chunk.error = "invalid face '" + std::string(q, e) + "'";
+					}
+				}
+				else if (keyword(q, e, "usemtl", 6)) {
+					Event ev = { Event::MATERIAL, chunk.faces.size(), rest_of_line(q + 6, e) };
+					chunk.events.push_back(ev);
+				}
+				else if (keyword(q, e, "o", 1) || keyword(q, e, "g", 1)) {
+					// Come Assimp, ogni gruppo diventa un oggetto
+					Event ev = { Event::OBJECT, chunk.faces.size(), rest_of_line(q + 1, e) };
+					chunk.events.push_back(ev);
+				}
+				else if (keyword(q, e, "mtllib", 6)) {
+					Event ev = { Event::LIBRARY, chunk.faces.size(), rest_of_line(q + 6, e) };
+					chunk.events.push_back(ev);
+				}
+				// Smoothing group, linee, punti e curve sono ignorati
+			}
+
+			p = line_end + 1;
+		}
+	}
+
+	/**
+		Legge la texture diffusiva (map_Kd) dei materiali di un file MTL
+	*/
+	void parse_mtl(const std::string &Filename, const std::string &Filepath,
+	               std::map<std::string, std::string> &textures, std::ostream &log) {
+		MappedFile file;
+		if (!file.open(Filename)) {
+			log<<"  Unable to open material library '"<<Filename<<"'"<<std::endl;
+			return;
+		}
+
+		const char *p   = reinterpret_cast<const char*>(file.data());
+		const char *end = p + file.size();
+		std::string current;
+
+		while (p < end) {
+			const char *line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (line_end == nullptr) line_end = end;
+
+			const char *e = line_end;
+			if (e > p && e[-1] == '\r') e--;
+			const char *q = skip_spaces(p, e);
+
+			if (keyword(q, e, "newmtl", 6)) {
+				current = rest_of_line(q + 6, e);
+				textures[current] = "";
+			}
+			else if (keyword(q, e, "map_Kd", 6) && !current.empty()) {
+				// Le eventuali opzioni precedono il nome del file: usiamo
+				// l'ultima parola della riga
+				std::string value = rest_of_line(q + 6, e);
+				std::string::size_type space = value.find_last_of(" \t");
+				if (space != std::string::npos) value = value.substr(space + 1);
+
+				textures[current] = Filepath + "/" + value;
+			}
+
+			p = line_end + 1;
+		}
+	}
+
+	std::string file_path(const std::string &Filename) {
+		std::string::size_type slash = Filename.find_last_of("/");
+		if (slash == std::string::npos) return ".";
+		if (slash == 0) return "/";
+		return Filename.substr(0, slash);
+	}
+}
+
+bool import_obj(const std::string &Filename, unsigned int flags, Mesh::MeshData &data, std::ostream &log) {
+	MappedFile file;
+	if (!file.open(Filename)) {
+		log<<"Error loading "<<Filename<<" : unable to open file"<<std::endl;
+		return false;
+	}
+
+	const char  *begin = reinterpret_cast<const char*>(file.data());
+	const size_t size  = file.size();
+
+	// Dividiamo il file in blocchi di righe intere, alcuni per thread per
+	// bilanciare il carico
+	ThreadPool &pool = ThreadPool::instance();
+
+	const size_t MIN_CHUNK_SIZE = 256 * 1024;
+	const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(pool.size() * 4, size / MIN_CHUNK_SIZE));
+
+	std::vector<const char*> bounds(num_chunks + 1);
+	bounds[0] = begin;
+	bounds[num_chunks] = begin + size;
+	for (size_t i = 1 ; i < num_chunks ; i++) {
+		const char *p = std::max(begin + size * i / num_chunks, bounds[i - 1]);
+		const char *nl = static_cast<const char*>(memchr(p, '\n', begin + size - p));
+		bounds[i] = nl ? nl + 1 : begin + size;
+	}
+
+	std::vector<Chunk> chunks(num_chunks);
+	pool.parallel_for(num_chunks, [&](unsigned int i) {
+		parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+	});
+
+	// Uniamo gli attributi dei blocchi: l'offset di ogni blocco serve a
+	// risolvere gli indici relativi
+	std::vector<float> positions, texcoords, normals;
+	std::vector<size_t> position_offset(num_chunks), texcoord_offset(num_chunks), normal_offset(num_chunks);
+
+	for (size_t i = 0 ; i < num_chunks ; i++) {
+		if (!chunks[i].error.empty()) {
+			log<<"Error loading "<<Filename<<" : "<<chunks[i].error<<std::endl;
+			return false;
+		}
+
+		position_offset[i] = positions.size() / 3;
+		texcoord_offset[i] = texcoords.size() / 2;
+		normal_offset[i]   = normals.size() / 3;
+
+		positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+		texcoords.insert(texcoords.end(), chunks[i].texcoords.begin(), chunks[i].texcoords.end());
+		normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+
+		std::vector<float>().swap(chunks[i].positions);
+		std::vector<float>().swap(chunks[i].texcoords);
+		std::vector<float>().swap(chunks[i].normals);
+	}
+
+	const size_t num_positions = positions.size() / 3;
+	const size_t num_texcoords = texcoords.size() / 2;
+	const size_t num_normals   = normals.size() / 3;
+
+	const bool triangulate = (flags & aiProcess_Triangulate) != 0;
+	const bool flip_uvs    = (flags & aiProcess_FlipUVs) != 0;
+	const bool join        = (flags & aiProcess_JoinIdenticalVertices) != 0;
+
+	const std::string Filepath = file_path(Filename);
+
+	if (data.vertices.empty()) {
+		data.bbox_min = glm::vec3( std::numeric_limits<float>::max());
+		data.bbox_max = glm::vec3(-std::numeric_limits<float>::max());
+	}
+
+	// Allochiamo una volta sola lo spazio per il caso peggiore (un vertice
+	// per angolo) invece di far crescere i vettori durante la costruzione
+	size_t num_corners = 0, num_triangles = 0;
+	for (size_t i = 0 ; i < num_chunks ; i++) {
+		for (size_t f = 0 ; f < chunks[i].faces.size() ; f++) {
+			const unsigned int count = chunks[i].faces[f];
+			if (count == 3 || (count > 3 && triangulate)) {
+				num_corners   += count;
+				num_triangles += count - 2;
+			}
+		}
+	}
+	data.vertices.reserve(data.vertices.size() + num_corners);
+	data.indices.reserve(data.indices.size() + num_triangles * 3);
+
+	// Stato della costruzione delle sotto-mesh (come in Mesh::import_scene,
+	// i materiali sono aggiunti alla prima sotto-mesh che li usa)
+	std::map<std::string, std::string>  material_textures;
+	std::map<std::string, unsigned int> material_index;
+	std::string material;
+	std::string object;
+
+	std::unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+
+	Mesh::SubMesh sm;
+
+	auto begin_submesh = [&]() {
+		sm.base_vertex   = data.vertices.size();
+		sm.base_index    = data.indices.size();
+		sm.primitive     = GL_TRIANGLES;
+		sm.first_meshlet = 0;
+		sm.num_meshlets  = 0;
+		unique.clear();
+	};
+
+	auto end_submesh = [&]() {
+		sm.num_vertices = data.vertices.size() - sm.base_vertex;
+		sm.num_indices  = data.indices.size() - sm.base_index;
+		if (sm.num_indices == 0) return;
+
+		std::map<std::string, unsigned int>::iterator it = material_index.find(material);
+		if (it == material_index.end()) {
+			std::map<std::string, std::string>::const_iterator tex = material_textures.find(material);
+			data.textures.push_back(tex != material_textures.end() ? tex->second : "");
+			it = material_index.insert(std::make_pair(material, data.textures.size() - 1)).first;
+		}
+		sm.material = it->second;
+
+		data.submeshes.push_back(sm);
+	};
+
+	// Ritorna l'indice (relativo alla sotto-mesh) del vertice di un angolo
+	auto vertex = [&](const Corner &c) -> unsigned int {
+		Mesh::Vertex v(glm::vec3(positions[c.v * 3], positions[c.v * 3 + 1], positions[c.v * 3 + 2]),
+		               glm::vec3(0.0f), glm::vec2(0.0f));
+
+		if (c.n >= 0) v.normal = glm::vec3(normals[c.n * 3], normals[c.n * 3 + 1], normals[c.n * 3 + 2]);
+		if (c.t >= 0) {
+			v.textcoord = glm::vec2(texcoords[c.t * 2], texcoords[c.t * 2 + 1]);
+			if (flip_uvs) v.textcoord.y = 1.0f - v.textcoord.y;
+		}
+
+		const unsigned int index = data.vertices.size() - sm.base_vertex;
+
+		if (join) {
+			std::pair<std::unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator, bool> r =
+				unique.insert(std::make_pair(VertexKey(v), index));
+			if (!r.second) return r.first->second;
+		}
+
+		data.vertices.push_back(v);
+		data.bbox_min = glm::min(data.bbox_min, v.position);
+		data.bbox_max = glm::max(data.bbox_max, v.position);
+
+		return index;
+	};
+
+	begin_submesh();
+
+	for (size_t i = 0 ; i < num_chunks ; i++) {
+		const Chunk &chunk = chunks[i];
+		size_t next_event = 0;
+		size_t corner = 0;
+
+		for (size_t f = 0 ; f <= chunk.faces.size() ; f++) {
+			for ( ; next_event < chunk.events.size() && chunk.events[next_event].face == f ; next_event++) {
+				const Event &ev = chunk.events[next_event];
+
+				if (ev.type == Event::LIBRARY) {
+					parse_mtl(Filepath + "/" + ev.name, Filepath, material_textures, log);
+				}
+				else if (ev.name != (ev.type == Event::OBJECT ? object : material)) {
+					// Come in Assimp (ObjFileParser) una nuova sotto-mesh inizia
+					// solo se cambia l'oggetto o il gruppo attivo o se cambia
+					// davvero il materiale: un usemtl ripetuto non divide la
+					// sotto-mesh. Le sotto-mesh vuote sono scartate.
+					end_submesh();
+					if (ev.type == Event::OBJECT) object = ev.name;
+					else material = ev.name;
+					begin_submesh();
+				}
+			}
+
+			if (f == chunk.faces.size()) break;
+
+			const unsigned int count = chunk.faces[f];
+			unsigned int first = 0, previous = 0;
+
+			// Punti e linee (senza aiProcess_Triangulate anche i poligoni)
+			// non sono gestiti
+			const bool keep = (count == 3) || (count > 3 && triangulate);
+
+			for (unsigned int k = 0 ; k < count && keep ; k++) {
+				Corner c = chunk.corners[corner + k];
+
+				// Risoluzione degli indici relativi al blocco
+				if (c.v < -1) c.v += RELATIVE_BIAS + position_offset[i];
+				if (c.t < -1) c.t += RELATIVE_BIAS + texcoord_offset[i];
+				if (c.n < -1) c.n += RELATIVE_BIAS + normal_offset[i];
+
+				if (c.v < 0 || size_t(c.v) >= num_positions || c.t < -1 || c.n < -1 ||
+				    size_t(c.t + 1) > num_texcoords || size_t(c.n + 1) > num_normals) {
+					log<<"Error loading "<<Filename<<" : vertex index out of range"<<std::endl;
+					return false;
+				}
+
+				// I poligoni sono divisi in triangoli a ventaglio
+				unsigned int index = vertex(c);
+				if (k == 0) {
+					first = index;
+				}
+				else if (k >= 2) {
+					data.indices.push_back(first);
+					data.indices.push_back(previous);
+					data.indices.push_back(index);
+				}
+				previous = index;
+			}
+
+			corner += count;
+		}
+	}
+
+	end_submesh();
+
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <string>
+#include <ostream>
+#include "mesh.h"
+
+/**
+	Post processing flags di Assimp supportati da import_obj(). Con altri
+	flag il caricamento deve passare da Assimp.
+*/
+const unsigned int OBJ_SUPPORTED_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs |
+                                         aiProcess_JoinIdenticalVertices;
+
+/**
+	Carica un file Wavefront OBJ (con i materiali MTL) senza usare Assimp.
+
+	Il file è mappato in memoria e diviso in blocchi di righe intere che
+	sono analizzati in parallelo dal pool di thread. I vertici sono poi
+	costruiti direttamente nel formato Mesh::Vertex e accodati a data, con
+	le stesse regole di Mesh::import_scene():
+	- ogni cambio di oggetto (o) o di gruppo (g) inizia una nuova
+	  sotto-mesh, come un cambio di materiale (usemtl) verso un materiale
+	  diverso da quello attivo (un usemtl ripetuto è ignorato);
+	- con aiProcess_Triangulate i poligoni sono divisi in triangoli a
+	  ventaglio, altrimenti sono scartati come punti e linee;
+	- con aiProcess_FlipUVs la coordinata v delle texture diventa 1 - v;
+	- con aiProcess_JoinIdenticalVertices gli angoli delle facce con la
+	  stessa terna posizione/texture/normale diventano un unico vertice,
+	  altrimenti ogni angolo ha il suo vertice;
+	- le normali e le coordinate di texture mancanti valgono 0.
+
+	@param Filename nome del file .obj
+	@param flags assimp post processing flags (solo OBJ_SUPPORTED_FLAGS)
+	@param data dati della mesh a cui accodare il contenuto del file
+	@param log stream dei messaggi
+	@return true se il file è stato caricato correttamente
+*/
+bool import_obj(const std::string &Filename, unsigned int flags, Mesh::MeshData &data, std::ostream &log);
+
+#endif
@@ -0,0 +1,235 @@
+#include "renderqueue.h"
+#include "myshaderclass.h"
+#include "texture.h"
+#include "glstate.h"
+#include "transform.h"
+
+#include <cstring>
+
+namespace {
+	// Bit dei campi della chiave
+	const unsigned int PROGRAM_BITS = 6;
+	const unsigned int TEXTURE_BITS = 12;
+	const unsigned int MESH_BITS    = 12;
+
+	// Il radix sort elabora le chiavi 8 bit per volta
+	const unsigned int RADIX_BITS = 8;
+	const unsigned int RADIX_SIZE = 1 << RADIX_BITS;
+
+	std::uint32_t distance_bits(float distance) {
+		// Per i float positivi l'ordine dei bit è quello dei valori
+		if (!(distance > 0.0f)) distance = 0.0f;
+
+		std::uint32_t bits;
+		std::memcpy(&bits, &distance, sizeof(bits));
+		return bits;
+	}
+}
+
+RenderQueue::Stats::Stats() : draws(0), programs(0), textures(0), meshes(0), objects(0) {}
+
+RenderQueue::RenderQueue() {}
+
+void RenderQueue::clear() {
+	_objects.clear();
+	_draws.clear();
+}
+
+unsigned int RenderQueue::add_object(const glm::mat4 &model, const glm::vec3 &position_scale,
+                                     const glm::vec3 &position_bias, float distance) {
+	Object object;
+	object.model = model;
+	object.normal = LocalTransform::normal_matrix(model);
+	object.position_scale = position_scale;
+	object.position_bias = position_bias;
+	object.distance = distance;
+
+	_objects.push_back(object);
+	return _objects.size() - 1;
+}
+
+void RenderQueue::add_draw(MyShaderClass &program, const void *mesh, GLuint vao, GLenum primitive, GLenum index_type,
+                           const Texture *texture, Pass pass, GLuint count, GLuint first_index, GLint base_vertex,
+                           unsigned int object) {
+	Draw draw;
+	draw.program = &program;
+	draw.mesh = mesh;
+	draw.vao = vao;
+	draw.primitive = primitive;
+	draw.index_type = index_type;
+	draw.texture = texture;
+	draw.pass = pass;
+	draw.count = count;
+	draw.first_index = first_index;
+	draw.base_vertex = base_vertex;
+	draw.object = object;
+
+	_draws.push_back(draw);
+}
+
+unsigned int RenderQueue::size() const {
+	return _draws.size();
+}
+
+const RenderQueue::Stats &RenderQueue::stats() const {
+	return _stats;
+}
+
+unsigned int RenderQueue::id(std::map<const void*, unsigned int> &ids, const void *state) {
+	// Gli identificativi restano gli stessi tra un frame e l'altro:
+	// l'ordine delle draw call non cambia se non cambia la scena
+	std::map<const void*, unsigned int>::iterator it = ids.find(state);
+	if (it != ids.end()) return it->second;
+
+	const unsigned int next = ids.size();
+	ids[state] = next;
+	return next;
+}
+
+std::uint64_t RenderQueue::make_key(Pass pass, unsigned int program, unsigned int texture,
+                                    unsigned int mesh, float distance) {
+	const std::uint64_t state =
+		(std::uint64_t(program & ((1u << PROGRAM_BITS) - 1)) << (TEXTURE_BITS + MESH_BITS)) |
+		(std::uint64_t(texture & ((1u << TEXTURE_BITS) - 1)) << MESH_BITS) |
+		 std::uint64_t(mesh & ((1u << MESH_BITS) - 1));
+
+	const std::uint64_t depth = distance_bits(distance);
+
+	// I trasparenti vanno disegnati dal più lontano: la distanza precede
+	// lo stato ed è invertita
+	if (pass == TRANSPARENT) {
+		return (std::uint64_t(pass) << 62) | (std::uint64_t(~depth & 0xFFFFFFFFu) << 30) | state;
+	}
+
+	return (std::uint64_t(pass) << 62) | (state << 32) | depth;
+}
+
+void RenderQueue::radix_sort(std::vector<Entry> &entries, std::vector<Entry> &temp) {
+	temp.resize(entries.size());
+
+	// LSD radix sort: ogni passata è stabile, quindi le draw call con la
+	// stessa chiave restano nell'ordine in cui sono state accodate
+	for (unsigned int shift = 0 ; shift < 64 ; shift += RADIX_BITS) {
+		size_t count[RADIX_SIZE] = {};
+
+		for (size_t i = 0 ; i < entries.size() ; i++) {
+			count[(entries[i].key >> shift) & (RADIX_SIZE - 1)]++;
+		}
+
+		// Se tutte le chiavi hanno la stessa cifra la passata è inutile
+		if (count[(entries[0].key >> shift) & (RADIX_SIZE - 1)] == entries.size()) continue;
+
+		size_t offset = 0;
+		for (unsigned int d = 0 ; d < RADIX_SIZE ; d++) {
+			const size_t c = count[d];
+			count[d] = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0 ; i < entries.size() ; i++) {
+			temp[count[(entries[i].key >> shift) & (RADIX_SIZE - 1)]++] = entries[i];
+		}
+
+		entries.swap(temp);
+	}
+}
+
+RenderQueue::Stats RenderQueue::execute(unsigned int TextureUnit) {
+	GlState &state = GlState::instance();
+
+	_stats = Stats();
+
+	if (_draws.empty()) return _stats;
+
+	_entries.resize(_draws.size());
+	for (size_t i = 0 ; i < _draws.size() ; i++) {
+		const Draw &draw = _draws[i];
+
+		_entries[i].key = make_key(draw.pass, id(_program_ids, draw.program), id(_texture_ids, draw.texture),
+		                           id(_mesh_ids, draw.mesh), _objects[draw.object].distance);
+		_entries[i].draw = i;
+	}
+
+	radix_sort(_entries, _temp);
+
+	MyShaderClass *program = nullptr;
+	const void *mesh = nullptr;
+	GLuint vao = 0;
+	const Texture *texture = nullptr;
+	unsigned int object = _objects.size();
+	bool blend = false;
+	GLenum restart = GL_NONE;
+
+	for (size_t i = 0 ; i < _entries.size() ; i++) {
+		const Draw &draw = _draws[_entries[i].draw];
+		const Object &data = _objects[draw.object];
+
+		if (draw.program != program) {
+			program = draw.program;
+			program->enable();
+			_stats.programs++;
+		}
+
+		if (draw.mesh != mesh) {
+			mesh = draw.mesh;
+			_stats.meshes++;
+		}
+
+		// Il blocco dell'oggetto è condiviso da tutti i programmi
+		if (draw.object != object) {
+			object = draw.object;
+			MyShaderClass::set_object_uniforms(data.model, data.normal, data.position_scale, data.position_bias);
+			_stats.objects++;
+		}
+
+		if (draw.vao != vao) {
+			vao = draw.vao;
+			state.bind_vertex_array(vao);
+
+			state.enable_vertex_attrib_array(0);
+			state.enable_vertex_attrib_array(1);
+			state.enable_vertex_attrib_array(2);
+		}
+
+		if (draw.texture != texture) {
+			texture = draw.texture;
+			if (texture != nullptr) texture->bind(TextureUnit);
+			_stats.textures++;
+		}
+
+		if (draw.pass == TRANSPARENT && !blend) {
+			state.enable(GL_BLEND);
+			state.enable(GL_ALPHA_TEST);
+			state.blend_func(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+			blend = true;
+		}
+
+		// Le strip sono separate dall'indice massimo rappresentabile
+		const GLenum restart_type = (draw.primitive == GL_TRIANGLE_STRIP) ? draw.index_type : GL_NONE;
+		if (restart_type != restart) {
+			if (restart_type == GL_NONE) {
+				state.disable(GL_PRIMITIVE_RESTART);
+			}
+			else {
+				if (restart == GL_NONE) state.enable(GL_PRIMITIVE_RESTART);
+				state.primitive_restart_index(restart_type == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+			}
+			restart = restart_type;
+		}
+
+		const size_t index_size = (draw.index_type == GL_UNSIGNED_SHORT) ? sizeof(unsigned short) : sizeof(unsigned int);
+		glDrawElementsBaseVertex(draw.primitive, draw.count, draw.index_type,
+		                         (void*)(index_size * draw.first_index), draw.base_vertex);
+		_stats.draws++;
+	}
+
+	state.bind_vertex_array(0);
+
+	if (blend) {
+		state.disable(GL_BLEND);
+		state.disable(GL_ALPHA_TEST);
+	}
+	if (restart != GL_NONE) state.disable(GL_PRIMITIVE_RESTART);
+
+	return _stats;
+}
@@ -0,0 +1,180 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include "GL/glew.h" // prima di freeglut
+#include "glm/glm.hpp"
+
+class Texture;
+class MyShaderClass;
+
+/**
+	Coda delle draw call di un frame, ordinata per ridurre i cambi di stato.
+
+	Ogni draw call accodata riceve una chiave a 64 bit che codifica, dai bit
+	più significativi, il passo (opaco o trasparente), il programma, la
+	texture, la mesh e la distanza dalla camera:
+
+	    opachi:       | passo 2 | programma 6 | texture 12 | mesh 12 | distanza 32 |
+	    trasparenti:  | passo 2 | ~distanza 32 | programma 6 | texture 12 | mesh 12 |
+
+	Le chiavi sono ordinate con un radix sort e execute() cambia programma,
+	texture e VAO solo quando cambiano nella sequenza ordinata: con molti
+	oggetti i cambi di programma e di texture scendono al numero di
+	programmi e materiali distinti. Gli oggetti opachi sono disegnati dal
+	più vicino al più lontano (a parità di stato), quelli trasparenti dal
+	più lontano al più vicino.
+
+	La distanza è memorizzata come bit del float (per i float positivi
+	l'ordine dei bit coincide con quello dei valori). Programmi, texture e
+	mesh ricevono un identificativo alla prima draw call: se sono più di
+	quanti ne può contenere il campo, l'ordinamento raggruppa meno stati
+	ma execute() confronta sempre lo stato effettivo.
+
+	La coda va usata con gli shader STANDARD (vedi MyShaderClass): le
+	matrici del modello e delle normali e la dequantizzazione delle 
+	posizioni sono scritte nell'ObjectBlock per ogni oggetto, la camera e le luci
+	(FrameBlock) vanno impostate prima di execute().
+*/
+class RenderQueue {
+public:
+
+	/**
+		Passi di rendering, nell'ordine di esecuzione
+	*/
+	enum Pass {
+		OPAQUE      = 0, ///< Oggetti opachi
+		TRANSPARENT = 1  ///< Oggetti con blending
+	};
+
+	/**
+		Numero di cambi di stato dell'ultima execute()
+	*/
+	struct Stats {
+		unsigned int draws;    ///< Draw call eseguite
+		unsigned int programs; ///< Cambi di programma
+		unsigned int textures; ///< Cambi di texture
+		unsigned int meshes;   ///< Cambi di mesh
+		unsigned int objects;  ///< Aggiornamenti dell'ObjectBlock
+
+		Stats();
+	};
+
+	RenderQueue();
+
+	/**
+		Svuota la coda (da chiamare all'inizio di ogni frame)
+	*/
+	void clear();
+
+	/**
+		Aggiunge un oggetto, a cui fanno riferimento le draw call aggiunte
+		con add_draw()
+
+		@param model matrice di trasformazione del modello
+		@param position_scale scala di dequantizzazione delle posizioni
+		@param position_bias offset di dequantizzazione delle posizioni
+		@param distance distanza dell'oggetto dalla camera
+		@return l'indice dell'oggetto
+	*/
+	unsigned int add_object(const glm::mat4 &model, const glm::vec3 &position_scale,
+	                        const glm::vec3 &position_bias, float distance);
+
+	/**
+		Aggiunge una draw call indicizzata
+
+		@param program shader usati per disegnare
+		@param mesh identificativo della geometria (es. la Mesh che la contiene)
+		@param vao VAO con i buffer della geometria
+		@param primitive tipo di primitiva (GL_TRIANGLES o GL_TRIANGLE_STRIP)
+		@param index_type tipo degli indici (GL_UNSIGNED_SHORT o GL_UNSIGNED_INT)
+		@param texture texture del materiale
+		@param pass passo in cui disegnare la draw call
+		@param count numero di indici
+		@param first_index primo indice nell'IBO
+		@param base_vertex valore sommato agli indici
+		@param object oggetto ritornato da add_object()
+	*/
+	void add_draw(MyShaderClass &program, const void *mesh, GLuint vao, GLenum primitive, GLenum index_type,
+	              const Texture *texture, Pass pass, GLuint count, GLuint first_index, GLint base_vertex,
+	              unsigned int object);
+
+	/**
+		Ordina le draw call e le esegue
+
+		@param TextureUnit TextureUnit usata per le texture
+		@return i cambi di stato eseguiti
+	*/
+	Stats execute(unsigned int TextureUnit = 0);
+
+	/**
+		Ritorna il numero di draw call accodate
+	*/
+	unsigned int size() const;
+
+	/**
+		Ritorna i cambi di stato dell'ultima execute()
+	*/
+	const Stats &stats() const;
+
+private:
+
+	/**
+		Dati di un oggetto
+	*/
+	struct Object {
+		glm::mat4 model;
+		glm::mat3 normal;
+		glm::vec3 position_scale;
+		glm::vec3 position_bias;
+		float distance;
+	};
+
+	/**
+		Draw call accodata con lo stato necessario per disegnarla
+	*/
+	struct Draw {
+		MyShaderClass *program;
+		const void *mesh;
+		GLuint vao;
+		GLenum primitive;
+		GLenum index_type;
+		const Texture *texture;
+		Pass pass;
+		GLuint count;
+		GLuint first_index;
+		GLint base_vertex;
+		unsigned int object;
+	};
+
+	/**
+		Chiave di ordinamento con l'indice della draw call
+	*/
+	struct Entry {
+		std::uint64_t key;
+		unsigned int draw;
+	};
+
+	static unsigned int id(std::map<const void*, unsigned int> &ids, const void *state);
+
+	static std::uint64_t make_key(Pass pass, unsigned int program, unsigned int texture,
+	                              unsigned int mesh, float distance);
+
+	static void radix_sort(std::vector<Entry> &entries, std::vector<Entry> &temp);
+
+	std::vector<Object> _objects; ///<< Oggetti del frame
+	std::vector<Draw>   _draws;   ///<< Draw call del frame
+	std::vector<Entry>  _entries; ///<< Chiavi delle draw call
+	std::vector<Entry>  _temp;    ///<< Vettore di lavoro del radix sort
+
+	std::map<const void*, unsigned int> _program_ids; ///<< Identificativi dei programmi
+	std::map<const void*, unsigned int> _texture_ids; ///<< Identificativi delle texture
+	std::map<const void*, unsigned int> _mesh_ids;    ///<< Identificativi delle mesh
+
+	Stats _stats; ///<< Cambi di stato dell'ultima execute()
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "resourcecache.h"
+#include "utilities.h"
+#include "mesh.h"
+#include "glstate.h"
+
+#include <iostream>
+#include <sstream>
+#include <climits>
+#include <cstdlib>
+
+ShaderProgram::ShaderProgram(GLuint program) : _program(program) {}
+
+ShaderProgram::~ShaderProgram() {
+	GlState::instance().delete_program(_program);
+}
+
+GLuint ShaderProgram::id() const {
+	return _program;
+}
+
+ResourceCache::ResourceCache() {
+	_texture_stats.requests = _texture_stats.hits = 0;
+	_program_stats.requests = _program_stats.hits = 0;
+	_mesh_stats.requests = _mesh_stats.hits = 0;
+}
+
+ResourceCache &ResourceCache::instance() {
+	// Le risorse non fanno riferimento alla cache: possono essere
+	// rilasciate (es. da oggetti globali) anche dopo la sua distruzione
+	static ResourceCache cache;
+	return cache;
+}
+
+std::string ResourceCache::canonical_path(const std::string &FileName) {
+#ifdef _WIN32
+	char path[_MAX_PATH];
+	if (_fullpath(path, FileName.c_str(), _MAX_PATH) == NULL) return FileName;
+	return path;
+#else
+	char path[PATH_MAX];
+	if (realpath(FileName.c_str(), path) == NULL) return FileName;
+	return path;
+#endif
+}
+
+std::shared_ptr<Texture> ResourceCache::texture(const std::string &FileName, const Texture::Image *image) {
+	const std::string key = canonical_path(FileName);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_texture_stats.requests++;
+
+		std::shared_ptr<Texture> texture = _textures[key].lock();
+		if (texture) {
+			_texture_stats.hits++;
+			return texture;
+		}
+	}
+
+	// Il caricamento avviene fuori dal lock: le texture sono create solo
+	// dal thread OpenGL, quindi non ci sono caricamenti concorrenti
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+	bool ok = (image != nullptr) ? texture->load(*image, FileName) : texture->load(FileName);
+	if (!ok) return nullptr;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_textures[key] = texture;
+	return texture;
+}
+
+bool ResourceCache::has_texture(const std::string &FileName) {
+	const std::string key = canonical_path(FileName);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::map<std::string, std::weak_ptr<Texture> >::const_iterator it = _textures.find(key);
+	return it != _textures.end() && !it->second.expired();
+}
+
+std::shared_ptr<ShaderProgram> ResourceCache::program(const ShaderSources &sources) {
+	std::ostringstream os;
+	for (unsigned int i = 0 ; i < sources.size() ; i++) {
+		os << sources[i].type << ':' << sources[i].code.size() << ':' << sources[i].code;
+	}
+	const std::string key = os.str();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_program_stats.requests++;
+
+		std::shared_ptr<ShaderProgram> program = _programs[key].lock();
+		if (program) {
+			_program_stats.hits++;
+			return program;
+		}
+	}
+
+	Shaders shaders;
+	GLuint id = 0;
+	bool ok = true;
+
+	try {
+		for (unsigned int i = 0 ; i < sources.size() ; i++) {
+			shaders.push_back(CreateShader(sources[i].type, sources[i].code));
+		}
+		id = CreateProgram(shaders);
+	}
+	catch(...) {
+		ok = false;
+	}
+
+	for (unsigned int i = 0 ; i < shaders.size() ; i++) {
+		glDeleteShader(shaders[i]);
+	}
+
+	if (!ok) return nullptr;
+
+	std::shared_ptr<ShaderProgram> program = std::make_shared<ShaderProgram>(id);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_programs[key] = program;
+	return program;
+}
+
+std::shared_ptr<Mesh> ResourceCache::mesh(const std::vector<std::string> &Filenames, unsigned int flags,
+                                          unsigned int options, bool prefetch) {
+	Mesh::LoadRequest request(Filenames, flags, options);
+
+	std::ostringstream os;
+	for (unsigned int i = 0 ; i < Filenames.size() ; i++) {
+		os << canonical_path(Filenames[i]) << '\n';
+	}
+	os << flags << ':' << options << ':' << request.settings();
+	const std::string key = os.str();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_mesh_stats.requests++;
+
+		std::shared_ptr<Mesh> cached = _meshes[key].lock();
+		if (cached) {
+			_mesh_stats.hits++;
+			if (!prefetch) cached->request_residency();
+			return cached;
+		}
+	}
+
+	// Come per le texture, i modelli sono richiesti solo dal thread
+	// OpenGL: la Mesh è creata solo se non è già presente
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+	request.mesh = mesh.get();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_meshes[key] = mesh;
+	}
+
+	Mesh::load_async(request, prefetch);
+	return mesh;
+}
+
+std::shared_ptr<Mesh> ResourceCache::mesh(const std::string &Filename, unsigned int flags,
+                                          unsigned int options, bool prefetch) {
+	return mesh(std::vector<std::string>(1, Filename), flags, options, prefetch);
+}
+
+template <typename T>
+void ResourceCache::print_stats(std::ostream &os, const char *name,
+                                const std::map<std::string, std::weak_ptr<T> > &entries, const Stats &stats) {
+	unsigned int alive = 0;
+	typename std::map<std::string, std::weak_ptr<T> >::const_iterator it;
+	for (it = entries.begin() ; it != entries.end() ; ++it) {
+		if (!it->second.expired()) alive++;
+	}
+
+	os << "  " << name << ": " << alive << " in use, " << stats.requests << " requests, "
+	   << stats.hits << " shared" << std::endl;
+}
+
+void ResourceCache::print_stats(std::ostream &os) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	os << "Resource cache" << std::endl;
+	print_stats(os, "Textures", _textures, _texture_stats);
+	print_stats(os, "Programs", _programs, _program_stats);
+	print_stats(os, "Meshes", _meshes, _mesh_stats);
+}
@@ -0,0 +1,169 @@
+#ifndef RESOURCECACHE_H
+#define RESOURCECACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include "GL/glew.h" // prima di freeglut
+#include "texture.h"
+
+class Mesh;
+
+/**
+	Programma OpenGL condiviso tra più ShaderClass. L'oggetto OpenGL viene
+	distrutto quando viene rilasciato l'ultimo riferimento.
+*/
+class ShaderProgram {
+public:
+	explicit ShaderProgram(GLuint program);
+
+	~ShaderProgram();
+
+	/**
+		Ritorna l'handle OpenGL del programma
+	*/
+	GLuint id() const;
+
+private:
+	GLuint _program;
+
+	// Blocchiamo le operazioni di copia: l'oggetto OpenGL ha un solo proprietario
+	ShaderProgram&operator=(const ShaderProgram &other);
+	ShaderProgram(const ShaderProgram &other);
+};
+
+/**
+	Sorgente di uno shader da compilare
+*/
+struct ShaderSource {
+	GLenum type;        ///< Tipo dello shader (es. GL_VERTEX_SHADER)
+	std::string code;   ///< Codice sorgente
+};
+
+typedef std::vector<ShaderSource> ShaderSources;
+
+/**
+	Cache delle risorse condivise dell'applicazione (texture, programmi
+	degli shader e modelli).
+
+	Le risorse sono restituite come std::shared_ptr: risorse identiche
+	richieste da più oggetti sono caricate, trasferite sulla GPU o
+	compilate una sola volta, e gli oggetti OpenGL sono liberati quando
+	l'ultimo utilizzatore rilascia il suo riferimento. La cache mantiene
+	solo dei std::weak_ptr, quindi non prolunga la vita delle risorse.
+	Le chiavi sono:
+	- texture: percorso canonico del file;
+	- programmi: tipo e codice sorgente di ogni shader;
+	- modelli: percorsi canonici dei file e parametri di caricamento
+	  (vedi Mesh::LoadRequest::settings()).
+
+	Le risorse vanno richieste e rilasciate dal thread che possiede il
+	contesto OpenGL; has_texture() può essere usata da qualunque thread.
+*/
+class ResourceCache {
+public:
+
+	/**
+		Ritorna la cache delle risorse dell'applicazione
+	*/
+	static ResourceCache &instance();
+
+	/**
+		Ritorna la texture associata al file. Se la texture non è già
+		presente viene caricata, usando l'immagine già decodificata se
+		indicata.
+
+		@param FileName nome del file
+		@param image immagine decodificata (opzionale, vedi Texture::decode())
+		@return la texture condivisa o nullptr in caso di errore
+	*/
+	std::shared_ptr<Texture> texture(const std::string &FileName, const Texture::Image *image=nullptr);
+
+	/**
+		Ritorna true se la texture associata al file è già sulla GPU (e
+		quindi non serve decodificarla)
+
+		@param FileName nome del file
+	*/
+	bool has_texture(const std::string &FileName);
+
+	/**
+		Ritorna il programma ottenuto collegando gli shader indicati. Se il
+		programma non è già presente gli shader vengono compilati e
+		collegati.
+
+		@param sources sorgenti degli shader
+		@return il programma condiviso o nullptr in caso di errore
+	*/
+	std::shared_ptr<ShaderProgram> program(const ShaderSources &sources);
+
+	/**
+		Ritorna il modello composto dai file indicati e caricato con i
+		parametri indicati. Se il modello non è già presente ne viene
+		accodato il caricamento con Mesh::load_async().
+
+		@param Filenames lista dei nomi dei file
+		@param flags assimp post processing flags
+		@param options opzioni di caricamento (Mesh::LoadOptions)
+		@param prefetch vedi Mesh::load_async()
+		@return il modello condiviso
+	*/
+	std::shared_ptr<Mesh> mesh(const std::vector<std::string> &Filenames, unsigned int flags=0,
+	                           unsigned int options=0, bool prefetch=false);
+
+	/**
+		Come mesh(), per un modello composto da un solo file
+	*/
+	std::shared_ptr<Mesh> mesh(const std::string &Filename, unsigned int flags=0,
+	                           unsigned int options=0, bool prefetch=false);
+
+	/**
+		Stampa il numero di risorse in uso e il numero di richieste servite
+		dalla cache
+
+		@param os stream di output
+	*/
+	void print_stats(std::ostream &os);
+
+	/**
+		Ritorna il percorso assoluto e normalizzato del file (il nome stesso
+		se il file non esiste)
+
+		@param FileName nome del file
+	*/
+	static std::string canonical_path(const std::string &FileName);
+
+private:
+	ResourceCache();
+
+	/**
+		Contatori delle richieste di un tipo di risorsa
+	*/
+	struct Stats {
+		unsigned int requests; ///< Richieste totali
+		unsigned int hits;     ///< Richieste servite da una risorsa già presente
+	};
+
+	template <typename T>
+	static void print_stats(std::ostream &os, const char *name,
+	                        const std::map<std::string, std::weak_ptr<T> > &entries, const Stats &stats);
+
+	std::mutex _mutex; ///<< Protegge le tabelle
+
+	std::map<std::string, std::weak_ptr<Texture> > _textures;
+	std::map<std::string, std::weak_ptr<ShaderProgram> > _programs;
+	std::map<std::string, std::weak_ptr<Mesh> > _meshes;
+
+	Stats _texture_stats;
+	Stats _program_stats;
+	Stats _mesh_stats;
+
+	// Blocchiamo le operazioni di copia
+	ResourceCache&operator=(const ResourceCache &other);
+	ResourceCache(const ResourceCache &other);
+};
+
+#endif
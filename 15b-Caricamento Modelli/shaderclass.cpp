@@ -1,62 +1,66 @@
 #include "shaderclass.h"
+#include "glstate.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
 
 ShaderClass::ShaderClass() : _program(0) {
 	
 }
 
 ShaderClass::~ShaderClass() {
-	
-	Shaders::const_iterator s,se;
-
-	for(s = _shaders.begin(),se=_shaders.end(); s!=se; ++s) {
-       glDeleteShader(*s);
- 	}
-
-    if (_program != 0) {
-        glDeleteProgram(_program);
-        _program = 0;
-    }
+	// Il programma (_shared_program) viene distrutto al rilascio
+	// dell'ultimo riferimento
 }
 
 void ShaderClass::enable() {
-	glUseProgram(_program);
+	GlState::instance().use_program(_program);
 }
 
 bool ShaderClass::init() {
 
     if (!load_shaders()) return false;
 
-    try {
-   		_program = CreateProgram(_shaders);
-	}
-	catch(...) {
-    	return false;
-	}
-	
-	Shaders::const_iterator s,se;
+	// Gli shader sono compilati solo se il programma non è già in uso
+    _shared_program = ResourceCache::instance().program(_sources);
+	_sources.clear();
+
+	if (!_shared_program) return false;
 
-	for(s = _shaders.begin(),se=_shaders.end(); s!=se; ++s) {
-       glDeleteShader(*s);
- 	}
-	_shaders.clear();
+	_program = _shared_program->id();
 	
 	return load_done();
 }
 
 bool ShaderClass::add_shader(GLenum ShaderType, const std::string &FileName) {
-	GLuint id;
-	try {
-		id = LoadShader(ShaderType,FileName.c_str());
-		_shaders.push_back(id);
-		return true;
-	}
-	catch(...) {
+	std::ifstream shaderFile(FileName.c_str());
+	if (!shaderFile) {
+		std::cerr<<"File not found: "<<FileName<<std::endl;
 		return false;
 	}
+	std::stringstream shaderData;
+	shaderData << shaderFile.rdbuf();
+
+	ShaderSource source;
+	source.type = ShaderType;
+	source.code = shaderData.str();
+	_sources.push_back(source);
+	return true;
 }
 
 
+bool ShaderClass::bind_uniform_block(const std::string &BlockName, GLuint binding) const {
+	GLuint index = glGetUniformBlockIndex(_program, BlockName.c_str());
+
+	if (index == GL_INVALID_INDEX) {
+		std::cerr<<"Warning! Unable to get the index of uniform block '"<<BlockName<<"'"<<std::endl;
+		return false;
+	}
+
+	glUniformBlockBinding(_program, index, binding);
+	return true;
+}
+
 GLint ShaderClass::get_uniform_location(const std::string &UniformName) const {
 	GLint Location = glGetUniformLocation(_program, UniformName.c_str());
 
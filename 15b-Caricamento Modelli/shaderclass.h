@@ -4,7 +4,9 @@
 #define INVALID_UNIFORM_LOCATION 0xffffffff
 
 #include "utilities.h"
+#include "resourcecache.h"
 #include <string>
+#include <memory>
 #include "GL/glew.h" // prima di freeglut
 
 /**
@@ -27,6 +29,9 @@ public:
 	/**
 		Metodo di inizializzazione della classe. Vengono chiamati automaticamente i metodi
 		virtuali load_shaders e load_done.
+		Il programma è condiviso (vedi ResourceCache) con le altre istanze che usano
+		gli stessi sorgenti: viene compilato una sola volta e i valori delle variabili
+		uniform sono comuni a tutte le istanze.
 
 		#return true se l'inizializzazione è andata a buon fine
 	*/
@@ -56,7 +61,8 @@ protected:
 	virtual bool load_done()=0;
 
 	/**
-		Metodo di utilità per caricare uno shader
+		Metodo di utilità per caricare uno shader. Il sorgente viene letto dal file e
+		compilato dalla init(), se il programma non è già presente nella cache.
 		@param ShaderType tipo di shader da caricare
 		@param FileName nome del file dello shader
 
@@ -71,12 +77,28 @@ protected:
     	@return l'handle della variabile
     */
     GLint get_uniform_location(const std::string &UniformName) const;
+
+    /**
+    	Metodo di utilità per associare un uniform block a un punto di binding
+    	(vedi UniformBuffer). L'associazione fa parte del programma: vale per
+    	tutte le istanze che lo condividono.
+
+    	@param BlockName nome del blocco
+    	@param binding punto di binding
+    	@return true se il blocco è presente nel programma
+    */
+    bool bind_uniform_block(const std::string &BlockName, GLuint binding) const;
         
     GLuint _program; ///<< Handle del programma che contiene gli shader
 
 private:
 
-    Shaders _shaders; ///<< Vettore fi lavoro che contiene i vari shader caricati
+    ShaderSources _sources; ///<< Vettore di lavoro che contiene i sorgenti degli shader caricati
+    std::shared_ptr<ShaderProgram> _shared_program; ///<< Programma condiviso (vedi ResourceCache)
+
+    // Blocchiamo le operazioni di copia: il programma è gestito da _shared_program
+    ShaderClass&operator=(const ShaderClass &other);
+    ShaderClass(const ShaderClass &other);
 };
 
 #endif
\ No newline at end of file
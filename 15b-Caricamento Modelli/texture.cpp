@@ -1,10 +1,13 @@
 #include "texture.h"
+#include "gpumemory.h"
+#include "glstate.h"
 
 #include <iostream>
+#include <mutex>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h" // Libreria di suporto per leggere immagini 
 
-Texture::Texture() : _texture(-1), _target(GL_TEXTURE_2D), _valid(false) {}
+Texture::Texture() : _texture(-1), _target(GL_TEXTURE_2D), _valid(false), _has_alpha(false) {}
 
 Texture::~Texture() {
   clear();
@@ -13,44 +16,87 @@ Texture::~Texture() {
 
 void Texture::clear() {
   if (is_valid()) {
-    glDeleteTextures(1, &_texture);
+    GpuMemory::instance().release_texture(_texture);
+    GlState::instance().delete_texture(_texture);
     _texture = -1;
     _valid = false;
   }
 }
 
+Texture::Image::Image() : width(0), height(0), channels(0), pixels(nullptr), translucent(false) {}
+
+bool Texture::decode(const std::string& FileName, Image &image) {
+  static std::once_flag flip_flag;
+
+  // L'impostazione di stb_image è globale: la facciamo una volta sola
+  // per poter decodificare da più thread
+  std::call_once(flip_flag, []{ stbi_set_flip_vertically_on_load(true); });
+
+  // Usa la libreria stb_image per caricare l'immagine
+  image.pixels = stbi_load(FileName.c_str(), &image.width, &image.height, &image.channels, 0); 
+
+  if (image.pixels==nullptr) {
+    std::cerr<<" Failed to load texture " << FileName << std::endl;
+    return false;
+  }
+
+  if (image.channels != 3 && image.channels != 4) {
+    release(image);
+    return false;
+  }
+
+  // Molti PNG RGBA sono completamente opachi: solo se almeno un pixel ha
+  // alpha minore di 255 il materiale va disegnato con il blending
+  image.translucent = false;
+  if (image.channels == 4) {
+    const size_t count = size_t(image.width) * image.height;
+    for (size_t i = 0 ; i < count && !image.translucent ; i++) {
+      image.translucent = (image.pixels[i * 4 + 3] != 255);
+    }
+  }
+
+  return true;
+}
+
+void Texture::release(Image &image) {
+  if (image.pixels != nullptr) {
+    stbi_image_free(image.pixels);
+  }
+  image.pixels = nullptr;
+}
+
 bool Texture::load(const std::string& FileName) {
-  int width, height, channels;
-  unsigned char *image = nullptr;
-  GLint format;
+  Image image;
 
   clear();
 
-  stbi_set_flip_vertically_on_load(true);
+  if (!decode(FileName, image)) return false;
 
-  // Usa la libreria lodepng per caricare l'immagine png
-  image = stbi_load(FileName.c_str(), &width, &height, &channels, 0); 
+  bool ret = load(image, FileName);
 
-  if (channels == 3) {
+  release(image);
+
+  return ret;
+}
+
+bool Texture::load(const Image &image, const std::string& FileName) {
+  GLint format;
+
+  clear();
+
+  if (image.channels == 3) {
     format = GL_RGB;
   } 
-  else if (channels == 4) {
+  else if (image.channels == 4) {
     format = GL_RGBA;
   }
   else return false;
 
-  //std::cout<<channels<<std::endl;
-
-  if (image==nullptr) {
-    std::cerr<<" Failed to load texture " << FileName << std::endl;
-    exit(0);
-  }
-
   // Crea un oggetto Texture in OpenGL
   glGenTextures(1, &_texture);
 
   // Collega la texture al target specifico (tipo) 
-  glBindTexture(_target,_texture);
+  GlState::instance().bind_texture(0, _target, _texture);
 
   // Passa le informazioni dell'immagine sulla GPU:
   // Target
@@ -62,7 +108,10 @@ bool Texture::load(const std::string& FileName) {
   // Formato dei pixel dell'immagine di input
   // Tipo di dati dei pixel dell'immagine di input
   // Puntatore ai dati 
-  glTexImage2D(_target, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, image);
+  glTexImage2D(_target, 0, GL_RGBA, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+
+  // Il formato interno è sempre RGBA a 8 bit per canale, senza mipmap
+  GpuMemory::instance().track_texture(_texture, size_t(image.width) * image.height * 4, FileName);
   
   // Imposta il filtro da usare per la texture minification
   glTexParameterf(_target, GL_TEXTURE_MIN_FILTER,  GL_LINEAR);
@@ -71,26 +120,25 @@ bool Texture::load(const std::string& FileName) {
   glTexParameterf(_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
   // Unbinda la texture 
-  glBindTexture(_target,0);
+  GlState::instance().bind_texture(0, _target, 0);
 
   _filename = FileName;
   _valid = true;
-
-  stbi_image_free(image);
+  _has_alpha = image.translucent;
 
   return true;
 }
 
 void Texture::bind(int TextureUnit) const {
-  GLenum unit = GL_TEXTURE0 + TextureUnit;
-
-  // Attiviamo la TextureUnit da usare per il sampling
-  glActiveTexture(unit);
-  
-  // Bindiamo la texture
-  glBindTexture(_target, _texture);
+  // Attiviamo la TextureUnit da usare per il sampling e bindiamo la 
+  // texture (solo se non è già collegata)
+  GlState::instance().bind_texture(TextureUnit, _target, _texture);
 }
 
 bool Texture::is_valid(void) const {
   return _valid;
+}
+
+bool Texture::has_alpha(void) const {
+  return _has_alpha;
 }
\ No newline at end of file
@@ -11,6 +11,19 @@
 */
 class Texture {
 public:
+	/**
+		Immagine decodificata in memoria, pronta per essere caricata sulla GPU
+	*/
+	struct Image {
+		int width;             ///< Larghezza in pixel
+		int height;            ///< Altezza in pixel
+		int channels;          ///< Numero di canali (3 o 4)
+		unsigned char *pixels; ///< Dati dei pixel
+		bool translucent;      ///< Almeno un pixel ha alpha minore di 255
+
+		Image();
+	};
+
 	/**
 		Costruttore
 	*/
@@ -32,6 +45,32 @@ public:
 	*/
 	bool load(const std::string& FileName);
 
+	/**
+		Carica in memoria una texture a partire da una immagine già
+		decodificata con decode().
+
+		@param image immagine decodificata
+		@param FileName nome del file da cui proviene l'immagine
+	*/
+	bool load(const Image &image, const std::string& FileName);
+
+	/**
+		Decodifica un file immagine in memoria senza usare OpenGL. 
+		La funzione può essere chiamata da qualunque thread.
+
+		@param FileName nome del file
+		@param image immagine decodificata in output
+		@return true se la decodifica è andata a buon fine
+	*/
+	static bool decode(const std::string& FileName, Image &image);
+
+	/**
+		Libera la memoria di una immagine decodificata con decode().
+
+		@param image immagine da liberare
+	*/
+	static void release(Image &image);
+
 	/**
 		Attiva la textureUnit indicata e binda la texture ad essa.
 	*/
@@ -43,11 +82,19 @@ public:
 	*/
 	bool is_valid(void) const;
 
+	/**
+		Controlla se l'immagine caricata ha dei pixel trasparenti.
+		@return true se la texture ha il canale alpha (RGBA) e almeno un
+		pixel non è opaco.
+	*/
+	bool has_alpha(void) const;
+
 private:
     std::string _filename; ///<< Nome del file
     GLenum _target; ///<< Tipo di texture
     GLuint _texture; ///<< Oggetto OpenGL che rappresenta la texture
     bool _valid; ///<< Flag di validità
+    bool _has_alpha; ///<< L'immagine ha dei pixel non opachi
 
     void clear();
 };
@@ -0,0 +1,117 @@
+#include "threadpool.h"
+
+namespace {
+	// Vero sui thread del pool e sul thread che sta eseguendo un ciclo
+	thread_local bool in_parallel_for = false;
+}
+
+ThreadPool &ThreadPool::instance() {
+	static ThreadPool pool(std::thread::hardware_concurrency());
+	return pool;
+}
+
+ThreadPool::ThreadPool(unsigned int num_threads) :
+	_job(nullptr), _next(0), _count(0), _busy(0), _generation(0), _quit(false) {
+
+	// Il thread chiamante partecipa ai cicli: ne creiamo uno in meno
+	for (unsigned int i = 1 ; i < num_threads ; i++) {
+		_threads.push_back(std::thread(&ThreadPool::worker, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_work_cv.notify_all();
+
+	for (unsigned int i = 0 ; i < _threads.size() ; i++) {
+		_threads[i].join();
+	}
+}
+
+unsigned int ThreadPool::size() const {
+	return _threads.size() + 1;
+}
+
+void ThreadPool::run_iterations() {
+	unsigned int i;
+	while ((i = _next.fetch_add(1)) < _count) {
+		(*_job)(i);
+	}
+}
+
+void ThreadPool::worker() {
+	in_parallel_for = true;
+
+	unsigned int generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_work_cv.wait(lock, [&]{ return _quit || _generation != generation; });
+			if (_quit) return;
+			generation = _generation;
+		}
+
+		run_iterations();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (--_busy == 0) _done_cv.notify_one();
+		}
+	}
+}
+
+void ThreadPool::parallel_for(unsigned int count, const std::function<void(unsigned int)> &fn) {
+	if (count == 0) return;
+
+	// Cicli annidati, pool vuoto o ciclo di una sola iterazione:
+	// esecuzione sequenziale
+	if (in_parallel_for || _threads.empty() || count == 1) {
+		for (unsigned int i = 0 ; i < count ; i++) fn(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit(_submit_mutex);
+	dispatch(count, fn);
+}
+
+void ThreadPool::try_parallel_for(unsigned int count, const std::function<void(unsigned int)> &fn) {
+	if (count == 0) return;
+
+	// Il controllo dei cicli annidati precede il try_lock: il thread
+	// potrebbe possedere già il mutex
+	std::unique_lock<std::mutex> submit;
+	if (!in_parallel_for && !_threads.empty() && count > 1) {
+		submit = std::unique_lock<std::mutex>(_submit_mutex, std::try_to_lock);
+	}
+
+	if (!submit.owns_lock()) {
+		for (unsigned int i = 0 ; i < count ; i++) fn(i);
+		return;
+	}
+
+	dispatch(count, fn);
+}
+
+void ThreadPool::dispatch(unsigned int count, const std::function<void(unsigned int)> &fn) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job   = &fn;
+		_count = count;
+		_next  = 0;
+		_busy  = _threads.size();
+		_generation++;
+	}
+	_work_cv.notify_all();
+
+	in_parallel_for = true;
+	run_iterations();
+	in_parallel_for = false;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done_cv.wait(lock, [&]{ return _busy == 0; });
+	_job = nullptr;
+}
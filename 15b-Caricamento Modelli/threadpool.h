@@ -0,0 +1,84 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/**
+	Semplice pool di thread persistente usato per parallelizzare i cicli
+	indipendenti (caricamento dei modelli, decodifica delle texture, ecc.).
+
+	Il pool è unico per l'applicazione ed è creato al primo utilizzo con
+	un thread per ogni core disponibile. Il thread chiamante partecipa
+	all'esecuzione del ciclo.
+*/
+class ThreadPool {
+public:
+
+	/**
+		Ritorna il pool di thread dell'applicazione
+	*/
+	static ThreadPool &instance();
+
+	/**
+		Ritorna il numero di thread che eseguono i cicli (incluso il chiamante)
+	*/
+	unsigned int size() const;
+
+	/**
+		Esegue fn(i) per ogni i in [0, count) distribuendo le iterazioni
+		sui thread del pool. La funzione ritorna quando tutte le iterazioni
+		sono state completate.
+		Se chiamata dall'interno di un ciclo già in esecuzione sul pool,
+		le iterazioni sono eseguite sequenzialmente dal thread chiamante.
+
+		@param count numero di iterazioni
+		@param fn funzione da eseguire per ogni iterazione
+	*/
+	void parallel_for(unsigned int count, const std::function<void(unsigned int)> &fn);
+
+	/**
+		Come parallel_for(), ma non attende mai un ciclo lanciato da un
+		altro thread: se il pool è occupato (es. da un caricamento in
+		background) le iterazioni sono eseguite sequenzialmente dal thread
+		chiamante. Da usare sul thread di rendering.
+
+		@param count numero di iterazioni
+		@param fn funzione da eseguire per ogni iterazione
+	*/
+	void try_parallel_for(unsigned int count, const std::function<void(unsigned int)> &fn);
+
+	~ThreadPool();
+
+private:
+	explicit ThreadPool(unsigned int num_threads);
+
+	void worker();
+
+	void run_iterations();
+
+	void dispatch(unsigned int count, const std::function<void(unsigned int)> &fn);
+
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;              ///<< Protegge lo stato del lavoro corrente
+	std::mutex _submit_mutex;       ///<< Serializza i cicli lanciati da thread diversi
+	std::condition_variable _work_cv;
+	std::condition_variable _done_cv;
+
+	const std::function<void(unsigned int)> *_job; ///<< Ciclo corrente
+	std::atomic<unsigned int> _next;  ///<< Prossima iterazione da eseguire
+	unsigned int _count;              ///<< Numero di iterazioni del ciclo corrente
+	unsigned int _busy;               ///<< Thread del pool ancora al lavoro
+	unsigned int _generation;         ///<< Contatore dei cicli lanciati
+	bool _quit;
+
+	// Blocchiamo le operazioni di copia
+	ThreadPool&operator=(const ThreadPool &other);
+	ThreadPool(const ThreadPool &other);
+};
+
+#endif
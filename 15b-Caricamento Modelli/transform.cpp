@@ -50,6 +50,7 @@ LocalTransform::LocalTransform() {
 
 void LocalTransform::update() {
 	_combined = _translation * _rotation * _scaling;
+	_normal_valid = false;
 }
 
 void LocalTransform::rotate(float degX, float degY, float degZ) {
@@ -90,8 +91,36 @@ const glm::mat4& LocalTransform::T() const {
 	return _combined;
 }
 
+const glm::mat3& LocalTransform::N() const {
+	if (!_normal_valid) {
+		// La composita è T * R * S: la trasposta inversa della parte 3x3 è 
+		// R * S^-1. Con scaling uniforme basta R (a meno della scala), ma
+		// con una scala negativa il fattore è negativo e va tenuto il segno,
+		// altrimenti le normali sarebbero rivolte verso l'interno
+		_normal = glm::mat3(_rotation);
+
+		const float sx = _scaling[0][0];
+		const float sy = _scaling[1][1];
+		const float sz = _scaling[2][2];
+		if (sx != sy || sx != sz) {
+			_normal[0] /= sx;
+			_normal[1] /= sy;
+			_normal[2] /= sz;
+		}
+		else if (sx < 0.0f) {
+			_normal = -_normal;
+		}
+
+		_normal_valid = true;
+	}
+
+	return _normal;
+}
+
 void LocalTransform::reset() {
 	_scaling = _translation = _rotation = _combined = glm::mat4(1.0f);
+	_normal = glm::mat3(1.0f);
+	_normal_valid = true;
 }
 
 glm::mat4 LocalTransform::rotation(float degX, float degY, float degZ) {
@@ -120,9 +149,9 @@ glm::mat4 LocalTransform::translation(float offsetX, float offsetY, float offset
 }
 
 glm::mat4 LocalTransform::scaling(float factorX, float factorY, float factorZ)  {
-	assert(factorX>0);
-	assert(factorY>0);
-	assert(factorZ>0);
+	assert(factorX!=0);
+	assert(factorY!=0);
+	assert(factorZ!=0);
 
 	glm::mat4 s(1.0f);
 	s[0][0]=factorX;
@@ -131,6 +160,19 @@ glm::mat4 LocalTransform::scaling(float factorX, float factorY, float factorZ)
 	return s;
 }
 
+glm::mat3 LocalTransform::normal_matrix(const glm::mat4 &m) {
+	const glm::vec3 a(m[0]);
+	const glm::vec3 b(m[1]);
+	const glm::vec3 c(m[2]);
+
+	glm::mat3 cofactor(glm::cross(b, c), glm::cross(c, a), glm::cross(a, b));
+
+	// I cofattori sono la trasposta inversa moltiplicata per il determinante
+	if (glm::dot(a, cofactor[0]) < 0.0f) cofactor = -cofactor;
+
+	return cofactor;
+}
+
 glm::mat3 LocalTransform::rotation3(float deg, const glm::vec3 &axis) {
 
  	glm::vec3 n = glm::normalize(axis);
@@ -29,6 +29,10 @@ float to_degree(float rad);
 	le funzioni statiche rotation, rotation3, translation, scaling permettono di 
 	calcolare e ottenere in output le matrici di trasformazioni richieste. Possono
 	essere usate senza istanziare la classe ma come: LocalTransform::rotation(...)
+
+	La matrice delle normali (trasposta inversa della parte 3x3 della 
+	composita) è calcolata solo quando viene richiesta con N() e resta 
+	memorizzata finchè la trasformazione non cambia.
 */
 class LocalTransform {
 
@@ -93,6 +97,16 @@ public:
 	*/
 	const glm::mat4& T() const;
 
+	/**
+		Ritorna la matrice di trasformazione delle normali. Se lo scaling è 
+		uniforme coincide con la rotazione (cambiata di segno se la scala è
+		negativa), altrimenti è la rotazione per l'inverso dello scaling.
+		La matrice è corretta a meno di un fattore positivo: le normali
+		trasformate vanno normalizzate.
+		@return la matrice 3x3 di trasformazione delle normali.
+	*/
+	const glm::mat3& N() const;
+
 	/**
 		Inizializza la matrice composita alla matrice identità.
 	*/
@@ -132,6 +146,8 @@ public:
 	
 	/**
 		Funzione statica che calcola la matrice di scaling sui tre assi.
+		I fattori devono essere non nulli: quelli negativi specchiano il
+		modello (vedi N()).
 
 		@param factorX fattore di scaling rispetto all'asse X
 		@param factorY fattore di scaling rispetto all'asse Y
@@ -140,6 +156,19 @@ public:
 	*/
 	static glm::mat4 scaling(float factorX, float factorY, float factorZ);
 
+	/**
+		Funzione statica che calcola la matrice di trasformazione delle 
+		normali di una matrice qualsiasi. Usa la matrice dei cofattori 
+		della parte 3x3 (tre prodotti vettoriali), che è la trasposta 
+		inversa a meno del determinante: non serve calcolare l'inversa.
+		Il segno è corretto se la matrice inverte l'orientamento.
+
+		@param m matrice 4x4 di trasformazione
+		@return la matrice 3x3 di trasformazione delle normali, a meno di 
+		        un fattore positivo
+	*/
+	static glm::mat3 normal_matrix(const glm::mat4 &m);
+
 private:
 
 	glm::mat4 _combined; 		///<< matrice composita
@@ -148,6 +177,9 @@ private:
 	glm::mat4 _scaling;			///<< matrice di scaling
 	glm::mat4 _translation;	///<< matrice di traslazione
 
+	mutable glm::mat3 _normal;	///<< matrice delle normali
+	mutable bool _normal_valid;	///<< true se _normal è aggiornata
+
 	/**
 		Funzione che aggiorna la matrice composita
 	*/
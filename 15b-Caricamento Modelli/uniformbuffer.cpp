@@ -0,0 +1,48 @@
+#include "uniformbuffer.h"
+#include "gpumemory.h"
+#include "glstate.h"
+
+UniformBuffer::UniformBuffer(GLuint binding, size_t size, const std::string &name) :
+	_buffer(0), _binding(binding), _size(size), _name(name) {}
+
+UniformBuffer::~UniformBuffer() {
+	if (_buffer != 0) {
+		GpuMemory::instance().release_buffer(_buffer);
+		GlState::instance().delete_buffer(_buffer);
+	}
+}
+
+void UniformBuffer::update(const void *data, size_t offset, size_t size) {
+	GlState &state = GlState::instance();
+
+	if (_buffer == 0) {
+		glGenBuffers(1, &_buffer);
+		state.bind_buffer(GL_UNIFORM_BUFFER, _buffer);
+		glBufferData(GL_UNIFORM_BUFFER, _size, nullptr, GL_DYNAMIC_DRAW);
+		GpuMemory::instance().track_buffer(_buffer, _size, _name, GpuMemory::UNIFORM_BUFFER);
+	}
+
+	// Il binding è quello del contesto: lo ricolleghiamo solo se qualcuno
+	// lo ha cambiato
+	state.bind_buffer_base(GL_UNIFORM_BUFFER, _binding, _buffer);
+	state.bind_buffer(GL_UNIFORM_BUFFER, _buffer);
+
+	if (offset == 0 && size == _size) {
+		glBufferData(GL_UNIFORM_BUFFER, _size, data, GL_DYNAMIC_DRAW);
+	}
+	else {
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	}
+}
+
+void UniformBuffer::update(const void *data) {
+	update(data, 0, _size);
+}
+
+GLuint UniformBuffer::binding() const {
+	return _binding;
+}
+
+size_t UniformBuffer::size() const {
+	return _size;
+}
@@ -0,0 +1,74 @@
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <cstddef>
+#include <string>
+#include "GL/glew.h" // prima di freeglut
+
+/**
+	Buffer di un uniform block (GL_UNIFORM_BUFFER) collegato a un punto di
+	binding.
+
+	Tutti i programmi che dichiarano il blocco e lo associano allo stesso
+	punto di binding (vedi ShaderClass::bind_uniform_block()) leggono gli
+	stessi dati: basta aggiornare il buffer una volta invece di impostare
+	le uniform di ogni programma.
+
+	Il contenuto è una struttura C++ con il layout std140 del blocco. Il
+	buffer è creato al primo aggiornamento.
+*/
+class UniformBuffer {
+public:
+
+	/**
+		Costruttore
+
+		@param binding punto di binding del blocco
+		@param size dimensione in byte del blocco
+		@param name nome usato per registrare il buffer in GpuMemory
+	*/
+	UniformBuffer(GLuint binding, size_t size, const std::string &name);
+
+	~UniformBuffer();
+
+	/**
+		Aggiorna una parte del blocco. Aggiornando tutto il blocco il buffer
+		viene riallocato, così il driver non deve attendere che la GPU
+		finisca di usare il contenuto precedente.
+
+		@param data dati da copiare
+		@param offset offset in byte nel blocco
+		@param size numero di byte da copiare
+	*/
+	void update(const void *data, size_t offset, size_t size);
+
+	/**
+		Aggiorna tutto il blocco
+
+		@param data dati da copiare (size() byte)
+	*/
+	void update(const void *data);
+
+	/**
+		Ritorna il punto di binding del blocco
+	*/
+	GLuint binding() const;
+
+	/**
+		Ritorna la dimensione in byte del blocco
+	*/
+	size_t size() const;
+
+private:
+
+	GLuint _buffer;    ///<< Buffer OpenGL
+	GLuint _binding;   ///<< Punto di binding
+	size_t _size;      ///<< Dimensione del blocco
+	std::string _name; ///<< Nome del buffer nel report della memoria
+
+	// Blocchiamo le operazioni di copia: non possiamo condividere il buffer
+	UniformBuffer&operator=(const UniformBuffer &other);
+	UniformBuffer(const UniformBuffer &other);
+};
+
+#endif